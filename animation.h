@@ -0,0 +1,303 @@
+//
+//  animation.h
+//  3D Object Drawing
+//
+
+#ifndef ANIMATION_H
+#define ANIMATION_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "draw_list.h"
+
+#include <vector>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <algorithm>
+
+// SSE2 is always there on x64 and on any x86 compiler targeting it; other CPUs use the scalar loop
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#include <emmintrin.h>
+#define ANIMATION_SSE2
+#endif
+
+// what a channel drives
+enum AnimatedProperty
+{
+    ANIMATE_ROTATION,       // degrees about the part's axis
+    ANIMATE_TRANSLATION,    // distance along the part's direction
+    ANIMATE_COLOR,          // 0..1 along the part's color ramp
+    ANIMATED_PROPERTY_COUNT
+};
+
+// materials interned between the two ends of a color ramp; the material table only grows,
+// so colors are picked from these instead of interning a new one every frame
+const int COLOR_RAMP_STEPS = 16;
+
+// seconds the batch evaluates in float before the channels are moved to a new epoch;
+// float time past this loses the precision of a fast spin (a float second is 2e-6 at 16)
+const double ANIMATION_EPOCH_SECONDS = 16.0;
+
+struct AnimationStats
+{
+    size_t parts = 0;
+    size_t channels = 0;
+    size_t keys = 0;
+    double evaluateMs = 0.0;    // the last frame: channels, matrices and the writes into the draw list
+    double totalMs = 0.0;
+    double maxMs = 0.0;
+    size_t frames = 0;
+};
+
+// Animated parts, added to the frame's draw list after the scene's own draws. A part is a
+// cube with a rigid placement (where its pivot is and how it is turned) and a shape (its
+// size and offset from the pivot), drawn as
+//   placement * translate(direction * offset) * rotate(angle, axis) * shape
+// with the material its tint picks from its color ramp. Channels drive the angle, the
+// offset and the tint. A channel runs in cycles of 1 / frequency seconds: a spin goes
+// through its span once a cycle (a fan turning 360 degrees), a keyed channel through
+// evenly spaced keys and back to the first (a door opening, standing open and closing).
+// Channels and parts are kept as structures of arrays and evaluated in one batch a frame:
+// the cycle positions of all channels four at a time, then the keys, then every part's
+// matrix, written straight into the draw list's commands. The batch runs in float on the
+// time since an epoch; every ANIMATION_EPOCH_SECONDS each channel's position at the new
+// epoch is worked out in double from the whole clock, so uptime never reaches the floats.
+class AnimationSystem
+{
+public:
+    AnimationStats stats;
+
+    AnimationSystem() : clock(0.0), epoch(0.0)
+    {
+    }
+
+    // returns the part's index for the channel functions
+    unsigned int addPart(DrawList& list, const glm::mat4& placement, const glm::mat4& shape, const glm::vec4& color,
+        const glm::vec3& axis = glm::vec3(0.0f, 1.0f, 0.0f), const glm::vec3& direction = glm::vec3(0.0f, 1.0f, 0.0f))
+    {
+        placements.push_back(placement);
+        shapes.push_back(shape);
+        axes.push_back(glm::normalize(axis));
+        directions.push_back(direction);
+        rampFirst.push_back((unsigned int)rampMaterials.size());
+        rampLength.push_back(1);
+        rampMaterials.push_back(list.materials.intern(color));
+        for (int p = 0; p < ANIMATED_PROPERTY_COUNT; p++)
+            values[p].push_back(0.0f);
+        stats.parts = placements.size();
+        return (unsigned int)(placements.size() - 1);
+    }
+
+    // tint 0 is the part's own color, tint 1 is to
+    void setColorRamp(DrawList& list, unsigned int part, const glm::vec4& to)
+    {
+        glm::vec4 from = list.materials[rampMaterials[rampFirst[part]]].color;
+        rampFirst[part] = (unsigned int)rampMaterials.size();
+        rampLength[part] = COLOR_RAMP_STEPS;
+        for (int step = 0; step < COLOR_RAMP_STEPS; step++)
+            rampMaterials.push_back(list.materials.intern(glm::mix(from, to, step / (float)(COLOR_RAMP_STEPS - 1))));
+    }
+
+    // span per cycle; phase is where in the cycle it starts, 0..1
+    void spin(unsigned int part, AnimatedProperty property, float span, float cyclesPerSecond, float phase = 0.0f)
+    {
+        addChannel(part, property, span, cyclesPerSecond, phase, 0, 0);
+    }
+
+    // count keys, evenly spaced over a cycle of cycleSeconds, blended linearly
+    void keyframes(unsigned int part, AnimatedProperty property, const float* keys, int count, float cycleSeconds, float phase = 0.0f)
+    {
+        if (count <= 0 || cycleSeconds <= 0.0f)
+            return;
+        unsigned int first = (unsigned int)keyValues.size();
+        keyValues.insert(keyValues.end(), keys, keys + count);
+        keyedChannels.push_back((unsigned int)channelPart.size());
+        addChannel(part, property, 0.0f, 1.0f / cycleSeconds, phase, first, count);
+        stats.keys = keyValues.size();
+    }
+
+    void advance(double seconds)
+    {
+        clock += seconds;
+    }
+
+    size_t partCount() const
+    {
+        return placements.size();
+    }
+
+    // evaluates every channel at the current time and appends the parts to list
+    void write(DrawList& list)
+    {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        if (clock - epoch >= ANIMATION_EPOCH_SECONDS)
+            moveEpoch();
+        evaluateChannels((float)(clock - epoch));
+
+        size_t first = list.commands.size();
+        size_t count = placements.size();
+        list.commands.resize(first + count);
+        if (list.trackSources)
+            list.sources.resize(first + count, "AnimationSystem");
+        const float* angles = values[ANIMATE_ROTATION].data();
+        const float* offsets = values[ANIMATE_TRANSLATION].data();
+        const float* tints = values[ANIMATE_COLOR].data();
+        DrawCommand* out = count > 0 ? &list.commands[first] : NULL;
+        for (size_t p = 0; p < count; p++)
+        {
+            // translate(direction * offset) * rotate(angle, axis), built directly
+            float radians = glm::radians(angles[p]);
+            float c = std::cos(radians), s = std::sin(radians);
+            const glm::vec3& axis = axes[p];
+            glm::vec3 t = axis * (1.0f - c);
+            glm::mat4 motion;
+            motion[0] = glm::vec4(c + t.x * axis.x, t.x * axis.y + s * axis.z, t.x * axis.z - s * axis.y, 0.0f);
+            motion[1] = glm::vec4(t.y * axis.x - s * axis.z, c + t.y * axis.y, t.y * axis.z + s * axis.x, 0.0f);
+            motion[2] = glm::vec4(t.z * axis.x + s * axis.y, t.z * axis.y - s * axis.x, c + t.z * axis.z, 0.0f);
+            motion[3] = glm::vec4(directions[p] * offsets[p], 1.0f);
+            out[p].model = placements[p] * motion * shapes[p];
+            float tint = std::min(std::max(tints[p], 0.0f), 1.0f);
+            out[p].material = rampMaterials[rampFirst[p] + (unsigned int)(tint * (rampLength[p] - 1) + 0.5f)];
+        }
+
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        stats.evaluateMs = ms;
+        stats.totalMs += ms;
+        stats.maxMs = std::max(stats.maxMs, ms);
+        stats.frames++;
+    }
+
+    void clear()
+    {
+        placements.clear();
+        shapes.clear();
+        axes.clear();
+        directions.clear();
+        rampFirst.clear();
+        rampLength.clear();
+        rampMaterials.clear();
+        for (int p = 0; p < ANIMATED_PROPERTY_COUNT; p++)
+            values[p].clear();
+        channelPart.clear();
+        channelProperty.clear();
+        channelSpan.clear();
+        channelFrequency.clear();
+        channelPhase.clear();
+        channelEpochPhase.clear();
+        channelKeyFirst.clear();
+        channelKeyCount.clear();
+        channelCycle.clear();
+        channelValue.clear();
+        keyedChannels.clear();
+        keyValues.clear();
+        stats = AnimationStats();
+    }
+
+private:
+    double clock;   // seconds since the start
+    double epoch;   // the clock the channels' epoch phases are at
+
+    // parts
+    std::vector<glm::mat4> placements;
+    std::vector<glm::mat4> shapes;
+    std::vector<glm::vec3> axes;
+    std::vector<glm::vec3> directions;
+    std::vector<unsigned int> rampFirst;
+    std::vector<unsigned int> rampLength;
+    std::vector<unsigned short> rampMaterials;
+    std::vector<float> values[ANIMATED_PROPERTY_COUNT];    // the sum of the part's channels, by property
+
+    // channels
+    std::vector<unsigned int> channelPart;
+    std::vector<unsigned char> channelProperty;
+    std::vector<float> channelSpan;
+    std::vector<float> channelFrequency;    // cycles per second
+    std::vector<float> channelPhase;        // 0..1
+    std::vector<float> channelEpochPhase;   // 0..1 through the cycle at epoch
+    std::vector<unsigned int> channelKeyFirst;
+    std::vector<float> channelKeyCount;     // 0 for a spin
+    std::vector<float> channelCycle;        // this frame: 0..1 through the cycle
+    std::vector<float> channelValue;        // this frame
+    std::vector<unsigned int> keyedChannels;
+    std::vector<float> keyValues;
+
+    void addChannel(unsigned int part, AnimatedProperty property, float span, float frequency, float phase, unsigned int keyFirst, int keyCount)
+    {
+        channelPart.push_back(part);
+        channelProperty.push_back((unsigned char)property);
+        channelSpan.push_back(span);
+        channelFrequency.push_back(std::max(frequency, 0.0f));
+        channelPhase.push_back(phase - std::floor(phase));
+        channelEpochPhase.push_back(epochPhase(channelFrequency.back(), channelPhase.back()));
+        channelKeyFirst.push_back(keyFirst);
+        channelKeyCount.push_back((float)keyCount);
+        channelCycle.push_back(0.0f);
+        channelValue.push_back(0.0f);
+        stats.channels = channelPart.size();
+    }
+
+    // fract(frequency * epoch + phase), in double so a long uptime keeps its fraction
+    float epochPhase(float frequency, float phase) const
+    {
+        double cycle = (double)frequency * epoch + phase;
+        return (float)(cycle - std::floor(cycle));
+    }
+
+    void moveEpoch()
+    {
+        epoch = clock;
+        for (size_t i = 0; i < channelPart.size(); i++)
+            channelEpochPhase[i] = epochPhase(channelFrequency[i], channelPhase[i]);
+    }
+
+    // time is seconds since epoch
+    void evaluateChannels(float time)
+    {
+        size_t count = channelPart.size();
+        size_t i = 0;
+#ifdef ANIMATION_SSE2
+        // cycle = fract(frequency * time + phase); never negative, so truncation is floor
+        __m128 t = _mm_set1_ps(time);
+        for (; i + 4 <= count; i += 4)
+        {
+            __m128 cycle = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(&channelFrequency[i]), t), _mm_loadu_ps(&channelEpochPhase[i]));
+            cycle = _mm_sub_ps(cycle, _mm_cvtepi32_ps(_mm_cvttps_epi32(cycle)));
+            _mm_storeu_ps(&channelCycle[i], cycle);
+            _mm_storeu_ps(&channelValue[i], _mm_mul_ps(cycle, _mm_loadu_ps(&channelSpan[i])));
+        }
+#endif
+        for (; i < count; i++)
+        {
+            float cycle = channelFrequency[i] * time + channelEpochPhase[i];
+            cycle -= (float)(int)cycle;
+            channelCycle[i] = cycle;
+            channelValue[i] = cycle * channelSpan[i];
+        }
+
+        for (size_t k = 0; k < keyedChannels.size(); k++)
+        {
+            unsigned int c = keyedChannels[k];
+            int keys = (int)channelKeyCount[c];
+            float position = channelCycle[c] * keys;
+            int key = std::min((int)position, keys - 1);
+            int next = key + 1 == keys ? 0 : key + 1;
+            const float* first = &keyValues[channelKeyFirst[c]];
+            channelValue[c] = first[key] + (first[next] - first[key]) * (position - key);
+        }
+
+        for (int p = 0; p < ANIMATED_PROPERTY_COUNT; p++)
+            std::fill(values[p].begin(), values[p].end(), 0.0f);
+        for (size_t c = 0; c < count; c++)
+            values[channelProperty[c]][channelPart[c]] += channelValue[c];
+    }
+};
+
+inline void printAnimationStats(const AnimationStats& stats)
+{
+    std::printf("animation: %zu parts, %zu channels (%zu keys), evaluated in %.3f ms, %.3f ms average and %.3f ms max over %zu frames\n",
+        stats.parts, stats.channels, stats.keys, stats.evaluateMs, stats.frames > 0 ? stats.totalMs / stats.frames : 0.0, stats.maxMs, stats.frames);
+}
+
+#endif
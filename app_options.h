@@ -0,0 +1,199 @@
+//
+//  app_options.h
+//  3D Object Drawing
+//
+
+#ifndef APP_OPTIONS_H
+#define APP_OPTIONS_H
+
+#include "multi_view.h"
+#include "restaurant_generator.h"
+#include "frame_pacer.h"
+#include "simulation.h"
+#include "frame_capture.h"
+#include "dynamic_resolution.h"
+#include "portal_visibility.h"
+#include "gpu_culling.h"
+#include "gpu_memory.h"
+#include "world_streaming.h"
+
+#include <string>
+#include <cstdlib>
+#include <algorithm>
+#include <iostream>
+
+// command line switches; everything defaults to the original single window behaviour.
+// A feature with a header of its own parses its switches there, into its options here.
+struct AppOptions
+{
+    int views = 1;                  // --views N       split screen surveillance views (1-4)
+    bool perViewPasses = false;     // --per-view      force one pass per view even if layered rendering is available
+    bool benchViews = false;        // --bench-views   measure CPU cost for 1..4 views and print a table
+
+    SceneOptions scene;             // procedural restaurant instead of the hand built scene
+    bool benchScale = false;        // --bench-scale   frame time and memory for 1k..1M objects
+    std::string benchScaleCsv = "bench_scale.csv";
+
+    int lights = 0;                 // --lights N      pendant lights with clustered lighting (0 = flat colors)
+    bool benchLights = false;       // --bench-lights  frame time for 1..1024 lights
+    int threads = 0;                // --threads N     worker threads for CPU jobs (0 = one per hardware thread)
+
+    std::string staticOut;          // --export-static FILE  write the scene for the Baker tool and exit
+    std::string bakedIn;            // --baked FILE    per-vertex light baked by the Baker tool
+
+    std::string softwareOut;        // --software FILE render one frame on the CPU to a PPM image and exit
+    bool benchSoftware = false;     // --bench-software  CPU rasteriser against OpenGL on the same scene
+    bool benchRecord = false;       // --bench-record  scene recording on 1, 2, 4 and 8 worker threads
+
+    std::string device = "gl";      // --device gl|null  null discards every command (CPU cost only)
+    std::string recordOut;          // --record FILE   write the device command stream to FILE
+    std::string replayIn;           // --replay FILE   play a recorded command stream and exit
+    bool validateGL = false;        // --validate-gl   check the GL state cache against glGet* at every draw
+
+    PacingSettings pacing;          // swap interval, frame cap, late input and latency measurement
+    SimulationOptions simulation;
+    CaptureOptions capture;
+    bool countAllocations = false;  // --count-allocs  count heap allocations in every frame
+    bool keepRedundantDraws = false;    // --keep-redundant  draw repeated draws instead of dropping them
+    bool listRedundantDraws = false;    // --list-redundant  print the repeated draws and their source functions
+    bool noQuads = false;           // --no-quads      draw zero-thickness boxes as whole cubes
+    bool depthPrepass = false;      // --depth-prepass lay down depth first, then shade with GL_EQUAL
+    bool overdraw = false;          // --overdraw      show and measure fragments shaded per pixel
+    bool benchOverdraw = false;     // --bench-overdraw overdraw and frame time without and with the pre-pass
+
+    ResolutionSettings resolution;  // dynamic resolution: budget, lowest scale, upscale filter and log
+    bool dumpGraph = false;         // --graph-dump    print the frame's render graph whenever it is compiled
+    PortalOptions portals;
+    GpuCullingOptions gpuCulling;
+    bool noShaderVariants = false;  // --no-shader-variants  draw every pass with the one program that branches on uniforms
+    bool animate = false;           // --animate       ceiling fans, trays and doors driven by the animation system
+    GpuMemoryOptions gpuMemory;
+
+    WorldOptions world;             // food court of many venues on several floors, streamed in cells around the camera
+
+    // the frames go straight to the GL device, so its framebuffer can be read and drawn to directly
+    bool directGL() const
+    {
+        return device == "gl" && recordOut.empty();
+    }
+};
+
+inline void printUsage(const char* program)
+{
+    std::cout << "usage: " << program << " [options]\n"
+              << "  --views N        render N (1-4) surveillance views in one window\n"
+              << "  --per-view       disable single pass layered rendering for multiple views\n"
+              << "  --bench-views    benchmark CPU cost of 1 to 4 views and exit\n";
+    SceneOptions::printUsage();
+    std::cout << "  --bench-scale [CSV]  benchmark 1k to 1M generated objects and exit\n"
+              << "  --lights N       light the scene with N (up to 1024) pendant lamps\n"
+              << "  --bench-lights   benchmark clustered lighting with 1 to 1024 lights and exit\n"
+              << "  --threads N      worker threads for light assignment (default: all cores)\n"
+              << "  --export-static F  write the scene's draws for the Baker tool to F and exit\n"
+              << "  --baked FILE     shade with light baked by the Baker tool\n"
+              << "  --software FILE  render with the CPU rasteriser to a PPM image and exit (no GPU needed)\n"
+              << "  --bench-software benchmark the CPU rasteriser against OpenGL and exit\n"
+              << "  --bench-record   benchmark scene recording on 1 to 8 worker threads and exit\n"
+              << "  --device NAME    render device: gl (default) or null\n"
+              << "  --record FILE    record the render commands to FILE\n"
+              << "  --replay FILE    replay commands recorded with --record and exit\n"
+              << "  --validate-gl    check the cached GL state against the driver at every draw\n";
+    PacingSettings::printUsage();
+    SimulationOptions::printUsage();
+    CaptureOptions::printUsage();
+    std::cout << "  --count-allocs   report heap allocations made by the frame loop\n"
+              << "  --keep-redundant draw repeated draws instead of dropping them\n"
+              << "  --list-redundant list draws that repeat an earlier draw, with the function that recorded them\n"
+              << "  --no-quads       draw zero-thickness boxes as whole cubes instead of one face\n"
+              << "  --depth-prepass  draw depth only first, then shade each pixel once\n"
+              << "  --overdraw       show fragments per pixel and print the overdraw\n"
+              << "  --bench-overdraw benchmark overdraw and frame time without and with the pre-pass and exit\n";
+    ResolutionSettings::printUsage();
+    std::cout << "  --graph-dump     print the frame's passes, their order and the transient textures at every compile\n";
+    PortalOptions::printUsage();
+    GpuCullingOptions::printUsage();
+    std::cout << "  --no-shader-variants  one program for every pass instead of the precompiled specialised variants\n"
+              << "  --animate        add spinning ceiling fans, sliding trays and swinging doors\n";
+    GpuMemoryOptions::printUsage();
+    WorldOptions::printUsage();
+}
+
+// returns false if the program should exit (bad argument or --help)
+inline bool parseOptions(int argc, char** argv, AppOptions& options)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (options.scene.parseArgs(arg, argc, argv, i) || options.pacing.parseArgs(arg, argc, argv, i)
+            || options.simulation.parseArgs(arg, argc, argv, i) || options.capture.parseArgs(arg, argc, argv, i)
+            || options.resolution.parseArgs(arg, argc, argv, i) || options.portals.parseArgs(arg, argc, argv, i)
+            || options.gpuCulling.parseArgs(arg, argc, argv, i) || options.gpuMemory.parseArgs(arg, argc, argv, i)
+            || options.world.parseArgs(arg, argc, argv, i))
+            continue;
+
+        if (arg == "--views" && i + 1 < argc)
+            options.views = std::min(std::max(std::atoi(argv[++i]), 1), MAX_VIEWS);
+        else if (arg == "--per-view")
+            options.perViewPasses = true;
+        else if (arg == "--bench-views")
+            options.benchViews = true;
+        else if (arg == "--bench-scale")
+        {
+            options.benchScale = true;
+            if (i + 1 < argc && argv[i + 1][0] != '-')
+                options.benchScaleCsv = argv[++i];
+        }
+        else if (arg == "--lights" && i + 1 < argc)
+            options.lights = std::atoi(argv[++i]);
+        else if (arg == "--bench-lights")
+            options.benchLights = true;
+        else if (arg == "--threads" && i + 1 < argc)
+            options.threads = std::atoi(argv[++i]);
+        else if (arg == "--export-static" && i + 1 < argc)
+            options.staticOut = argv[++i];
+        else if (arg == "--baked" && i + 1 < argc)
+            options.bakedIn = argv[++i];
+        else if (arg == "--software" && i + 1 < argc)
+            options.softwareOut = argv[++i];
+        else if (arg == "--bench-software")
+            options.benchSoftware = true;
+        else if (arg == "--bench-record")
+            options.benchRecord = true;
+        else if (arg == "--device" && i + 1 < argc && (std::string(argv[i + 1]) == "gl" || std::string(argv[i + 1]) == "null"))
+            options.device = argv[++i];
+        else if (arg == "--record" && i + 1 < argc)
+            options.recordOut = argv[++i];
+        else if (arg == "--replay" && i + 1 < argc)
+            options.replayIn = argv[++i];
+        else if (arg == "--validate-gl")
+            options.validateGL = true;
+        else if (arg == "--count-allocs")
+            options.countAllocations = true;
+        else if (arg == "--keep-redundant")
+            options.keepRedundantDraws = true;
+        else if (arg == "--list-redundant")
+            options.listRedundantDraws = true;
+        else if (arg == "--no-quads")
+            options.noQuads = true;
+        else if (arg == "--depth-prepass")
+            options.depthPrepass = true;
+        else if (arg == "--overdraw")
+            options.overdraw = true;
+        else if (arg == "--bench-overdraw")
+            options.benchOverdraw = true;
+        else if (arg == "--graph-dump")
+            options.dumpGraph = true;
+        else if (arg == "--no-shader-variants")
+            options.noShaderVariants = true;
+        else if (arg == "--animate")
+            options.animate = true;
+        else
+        {
+            printUsage(argv[0]);
+            return false;
+        }
+    }
+    return true;
+}
+
+#endif
@@ -0,0 +1,98 @@
+//
+//  baked_lighting.h
+//  3D Object Drawing
+//
+
+#ifndef BAKED_LIGHTING_H
+#define BAKED_LIGHTING_H
+
+#include "render_device.h"
+#include "draw_list.h"
+#include "static_scene.h"
+#include "vertex_baker.h"
+
+#include <string>
+#include <vector>
+#include <iostream>
+
+const int BAKED_LIGHT_UNIT = 3;
+
+// Per-vertex light baked offline by the Baker tool. The texels sit in a texture buffer that
+// the vertex shader reads at instanceDrawIndex * 24 + gl_VertexID. The draw index is a
+// per-instance attribute because instances are grouped by mesh and culled, so
+// gl_InstanceID no longer matches the draw. A lit frame costs one fetch per vertex on top
+// of flat shading. The bake is only used while the draw list still
+// has the cube count and matrices it was baked from; draws added after those (the animated
+// props) are left out of the comparison and are drawn without baked light.
+class BakedLighting
+{
+public:
+    explicit BakedLighting(RenderDevice& renderDevice) : device(renderDevice), buffer(0), texture(0), sceneHash(0), checked(false), valid(false)
+    {
+    }
+
+    bool load(const std::string& path)
+    {
+        if (!loadBake(path, sceneHash, texels))
+            return false;
+        std::cout << "loaded " << texels.size() << " baked vertices from " << path << std::endl;
+        return true;
+    }
+
+    bool loaded() const
+    {
+        return !texels.empty();
+    }
+
+    // compares the bake with the first staticDraws draws of the scene once and uploads it if
+    // they match
+    bool matches(const DrawList& drawList, size_t staticDraws)
+    {
+        if (checked)
+            return valid;
+        checked = true;
+        if (texels.size() != staticDraws * CUBE_VERTEX_COUNT || sceneHash != drawListHash(drawList, staticDraws))
+        {
+            std::cout << "WARNING::BAKE::SCENE_MISMATCH: the bake was made for a different scene, ignoring it" << std::endl;
+            return false;
+        }
+
+        buffer = device.createBuffer(TEXTURE_BUFFER, texels.size() * sizeof(unsigned int), &texels[0], STATIC_BUFFER, MEMORY_SHADING);
+        texture = device.createTextureBuffer(buffer, TEXTURE_RGBA8);
+        valid = true;
+        return true;
+    }
+
+    static void bindSampler(RenderDevice& device, DeviceHandle program)
+    {
+        device.useProgram(program);
+        device.setInt(program, "bakedLight", BAKED_LIGHT_UNIT);
+    }
+
+    // program must be in use
+    void apply(DeviceHandle program) const
+    {
+        device.bindTextureBuffer(BAKED_LIGHT_UNIT, texture);
+        device.setInt(program, "bakedEnabled", 1);
+    }
+
+    void release()
+    {
+        if (texture != 0)
+            device.destroyTexture(texture);
+        if (buffer != 0)
+            device.destroyBuffer(buffer);
+        buffer = texture = 0;
+    }
+
+private:
+    RenderDevice& device;
+    DeviceHandle buffer;
+    DeviceHandle texture;
+    unsigned int sceneHash;
+    std::vector<unsigned int> texels;
+    bool checked;
+    bool valid;
+};
+
+#endif
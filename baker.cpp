@@ -0,0 +1,124 @@
+//
+//  baker.cpp
+//  3D Object Drawing
+//
+//  Offline light baker (the Baker project). Reads a static scene exported with
+//  3D --export-static, ray traces lamp light and ambient occlusion at every cube
+//  vertex on all cores and writes a .bake file for 3D --baked.
+//
+
+#include <glm/glm.hpp>
+
+#include "draw_list.h"
+#include "static_scene.h"
+#include "point_light.h"
+#include "job_system.h"
+#include "vertex_baker.h"
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+
+using namespace std;
+
+struct BakerOptions
+{
+    std::string sceneIn;
+    std::string bakeOut;
+    int lights = 32;            // must match the app's --lights to bake the same lamps
+    unsigned int seed = 1;
+    int threads = 0;
+    bool bench = false;
+    BakeSettings settings;
+};
+
+void printBakerUsage(const char* program)
+{
+    std::cout << "usage: " << program << " SCENE.static OUT.bake [options]\n"
+              << "  --lights N     pendant lamps to bake (default 32)\n"
+              << "  --seed N       lamp placement seed (default 1)\n"
+              << "  --rays N       ambient occlusion rays per vertex (default 64)\n"
+              << "  --ao-distance D  occlusion range in world units (default 0.4)\n"
+              << "  --threads N    worker threads (default: all cores)\n"
+              << "  --bench        bake with 1, 2, 4 ... threads and print the timings\n";
+}
+
+bool parseBakerOptions(int argc, char** argv, BakerOptions& options)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--lights" && i + 1 < argc)
+            options.lights = std::atoi(argv[++i]);
+        else if (arg == "--seed" && i + 1 < argc)
+            options.seed = (unsigned int)std::strtoul(argv[++i], NULL, 10);
+        else if (arg == "--rays" && i + 1 < argc)
+            options.settings.aoRays = std::atoi(argv[++i]);
+        else if (arg == "--ao-distance" && i + 1 < argc)
+            options.settings.aoDistance = (float)std::atof(argv[++i]);
+        else if (arg == "--threads" && i + 1 < argc)
+            options.threads = std::atoi(argv[++i]);
+        else if (arg == "--bench")
+            options.bench = true;
+        else if (arg[0] != '-' && options.sceneIn.empty())
+            options.sceneIn = arg;
+        else if (arg[0] != '-' && options.bakeOut.empty())
+            options.bakeOut = arg;
+        else
+            return false;
+    }
+    return !options.sceneIn.empty() && !options.bakeOut.empty();
+}
+
+int main(int argc, char** argv)
+{
+    BakerOptions options;
+    if (!parseBakerOptions(argc, argv, options))
+    {
+        printBakerUsage(argv[0]);
+        return 1;
+    }
+    options.settings.seed = options.seed;
+
+    DrawList drawList;
+    if (!readStaticScene(options.sceneIn, drawList))
+        return 1;
+    std::vector<PointLight> lights = placePendantLights(options.lights, drawListBounds(drawList), options.seed);
+    std::cout << drawList.size() << " cubes, " << drawList.size() * CUBE_VERTEX_COUNT << " vertices, " << lights.size() << " lamps" << std::endl;
+
+    // thread counts to run: just the requested one, or a doubling sweep up to all cores
+    std::vector<int> threadCounts;
+    int hardwareThreads = (int)std::thread::hardware_concurrency();
+    if (hardwareThreads <= 0)
+        hardwareThreads = 1;
+    if (options.bench)
+    {
+        int top = options.threads > 0 ? options.threads : hardwareThreads;
+        for (int threads = 1; threads < top; threads *= 2)
+            threadCounts.push_back(threads);
+        threadCounts.push_back(top);
+    }
+    else
+        threadCounts.push_back(options.threads > 0 ? options.threads : hardwareThreads);
+
+    std::vector<unsigned int> texels;
+    double singleThreadMs = 0.0;
+    std::cout << "threads  bvh ms  bake ms  speedup  Mrays/s" << std::endl;
+    for (size_t i = 0; i < threadCounts.size(); i++)
+    {
+        JobSystem jobs(threadCounts[i]);
+        BakeStats stats = VertexBaker::bake(drawList, lights, options.settings, jobs, texels);
+        if (i == 0)
+            singleThreadMs = stats.bakeMs;
+        std::printf("%7d  %6.1f  %7.1f  %7.2f  %7.2f\n", stats.threads, stats.buildMs, stats.bakeMs,
+            singleThreadMs / stats.bakeMs, stats.rays / (stats.bakeMs * 1000.0));
+    }
+
+    if (!saveBake(options.bakeOut, drawListHash(drawList), texels))
+        return 1;
+    std::cout << "written " << texels.size() * sizeof(unsigned int) / 1024 << " KB to " << options.bakeOut << std::endl;
+    return 0;
+}
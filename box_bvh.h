@@ -0,0 +1,193 @@
+//
+//  box_bvh.h
+//  3D Object Drawing
+//
+
+#ifndef BOX_BVH_H
+#define BOX_BVH_H
+
+#include <glm/glm.hpp>
+
+#include "draw_list.h"
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+
+// Bounding volume hierarchy over the scene's cubes. Every draw is the same cube under a
+// different model matrix, so the leaves hold the inverse matrices and a ray is tested
+// against the cube in its local space: an exact oriented box test with no triangles.
+// Only occlusion queries are needed for baking, so traversal stops at the first hit.
+class BoxBVH
+{
+public:
+    void build(const DrawList& drawList)
+    {
+        boxes.clear();
+        nodes.clear();
+        for (size_t i = 0; i < drawList.size(); i++)
+        {
+            const glm::mat4& model = drawList[i].model;
+            // flattened cubes (a zero scale axis) cannot block anything
+            if (std::fabs(glm::determinant(model)) < 1e-12f)
+                continue;
+            Box box;
+            box.toLocal = glm::inverse(model);
+            box.bounds = cubeWorldBounds(model);
+            box.center = (box.bounds.min + box.bounds.max) * 0.5f;
+            boxes.push_back(box);
+        }
+        if (boxes.empty())
+            return;
+        nodes.reserve(boxes.size() * 2);
+        nodes.push_back(Node());
+        subdivide(0, 0, boxes.size());
+    }
+
+    size_t boxCount() const
+    {
+        return boxes.size();
+    }
+
+    size_t nodeCount() const
+    {
+        return nodes.size();
+    }
+
+    // true if anything lies along origin + t * direction for t in (0, maxDistance)
+    bool occluded(const glm::vec3& origin, const glm::vec3& direction, float maxDistance) const
+    {
+        if (nodes.empty())
+            return false;
+        glm::vec3 inverseDirection(1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z);
+
+        size_t stack[64];
+        int top = 0;
+        stack[top++] = 0;
+        while (top > 0)
+        {
+            const Node& node = nodes[stack[--top]];
+            if (!hitsBounds(node.bounds, origin, inverseDirection, maxDistance))
+                continue;
+            if (node.count > 0)
+            {
+                for (size_t i = node.first; i < node.first + node.count; i++)
+                {
+                    if (hitsCube(boxes[i], origin, direction, maxDistance))
+                        return true;
+                }
+            }
+            else if (top + 2 <= 64)
+            {
+                stack[top++] = node.first;
+                stack[top++] = node.first + 1;
+            }
+        }
+        return false;
+    }
+
+private:
+    struct Box
+    {
+        glm::mat4 toLocal;
+        AABB bounds;
+        glm::vec3 center;
+    };
+
+    // inner nodes: first is the left child, the right child follows it; leaves: count > 0
+    struct Node
+    {
+        AABB bounds;
+        size_t first = 0;
+        size_t count = 0;
+    };
+
+    static const size_t LEAF_SIZE = 4;
+
+    std::vector<Box> boxes;
+    std::vector<Node> nodes;
+
+    // median split on the longest axis of the box centers
+    void subdivide(size_t nodeIndex, size_t first, size_t count)
+    {
+        AABB bounds = boxes[first].bounds;
+        AABB centers = { boxes[first].center, boxes[first].center };
+        for (size_t i = first + 1; i < first + count; i++)
+        {
+            bounds.min = glm::min(bounds.min, boxes[i].bounds.min);
+            bounds.max = glm::max(bounds.max, boxes[i].bounds.max);
+            centers.min = glm::min(centers.min, boxes[i].center);
+            centers.max = glm::max(centers.max, boxes[i].center);
+        }
+        nodes[nodeIndex].bounds = bounds;
+
+        if (count <= LEAF_SIZE)
+        {
+            nodes[nodeIndex].first = first;
+            nodes[nodeIndex].count = count;
+            return;
+        }
+
+        glm::vec3 extent = centers.max - centers.min;
+        int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+        size_t half = count / 2;
+        std::nth_element(boxes.begin() + first, boxes.begin() + first + half, boxes.begin() + first + count,
+            [axis](const Box& a, const Box& b) { return a.center[axis] < b.center[axis]; });
+
+        size_t left = nodes.size();
+        nodes.push_back(Node());
+        nodes.push_back(Node());
+        nodes[nodeIndex].first = left;
+        nodes[nodeIndex].count = 0;
+        subdivide(left, first, half);
+        subdivide(left + 1, first + half, count - half);
+    }
+
+    static bool hitsBounds(const AABB& box, const glm::vec3& origin, const glm::vec3& inverseDirection, float maxDistance)
+    {
+        float tNear = 0.0f;
+        float tFar = maxDistance;
+        for (int axis = 0; axis < 3; axis++)
+        {
+            float t0 = (box.min[axis] - origin[axis]) * inverseDirection[axis];
+            float t1 = (box.max[axis] - origin[axis]) * inverseDirection[axis];
+            if (t0 > t1)
+                std::swap(t0, t1);
+            tNear = t0 > tNear ? t0 : tNear;
+            tFar = t1 < tFar ? t1 : tFar;
+            if (tNear > tFar)
+                return false;
+        }
+        return true;
+    }
+
+    // slab test against CUBE_MIN..CUBE_MAX in the cube's own space; the affine inverse keeps
+    // t in world units because the ray is mapped rather than renormalized
+    static bool hitsCube(const Box& box, const glm::vec3& origin, const glm::vec3& direction, float maxDistance)
+    {
+        glm::vec3 localOrigin = glm::vec3(box.toLocal * glm::vec4(origin, 1.0f));
+        glm::vec3 localDirection = glm::vec3(box.toLocal * glm::vec4(direction, 0.0f));
+        float tNear = 1e-4f;
+        float tFar = maxDistance;
+        for (int axis = 0; axis < 3; axis++)
+        {
+            if (std::fabs(localDirection[axis]) < 1e-12f)
+            {
+                if (localOrigin[axis] < CUBE_MIN[axis] || localOrigin[axis] > CUBE_MAX[axis])
+                    return false;
+                continue;
+            }
+            float t0 = (CUBE_MIN[axis] - localOrigin[axis]) / localDirection[axis];
+            float t1 = (CUBE_MAX[axis] - localOrigin[axis]) / localDirection[axis];
+            if (t0 > t1)
+                std::swap(t0, t1);
+            tNear = t0 > tNear ? t0 : tNear;
+            tFar = t1 < tFar ? t1 : tFar;
+            if (tNear > tFar)
+                return false;
+        }
+        return true;
+    }
+};
+
+#endif
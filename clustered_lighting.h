@@ -0,0 +1,457 @@
+//
+//  clustered_lighting.h
+//  3D Object Drawing
+//
+
+#ifndef CLUSTERED_LIGHTING_H
+#define CLUSTERED_LIGHTING_H
+
+#include <glm/glm.hpp>
+
+#include "render_device.h"
+#include "draw_list.h"
+#include "point_light.h"
+#include "job_system.h"
+#include "frame_arena.h"
+
+#include <vector>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+
+// cluster grid; the dimensions must match the constants in fragmentShader.fs
+const int CLUSTER_X = 16;
+const int CLUSTER_Y = 9;
+const int CLUSTER_Z = 24;
+const int CLUSTER_COUNT = CLUSTER_X * CLUSTER_Y * CLUSTER_Z;
+const unsigned int MAX_LIGHTS = 1024;
+const unsigned int MAX_LIGHTS_PER_CLUSTER = 256;
+
+// texture units of the three light buffers
+const int LIGHT_DATA_UNIT = 0;
+const int CLUSTER_GRID_UNIT = 1;
+const int CLUSTER_LIGHTS_UNIT = 2;
+
+struct LightingStats
+{
+    size_t lights = 0;
+    size_t lightsInRange = 0;       // lights overlapping the near..far depth range
+    size_t lightIndices = 0;        // total entries in all cluster lists
+    size_t maxPerCluster = 0;
+    size_t overflowedClusters = 0;  // clusters that hit MAX_LIGHTS_PER_CLUSTER
+    int threads = 0;
+    double assignMs = 0.0;
+    double uploadMs = 0.0;
+};
+
+// Clustered forward shading. The view frustum is cut into CLUSTER_X x CLUSTER_Y screen tiles
+// and CLUSTER_Z exponential depth slices. Every frame the lights are assigned to the clusters
+// they touch on the job system's worker threads, and three texture buffers go to the GPU:
+// the lights in view space, an (offset, count) pair per cluster and the packed light indices.
+// The fragment shader finds its cluster from gl_FragCoord and depth and only loops over
+// that cluster's lights.
+class ClusteredLighting
+{
+public:
+    LightingStats stats;
+    std::vector<PointLight> lights;
+
+    ClusteredLighting(JobSystem& jobSystem, RenderDevice& renderDevice, FrameArenas& frameArenas)
+        : jobs(jobSystem), device(renderDevice), arenas(frameArenas), lightBuffer(0), gridBuffer(0), indexBuffer(0), lightTexture(0), gridTexture(0), indexTexture(0),
+          builtWidth(0), builtHeight(0), nearPlane(0.0f), farPlane(0.0f)
+    {
+        clusterBounds.resize(CLUSTER_COUNT);
+        grid.resize(CLUSTER_COUNT * 2);
+    }
+
+    void init()
+    {
+        lightBuffer = device.createBuffer(TEXTURE_BUFFER, MAX_LIGHTS * 2 * sizeof(glm::vec4), NULL, STREAM_BUFFER, MEMORY_SHADING);
+        gridBuffer = device.createBuffer(TEXTURE_BUFFER, grid.size() * sizeof(unsigned int), NULL, STREAM_BUFFER, MEMORY_SHADING);
+        indexBuffer = device.createBuffer(TEXTURE_BUFFER, sizeof(unsigned short), NULL, STREAM_BUFFER, MEMORY_SHADING);
+
+        lightTexture = device.createTextureBuffer(lightBuffer, TEXTURE_RGBA32F);
+        gridTexture = device.createTextureBuffer(gridBuffer, TEXTURE_RG32UI);
+        indexTexture = device.createTextureBuffer(indexBuffer, TEXTURE_R16UI);
+    }
+
+    // points the program's light samplers at their texture units
+    static void bindSamplers(RenderDevice& device, DeviceHandle program)
+    {
+        device.useProgram(program);
+        device.setInt(program, "lightData", LIGHT_DATA_UNIT);
+        device.setInt(program, "clusterGrid", CLUSTER_GRID_UNIT);
+        device.setInt(program, "clusterLights", CLUSTER_LIGHTS_UNIT);
+    }
+
+    // assigns the lights to clusters for this camera and uploads the result
+    void update(const glm::mat4& view, const glm::mat4& projection, float zNear, float zFar, int width, int height)
+    {
+        stats = LightingStats();
+        stats.lights = lights.size();
+        stats.threads = jobs.threadCount();
+
+        std::chrono::steady_clock::time_point assignStart = std::chrono::steady_clock::now();
+        if (width != builtWidth || height != builtHeight || zNear != nearPlane || zFar != farPlane || projection != builtProjection)
+            buildClusters(projection, zNear, zFar, width, height);
+        prepareLights(view);
+        assignLights();
+        stats.assignMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - assignStart).count();
+
+        std::chrono::steady_clock::time_point uploadStart = std::chrono::steady_clock::now();
+        upload();
+        stats.uploadMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - uploadStart).count();
+    }
+
+    // binds the light buffers and sets the cluster lookup uniforms; program must be in use
+    void apply(DeviceHandle program, const glm::vec3& ambient) const
+    {
+        device.bindTextureBuffer(LIGHT_DATA_UNIT, lightTexture);
+        device.bindTextureBuffer(CLUSTER_GRID_UNIT, gridTexture);
+        device.bindTextureBuffer(CLUSTER_LIGHTS_UNIT, indexTexture);
+
+        // slice = log(depth) * scale + bias inverts the exponential slice depths in buildClusters
+        float logRatio = std::log(farPlane / nearPlane);
+        device.setInt(program, "lightingEnabled", 1);
+        device.setVec2(program, "clusterScreenScale", glm::vec2((float)CLUSTER_X / builtWidth, (float)CLUSTER_Y / builtHeight));
+        device.setFloat(program, "clusterSliceScale", CLUSTER_Z / logRatio);
+        device.setFloat(program, "clusterSliceBias", -CLUSTER_Z * std::log(nearPlane) / logRatio);
+        device.setVec3(program, "ambientLight", ambient);
+    }
+
+    void release()
+    {
+        device.destroyTexture(lightTexture);
+        device.destroyTexture(gridTexture);
+        device.destroyTexture(indexTexture);
+        device.destroyBuffer(lightBuffer);
+        device.destroyBuffer(gridBuffer);
+        device.destroyBuffer(indexBuffer);
+        lightBuffer = gridBuffer = indexBuffer = 0;
+        lightTexture = gridTexture = indexTexture = 0;
+    }
+
+private:
+    // light transformed to view space, with the depth slices it can reach
+    struct ViewLight
+    {
+        glm::vec3 center;
+        float radius;
+        int firstSlice;
+        int lastSlice;
+        int tileMin[2];     // screen tiles the light's box can cover
+        int tileMax[2];
+    };
+
+    JobSystem& jobs;
+    RenderDevice& device;
+    FrameArenas& arenas;
+    DeviceHandle lightBuffer, gridBuffer, indexBuffer;
+    DeviceHandle lightTexture, gridTexture, indexTexture;
+
+    int builtWidth, builtHeight;
+    float nearPlane, farPlane;
+    glm::mat4 builtProjection;
+    float projectionScale[2];                           // x and y scale of the symmetric perspective
+    std::vector<AABB> clusterBounds;                    // view space
+    std::vector<ViewLight> viewLights;
+    std::vector<std::vector<unsigned short> > sliceLights;
+    std::vector<size_t> workerClusters;                 // first, end cluster per worker
+    std::vector<unsigned int> grid;                     // offset, count per cluster
+    std::vector<unsigned short> indices;
+    std::vector<glm::vec4> lightData;
+
+    float sliceDepth(int slice) const
+    {
+        return nearPlane * std::pow(farPlane / nearPlane, (float)slice / CLUSTER_Z);
+    }
+
+    int depthSlice(float depth) const
+    {
+        if (depth <= nearPlane)
+            return 0;
+        int slice = (int)(std::log(depth / nearPlane) * CLUSTER_Z / std::log(farPlane / nearPlane));
+        return slice < CLUSTER_Z ? slice : CLUSTER_Z - 1;
+    }
+
+    // view space boxes of every cluster; only changes with the projection or window size
+    void buildClusters(const glm::mat4& projection, float zNear, float zFar, int width, int height)
+    {
+        builtProjection = projection;
+        builtWidth = width;
+        builtHeight = height;
+        nearPlane = zNear;
+        farPlane = zFar;
+        projectionScale[0] = projection[0][0];
+        projectionScale[1] = projection[1][1];
+
+        glm::mat4 inverseProjection = glm::inverse(projection);
+        for (int z = 0; z < CLUSTER_Z; z++)
+        {
+            float depths[2] = { sliceDepth(z), sliceDepth(z + 1) };
+            for (int y = 0; y < CLUSTER_Y; y++)
+            {
+                for (int x = 0; x < CLUSTER_X; x++)
+                {
+                    AABB box;
+                    box.min = glm::vec3(1e30f);
+                    box.max = glm::vec3(-1e30f);
+                    for (int corner = 0; corner < 4; corner++)
+                    {
+                        // ray through the tile corner on the near plane, cut at both slice depths
+                        float ndcX = -1.0f + 2.0f * (x + (corner & 1)) / CLUSTER_X;
+                        float ndcY = -1.0f + 2.0f * (y + (corner >> 1)) / CLUSTER_Y;
+                        glm::vec4 onNear = inverseProjection * glm::vec4(ndcX, ndcY, -1.0f, 1.0f);
+                        glm::vec3 ray = glm::vec3(onNear) / onNear.w;
+                        for (int d = 0; d < 2; d++)
+                        {
+                            glm::vec3 point = ray * (depths[d] / -ray.z);
+                            box.min = glm::min(box.min, point);
+                            box.max = glm::max(box.max, point);
+                        }
+                    }
+                    clusterBounds[x + CLUSTER_X * (y + CLUSTER_Y * z)] = box;
+                }
+            }
+        }
+    }
+
+    // moves the lights to view space and bins them by the depth slices they overlap
+    void prepareLights(const glm::mat4& view)
+    {
+        size_t count = lights.size() < MAX_LIGHTS ? lights.size() : MAX_LIGHTS;
+        viewLights.resize(count);
+        lightData.resize(count * 2);
+        sliceLights.resize(CLUSTER_Z);
+        for (int z = 0; z < CLUSTER_Z; z++)
+            sliceLights[z].clear();
+
+        for (size_t i = 0; i < count; i++)
+        {
+            const PointLight& light = lights[i];
+            ViewLight& viewLight = viewLights[i];
+            viewLight.center = glm::vec3(view * glm::vec4(light.position, 1.0f));
+            viewLight.radius = light.radius;
+            lightData[i * 2] = glm::vec4(viewLight.center, light.radius);
+            lightData[i * 2 + 1] = glm::vec4(light.color * light.intensity, 0.0f);
+
+            float depth = -viewLight.center.z;
+            if (depth + light.radius < nearPlane || depth - light.radius > farPlane)
+            {
+                viewLight.firstSlice = 1;
+                viewLight.lastSlice = 0;
+                continue;
+            }
+            viewLight.firstSlice = depthSlice(depth - light.radius);
+            viewLight.lastSlice = depthSlice(depth + light.radius);
+            tileRange(viewLight, 0, CLUSTER_X);
+            tileRange(viewLight, 1, CLUSTER_Y);
+            for (int z = viewLight.firstSlice; z <= viewLight.lastSlice; z++)
+                sliceLights[z].push_back((unsigned short)i);
+            stats.lightsInRange++;
+        }
+    }
+
+    // conservative range of tiles along one screen axis: project the light's view space box
+    // at its nearest and farthest depth and keep the widest extent
+    void tileRange(ViewLight& light, int axis, int tiles) const
+    {
+        float front = glm::max(-light.center.z - light.radius, nearPlane);
+        float back = glm::max(-light.center.z + light.radius, nearPlane);
+        float low = light.center[axis] - light.radius;
+        float high = light.center[axis] + light.radius;
+        float ndcLow = projectionScale[axis] * low / (low < 0.0f ? front : back);
+        float ndcHigh = projectionScale[axis] * high / (high > 0.0f ? front : back);
+        light.tileMin[axis] = glm::clamp((int)std::floor((ndcLow + 1.0f) * 0.5f * tiles), 0, tiles - 1);
+        light.tileMax[axis] = glm::clamp((int)std::floor((ndcHigh + 1.0f) * 0.5f * tiles), 0, tiles - 1);
+    }
+
+    static bool sphereIntersects(const AABB& box, const glm::vec3& center, float radius)
+    {
+        glm::vec3 closest = glm::clamp(center, box.min, box.max);
+        glm::vec3 offset = center - closest;
+        return glm::dot(offset, offset) <= radius * radius;
+    }
+
+    // Each worker takes a contiguous run of depth slices, so it owns a contiguous run of
+    // clusters and writes them without locking. The per-worker lists are then concatenated
+    // in worker order, which keeps the result identical for any number of threads. Each
+    // list lives in its worker's frame arena and is gone at the end of the frame.
+    void assignLights()
+    {
+        int threads = jobs.threadCount();
+        workerClusters.assign(threads * 2, 0);
+        FrameVector<FrameVector<unsigned short> > workerIndices((ArenaAllocator<FrameVector<unsigned short> >(arenas[0])));
+        workerIndices.reserve(threads);
+        for (int worker = 0; worker < threads; worker++)
+        {
+            // sized from last frame's total, so the lists rarely have to grow
+            workerIndices.push_back(FrameVector<unsigned short>(ArenaAllocator<unsigned short>(arenas[worker])));
+            workerIndices.back().reserve(indices.size() / threads + 256);
+        }
+
+        jobs.parallelFor(CLUSTER_Z, [&](int worker, size_t beginSlice, size_t endSlice)
+        {
+            FrameVector<unsigned short>& local = workerIndices[worker];
+            workerClusters[worker * 2] = beginSlice * CLUSTER_X * CLUSTER_Y;
+            workerClusters[worker * 2 + 1] = endSlice * CLUSTER_X * CLUSTER_Y;
+            for (size_t z = beginSlice; z < endSlice; z++)
+            {
+                const std::vector<unsigned short>& candidates = sliceLights[z];
+                for (int tile = 0; tile < CLUSTER_X * CLUSTER_Y; tile++)
+                {
+                    int tileX = tile % CLUSTER_X;
+                    int tileY = tile / CLUSTER_X;
+                    size_t cluster = z * CLUSTER_X * CLUSTER_Y + tile;
+                    const AABB& box = clusterBounds[cluster];
+                    unsigned int offset = (unsigned int)local.size();
+                    unsigned int count = 0;
+                    for (size_t i = 0; i < candidates.size() && count < MAX_LIGHTS_PER_CLUSTER; i++)
+                    {
+                        const ViewLight& light = viewLights[candidates[i]];
+                        if (tileX < light.tileMin[0] || tileX > light.tileMax[0] || tileY < light.tileMin[1] || tileY > light.tileMax[1])
+                            continue;
+                        if (sphereIntersects(box, light.center, light.radius))
+                        {
+                            local.push_back(candidates[i]);
+                            count++;
+                        }
+                    }
+                    grid[cluster * 2] = offset;
+                    grid[cluster * 2 + 1] = count;
+                }
+            }
+        });
+
+        // rebase the worker-local offsets and pack the lists
+        indices.clear();
+        for (int worker = 0; worker < threads; worker++)
+        {
+            const FrameVector<unsigned short>& local = workerIndices[worker];
+            unsigned int base = (unsigned int)indices.size();
+            for (size_t cluster = workerClusters[worker * 2]; cluster < workerClusters[worker * 2 + 1]; cluster++)
+                grid[cluster * 2] += base;
+            indices.insert(indices.end(), local.begin(), local.end());
+        }
+
+        stats.lightIndices = indices.size();
+        for (int cluster = 0; cluster < CLUSTER_COUNT; cluster++)
+        {
+            size_t count = grid[cluster * 2 + 1];
+            if (count > stats.maxPerCluster)
+                stats.maxPerCluster = count;
+            if (count == MAX_LIGHTS_PER_CLUSTER)
+                stats.overflowedClusters++;
+        }
+    }
+
+    void upload()
+    {
+        if (!lightData.empty())
+            device.updateBuffer(lightBuffer, 0, lightData.size() * sizeof(glm::vec4), &lightData[0]);
+        device.updateBuffer(gridBuffer, 0, grid.size() * sizeof(unsigned int), &grid[0]);
+
+        // the index list changes size every frame; respecifying it also orphans last frame's copy
+        if (indices.empty())
+            device.setBufferData(indexBuffer, sizeof(unsigned short), NULL);
+        else
+            device.setBufferData(indexBuffer, indices.size() * sizeof(unsigned short), &indices[0]);
+    }
+};
+
+inline void printLightingStats(const LightingStats& stats)
+{
+    std::cout << "lights: " << stats.lights
+              << "  in range: " << stats.lightsInRange
+              << "  cluster entries: " << stats.lightIndices
+              << "  max per cluster: " << stats.maxPerCluster
+              << "  full clusters: " << stats.overflowedClusters
+              << "  assign ms: " << stats.assignMs << " (" << stats.threads << " threads)"
+              << "  upload ms: " << stats.uploadMs << std::endl;
+}
+
+// Renders with 1, 2, 4 ... 1024 lights and records the frame time and light assignment
+// cost for each count.
+class LightingBenchmark
+{
+public:
+    LightingBenchmark(int warmupFrames = 30, int measuredFrames = 120)
+        : warmup(warmupFrames), measured(measuredFrames)
+    {
+        for (unsigned int count = 1; count <= MAX_LIGHTS; count *= 2)
+        {
+            Row row;
+            row.lights = count;
+            rows.push_back(row);
+        }
+    }
+
+    bool done() const
+    {
+        return step >= rows.size();
+    }
+
+    // true on the first frame of a step: the caller should place lightCount() lights
+    bool needsLights() const
+    {
+        return !done() && frameInStep == 0;
+    }
+
+    int lightCount() const
+    {
+        return (int)rows[step].lights;
+    }
+
+    void record(double frameMs, const LightingStats& frame)
+    {
+        if (done())
+            return;
+        Row& row = rows[step];
+        frameInStep++;
+        if (frameInStep > warmup)
+        {
+            row.frameMs += frameMs / measured;
+            row.assignMs += frame.assignMs / measured;
+            row.uploadMs += frame.uploadMs / measured;
+            row.entries += (double)frame.lightIndices / measured;
+            row.maxPerCluster = frame.maxPerCluster > row.maxPerCluster ? frame.maxPerCluster : row.maxPerCluster;
+            row.threads = frame.threads;
+        }
+        if (frameInStep == warmup + measured)
+        {
+            step++;
+            frameInStep = 0;
+        }
+    }
+
+    void print() const
+    {
+        std::cout << "lights  threads  frame ms  assign ms  upload ms  cluster entries  max per cluster" << std::endl;
+        for (size_t i = 0; i < rows.size(); i++)
+        {
+            const Row& row = rows[i];
+            std::printf("%6zu  %7d  %8.3f  %9.3f  %9.3f  %15.0f  %15zu\n", row.lights, row.threads, row.frameMs, row.assignMs, row.uploadMs, row.entries, row.maxPerCluster);
+        }
+    }
+
+private:
+    struct Row
+    {
+        size_t lights = 0;
+        int threads = 0;
+        double frameMs = 0.0;
+        double assignMs = 0.0;
+        double uploadMs = 0.0;
+        double entries = 0.0;
+        size_t maxPerCluster = 0;
+    };
+
+    int warmup;
+    int measured;
+    size_t step = 0;
+    int frameInStep = 0;
+    std::vector<Row> rows;
+};
+
+#endif
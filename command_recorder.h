@@ -0,0 +1,730 @@
+//
+//  command_recorder.h
+//  3D Object Drawing
+//
+
+#ifndef COMMAND_RECORDER_H
+#define COMMAND_RECORDER_H
+
+#include <glm/glm.hpp>
+
+#include "render_device.h"
+
+#include <vector>
+#include <string>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <unordered_map>
+#include <iostream>
+
+// Command stream file written by RecordingRenderDevice and read by CommandReplay. Little
+// endian, as written by the machine that records it:
+//   char[4] "RCMD", uint32 version
+//   per command: uint32 opcode, uint32 payload bytes, payload (the call's arguments)
+// Buffer contents and uniform values are stored in full; programs are stored by their
+// shader file names, so a replay needs the same shader files next to it.
+const char COMMAND_STREAM_MAGIC[4] = { 'R', 'C', 'M', 'D' };
+// version 2 added the first index to draws, version 3 the depth mode and blend commands,
+// version 4 the defines of a program, version 5 the memory category of a buffer; older
+// streams still play
+const unsigned int COMMAND_STREAM_VERSION = 5;
+
+enum RecordedCommand
+{
+    CMD_CREATE_BUFFER = 1,
+    CMD_SET_BUFFER_DATA,
+    CMD_UPDATE_BUFFER,
+    CMD_BIND_UNIFORM_BUFFER,
+    CMD_DESTROY_BUFFER,
+    CMD_CREATE_TEXTURE_BUFFER,
+    CMD_BIND_TEXTURE_BUFFER,
+    CMD_DESTROY_TEXTURE,
+    CMD_CREATE_VERTEX_LAYOUT,
+    CMD_SET_ATTRIBUTE_DIVISOR,
+    CMD_DESTROY_VERTEX_LAYOUT,
+    CMD_CREATE_PROGRAM,
+    CMD_USE_PROGRAM,
+    CMD_BIND_UNIFORM_BLOCK,
+    CMD_SET_UNIFORM,
+    CMD_DESTROY_PROGRAM,
+    CMD_SET_VIEWPORT,
+    CMD_SET_VIEWPORT_INDEXED,
+    CMD_CLEAR,
+    CMD_DRAW_INDEXED_INSTANCED,
+    CMD_END_FRAME,
+    CMD_SET_DEPTH_MODE,
+    CMD_SET_ADDITIVE_BLEND
+};
+
+inline size_t uniformBytes(UniformType type, int count)
+{
+    static const size_t floats[] = { 1, 1, 2, 3, 16 };
+    return floats[type] * 4 * count;
+}
+
+// Passes every call on to another device and appends it to a command stream file. The
+// handles written are the target device's; CommandReplay maps them to its own.
+class RecordingRenderDevice : public RenderDevice
+{
+public:
+    explicit RecordingRenderDevice(RenderDevice& targetDevice) : target(targetDevice), frames(0)
+    {
+    }
+
+    bool open(const std::string& path)
+    {
+        file.open(path.c_str(), std::ios::binary);
+        if (!file)
+        {
+            std::cout << "ERROR::COMMAND_RECORDER::FILE_NOT_WRITABLE: " << path << std::endl;
+            return false;
+        }
+        file.write(COMMAND_STREAM_MAGIC, sizeof(COMMAND_STREAM_MAGIC));
+        file.write((const char*)&COMMAND_STREAM_VERSION, sizeof(COMMAND_STREAM_VERSION));
+        return true;
+    }
+
+    size_t recordedFrames() const
+    {
+        return frames;
+    }
+
+    std::string name() const
+    {
+        return "recording " + target.name();
+    }
+
+    bool supportsLayeredViews() const
+    {
+        return target.supportsLayeredViews();
+    }
+
+    DeviceHandle createBuffer(BufferKind kind, size_t bytes, const void* data, BufferUsage usage, MemoryCategory category)
+    {
+        DeviceHandle buffer = target.createBuffer(kind, bytes, data, usage, category);
+        begin(CMD_CREATE_BUFFER);
+        put(buffer);
+        put((unsigned int)kind);
+        put((unsigned int)usage);
+        put((unsigned int)category);
+        putData(bytes, data);
+        end();
+        return buffer;
+    }
+
+    void setBufferData(DeviceHandle buffer, size_t bytes, const void* data)
+    {
+        target.setBufferData(buffer, bytes, data);
+        begin(CMD_SET_BUFFER_DATA);
+        put(buffer);
+        putData(bytes, data);
+        end();
+    }
+
+    void updateBuffer(DeviceHandle buffer, size_t offset, size_t bytes, const void* data)
+    {
+        target.updateBuffer(buffer, offset, bytes, data);
+        begin(CMD_UPDATE_BUFFER);
+        put(buffer);
+        put((unsigned long long)offset);
+        putData(bytes, data);
+        end();
+    }
+
+    void bindUniformBuffer(unsigned int binding, DeviceHandle buffer)
+    {
+        target.bindUniformBuffer(binding, buffer);
+        begin(CMD_BIND_UNIFORM_BUFFER);
+        put(binding);
+        put(buffer);
+        end();
+    }
+
+    void destroyBuffer(DeviceHandle buffer)
+    {
+        target.destroyBuffer(buffer);
+        begin(CMD_DESTROY_BUFFER);
+        put(buffer);
+        end();
+    }
+
+    DeviceHandle createTextureBuffer(DeviceHandle buffer, TextureBufferFormat format)
+    {
+        DeviceHandle texture = target.createTextureBuffer(buffer, format);
+        begin(CMD_CREATE_TEXTURE_BUFFER);
+        put(texture);
+        put(buffer);
+        put((unsigned int)format);
+        end();
+        return texture;
+    }
+
+    void bindTextureBuffer(unsigned int unit, DeviceHandle texture)
+    {
+        target.bindTextureBuffer(unit, texture);
+        begin(CMD_BIND_TEXTURE_BUFFER);
+        put(unit);
+        put(texture);
+        end();
+    }
+
+    void destroyTexture(DeviceHandle texture)
+    {
+        target.destroyTexture(texture);
+        begin(CMD_DESTROY_TEXTURE);
+        put(texture);
+        end();
+    }
+
+    DeviceHandle createVertexLayout(const VertexAttribute* attributes, int count, DeviceHandle indexBuffer)
+    {
+        DeviceHandle layout = target.createVertexLayout(attributes, count, indexBuffer);
+        begin(CMD_CREATE_VERTEX_LAYOUT);
+        put(layout);
+        put(indexBuffer);
+        put(count);
+        for (int i = 0; i < count; i++)
+            put(attributes[i]);
+        end();
+        return layout;
+    }
+
+    void setAttributeDivisor(DeviceHandle layout, unsigned int location, unsigned int divisor)
+    {
+        target.setAttributeDivisor(layout, location, divisor);
+        begin(CMD_SET_ATTRIBUTE_DIVISOR);
+        put(layout);
+        put(location);
+        put(divisor);
+        end();
+    }
+
+    void destroyVertexLayout(DeviceHandle layout)
+    {
+        target.destroyVertexLayout(layout);
+        begin(CMD_DESTROY_VERTEX_LAYOUT);
+        put(layout);
+        end();
+    }
+
+    DeviceHandle createProgram(const std::string& vertexPath, const std::string& fragmentPath, const std::string& defines = std::string())
+    {
+        DeviceHandle program = target.createProgram(vertexPath, fragmentPath, defines);
+        begin(CMD_CREATE_PROGRAM);
+        put(program);
+        putString(vertexPath.c_str());
+        putString(fragmentPath.c_str());
+        putString(defines.c_str());
+        end();
+        return program;
+    }
+
+    void useProgram(DeviceHandle program)
+    {
+        target.useProgram(program);
+        begin(CMD_USE_PROGRAM);
+        put(program);
+        end();
+    }
+
+    void bindUniformBlock(DeviceHandle program, const char* block, unsigned int binding)
+    {
+        target.bindUniformBlock(program, block, binding);
+        begin(CMD_BIND_UNIFORM_BLOCK);
+        put(program);
+        putString(block);
+        put(binding);
+        end();
+    }
+
+    void setUniform(DeviceHandle program, const char* uniform, UniformType type, int count, const void* values)
+    {
+        target.setUniform(program, uniform, type, count, values);
+        begin(CMD_SET_UNIFORM);
+        put(program);
+        putString(uniform);
+        put((unsigned int)type);
+        put(count);
+        putData(uniformBytes(type, count), values);
+        end();
+    }
+
+    void destroyProgram(DeviceHandle program)
+    {
+        target.destroyProgram(program);
+        begin(CMD_DESTROY_PROGRAM);
+        put(program);
+        end();
+    }
+
+    void setViewport(int x, int y, int width, int height)
+    {
+        target.setViewport(x, y, width, height);
+        begin(CMD_SET_VIEWPORT);
+        put(x);
+        put(y);
+        put(width);
+        put(height);
+        end();
+    }
+
+    void setViewportIndexed(unsigned int index, float x, float y, float width, float height)
+    {
+        target.setViewportIndexed(index, x, y, width, height);
+        begin(CMD_SET_VIEWPORT_INDEXED);
+        put(index);
+        put(x);
+        put(y);
+        put(width);
+        put(height);
+        end();
+    }
+
+    void clear(const glm::vec4& color)
+    {
+        target.clear(color);
+        begin(CMD_CLEAR);
+        put(color);
+        end();
+    }
+
+    void setDepthMode(DepthMode mode)
+    {
+        target.setDepthMode(mode);
+        begin(CMD_SET_DEPTH_MODE);
+        put((unsigned int)mode);
+        end();
+    }
+
+    void setAdditiveBlend(bool enabled)
+    {
+        target.setAdditiveBlend(enabled);
+        begin(CMD_SET_ADDITIVE_BLEND);
+        put((unsigned char)enabled);
+        end();
+    }
+
+    void drawIndexedInstanced(DeviceHandle layout, unsigned int indexCount, unsigned int instanceCount, unsigned int firstIndex)
+    {
+        target.drawIndexedInstanced(layout, indexCount, instanceCount, firstIndex);
+        begin(CMD_DRAW_INDEXED_INSTANCED);
+        put(layout);
+        put(indexCount);
+        put(instanceCount);
+        put(firstIndex);
+        end();
+    }
+
+    void endFrame()
+    {
+        target.endFrame();
+        begin(CMD_END_FRAME);
+        end();
+        frames++;
+    }
+
+    const DeviceStats& frameStats() const
+    {
+        return target.frameStats();
+    }
+
+    GpuMemoryTracker& memory()
+    {
+        return target.memory();
+    }
+
+private:
+    RenderDevice& target;
+    std::ofstream file;
+    std::vector<char> packet;
+    size_t frames;
+
+    void begin(RecordedCommand command)
+    {
+        packet.clear();
+        put((unsigned int)command);
+        put((unsigned int)0);
+    }
+
+    template <typename T>
+    void put(const T& value)
+    {
+        const char* bytes = (const char*)&value;
+        packet.insert(packet.end(), bytes, bytes + sizeof(T));
+    }
+
+    void putString(const char* text)
+    {
+        unsigned int length = (unsigned int)std::strlen(text);
+        put(length);
+        packet.insert(packet.end(), text, text + length);
+    }
+
+    // byte count, a has-data flag and the bytes themselves
+    void putData(size_t bytes, const void* data)
+    {
+        put((unsigned long long)bytes);
+        put((unsigned char)(data != NULL));
+        if (data != NULL)
+            packet.insert(packet.end(), (const char*)data, (const char*)data + bytes);
+    }
+
+    void end()
+    {
+        if (!file)
+            return;
+        unsigned int payload = (unsigned int)(packet.size() - 2 * sizeof(unsigned int));
+        std::memcpy(&packet[sizeof(unsigned int)], &payload, sizeof(payload));
+        file.write(&packet[0], packet.size());
+    }
+};
+
+// Plays a recorded command stream into a device one frame at a time, translating the
+// recorded handles into the ones the device hands out.
+class CommandReplay
+{
+public:
+    CommandReplay() : position(0), packetEnd(0), overrun(false), frames(0), streamVersion(0)
+    {
+    }
+
+    bool load(const std::string& path)
+    {
+        std::ifstream file(path.c_str(), std::ios::binary);
+        if (!file)
+        {
+            std::cout << "ERROR::COMMAND_REPLAY::FILE_NOT_SUCCESSFULLY_READ: " << path << std::endl;
+            return false;
+        }
+        stream.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        unsigned int version = 0;
+        if (stream.size() >= 8)
+            std::memcpy(&version, &stream[4], sizeof(version));
+        if (stream.size() < 8 || std::memcmp(&stream[0], COMMAND_STREAM_MAGIC, 4) != 0 || version < 1 || version > COMMAND_STREAM_VERSION)
+        {
+            std::cout << "ERROR::COMMAND_REPLAY::BAD_HEADER: " << path << std::endl;
+            stream.clear();
+            return false;
+        }
+        position = 8;
+        streamVersion = version;
+        return true;
+    }
+
+    size_t playedFrames() const
+    {
+        return frames;
+    }
+
+    // runs commands up to and including the next end of frame; false once the stream is done
+    bool playFrame(RenderDevice& device)
+    {
+        while (position + 8 <= stream.size())
+        {
+            packetEnd = stream.size();
+            unsigned int command = get<unsigned int>();
+            unsigned int payload = get<unsigned int>();
+            size_t next = position + payload;
+            if (next > stream.size())
+            {
+                std::cout << "ERROR::COMMAND_REPLAY::TRUNCATED: command " << command << std::endl;
+                break;
+            }
+            bool frameEnded = execute(device, (RecordedCommand)command, next);
+            if (overrun)
+            {
+                std::cout << "ERROR::COMMAND_REPLAY::TRUNCATED: a field of command " << command << " runs past its packet" << std::endl;
+                break;
+            }
+            position = next;
+            if (frameEnded)
+            {
+                frames++;
+                return true;
+            }
+        }
+        position = stream.size();
+        return false;
+    }
+
+private:
+    std::vector<char> stream;
+    size_t position;
+    size_t packetEnd;       // fields are only read up to here
+    bool overrun;           // a field ran past packetEnd; the packet is not executed
+    size_t frames;
+    unsigned int streamVersion;
+    std::unordered_map<DeviceHandle, DeviceHandle> buffers;
+    std::unordered_map<DeviceHandle, DeviceHandle> textures;
+    std::unordered_map<DeviceHandle, DeviceHandle> layouts;
+    std::unordered_map<DeviceHandle, DeviceHandle> programs;
+
+    // whether bytes more can be read from the packet; marks the overrun if not
+    bool fits(size_t bytes)
+    {
+        if (!overrun && bytes <= packetEnd - position)
+            return true;
+        overrun = true;
+        return false;
+    }
+
+    // a zero value once the packet has overrun
+    template <typename T>
+    T get()
+    {
+        T value;
+        std::memset(&value, 0, sizeof(T));
+        if (!fits(sizeof(T)))
+            return value;
+        std::memcpy(&value, &stream[position], sizeof(T));
+        position += sizeof(T);
+        return value;
+    }
+
+    std::string getString()
+    {
+        unsigned int length = get<unsigned int>();
+        if (!fits(length))
+            return std::string();
+        std::string text(&stream[position], length);
+        position += length;
+        return text;
+    }
+
+    // NULL for a recorded NULL pointer, and with bytes 0 once the packet has overrun
+    const void* getData(size_t& bytes)
+    {
+        bytes = (size_t)get<unsigned long long>();
+        bool hasData = get<unsigned char>() != 0;
+        if (overrun || (hasData && !fits(bytes)))
+        {
+            bytes = 0;
+            return NULL;
+        }
+        const void* data = hasData ? &stream[position] : NULL;
+        if (hasData)
+            position += bytes;
+        return data;
+    }
+
+    static DeviceHandle lookup(const std::unordered_map<DeviceHandle, DeviceHandle>& handles, DeviceHandle recorded)
+    {
+        std::unordered_map<DeviceHandle, DeviceHandle>::const_iterator found = handles.find(recorded);
+        return found != handles.end() ? found->second : 0;
+    }
+
+    // returns true for the end of a frame. Every field is read before the device is called,
+    // so a packet whose fields run past end sets overrun and reaches the device not at all.
+    bool execute(RenderDevice& device, RecordedCommand command, size_t end)
+    {
+        packetEnd = end;
+        size_t bytes;
+        switch (command)
+        {
+        case CMD_CREATE_BUFFER:
+        {
+            DeviceHandle recorded = get<DeviceHandle>();
+            BufferKind kind = (BufferKind)get<unsigned int>();
+            BufferUsage usage = (BufferUsage)get<unsigned int>();
+            // older streams did not say; their buffers were meshes and shading data
+            MemoryCategory category = streamVersion >= 5 ? (MemoryCategory)get<unsigned int>() : (kind == VERTEX_BUFFER || kind == INDEX_BUFFER ? MEMORY_GEOMETRY : MEMORY_SHADING);
+            const void* data = getData(bytes);
+            if (!overrun)
+                buffers[recorded] = device.createBuffer(kind, bytes, data, usage, category);
+            break;
+        }
+        case CMD_SET_BUFFER_DATA:
+        {
+            DeviceHandle buffer = lookup(buffers, get<DeviceHandle>());
+            const void* data = getData(bytes);
+            if (!overrun)
+                device.setBufferData(buffer, bytes, data);
+            break;
+        }
+        case CMD_UPDATE_BUFFER:
+        {
+            DeviceHandle buffer = lookup(buffers, get<DeviceHandle>());
+            size_t offset = (size_t)get<unsigned long long>();
+            const void* data = getData(bytes);
+            if (!overrun)
+                device.updateBuffer(buffer, offset, bytes, data);
+            break;
+        }
+        case CMD_BIND_UNIFORM_BUFFER:
+        {
+            unsigned int binding = get<unsigned int>();
+            DeviceHandle buffer = lookup(buffers, get<DeviceHandle>());
+            if (!overrun)
+                device.bindUniformBuffer(binding, buffer);
+            break;
+        }
+        case CMD_DESTROY_BUFFER:
+        {
+            DeviceHandle buffer = lookup(buffers, get<DeviceHandle>());
+            if (!overrun)
+                device.destroyBuffer(buffer);
+            break;
+        }
+        case CMD_CREATE_TEXTURE_BUFFER:
+        {
+            DeviceHandle recorded = get<DeviceHandle>();
+            DeviceHandle buffer = lookup(buffers, get<DeviceHandle>());
+            TextureBufferFormat format = (TextureBufferFormat)get<unsigned int>();
+            if (!overrun)
+                textures[recorded] = device.createTextureBuffer(buffer, format);
+            break;
+        }
+        case CMD_BIND_TEXTURE_BUFFER:
+        {
+            unsigned int unit = get<unsigned int>();
+            DeviceHandle texture = lookup(textures, get<DeviceHandle>());
+            if (!overrun)
+                device.bindTextureBuffer(unit, texture);
+            break;
+        }
+        case CMD_DESTROY_TEXTURE:
+        {
+            DeviceHandle texture = lookup(textures, get<DeviceHandle>());
+            if (!overrun)
+                device.destroyTexture(texture);
+            break;
+        }
+        case CMD_CREATE_VERTEX_LAYOUT:
+        {
+            DeviceHandle recorded = get<DeviceHandle>();
+            DeviceHandle indexBuffer = lookup(buffers, get<DeviceHandle>());
+            int count = get<int>();
+            // checked before the attributes are allocated, so a bad count cannot ask for gigabytes
+            if (count < 0 || !fits((size_t)count * sizeof(VertexAttribute)))
+            {
+                overrun = true;
+                break;
+            }
+            std::vector<VertexAttribute> attributes(count);
+            for (int i = 0; i < count; i++)
+            {
+                attributes[i] = get<VertexAttribute>();
+                attributes[i].buffer = lookup(buffers, attributes[i].buffer);
+            }
+            layouts[recorded] = device.createVertexLayout(count > 0 ? &attributes[0] : NULL, count, indexBuffer);
+            break;
+        }
+        case CMD_SET_ATTRIBUTE_DIVISOR:
+        {
+            DeviceHandle layout = lookup(layouts, get<DeviceHandle>());
+            unsigned int location = get<unsigned int>();
+            unsigned int divisor = get<unsigned int>();
+            if (!overrun)
+                device.setAttributeDivisor(layout, location, divisor);
+            break;
+        }
+        case CMD_DESTROY_VERTEX_LAYOUT:
+        {
+            DeviceHandle layout = lookup(layouts, get<DeviceHandle>());
+            if (!overrun)
+                device.destroyVertexLayout(layout);
+            break;
+        }
+        case CMD_CREATE_PROGRAM:
+        {
+            DeviceHandle recorded = get<DeviceHandle>();
+            std::string vertexPath = getString();
+            std::string fragmentPath = getString();
+            std::string defines = streamVersion >= 4 ? getString() : std::string();
+            if (!overrun)
+                programs[recorded] = device.createProgram(vertexPath, fragmentPath, defines);
+            break;
+        }
+        case CMD_USE_PROGRAM:
+        {
+            DeviceHandle program = lookup(programs, get<DeviceHandle>());
+            if (!overrun)
+                device.useProgram(program);
+            break;
+        }
+        case CMD_BIND_UNIFORM_BLOCK:
+        {
+            DeviceHandle program = lookup(programs, get<DeviceHandle>());
+            std::string block = getString();
+            unsigned int binding = get<unsigned int>();
+            if (!overrun)
+                device.bindUniformBlock(program, block.c_str(), binding);
+            break;
+        }
+        case CMD_SET_UNIFORM:
+        {
+            DeviceHandle program = lookup(programs, get<DeviceHandle>());
+            std::string uniform = getString();
+            UniformType type = (UniformType)get<unsigned int>();
+            int count = get<int>();
+            const void* values = getData(bytes);
+            if (!overrun)
+                device.setUniform(program, uniform.c_str(), type, count, values);
+            break;
+        }
+        case CMD_DESTROY_PROGRAM:
+        {
+            DeviceHandle program = lookup(programs, get<DeviceHandle>());
+            if (!overrun)
+                device.destroyProgram(program);
+            break;
+        }
+        case CMD_SET_VIEWPORT:
+        {
+            int x = get<int>(), y = get<int>(), width = get<int>(), height = get<int>();
+            if (!overrun)
+                device.setViewport(x, y, width, height);
+            break;
+        }
+        case CMD_SET_VIEWPORT_INDEXED:
+        {
+            unsigned int index = get<unsigned int>();
+            float x = get<float>(), y = get<float>(), width = get<float>(), height = get<float>();
+            if (!overrun)
+                device.setViewportIndexed(index, x, y, width, height);
+            break;
+        }
+        case CMD_CLEAR:
+        {
+            glm::vec4 color = get<glm::vec4>();
+            if (!overrun)
+                device.clear(color);
+            break;
+        }
+        case CMD_SET_DEPTH_MODE:
+        {
+            DepthMode mode = (DepthMode)get<unsigned int>();
+            if (!overrun)
+                device.setDepthMode(mode);
+            break;
+        }
+        case CMD_SET_ADDITIVE_BLEND:
+        {
+            bool additive = get<unsigned char>() != 0;
+            if (!overrun)
+                device.setAdditiveBlend(additive);
+            break;
+        }
+        case CMD_DRAW_INDEXED_INSTANCED:
+        {
+            DeviceHandle layout = lookup(layouts, get<DeviceHandle>());
+            unsigned int indexCount = get<unsigned int>();
+            unsigned int instanceCount = get<unsigned int>();
+            unsigned int firstIndex = streamVersion >= 2 ? get<unsigned int>() : 0;
+            if (!overrun)
+                device.drawIndexedInstanced(layout, indexCount, instanceCount, firstIndex);
+            break;
+        }
+        case CMD_END_FRAME:
+            device.endFrame();
+            return true;
+        default:
+            std::cout << "WARNING::COMMAND_REPLAY::UNKNOWN_COMMAND: " << (unsigned int)command << std::endl;
+            break;
+        }
+        return false;
+    }
+};
+
+#endif
@@ -0,0 +1,190 @@
+//
+//  draw_list.h
+//  3D Object Drawing
+//
+
+#ifndef DRAW_LIST_H
+#define DRAW_LIST_H
+
+#include <glm/glm.hpp>
+
+#include "material_table.h"
+
+#include <vector>
+#include <cmath>
+
+// every object in the scene is the unit cube from main.cpp, spanning [0, 0.5] on each axis
+const glm::vec3 CUBE_MIN = glm::vec3(0.0f, 0.0f, 0.0f);
+const glm::vec3 CUBE_MAX = glm::vec3(0.5f, 0.5f, 0.5f);
+const unsigned int CUBE_VERTEX_COUNT = 24;   // four per face, faces in the order of cube_vertices in main.cpp
+const unsigned int CUBE_INDEX_COUNT = 36;
+
+// the cube mesh of main.cpp for code that works on it without OpenGL: positions in the
+// order of cube_vertices and the triangles of cube_indices
+const glm::vec3 CUBE_VERTICES[CUBE_VERTEX_COUNT] = {
+    glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.5f, 0.0f, 0.0f), glm::vec3(0.5f, 0.5f, 0.0f), glm::vec3(0.0f, 0.5f, 0.0f),
+    glm::vec3(0.5f, 0.0f, 0.0f), glm::vec3(0.5f, 0.5f, 0.0f), glm::vec3(0.5f, 0.0f, 0.5f), glm::vec3(0.5f, 0.5f, 0.5f),
+    glm::vec3(0.0f, 0.0f, 0.5f), glm::vec3(0.5f, 0.0f, 0.5f), glm::vec3(0.5f, 0.5f, 0.5f), glm::vec3(0.0f, 0.5f, 0.5f),
+    glm::vec3(0.0f, 0.0f, 0.5f), glm::vec3(0.0f, 0.5f, 0.5f), glm::vec3(0.0f, 0.5f, 0.0f), glm::vec3(0.0f, 0.0f, 0.0f),
+    glm::vec3(0.5f, 0.5f, 0.5f), glm::vec3(0.5f, 0.5f, 0.0f), glm::vec3(0.0f, 0.5f, 0.0f), glm::vec3(0.0f, 0.5f, 0.5f),
+    glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.5f, 0.0f, 0.0f), glm::vec3(0.5f, 0.0f, 0.5f), glm::vec3(0.0f, 0.0f, 0.5f)
+};
+const unsigned int CUBE_INDICES[CUBE_INDEX_COUNT] = {
+    0, 3, 2, 2, 1, 0,
+    4, 5, 7, 7, 6, 4,
+    8, 9, 10, 10, 11, 8,
+    12, 13, 14, 14, 15, 12,
+    16, 17, 18, 18, 19, 16,
+    20, 21, 22, 22, 23, 20
+};
+
+// world space axis aligned bounding box
+struct AABB
+{
+    glm::vec3 min;
+    glm::vec3 max;
+};
+
+// one recorded draw of the cube mesh
+struct DrawCommand
+{
+    glm::mat4 model;
+    unsigned short material;    // index into the owning DrawList's material table
+};
+
+// transforms the cube's local box by a model matrix and returns the enclosing world box
+inline AABB cubeWorldBounds(const glm::mat4& model)
+{
+    glm::vec3 localCenter = (CUBE_MIN + CUBE_MAX) * 0.5f;
+    glm::vec3 localExtent = (CUBE_MAX - CUBE_MIN) * 0.5f;
+
+    glm::vec3 center = glm::vec3(model * glm::vec4(localCenter, 1.0f));
+    glm::vec3 extent;
+    for (int row = 0; row < 3; row++)
+    {
+        extent[row] = std::fabs(model[0][row]) * localExtent.x
+                    + std::fabs(model[1][row]) * localExtent.y
+                    + std::fabs(model[2][row]) * localExtent.z;
+    }
+
+    AABB box;
+    box.min = center - extent;
+    box.max = center + extent;
+    return box;
+}
+
+// The meshes a cube instance can be drawn with, as ranges of the cube's index buffer. A cube
+// scaled to nothing along one axis has two coinciding faces across that axis and four sides
+// without area; it is drawn as the one face that comes first in the index buffer, which
+// is the one that wins the depth test (GL_LESS) when the whole cube is drawn.
+enum InstanceMesh
+{
+    MESH_CUBE,
+    MESH_QUAD_X,    // flat along local x: the x = 0.5 face
+    MESH_QUAD_Y,    // flat along local y: the y = 0.5 face
+    MESH_QUAD_Z,    // flat along local z: the z = 0 face
+    MESH_NONE       // flat along two or three axes: covers no pixels
+};
+
+const int INSTANCE_MESH_COUNT = 4;     // meshes that draw something
+
+struct MeshRange
+{
+    unsigned int firstIndex;
+    unsigned int indexCount;
+};
+
+const MeshRange MESH_RANGES[INSTANCE_MESH_COUNT] = { { 0, CUBE_INDEX_COUNT }, { 6, 6 }, { 24, 6 }, { 0, 6 } };
+
+// an axis is flat when it is shorter than this fraction of the longest one
+const float FLAT_AXIS_RATIO = 1e-4f;
+
+inline InstanceMesh instanceMesh(const glm::mat4& model)
+{
+    float lengths[3];
+    float longest = 0.0f;
+    for (int axis = 0; axis < 3; axis++)
+    {
+        lengths[axis] = glm::length(glm::vec3(model[axis]));
+        longest = lengths[axis] > longest ? lengths[axis] : longest;
+    }
+    int flatAxes = 0;
+    InstanceMesh mesh = MESH_CUBE;
+    for (int axis = 0; axis < 3; axis++)
+    {
+        if (lengths[axis] <= longest * FLAT_AXIS_RATIO)
+        {
+            flatAxes++;
+            mesh = (InstanceMesh)(MESH_QUAD_X + axis);
+        }
+    }
+    return flatAxes <= 1 ? mesh : MESH_NONE;
+}
+
+// The scene is traversed once per frame into a DrawList; renderers then decide
+// how (and how many times) the recorded commands are submitted to OpenGL.
+// Colors are interned into the material table as they are recorded; the table
+// outlives clear() so material indices stay stable from frame to frame.
+// With trackSources set, the function that recorded each command (see DrawSource) is kept
+// alongside it for diagnostics.
+class DrawList
+{
+public:
+    std::vector<DrawCommand> commands;
+    MaterialTable materials;
+    bool trackSources = false;
+    std::vector<const char*> sources;
+    const char* source = NULL;      // set by DrawSource
+
+    void add(const glm::mat4& model, const glm::vec4& color)
+    {
+        DrawCommand command;
+        command.model = model;
+        command.material = materials.intern(color);
+        commands.push_back(command);
+        if (trackSources)
+            sources.push_back(source);
+    }
+
+    void clear()
+    {
+        commands.clear();
+        sources.clear();
+    }
+
+    size_t size() const
+    {
+        return commands.size();
+    }
+
+    const DrawCommand& operator[](size_t i) const
+    {
+        return commands[i];
+    }
+};
+
+// names the function recording into a list until the end of the scope:
+//   DrawSource source(drawList, __FUNCTION__);
+// the name must be a string literal
+class DrawSource
+{
+public:
+    DrawSource(DrawList& drawList, const char* name) : list(drawList), previous(drawList.source)
+    {
+        list.source = name;
+    }
+
+    ~DrawSource()
+    {
+        list.source = previous;
+    }
+
+private:
+    DrawList& list;
+    const char* previous;
+
+    DrawSource(const DrawSource&);
+    DrawSource& operator=(const DrawSource&);
+};
+
+#endif
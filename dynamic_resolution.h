@@ -0,0 +1,338 @@
+//
+//  dynamic_resolution.h
+//  3D Object Drawing
+//
+
+#ifndef DYNAMIC_RESOLUTION_H
+#define DYNAMIC_RESOLUTION_H
+
+#include <glad/glad.h>
+
+#include "gl_render_device.h"
+
+#include <string>
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <algorithm>
+#include <iostream>
+
+enum UpscaleFilter
+{
+    UPSCALE_BILINEAR,   // glBlitFramebuffer with GL_LINEAR
+    UPSCALE_SHARPEN     // bilinear plus an unsharp mask, upscale.fs
+};
+
+struct ResolutionSettings
+{
+    double budgetMs = 0.0;          // scene GPU time to aim for; 0 = always full resolution
+    float minScale = 0.5f;
+    float maxScale = 1.0f;
+    int adjustInterval = 8;         // frames averaged per adjustment
+    UpscaleFilter filter = UPSCALE_BILINEAR;
+    float sharpness = 0.5f;
+    std::string logPath;            // CSV of the scale and frame times, one row per frame; empty for none
+
+    // --dynamic-res MS, --min-scale S, --upscale bilinear|sharpen, --res-log FILE; false if
+    // arg is none of them
+    bool parseArgs(const std::string& arg, int argc, char** argv, int& i)
+    {
+        std::string value = i + 1 < argc ? argv[i + 1] : "";
+        if (arg == "--dynamic-res" && i + 1 < argc)
+            budgetMs = std::atof(argv[++i]);
+        else if (arg == "--min-scale" && i + 1 < argc)
+            minScale = std::min(std::max((float)std::atof(argv[++i]), 0.1f), 1.0f);
+        else if (arg == "--upscale" && (value == "bilinear" || value == "sharpen"))
+        {
+            filter = value == "sharpen" ? UPSCALE_SHARPEN : UPSCALE_BILINEAR;
+            i++;
+        }
+        else if (arg == "--res-log" && i + 1 < argc)
+            logPath = argv[++i];
+        else
+            return false;
+        return true;
+    }
+
+    static void printUsage()
+    {
+        std::cout << "  --dynamic-res MS lower the scene resolution to keep its GPU time under MS milliseconds\n"
+                  << "  --min-scale S    lowest resolution scale for --dynamic-res (default 0.5)\n"
+                  << "  --upscale F      bilinear or sharpen: how the scene is scaled up to the window\n"
+                  << "  --res-log FILE   write the resolution scale and frame times of every frame as CSV\n";
+    }
+};
+
+struct ResolutionStats
+{
+    float scale = 1.0f;
+    int sceneWidth = 0;
+    int sceneHeight = 0;
+    double sceneGpuMs = 0.0;        // last measured scene pass, read back a few frames late
+    double averageGpuMs = 0.0;      // what the last adjustment was based on
+    size_t changes = 0;
+};
+
+inline void printResolutionStats(const ResolutionStats& stats, double budgetMs)
+{
+    std::printf("dynamic resolution: scale %.3f (%dx%d)  scene gpu ms: %.3f (average %.3f, budget %.3f)  changes: %zu\n",
+        stats.scale, stats.sceneWidth, stats.sceneHeight, stats.sceneGpuMs, stats.averageGpuMs, budgetMs, stats.changes);
+}
+
+// Picks the render scale from the measured scene GPU time. The fragment work goes with the
+// pixel count, the square of the scale, so the scale that meets the budget is
+// scale * sqrt(budget / time). The controller moves halfway there every adjustInterval
+// frames and ignores corrections under 2%, so that timing noise does not make the
+// resolution oscillate.
+class ResolutionController
+{
+public:
+    explicit ResolutionController(const ResolutionSettings& resolutionSettings)
+        : settings(resolutionSettings), current(resolutionSettings.maxScale), sum(0.0), samples(0), average(0.0), changes(0)
+    {
+    }
+
+    float scale() const
+    {
+        return current;
+    }
+
+    double averageMs() const
+    {
+        return average;
+    }
+
+    size_t changeCount() const
+    {
+        return changes;
+    }
+
+    // one frame's scene time at the current scale; true when the scale changed
+    bool record(double sceneMs)
+    {
+        if (settings.budgetMs <= 0.0)
+            return false;
+        sum += sceneMs;
+        samples++;
+        if (samples < settings.adjustInterval)
+            return false;
+        average = sum / samples;
+        sum = 0.0;
+        samples = 0;
+        if (average <= 0.0)
+            return false;
+
+        float target = current * (float)std::sqrt(settings.budgetMs / average);
+        float next = std::min(std::max(current + (target - current) * 0.5f, settings.minScale), settings.maxScale);
+        bool atLimit = (next == settings.minScale || next == settings.maxScale) && next != current;
+        if (std::fabs(next - current) < 0.02f && !atLimit)
+            return false;
+        current = next;
+        changes++;
+        return true;
+    }
+
+private:
+    ResolutionSettings settings;
+    float current;
+    double sum;
+    int samples;
+    double average;
+    size_t changes;
+};
+
+// Renders the scene into an offscreen target at a fraction of the window size and scales
+// it up to the window afterwards. The target belongs to the render graph (render_graph.h),
+// which makes it at the full window size; only the viewport shrinks, so changing the scale
+// allocates nothing. The scene pass is timed with a ring of GL_TIME_ELAPSED queries that
+// are read a few frames later, so the measurement never waits for the GPU. Needs the GL
+// device: the queries and the blit are not RenderDevice operations.
+class DynamicResolution
+{
+public:
+    ResolutionStats stats;
+
+    DynamicResolution(GLRenderDevice& renderDevice, const ResolutionSettings& resolutionSettings)
+        : device(renderDevice), settings(resolutionSettings), controller(resolutionSettings), upscaleProgram(0), triangleIndices(0),
+          triangleLayout(0), timing(false), frame(0), log(NULL)
+    {
+        for (int i = 0; i < TIMER_RING; i++)
+        {
+            queries[i] = 0;
+            queryScale[i] = 0.0f;
+            queryPending[i] = false;
+        }
+    }
+
+    ~DynamicResolution()
+    {
+        if (log != NULL)
+            std::fclose(log);
+    }
+
+    // the budget is set; otherwise the scene is always drawn at full resolution
+    bool enabled() const
+    {
+        return settings.budgetMs > 0.0;
+    }
+
+    // directGL: the frames go straight to the GL device, not to the null device or --record
+    bool init(bool directGL)
+    {
+        if (!enabled())
+            return true;
+        if (!directGL)
+        {
+            std::cout << "ERROR::DYNAMIC_RESOLUTION::NEEDS_GL: dynamic resolution renders to an OpenGL framebuffer object, use --device gl without --record" << std::endl;
+            return false;
+        }
+        glGenQueries(TIMER_RING, queries);
+        if (settings.filter == UPSCALE_SHARPEN)
+        {
+            upscaleProgram = device.createProgram("upscale.vs", "upscale.fs");
+            const unsigned int indices[] = { 0, 1, 2 };
+            triangleIndices = device.createBuffer(INDEX_BUFFER, sizeof(indices), indices, STATIC_BUFFER, MEMORY_GEOMETRY);
+            triangleLayout = device.createVertexLayout(NULL, 0, triangleIndices);
+        }
+        if (!settings.logPath.empty())
+        {
+            log = std::fopen(settings.logPath.c_str(), "w");
+            if (log == NULL)
+            {
+                std::cout << "ERROR::DYNAMIC_RESOLUTION::LOG_NOT_WRITTEN: " << settings.logPath << std::endl;
+                return false;
+            }
+            std::fprintf(log, "frame,scale,width,height,frame_ms,scene_gpu_ms\n");
+        }
+        return true;
+    }
+
+    // sets the viewport to the part of the bound window sized target the scene is drawn in;
+    // returns that size in sceneWidth and sceneHeight
+    void beginScene(int windowWidth, int windowHeight, int& sceneWidth, int& sceneHeight)
+    {
+        collectTimers();
+
+        stats.scale = controller.scale();
+        stats.sceneWidth = std::max(1, (int)(windowWidth * stats.scale + 0.5f));
+        stats.sceneHeight = std::max(1, (int)(windowHeight * stats.scale + 0.5f));
+        sceneWidth = stats.sceneWidth;
+        sceneHeight = stats.sceneHeight;
+        device.setViewport(0, 0, sceneWidth, sceneHeight);
+
+        int slot = (int)(frame % TIMER_RING);
+        timing = !queryPending[slot];
+        if (timing)
+        {
+            glBeginQuery(GL_TIME_ELAPSED, queries[slot]);
+            queryScale[slot] = stats.scale;
+        }
+    }
+
+    // stops timing the scene; frameMs is logged with the scale
+    void endScene(double frameMs)
+    {
+        int slot = (int)(frame % TIMER_RING);
+        if (timing)
+        {
+            glEndQuery(GL_TIME_ELAPSED);
+            queryPending[slot] = true;
+        }
+
+        if (log != NULL)
+            std::fprintf(log, "%zu,%.4f,%d,%d,%.3f,%.3f\n", frame, stats.scale, stats.sceneWidth, stats.sceneHeight, frameMs, stats.sceneGpuMs);
+        frame++;
+    }
+
+    // scales the scene in colorTexture, bound as the read framebuffer, up into the bound
+    // draw framebuffer of the window's size
+    void upscale(GLuint colorTexture, int textureWidth, int textureHeight, int windowWidth, int windowHeight)
+    {
+        device.setViewport(0, 0, windowWidth, windowHeight);
+        if (settings.filter == UPSCALE_SHARPEN)
+            sharpenPass(colorTexture, textureWidth, textureHeight);
+        else
+            glBlitFramebuffer(0, 0, stats.sceneWidth, stats.sceneHeight, 0, 0, windowWidth, windowHeight, GL_COLOR_BUFFER_BIT, GL_LINEAR);
+    }
+
+    void release()
+    {
+        if (queries[0] != 0)
+            glDeleteQueries(TIMER_RING, queries);
+        if (triangleLayout != 0)
+            device.destroyVertexLayout(triangleLayout);
+        if (triangleIndices != 0)
+            device.destroyBuffer(triangleIndices);
+        if (upscaleProgram != 0)
+            device.destroyProgram(upscaleProgram);
+        queries[0] = triangleLayout = triangleIndices = upscaleProgram = 0;
+    }
+
+    // at exit: the last scale and timings, then the GL objects
+    void shutdown()
+    {
+        if (!enabled())
+            return;
+        printResolutionStats(stats, settings.budgetMs);
+        release();
+    }
+
+private:
+    static const int TIMER_RING = 4;
+
+    GLRenderDevice& device;
+    ResolutionSettings settings;
+    ResolutionController controller;
+
+    DeviceHandle upscaleProgram;
+    DeviceHandle triangleIndices;
+    DeviceHandle triangleLayout;
+
+    GLuint queries[TIMER_RING];
+    float queryScale[TIMER_RING];       // the scale each query timed
+    bool queryPending[TIMER_RING];
+    bool timing;                        // this frame's scene pass is being timed
+    size_t frame;
+    std::FILE* log;
+
+    DynamicResolution(const DynamicResolution&);
+    DynamicResolution& operator=(const DynamicResolution&);
+
+    // results of earlier frames that are ready; times taken at another scale are dropped
+    void collectTimers()
+    {
+        for (int i = 0; i < TIMER_RING; i++)
+        {
+            if (!queryPending[i])
+                continue;
+            GLuint available = 0;
+            glGetQueryObjectuiv(queries[i], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available)
+                continue;
+            GLuint64 nanoseconds = 0;
+            glGetQueryObjectui64v(queries[i], GL_QUERY_RESULT, &nanoseconds);
+            queryPending[i] = false;
+            stats.sceneGpuMs = nanoseconds / 1e6;
+            if (queryScale[i] == controller.scale())
+                controller.record(stats.sceneGpuMs);
+        }
+        stats.averageGpuMs = controller.averageMs();
+        stats.changes = controller.changeCount();
+    }
+
+    void sharpenPass(GLuint colorTexture, int textureWidth, int textureHeight)
+    {
+        GLStateCache& state = device.stateCache();
+        glBindTexture(GL_TEXTURE_2D, colorTexture);
+        state.enable(GL_DEPTH_TEST, false);
+        device.useProgram(upscaleProgram);
+        device.setInt(upscaleProgram, "sceneColor", state.activeTextureUnit());
+        device.setVec2(upscaleProgram, "sceneScale", glm::vec2((float)stats.sceneWidth / textureWidth, (float)stats.sceneHeight / textureHeight));
+        device.setVec2(upscaleProgram, "texelSize", glm::vec2(1.0f / textureWidth, 1.0f / textureHeight));
+        device.setFloat(upscaleProgram, "sharpness", settings.sharpness);
+        device.drawIndexedInstanced(triangleLayout, 3, 1, 0);
+        state.enable(GL_DEPTH_TEST, true);
+    }
+};
+
+#endif
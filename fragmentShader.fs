@@ -1,9 +1,102 @@
 #version 330 core
-uniform vec4 color;
+flat in int materialIndex;
+in vec3 viewPosition;
+in vec3 bakedColor;
+
+// must match MAX_MATERIALS in material_table.h
+layout (std140) uniform Materials
+{
+    vec4 materialColor[1024];
+};
+
+// clustered lighting, see clustered_lighting.h; the grid must match CLUSTER_X/Y/Z there
+const int CLUSTER_X = 16;
+const int CLUSTER_Y = 9;
+const int CLUSTER_Z = 24;
+
+// permutation features, see shader_variants.h. A variant is compiled with SHADER_VARIANT
+// and the features it has defined, which makes the switches below constants the compiler
+// folds away; the program without SHADER_VARIANT takes them as uniforms.
+#pragma feature CLUSTERED_LIGHTING
+#pragma feature BAKED_LIGHTING
+#pragma feature DEPTH_ONLY
+#pragma feature OVERDRAW
+
+#ifdef SHADER_VARIANT
+#ifdef CLUSTERED_LIGHTING
+const int lightingEnabled = 1;
+#else
+const int lightingEnabled = 0;
+#endif
+#ifdef BAKED_LIGHTING
+const int bakedEnabled = 1;
+#else
+const int bakedEnabled = 0;
+#endif
+#else
+uniform int lightingEnabled;
+uniform int bakedEnabled;
+#endif
+
+uniform samplerBuffer lightData;        // per light: view space position + radius, color * intensity
+uniform usamplerBuffer clusterGrid;     // per cluster: offset, count into clusterLights
+uniform usamplerBuffer clusterLights;   // packed light indices
+uniform vec2 clusterScreenScale;
+uniform float clusterSliceScale;
+uniform float clusterSliceBias;
+uniform vec3 ambientLight;
+
+// what the pass writes, see overdraw.h: 0 the shaded color, 1 nothing (depth pre-pass,
+// color writes are masked), 2 one overdraw step for additive counting
+#if !defined(SHADER_VARIANT)
+uniform int fragmentOutput;
+#elif defined(DEPTH_ONLY)
+const int fragmentOutput = 1;
+#elif defined(OVERDRAW)
+const int fragmentOutput = 2;
+#else
+const int fragmentOutput = 0;
+#endif
+const float OVERDRAW_STEP = 1.0f / 255.0f;     // red: exact count in an 8-bit channel
+const float OVERDRAW_SHADE = 1.0f / 8.0f;      // green: visible, saturates at 8 layers
 
 out vec4 FragColor;
 
 void main()
 {
-    FragColor = color;
+    if (fragmentOutput != 0)
+    {
+        FragColor = fragmentOutput == 2 ? vec4(OVERDRAW_STEP, OVERDRAW_SHADE, 0.0f, 1.0f) : vec4(0.0f);
+        return;
+    }
+
+    vec4 albedo = materialColor[materialIndex];
+    if (lightingEnabled == 0)
+    {
+        FragColor = bakedEnabled != 0 ? vec4(albedo.rgb * bakedColor, albedo.a) : albedo;
+        return;
+    }
+
+    // the cubes are flat shaded, so the face normal comes from the screen space derivatives
+    vec3 normal = normalize(cross(dFdx(viewPosition), dFdy(viewPosition)));
+    if (dot(normal, viewPosition) > 0.0f)
+        normal = -normal;
+
+    ivec2 tile = min(ivec2(gl_FragCoord.xy * clusterScreenScale), ivec2(CLUSTER_X - 1, CLUSTER_Y - 1));
+    int slice = clamp(int(log(-viewPosition.z) * clusterSliceScale + clusterSliceBias), 0, CLUSTER_Z - 1);
+    uvec2 range = texelFetch(clusterGrid, tile.x + CLUSTER_X * (tile.y + CLUSTER_Y * slice)).xy;
+
+    vec3 light = ambientLight;
+    for (uint i = 0u; i < range.y; i++)
+    {
+        int index = int(texelFetch(clusterLights, int(range.x + i)).x);
+        vec4 positionRadius = texelFetch(lightData, index * 2);
+        vec3 color = texelFetch(lightData, index * 2 + 1).xyz;
+
+        vec3 toLight = positionRadius.xyz - viewPosition;
+        float distanceSquared = dot(toLight, toLight);
+        float falloff = clamp(1.0f - distanceSquared / (positionRadius.w * positionRadius.w), 0.0f, 1.0f);
+        light += color * falloff * falloff * max(dot(normal, toLight * inversesqrt(distanceSquared)), 0.0f);
+    }
+    FragColor = vec4(albedo.rgb * light, albedo.a);
 }
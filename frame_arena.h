@@ -0,0 +1,244 @@
+//
+//  frame_arena.h
+//  3D Object Drawing
+//
+
+#ifndef FRAME_ARENA_H
+#define FRAME_ARENA_H
+
+#include <vector>
+#include <memory>
+#include <cstddef>
+#include <cstdio>
+#include <algorithm>
+#include <new>
+
+struct ArenaStats
+{
+    size_t used = 0;            // bytes handed out since the last reset
+    size_t capacity = 0;        // bytes in all blocks
+    size_t highWater = 0;       // most bytes used in one frame
+    size_t overflows = 0;       // blocks chained because the first one was full
+    size_t frames = 0;
+};
+
+// Bump allocator for data that lives for one frame. Allocation moves a pointer; nothing is
+// freed until reset() at the end of the frame releases everything at once. When a block
+// runs out another one, at least twice as big, is chained on; the next reset replaces the
+// chain with one block that holds the whole frame, so after a few frames the arena stops
+// touching the heap. Not thread safe: every thread allocates from its own arena.
+class FrameArena
+{
+public:
+    explicit FrameArena(size_t initialBytes = 64 * 1024)
+    {
+        addBlock(initialBytes);
+    }
+
+    ~FrameArena()
+    {
+        for (size_t i = 0; i < blocks.size(); i++)
+            ::operator delete(blocks[i].memory);
+    }
+
+    void* allocate(size_t bytes, size_t alignment = alignof(std::max_align_t))
+    {
+        Block* block = &blocks.back();
+        size_t offset = alignUp(block->memory, block->used, alignment);
+        if (offset + bytes > block->size)
+        {
+            stats.overflows++;
+            addBlock(std::max(block->size * 2, bytes + alignment));
+            block = &blocks.back();
+            offset = alignUp(block->memory, 0, alignment);
+        }
+        block->used = offset + bytes;
+        stats.used += bytes;
+        return block->memory + offset;
+    }
+
+    // frees everything allocated since the last reset; call once nothing uses it any more
+    void reset()
+    {
+        if (stats.used > stats.highWater)
+            stats.highWater = stats.used;
+        if (blocks.size() > 1)
+        {
+            size_t total = stats.capacity;
+            for (size_t i = 0; i < blocks.size(); i++)
+                ::operator delete(blocks[i].memory);
+            blocks.clear();
+            stats.capacity = 0;
+            addBlock(total);
+        }
+        blocks.back().used = 0;
+        stats.used = 0;
+        stats.frames++;
+    }
+
+    const ArenaStats& statistics() const
+    {
+        return stats;
+    }
+
+private:
+    struct Block
+    {
+        unsigned char* memory;
+        size_t size;
+        size_t used;
+    };
+
+    std::vector<Block> blocks;
+    ArenaStats stats;
+
+    FrameArena(const FrameArena&);
+    FrameArena& operator=(const FrameArena&);
+
+    void addBlock(size_t bytes)
+    {
+        Block block = { (unsigned char*)::operator new(bytes), bytes, 0 };
+        blocks.push_back(block);
+        stats.capacity += bytes;
+    }
+
+    static size_t alignUp(const unsigned char* base, size_t offset, size_t alignment)
+    {
+        size_t address = (size_t)(base + offset);
+        return offset + ((alignment - address % alignment) % alignment);
+    }
+};
+
+// Standard allocator on top of a FrameArena, for containers that only live within a frame.
+// deallocate does nothing, so a growing vector leaves its old buffers behind until the
+// reset; reserve up front when the size is known.
+template<class T>
+class ArenaAllocator
+{
+public:
+    typedef T value_type;
+
+    explicit ArenaAllocator(FrameArena& frameArena) : arena(&frameArena)
+    {
+    }
+
+    template<class U>
+    ArenaAllocator(const ArenaAllocator<U>& other) : arena(other.arena)
+    {
+    }
+
+    T* allocate(size_t count)
+    {
+        return (T*)arena->allocate(count * sizeof(T), alignof(T));
+    }
+
+    void deallocate(T*, size_t)
+    {
+    }
+
+    FrameArena* arena;
+};
+
+template<class T, class U>
+bool operator==(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b)
+{
+    return a.arena == b.arena;
+}
+
+template<class T, class U>
+bool operator!=(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b)
+{
+    return a.arena != b.arena;
+}
+
+template<class T>
+using FrameVector = std::vector<T, ArenaAllocator<T> >;
+
+// One arena per job system worker (worker 0 is the thread that runs the frame loop), all
+// reset together at the end of the frame.
+class FrameArenas
+{
+public:
+    explicit FrameArenas(int threads, size_t initialBytes = 64 * 1024)
+    {
+        for (int i = 0; i < (threads > 0 ? threads : 1); i++)
+            arenas.push_back(std::unique_ptr<FrameArena>(new FrameArena(initialBytes)));
+    }
+
+    FrameArena& operator[](int worker)
+    {
+        return *arenas[worker];
+    }
+
+    int count() const
+    {
+        return (int)arenas.size();
+    }
+
+    void reset()
+    {
+        for (size_t i = 0; i < arenas.size(); i++)
+            arenas[i]->reset();
+    }
+
+    // summed over the workers; the high water mark is the sum of each arena's own
+    ArenaStats statistics() const
+    {
+        ArenaStats total;
+        for (size_t i = 0; i < arenas.size(); i++)
+        {
+            const ArenaStats& stats = arenas[i]->statistics();
+            total.used += stats.used;
+            total.capacity += stats.capacity;
+            total.highWater += stats.highWater;
+            total.overflows += stats.overflows;
+            total.frames = stats.frames;
+        }
+        return total;
+    }
+
+private:
+    std::vector<std::unique_ptr<FrameArena> > arenas;
+};
+
+// per-frame heap allocation counts for --count-allocs; the first frames warm up the arenas
+// and the persistent buffers and are not checked
+struct AllocationCheck
+{
+    size_t warmupFrames = 30;
+    size_t frames = 0;
+    size_t checkedFrames = 0;
+    size_t allocatingFrames = 0;
+    size_t allocations = 0;
+    size_t worst = 0;
+
+    void record(size_t frameAllocations)
+    {
+        frames++;
+        if (frames <= warmupFrames)
+            return;
+        checkedFrames++;
+        if (frameAllocations == 0)
+            return;
+        if (allocatingFrames == 0)
+            std::printf("WARNING::FRAME_LOOP::HEAP_ALLOCATION: frame %zu made %zu heap allocations\n", frames, frameAllocations);
+        allocatingFrames++;
+        allocations += frameAllocations;
+        worst = std::max(worst, frameAllocations);
+    }
+};
+
+inline void printAllocationCheck(const AllocationCheck& check)
+{
+    std::printf("heap allocations after %zu warm-up frames: %zu in %zu of %zu frames (at most %zu in one frame)\n",
+        check.warmupFrames, check.allocations, check.allocatingFrames, check.checkedFrames, check.worst);
+}
+
+inline void printArenaStats(const FrameArenas& arenas)
+{
+    ArenaStats stats = arenas.statistics();
+    std::printf("frame arenas: %d, %.1f KB reserved, high water %.1f KB, %zu overflow blocks in %zu frames\n",
+        arenas.count(), stats.capacity / 1024.0, stats.highWater / 1024.0, stats.overflows, stats.frames);
+}
+
+#endif
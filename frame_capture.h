@@ -0,0 +1,673 @@
+//
+//  frame_capture.h
+//  3D Object Drawing
+//
+
+#ifndef FRAME_CAPTURE_H
+#define FRAME_CAPTURE_H
+
+#include <glad/glad.h>
+
+#include "gpu_memory.h"
+
+#include <vector>
+#include <deque>
+#include <string>
+#include <fstream>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstdio>
+#include <algorithm>
+#include <iostream>
+
+// frames between reading a frame into a pixel buffer and mapping it; the ring holds one more
+const int CAPTURE_LAG = 2;
+const int CAPTURE_RING = CAPTURE_LAG + 1;
+// frames waiting for the encoder before the render thread has to wait for it
+const size_t MAX_QUEUED_FRAMES = 8;
+
+enum CaptureMode
+{
+    CAPTURE_OFF,
+    CAPTURE_SYNC,       // glReadPixels into client memory: stalls until the GPU has finished the frame
+    CAPTURE_ASYNC       // glReadPixels into a pixel buffer object, mapped CAPTURE_LAG frames later
+};
+
+const char* const CAPTURE_MODE_NAMES[] = { "off", "glReadPixels", "PBO ring" };
+
+struct CaptureStats
+{
+    size_t frames = 0;
+    size_t encoded = 0;
+    double readMs = 0.0;        // render thread: issuing the read
+    double collectMs = 0.0;     // render thread: waiting for, mapping and copying an older frame
+    double queueWaitMs = 0.0;   // render thread: waiting for room in the encoder queue
+    double encodeMs = 0.0;      // encoder thread
+};
+
+// RGBA8 rows bottom to top, as glReadPixels returns them
+struct CapturedFrame
+{
+    int width = 0;
+    int height = 0;
+    std::vector<unsigned char> pixels;
+};
+
+// Writes frames on its own thread, either as a numbered PNG sequence (PREFIX00000.png ...)
+// or as one raw YUV4MPEG2 stream (4:2:0, BT.601) that ffmpeg and most players read.
+// A stream has one frame size, so when the window is resized the stream is ended and the
+// frames go on in a new one, OUT.1.y4m, OUT.2.y4m and so on.
+// The PNGs use stored deflate blocks: large files, but no compression library and no
+// encoder time that could fall behind the renderer.
+class FrameEncoder
+{
+public:
+    FrameEncoder() : y4m(false), fps(60.0), nextIndex(0), streamWidth(0), streamHeight(0), streamCount(0), running(false), encodeMs(0.0), encoded(0)
+    {
+    }
+
+    ~FrameEncoder()
+    {
+        close();
+    }
+
+    bool open(const std::string& target, double framesPerSecond)
+    {
+        path = target;
+        fps = framesPerSecond > 0.0 ? framesPerSecond : 60.0;
+        nextIndex = 0;
+        streamCount = 0;
+        y4m = path.size() > 4 && path.compare(path.size() - 4, 4, ".y4m") == 0;
+        if (y4m)
+        {
+            stream.open(path.c_str(), std::ios::binary);
+            if (!stream)
+            {
+                std::cout << "ERROR::CAPTURE::FILE_NOT_WRITABLE: " << path << std::endl;
+                return false;
+            }
+        }
+        running = true;
+        worker = std::thread(&FrameEncoder::encodeLoop, this);
+        return true;
+    }
+
+    // a recycled buffer for the next frame
+    CapturedFrame take()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (pool.empty())
+            return CapturedFrame();
+        CapturedFrame frame;
+        frame.pixels.swap(pool.back().pixels);
+        pool.pop_back();
+        return frame;
+    }
+
+    // hands a frame to the encoder; returns the milliseconds spent waiting for queue room
+    double submit(CapturedFrame& frame)
+    {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        std::unique_lock<std::mutex> lock(mutex);
+        room.wait(lock, [this] { return queue.size() < MAX_QUEUED_FRAMES; });
+        queue.push_back(CapturedFrame());
+        queue.back().width = frame.width;
+        queue.back().height = frame.height;
+        queue.back().pixels.swap(frame.pixels);
+        lock.unlock();
+        ready.notify_one();
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // encodes what is queued and stops the thread
+    void close()
+    {
+        if (!running)
+            return;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            running = false;
+        }
+        ready.notify_one();
+        worker.join();
+        stream.close();
+    }
+
+    double encodeMilliseconds() const
+    {
+        return encodeMs;
+    }
+
+    size_t encodedFrames() const
+    {
+        return encoded;
+    }
+
+private:
+    std::string path;
+    bool y4m;
+    double fps;
+    std::ofstream stream;
+    size_t nextIndex;
+    int streamWidth, streamHeight;  // of the y4m stream being written
+    int streamCount;                // streams started after the first
+
+    std::thread worker;
+    std::mutex mutex;
+    std::condition_variable ready;
+    std::condition_variable room;
+    std::deque<CapturedFrame> queue;
+    std::vector<CapturedFrame> pool;
+    bool running;
+
+    // written by the encoder thread, read after close()
+    double encodeMs;
+    size_t encoded;
+
+    std::vector<unsigned char> rgb;
+    std::vector<unsigned char> planes;
+    std::vector<unsigned char> png;
+
+    void encodeLoop()
+    {
+        for (;;)
+        {
+            CapturedFrame frame;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                ready.wait(lock, [this] { return !running || !queue.empty(); });
+                if (queue.empty())
+                    return;
+                frame.width = queue.front().width;
+                frame.height = queue.front().height;
+                frame.pixels.swap(queue.front().pixels);
+                queue.pop_front();
+            }
+            room.notify_one();
+
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            if (y4m)
+                writeY4M(frame);
+            else
+                writePNG(frame);
+            encodeMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            encoded++;
+
+            std::lock_guard<std::mutex> lock(mutex);
+            pool.push_back(CapturedFrame());
+            pool.back().pixels.swap(frame.pixels);
+        }
+    }
+
+    void writeY4M(const CapturedFrame& frame)
+    {
+        int width = frame.width & ~1;
+        int height = frame.height & ~1;
+        if (width == 0 || height == 0)
+            return;
+        if (nextIndex > 0 && (width != streamWidth || height != streamHeight))
+            nextStream(width, height);
+        if (nextIndex == 0)
+        {
+            streamWidth = width;
+            streamHeight = height;
+            char header[128];
+            std::snprintf(header, sizeof(header), "YUV4MPEG2 W%d H%d F%d:1000 Ip A1:1 C420jpeg\n", width, height, (int)(fps * 1000.0 + 0.5));
+            stream << header;
+        }
+        nextIndex++;
+
+        // full range BT.601, chroma averaged over 2x2 blocks; rows flipped to top first
+        size_t lumaSize = (size_t)width * height;
+        planes.resize(lumaSize + lumaSize / 2);
+        unsigned char* luma = &planes[0];
+        unsigned char* cb = luma + lumaSize;
+        unsigned char* cr = cb + lumaSize / 4;
+        for (int y = 0; y < height; y += 2)
+        {
+            for (int x = 0; x < width; x += 2)
+            {
+                int sumR = 0, sumG = 0, sumB = 0;
+                for (int dy = 0; dy < 2; dy++)
+                {
+                    const unsigned char* row = &frame.pixels[((size_t)(frame.height - 1 - (y + dy)) * frame.width) * 4];
+                    for (int dx = 0; dx < 2; dx++)
+                    {
+                        const unsigned char* p = row + (x + dx) * 4;
+                        luma[(size_t)(y + dy) * width + x + dx] = (unsigned char)((77 * p[0] + 150 * p[1] + 29 * p[2] + 128) >> 8);
+                        sumR += p[0];
+                        sumG += p[1];
+                        sumB += p[2];
+                    }
+                }
+                size_t chroma = (size_t)(y / 2) * (width / 2) + x / 2;
+                cb[chroma] = (unsigned char)std::min(255, std::max(0, ((-43 * sumR - 85 * sumG + 128 * sumB) / 4 + 32768 + 128) >> 8));
+                cr[chroma] = (unsigned char)std::min(255, std::max(0, ((128 * sumR - 107 * sumG - 21 * sumB) / 4 + 32768 + 128) >> 8));
+            }
+        }
+        stream.write("FRAME\n", 6);
+        stream.write((const char*)&planes[0], planes.size());
+    }
+
+    // ends the stream after a resize and opens OUT.N.y4m for the frames of the new size;
+    // if that fails the frames are dropped until the next resize
+    void nextStream(int width, int height)
+    {
+        std::string previous = streamCount == 0 ? path : streamPath(streamCount);
+        std::string next = streamPath(++streamCount);
+        std::cout << "WARNING::CAPTURE::RESIZED: " << streamWidth << "x" << streamHeight << " to " << width << "x" << height
+                  << "; " << previous << " ends after " << nextIndex << " frames, continuing in " << next << std::endl;
+        stream.close();
+        stream.open(next.c_str(), std::ios::binary);
+        if (!stream)
+            std::cout << "ERROR::CAPTURE::FILE_NOT_WRITABLE: " << next << std::endl;
+        nextIndex = 0;
+    }
+
+    std::string streamPath(int number) const
+    {
+        return path.substr(0, path.size() - 4) + "." + std::to_string(number) + ".y4m";
+    }
+
+    void writePNG(const CapturedFrame& frame)
+    {
+        char name[32];
+        std::snprintf(name, sizeof(name), "%05u.png", (unsigned int)nextIndex++);
+        std::string file = path + name;
+        std::ofstream out(file.c_str(), std::ios::binary);
+        if (!out)
+        {
+            std::cout << "ERROR::CAPTURE::FILE_NOT_WRITABLE: " << file << std::endl;
+            return;
+        }
+
+        // filter byte 0 and RGB per row, top row first
+        size_t rowBytes = (size_t)frame.width * 3 + 1;
+        rgb.resize(rowBytes * frame.height);
+        for (int y = 0; y < frame.height; y++)
+        {
+            unsigned char* row = &rgb[rowBytes * y];
+            const unsigned char* source = &frame.pixels[(size_t)(frame.height - 1 - y) * frame.width * 4];
+            row[0] = 0;
+            for (int x = 0; x < frame.width; x++)
+            {
+                row[1 + x * 3] = source[x * 4];
+                row[2 + x * 3] = source[x * 4 + 1];
+                row[3 + x * 3] = source[x * 4 + 2];
+            }
+        }
+
+        // zlib stream of stored blocks
+        png.clear();
+        png.push_back(0x78);
+        png.push_back(0x01);
+        for (size_t offset = 0; offset < rgb.size() || offset == 0; offset += 65535)
+        {
+            size_t length = std::min((size_t)65535, rgb.size() - offset);
+            png.push_back(offset + length == rgb.size() ? 1 : 0);
+            png.push_back((unsigned char)(length & 0xFF));
+            png.push_back((unsigned char)(length >> 8));
+            png.push_back((unsigned char)(~length & 0xFF));
+            png.push_back((unsigned char)((~length >> 8) & 0xFF));
+            png.insert(png.end(), rgb.begin() + offset, rgb.begin() + offset + length);
+            if (length == 0)
+                break;
+        }
+        putBigEndian(png, adler32(&rgb[0], rgb.size()));
+
+        static const unsigned char signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+        out.write((const char*)signature, 8);
+        std::vector<unsigned char> header;
+        putBigEndian(header, (unsigned int)frame.width);
+        putBigEndian(header, (unsigned int)frame.height);
+        const unsigned char format[5] = { 8, 2, 0, 0, 0 };     // 8 bit RGB, deflate, no interlace
+        header.insert(header.end(), format, format + 5);
+        writeChunk(out, "IHDR", header);
+        writeChunk(out, "IDAT", png);
+        writeChunk(out, "IEND", std::vector<unsigned char>());
+    }
+
+    static void putBigEndian(std::vector<unsigned char>& out, unsigned int value)
+    {
+        out.push_back((unsigned char)(value >> 24));
+        out.push_back((unsigned char)(value >> 16));
+        out.push_back((unsigned char)(value >> 8));
+        out.push_back((unsigned char)value);
+    }
+
+    static unsigned int adler32(const unsigned char* data, size_t size)
+    {
+        unsigned int a = 1, b = 0;
+        for (size_t i = 0; i < size; i++)
+        {
+            a = (a + data[i]) % 65521;
+            b = (b + a) % 65521;
+        }
+        return (b << 16) | a;
+    }
+
+    static unsigned int crc32(unsigned int crc, const unsigned char* data, size_t size)
+    {
+        static unsigned int table[256];
+        static bool built = false;
+        if (!built)
+        {
+            for (unsigned int n = 0; n < 256; n++)
+            {
+                unsigned int c = n;
+                for (int k = 0; k < 8; k++)
+                    c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+                table[n] = c;
+            }
+            built = true;
+        }
+        crc = ~crc;
+        for (size_t i = 0; i < size; i++)
+            crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+        return ~crc;
+    }
+
+    static void writeChunk(std::ofstream& out, const char* type, const std::vector<unsigned char>& data)
+    {
+        std::vector<unsigned char> length;
+        putBigEndian(length, (unsigned int)data.size());
+        out.write((const char*)&length[0], 4);
+        out.write(type, 4);
+        if (!data.empty())
+            out.write((const char*)&data[0], data.size());
+        unsigned int crc = crc32(0, (const unsigned char*)type, 4);
+        if (!data.empty())
+            crc = crc32(crc, &data[0], data.size());
+        std::vector<unsigned char> tail;
+        putBigEndian(tail, crc);
+        out.write((const char*)&tail[0], 4);
+    }
+};
+
+inline void printCaptureStats(const CaptureStats& stats)
+{
+    double frames = stats.frames > 0 ? (double)stats.frames : 1.0;
+    std::printf("captured %zu frames (%zu encoded); per frame: read %.3f ms, collect %.3f ms, encoder queue wait %.3f ms, encode %.3f ms (background)\n",
+        stats.frames, stats.encoded, stats.readMs / frames, stats.collectMs / frames, stats.queueWaitMs / frames,
+        stats.encoded > 0 ? stats.encodeMs / stats.encoded : 0.0);
+}
+
+// command line switches of frame capture
+struct CaptureOptions
+{
+    std::string target;             // --capture PREFIX|FILE.y4m  record every frame as PNGs or a Y4M video
+    bool benchmark = false;         // --bench-capture frame time without capture, with glReadPixels and with the PBO ring
+
+    // false if arg is not one of the switches above
+    bool parseArgs(const std::string& arg, int argc, char** argv, int& i)
+    {
+        if (arg == "--capture" && i + 1 < argc)
+            target = argv[++i];
+        else if (arg == "--bench-capture")
+            benchmark = true;
+        else
+            return false;
+        return true;
+    }
+
+    static void printUsage()
+    {
+        std::cout << "  --capture OUT    capture every frame to OUT00000.png ... or to OUT if it ends in .y4m\n"
+                  << "  --bench-capture  benchmark the cost of frame capture and exit\n";
+    }
+};
+
+// Reads the back buffer of every frame for the encoder. In the asynchronous mode the read
+// goes into one of CAPTURE_RING pixel buffer objects and returns at once; the buffer is
+// mapped CAPTURE_LAG frames later, when the GPU has long finished with it, and its
+// pixels are copied out for the encoder thread. Call before glfwSwapBuffers. Needs the GL
+// device; the pixel pack binding is left at 0. The ring is counted as staging memory.
+class FrameCapture
+{
+public:
+    CaptureStats stats;
+
+    explicit FrameCapture(GpuMemoryTracker& memoryTracker) : memory(memoryTracker), width(0), height(0), head(0), pending(0), active(false)
+    {
+        for (int i = 0; i < CAPTURE_RING; i++)
+        {
+            buffers[i] = 0;
+            fences[i] = NULL;
+        }
+    }
+
+    bool open(const std::string& target, double fps)
+    {
+        return encoder.open(target, fps);
+    }
+
+    // opens the file of --capture, or of --bench-capture if there is none; glDevice: the
+    // frames are drawn by the GL device, so there is a back buffer to read
+    bool init(const CaptureOptions& options, bool glDevice, double fps)
+    {
+        std::string target = options.target;
+        if (options.benchmark && target.empty())
+            target = "capture_bench.y4m";
+        if (target.empty())
+            return true;
+        if (!glDevice)
+        {
+            std::cout << "ERROR::CAPTURE::NEEDS_GL: frame capture reads the OpenGL framebuffer, use --device gl" << std::endl;
+            return false;
+        }
+        active = open(target, fps);
+        return active;
+    }
+
+    // a file was opened by init
+    bool capturing() const
+    {
+        return active;
+    }
+
+    void captureFrame(CaptureMode mode, int frameWidth, int frameHeight)
+    {
+        if (mode == CAPTURE_OFF || frameWidth <= 0 || frameHeight <= 0)
+            return;
+        stats.frames++;
+
+        if (mode == CAPTURE_SYNC)
+        {
+            flush();
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            CapturedFrame frame = encoder.take();
+            frame.width = frameWidth;
+            frame.height = frameHeight;
+            frame.pixels.resize((size_t)frameWidth * frameHeight * 4);
+            glReadPixels(0, 0, frameWidth, frameHeight, GL_RGBA, GL_UNSIGNED_BYTE, &frame.pixels[0]);
+            stats.readMs += elapsed(start);
+            stats.queueWaitMs += encoder.submit(frame);
+            return;
+        }
+
+        if (frameWidth != width || frameHeight != height)
+            resize(frameWidth, frameHeight);
+
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, buffers[head]);
+        glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, (void*)0);
+        fences[head] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        head = (head + 1) % CAPTURE_RING;
+        pending++;
+        stats.readMs += elapsed(start);
+
+        if (pending > CAPTURE_LAG)
+            collect();
+    }
+
+    // maps the frames still in flight and waits for the encoder to write everything
+    void close()
+    {
+        flush();
+        release();
+        encoder.close();
+        stats.encoded = encoder.encodedFrames();
+        stats.encodeMs = encoder.encodeMilliseconds();
+    }
+
+    // at exit: closes the file opened by init and prints what it cost
+    void shutdown()
+    {
+        if (!active)
+            return;
+        close();
+        printCaptureStats(stats);
+        active = false;
+    }
+
+private:
+    FrameEncoder encoder;
+    GpuMemoryTracker& memory;
+    GLuint buffers[CAPTURE_RING];
+    GLsync fences[CAPTURE_RING];
+    int width, height;
+    int head;       // next buffer to read into
+    int pending;    // frames read but not yet collected
+    bool active;    // init opened a file
+
+    static double elapsed(std::chrono::steady_clock::time_point start)
+    {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    void resize(int frameWidth, int frameHeight)
+    {
+        flush();
+        release();
+        width = frameWidth;
+        height = frameHeight;
+        glGenBuffers(CAPTURE_RING, buffers);
+        for (int i = 0; i < CAPTURE_RING; i++)
+        {
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, buffers[i]);
+            glBufferData(GL_PIXEL_PACK_BUFFER, (size_t)width * height * 4, NULL, GL_STREAM_READ);
+            memory.allocate(GPU_BUFFER, buffers[i], MEMORY_STAGING, (size_t)width * height * 4);
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        head = 0;
+    }
+
+    // the oldest frame in flight goes to the encoder
+    void collect()
+    {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        int slot = (head + CAPTURE_RING - pending) % CAPTURE_RING;
+        glClientWaitSync(fences[slot], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000ull);
+        glDeleteSync(fences[slot]);
+        fences[slot] = NULL;
+
+        CapturedFrame frame = encoder.take();
+        frame.width = width;
+        frame.height = height;
+        frame.pixels.resize((size_t)width * height * 4);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, buffers[slot]);
+        const void* mapped = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, frame.pixels.size(), GL_MAP_READ_BIT);
+        if (mapped != NULL)
+        {
+            std::copy((const unsigned char*)mapped, (const unsigned char*)mapped + frame.pixels.size(), frame.pixels.begin());
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        pending--;
+        stats.collectMs += elapsed(start);
+
+        if (mapped == NULL)
+        {
+            std::cout << "ERROR::CAPTURE::MAP_FAILED: frame dropped" << std::endl;
+            return;
+        }
+        stats.queueWaitMs += encoder.submit(frame);
+    }
+
+    void flush()
+    {
+        while (pending > 0)
+            collect();
+    }
+
+    void release()
+    {
+        if (buffers[0] != 0)
+            glDeleteBuffers(CAPTURE_RING, buffers);
+        for (int i = 0; i < CAPTURE_RING; i++)
+        {
+            memory.release(GPU_BUFFER, buffers[i]);
+            buffers[i] = 0;
+            if (fences[i] != NULL)
+                glDeleteSync(fences[i]);
+            fences[i] = NULL;
+        }
+        width = height = 0;
+    }
+};
+
+// Renders 120 frames each without capture, with a synchronous glReadPixels and with the
+// PBO ring, and prints the average frame time of each and the difference to no capture.
+class CaptureBenchmark
+{
+public:
+    CaptureBenchmark(int warmupFrames = 30, int measuredFrames = 120)
+        : warmup(warmupFrames), measured(measuredFrames), step(0), frameInStep(0)
+    {
+        for (int i = 0; i < 3; i++)
+        {
+            frameMs[i] = 0.0;
+            renderThreadMs[i] = 0.0;
+        }
+    }
+
+    bool done() const
+    {
+        return step >= 3;
+    }
+
+    CaptureMode mode() const
+    {
+        return done() ? CAPTURE_OFF : (CaptureMode)step;
+    }
+
+    // frame time of the previous frame and the capture statistics so far
+    void record(double ms, const CaptureStats& stats)
+    {
+        if (done())
+            return;
+        frameInStep++;
+        double captureMs = stats.readMs + stats.collectMs + stats.queueWaitMs;
+        if (frameInStep == warmup)
+            captureStart = captureMs;
+        if (frameInStep > warmup)
+            frameMs[step] += ms / measured;
+        if (frameInStep == warmup + measured)
+        {
+            renderThreadMs[step] = (captureMs - captureStart) / measured;
+            step++;
+            frameInStep = 0;
+        }
+    }
+
+    void print() const
+    {
+        std::printf("capture        frame ms  capture ms (render thread)  overhead ms\n");
+        for (int i = 0; i < 3; i++)
+            std::printf("%-13s  %8.3f  %26.3f  %11.3f\n", CAPTURE_MODE_NAMES[i], frameMs[i], renderThreadMs[i], frameMs[i] - frameMs[0]);
+    }
+
+private:
+    int warmup;
+    int measured;
+    int step;
+    int frameInStep;
+    double captureStart = 0.0;
+    double frameMs[3];
+    double renderThreadMs[3];
+};
+
+#endif
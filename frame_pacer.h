@@ -0,0 +1,305 @@
+//
+//  frame_pacer.h
+//  3D Object Drawing
+//
+
+#ifndef FRAME_PACER_H
+#define FRAME_PACER_H
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+#include <vector>
+#include <string>
+#include <chrono>
+#include <thread>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+#include <iostream>
+
+enum VsyncMode
+{
+    VSYNC_DRIVER,       // leave the swap interval to the driver
+    VSYNC_OFF,
+    VSYNC_ON,
+    VSYNC_ADAPTIVE      // sync when on time, tear when late (swap_control_tear)
+};
+
+// how the moment a frame reached the screen is estimated
+enum LatencyMeasure
+{
+    LATENCY_OFF,
+    LATENCY_FINISH,     // glFinish after the swap: exact, but the CPU waits for the GPU every frame
+    LATENCY_FENCE       // fence after the swap, waited on by the next frame: keeps one frame in flight
+};
+
+struct PacingSettings
+{
+    VsyncMode vsync = VSYNC_DRIVER;
+    double fpsCap = 0.0;            // 0 = uncapped
+    bool lateInput = false;         // read input after the CPU work, just before the camera is used
+    LatencyMeasure latency = LATENCY_OFF;
+
+    // --vsync off|on|adaptive, --fps-cap N, --late-input, --latency finish|fence; false if
+    // arg is none of them
+    bool parseArgs(const std::string& arg, int argc, char** argv, int& i)
+    {
+        std::string value = i + 1 < argc ? argv[i + 1] : "";
+        if (arg == "--vsync" && (value == "off" || value == "on" || value == "adaptive"))
+        {
+            vsync = value == "off" ? VSYNC_OFF : (value == "on" ? VSYNC_ON : VSYNC_ADAPTIVE);
+            i++;
+        }
+        else if (arg == "--fps-cap" && i + 1 < argc)
+            fpsCap = std::atof(argv[++i]);
+        else if (arg == "--late-input")
+            lateInput = true;
+        else if (arg == "--latency" && (value == "finish" || value == "fence"))
+        {
+            latency = value == "finish" ? LATENCY_FINISH : LATENCY_FENCE;
+            i++;
+        }
+        else
+            return false;
+        return true;
+    }
+
+    static void printUsage()
+    {
+        std::cout << "  --vsync MODE     off, on or adaptive (default: driver setting)\n"
+                  << "  --fps-cap N      limit the frame rate to N frames per second\n"
+                  << "  --late-input     read input after the scene traversal, just before rendering\n"
+                  << "  --latency MODE   measure input-to-present latency with glFinish (finish) or fences (fence)\n";
+    }
+};
+
+// percentiles of the last MAX_PACING_SAMPLES frames, in milliseconds
+struct PacingReport
+{
+    size_t frames = 0;
+    double latency[4] = {};         // p50, p90, p99, max input-to-present
+    double interval[4] = {};        // p50, p90, p99, max time between frame starts
+};
+
+const size_t MAX_PACING_SAMPLES = 4096;
+
+inline void printPacingReport(const PacingReport& report)
+{
+    std::printf("frame interval ms  p50 %.2f  p90 %.2f  p99 %.2f  max %.2f\n",
+        report.interval[0], report.interval[1], report.interval[2], report.interval[3]);
+    if (report.frames > 0)
+        std::printf("input to present ms (%zu frames)  p50 %.2f  p90 %.2f  p99 %.2f  max %.2f\n",
+            report.frames, report.latency[0], report.latency[1], report.latency[2], report.latency[3]);
+}
+
+// Controls when a frame starts and measures how old its input is once it is on screen.
+// The frame cap sleeps in 1 ms steps while the time left is longer than the worst sleep
+// overshoot seen so far, then spins to the deadline, so it holds the rate even where the
+// OS sleeps in coarse steps. With late input the wait and the input read come after the
+// scene traversal, right before the view matrix is built, so the camera sees input that
+// is a whole traversal younger.
+class FramePacer
+{
+public:
+    explicit FramePacer(const PacingSettings& pacingSettings)
+        : settings(pacingSettings), sleepMean(1.0), sleepSquares(0.0), sleepSamples(0), fence(NULL), fenceInputTime(0.0),
+          inputTime(0.0), lastFrameStart(0.0), latencyIndex(0), intervalIndex(0)
+    {
+        start = std::chrono::steady_clock::now();
+        period = settings.fpsCap > 0.0 ? 1000.0 / settings.fpsCap : 0.0;
+        nextFrame = 0.0;
+        // the sample rings are allocated up front so that recording never allocates mid-frame
+        latencies.reserve(MAX_PACING_SAMPLES);
+        intervals.reserve(MAX_PACING_SAMPLES);
+    }
+
+    // needs the current context; benchmarks pass false to run unsynchronised
+    void applyVsync()
+    {
+        switch (settings.vsync)
+        {
+        case VSYNC_DRIVER:
+            break;
+        case VSYNC_OFF:
+            glfwSwapInterval(0);
+            break;
+        case VSYNC_ON:
+            glfwSwapInterval(1);
+            break;
+        case VSYNC_ADAPTIVE:
+            if (glfwExtensionSupported("WGL_EXT_swap_control_tear") || glfwExtensionSupported("GLX_EXT_swap_control_tear"))
+                glfwSwapInterval(-1);
+            else
+            {
+                std::cout << "WARNING::FRAME_PACER::NO_ADAPTIVE_VSYNC: swap_control_tear is not supported, using vsync" << std::endl;
+                glfwSwapInterval(1);
+            }
+            break;
+        }
+    }
+
+    bool lateInput() const
+    {
+        return settings.lateInput;
+    }
+
+    bool measuring() const
+    {
+        return settings.latency != LATENCY_OFF;
+    }
+
+    // latency is measured or the rate capped, so there is a report to print
+    bool reporting() const
+    {
+        return measuring() || settings.fpsCap > 0.0;
+    }
+
+    // call right before the frame's input is read
+    void waitForFrame()
+    {
+        // the previous frame must be done before its latency is known and before the next
+        // one queues up behind it
+        if (fence != NULL)
+        {
+            glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000ull);
+            glDeleteSync(fence);
+            fence = NULL;
+            addSample(latencies, latencyIndex, nowMs() - fenceInputTime);
+        }
+
+        if (period > 0.0)
+        {
+            double now = nowMs();
+            if (now < nextFrame)
+                waitUntil(nextFrame);
+            now = nowMs();
+            // one late frame moves the schedule instead of causing a burst to catch up
+            nextFrame = nextFrame + period > now ? nextFrame + period : now + period;
+        }
+
+        double frameStart = nowMs();
+        if (lastFrameStart > 0.0)
+            addSample(intervals, intervalIndex, frameStart - lastFrameStart);
+        lastFrameStart = frameStart;
+    }
+
+    // the camera now holds this frame's input
+    void inputSampled()
+    {
+        inputTime = nowMs();
+    }
+
+    // right after glfwSwapBuffers
+    void framePresented()
+    {
+        if (settings.latency == LATENCY_FINISH)
+        {
+            glFinish();
+            addSample(latencies, latencyIndex, nowMs() - inputTime);
+        }
+        else if (settings.latency == LATENCY_FENCE)
+        {
+            if (fence != NULL)
+                glDeleteSync(fence);
+            fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            fenceInputTime = inputTime;
+        }
+    }
+
+    PacingReport report() const
+    {
+        PacingReport result;
+        result.frames = latencies.size();
+        percentiles(latencies, result.latency);
+        percentiles(intervals, result.interval);
+        return result;
+    }
+
+    void release()
+    {
+        if (fence != NULL)
+            glDeleteSync(fence);
+        fence = NULL;
+    }
+
+    // at exit: the report of the whole run, if there is one
+    void shutdown()
+    {
+        if (reporting())
+            printPacingReport(report());
+        release();
+    }
+
+private:
+    PacingSettings settings;
+    std::chrono::steady_clock::time_point start;
+    double period;
+    double nextFrame;
+
+    // running mean and variance of how long a 1 ms sleep really takes
+    double sleepMean;
+    double sleepSquares;
+    size_t sleepSamples;
+
+    GLsync fence;
+    double fenceInputTime;
+    double inputTime;
+    double lastFrameStart;
+
+    std::vector<double> latencies;
+    std::vector<double> intervals;
+    size_t latencyIndex;        // the oldest sample of each full ring, overwritten next
+    size_t intervalIndex;
+
+    double nowMs() const
+    {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    void waitUntil(double deadline)
+    {
+        for (;;)
+        {
+            double before = nowMs();
+            double stddev = sleepSamples > 1 ? std::sqrt(sleepSquares / (sleepSamples - 1)) : 0.0;
+            if (deadline - before <= sleepMean + stddev)
+                break;
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            double slept = nowMs() - before;
+
+            // Welford's update
+            sleepSamples++;
+            double delta = slept - sleepMean;
+            sleepMean += delta / sleepSamples;
+            sleepSquares += delta * (slept - sleepMean);
+        }
+        while (nowMs() < deadline)
+        {
+        }
+    }
+
+    // next is the ring's own write position, so each ring keeps its last MAX_PACING_SAMPLES
+    static void addSample(std::vector<double>& samples, size_t& next, double ms)
+    {
+        if (samples.size() < MAX_PACING_SAMPLES)
+            samples.push_back(ms);
+        else
+            samples[next++ % MAX_PACING_SAMPLES] = ms;
+    }
+
+    static void percentiles(const std::vector<double>& samples, double out[4])
+    {
+        if (samples.empty())
+            return;
+        std::vector<double> sorted(samples);
+        std::sort(sorted.begin(), sorted.end());
+        const double ranks[3] = { 0.5, 0.9, 0.99 };
+        for (int i = 0; i < 3; i++)
+            out[i] = sorted[(size_t)(ranks[i] * (sorted.size() - 1) + 0.5)];
+        out[3] = sorted.back();
+    }
+};
+
+#endif
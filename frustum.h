@@ -0,0 +1,62 @@
+//
+//  frustum.h
+//  3D Object Drawing
+//
+
+#ifndef FRUSTUM_H
+#define FRUSTUM_H
+
+#include <glm/glm.hpp>
+
+#include "draw_list.h"
+
+// view frustum as six inward facing planes (xyz = normal, w = distance)
+class Frustum
+{
+public:
+    glm::vec4 planes[6];
+
+    Frustum()
+    {
+        for (int i = 0; i < 6; i++)
+            planes[i] = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+    }
+
+    // extracts the planes from a projection * view matrix (Gribb/Hartmann)
+    explicit Frustum(const glm::mat4& viewProjection)
+    {
+        glm::vec4 row0(viewProjection[0][0], viewProjection[1][0], viewProjection[2][0], viewProjection[3][0]);
+        glm::vec4 row1(viewProjection[0][1], viewProjection[1][1], viewProjection[2][1], viewProjection[3][1]);
+        glm::vec4 row2(viewProjection[0][2], viewProjection[1][2], viewProjection[2][2], viewProjection[3][2]);
+        glm::vec4 row3(viewProjection[0][3], viewProjection[1][3], viewProjection[2][3], viewProjection[3][3]);
+
+        planes[0] = row3 + row0;    // left
+        planes[1] = row3 - row0;    // right
+        planes[2] = row3 + row1;    // bottom
+        planes[3] = row3 - row1;    // top
+        planes[4] = row3 + row2;    // near
+        planes[5] = row3 - row2;    // far
+
+        for (int i = 0; i < 6; i++)
+        {
+            float length = glm::length(glm::vec3(planes[i]));
+            planes[i] = planes[i] / length;
+        }
+    }
+
+    // conservative test: false only when the box is completely outside one plane
+    bool intersects(const AABB& box) const
+    {
+        for (int i = 0; i < 6; i++)
+        {
+            glm::vec3 positive(planes[i].x >= 0.0f ? box.max.x : box.min.x,
+                               planes[i].y >= 0.0f ? box.max.y : box.min.y,
+                               planes[i].z >= 0.0f ? box.max.z : box.min.z);
+            if (glm::dot(glm::vec3(planes[i]), positive) + planes[i].w < 0.0f)
+                return false;
+        }
+        return true;
+    }
+};
+
+#endif
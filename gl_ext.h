@@ -0,0 +1,104 @@
+//
+//  gl_ext.h
+//  3D Object Drawing
+//
+
+#ifndef GL_EXT_H
+#define GL_EXT_H
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+#include <cstring>
+
+// Entry points and enums newer than the 3.3 core profile that glad was generated for. They
+// are fetched by hand so the program still starts on drivers that do not expose them.
+typedef void (APIENTRY* PFN_ViewportIndexedf)(GLuint index, GLfloat x, GLfloat y, GLfloat w, GLfloat h);
+typedef void (APIENTRY* PFN_DispatchCompute)(GLuint groupsX, GLuint groupsY, GLuint groupsZ);
+typedef void (APIENTRY* PFN_MemoryBarrier)(GLbitfield barriers);
+typedef void (APIENTRY* PFN_MultiDrawElementsIndirect)(GLenum mode, GLenum type, const void* indirect, GLsizei drawCount, GLsizei stride);
+typedef void (APIENTRY* PFN_MultiDrawElementsIndirectCount)(GLenum mode, GLenum type, const void* indirect, GLintptr countOffset, GLsizei maxDrawCount, GLsizei stride);
+
+#ifndef GL_COMPUTE_SHADER
+#define GL_COMPUTE_SHADER 0x91B9
+#endif
+#ifndef GL_SHADER_STORAGE_BUFFER
+#define GL_SHADER_STORAGE_BUFFER 0x90D2
+#endif
+#ifndef GL_DRAW_INDIRECT_BUFFER
+#define GL_DRAW_INDIRECT_BUFFER 0x8F3F
+#endif
+#ifndef GL_PARAMETER_BUFFER
+#define GL_PARAMETER_BUFFER 0x80EE
+#endif
+#ifndef GL_SHADER_STORAGE_BARRIER_BIT
+#define GL_SHADER_STORAGE_BARRIER_BIT 0x00002000
+#endif
+#ifndef GL_COMMAND_BARRIER_BIT
+#define GL_COMMAND_BARRIER_BIT 0x00000040
+#endif
+#ifndef GL_BUFFER_UPDATE_BARRIER_BIT
+#define GL_BUFFER_UPDATE_BARRIER_BIT 0x00000200
+#endif
+
+class GLExtensions
+{
+public:
+    // gl_ViewportIndex may be written from the vertex shader
+    bool shaderViewportLayerArray;
+
+    // compute shaders writing storage buffers and glMultiDrawElementsIndirect (4.3)
+    bool computeCulling;
+    // the draw count of a multi-draw can come from a buffer (4.6, GL_ARB_indirect_parameters)
+    bool indirectCount;
+
+    PFN_ViewportIndexedf viewportIndexedf;
+    PFN_DispatchCompute dispatchCompute;
+    PFN_MemoryBarrier memoryBarrier;
+    PFN_MultiDrawElementsIndirect multiDrawElementsIndirect;
+    PFN_MultiDrawElementsIndirectCount multiDrawElementsIndirectCount;
+
+    GLExtensions() : shaderViewportLayerArray(false), computeCulling(false), indirectCount(false), viewportIndexedf(NULL),
+        dispatchCompute(NULL), memoryBarrier(NULL), multiDrawElementsIndirect(NULL), multiDrawElementsIndirectCount(NULL)
+    {
+    }
+
+    // must be called after gladLoadGLLoader with the context current
+    void load()
+    {
+        viewportIndexedf = (PFN_ViewportIndexedf)glfwGetProcAddress("glViewportIndexedf");
+
+        bool viewportArray = (GLVersion.major > 4 || (GLVersion.major == 4 && GLVersion.minor >= 1)) || has("GL_ARB_viewport_array");
+        shaderViewportLayerArray = viewportArray && viewportIndexedf != NULL &&
+            (has("GL_ARB_shader_viewport_layer_array") || has("GL_AMD_vertex_shader_viewport_index"));
+
+        dispatchCompute = (PFN_DispatchCompute)glfwGetProcAddress("glDispatchCompute");
+        memoryBarrier = (PFN_MemoryBarrier)glfwGetProcAddress("glMemoryBarrier");
+        multiDrawElementsIndirect = (PFN_MultiDrawElementsIndirect)glfwGetProcAddress("glMultiDrawElementsIndirect");
+        bool version43 = GLVersion.major > 4 || (GLVersion.major == 4 && GLVersion.minor >= 3);
+        computeCulling = dispatchCompute != NULL && memoryBarrier != NULL && multiDrawElementsIndirect != NULL &&
+            (version43 || (has("GL_ARB_compute_shader") && has("GL_ARB_shader_storage_buffer_object") && has("GL_ARB_multi_draw_indirect")));
+
+        bool version46 = GLVersion.major > 4 || (GLVersion.major == 4 && GLVersion.minor >= 6);
+        if (version46)
+            multiDrawElementsIndirectCount = (PFN_MultiDrawElementsIndirectCount)glfwGetProcAddress("glMultiDrawElementsIndirectCount");
+        else if (has("GL_ARB_indirect_parameters"))
+            multiDrawElementsIndirectCount = (PFN_MultiDrawElementsIndirectCount)glfwGetProcAddress("glMultiDrawElementsIndirectCountARB");
+        indirectCount = computeCulling && multiDrawElementsIndirectCount != NULL;
+    }
+
+    static bool has(const char* name)
+    {
+        GLint count = 0;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+        for (GLint i = 0; i < count; i++)
+        {
+            const char* extension = (const char*)glGetStringi(GL_EXTENSIONS, i);
+            if (extension != NULL && std::strcmp(extension, name) == 0)
+                return true;
+        }
+        return false;
+    }
+};
+
+#endif
@@ -0,0 +1,334 @@
+//
+//  gl_render_device.h
+//  3D Object Drawing
+//
+
+#ifndef GL_RENDER_DEVICE_H
+#define GL_RENDER_DEVICE_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "shader.h"
+#include "gl_ext.h"
+#include "gl_state_cache.h"
+#include "gl_resources.h"
+#include "render_device.h"
+
+#include <vector>
+#include <string>
+#include <unordered_map>
+
+// RenderDevice on the OpenGL 3.3 core context that glfw made current. The GL objects are
+// owned by a GLResources table, and handles are its generation-checked handles: destroying
+// one retires the object until the GPU is done with it (see gl_resources.h). Every state
+// change goes through a GLStateCache, which drops the redundant ones. Created after
+// gladLoadGLLoader; release() before the context goes away.
+class GLRenderDevice : public RenderDevice
+{
+public:
+    GLRenderDevice()
+    {
+        extensions.load();
+        state.reset();
+        state.enable(GL_DEPTH_TEST, true);
+    }
+
+    GLStateCache& stateCache()
+    {
+        return state;
+    }
+
+    const GLExtensions& glExtensions() const
+    {
+        return extensions;
+    }
+
+    // the GL name of a handle, for the GL-only renderers that bind objects themselves
+    GLuint glObject(DeviceHandle handle)
+    {
+        return resources.get(handle);
+    }
+
+    // takes over an object made with GL directly (the culling compute program); it is
+    // destroyed with the matching destroy call
+    DeviceHandle adopt(GLObject object)
+    {
+        return resources.add(std::move(object));
+    }
+
+    const GLResourceStats& resourceStats() const
+    {
+        return resources.stats;
+    }
+
+    // deletes every object, waiting for the GPU first; anything not destroyed by now is
+    // reported as leaked
+    void release()
+    {
+        size_t leaked = resources.releaseAll([this](const GLObject& object) { forget(object); });
+        if (leaked > 0)
+            std::cout << "WARNING::RESOURCES::LEAKED: " << leaked << " GL objects were never destroyed" << std::endl;
+    }
+
+    std::string name() const
+    {
+        const char* renderer = (const char*)glGetString(GL_RENDERER);
+        return std::string("OpenGL (") + (renderer != NULL ? renderer : "unknown") + ")";
+    }
+
+    bool supportsLayeredViews() const
+    {
+        return extensions.shaderViewportLayerArray;
+    }
+
+    // every upload goes through the copy target: binding an index buffer would attach it to
+    // whatever vertex array happens to be bound
+    DeviceHandle createBuffer(BufferKind, size_t bytes, const void* data, BufferUsage usage, MemoryCategory category)
+    {
+        GLuint buffer;
+        glGenBuffers(1, &buffer);
+        GLenum glUsage = usage == STATIC_BUFFER ? GL_STATIC_DRAW : (usage == DYNAMIC_BUFFER ? GL_DYNAMIC_DRAW : GL_STREAM_DRAW);
+        bufferUsage[buffer] = glUsage;
+        state.bindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+        glBufferData(GL_COPY_WRITE_BUFFER, bytes, data, glUsage);
+        tracker.allocate(GPU_BUFFER, buffer, category, bytes);
+        stats.commands++;
+        stats.bytesUploaded += data != NULL ? bytes : 0;
+        return resources.add(GLObject(OBJECT_BUFFER, buffer));
+    }
+
+    void setBufferData(DeviceHandle handle, size_t bytes, const void* data)
+    {
+        GLuint buffer = resources.get(handle);
+        state.bindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+        glBufferData(GL_COPY_WRITE_BUFFER, bytes, data, bufferUsage[buffer]);
+        tracker.resize(GPU_BUFFER, buffer, bytes);
+        stats.commands++;
+        stats.bytesUploaded += data != NULL ? bytes : 0;
+    }
+
+    void updateBuffer(DeviceHandle buffer, size_t offset, size_t bytes, const void* data)
+    {
+        state.bindBuffer(GL_COPY_WRITE_BUFFER, resources.get(buffer));
+        glBufferSubData(GL_COPY_WRITE_BUFFER, offset, bytes, data);
+        stats.commands++;
+        stats.bytesUploaded += bytes;
+    }
+
+    void bindUniformBuffer(unsigned int binding, DeviceHandle buffer)
+    {
+        state.bindUniformBufferBase(binding, resources.get(buffer));
+        stats.commands++;
+    }
+
+    void destroyBuffer(DeviceHandle buffer)
+    {
+        retire(buffer);
+        stats.commands++;
+    }
+
+    DeviceHandle createTextureBuffer(DeviceHandle buffer, TextureBufferFormat format)
+    {
+        static const GLenum formats[] = { GL_RGBA32F, GL_RG32UI, GL_R16UI, GL_RGBA8 };
+        GLuint texture;
+        glGenTextures(1, &texture);
+        state.bindTextureBuffer(state.activeTextureUnit(), texture);
+        glTexBuffer(GL_TEXTURE_BUFFER, formats[format], resources.get(buffer));
+        stats.commands++;
+        return resources.add(GLObject(OBJECT_TEXTURE, texture));
+    }
+
+    void bindTextureBuffer(unsigned int unit, DeviceHandle texture)
+    {
+        state.bindTextureBuffer(unit, resources.get(texture));
+        stats.commands++;
+    }
+
+    void destroyTexture(DeviceHandle texture)
+    {
+        retire(texture);
+        stats.commands++;
+    }
+
+    DeviceHandle createVertexLayout(const VertexAttribute* attributes, int count, DeviceHandle indexBuffer)
+    {
+        GLuint layout;
+        glGenVertexArrays(1, &layout);
+        state.bindVertexArray(layout);
+        for (int i = 0; i < count; i++)
+        {
+            const VertexAttribute& attribute = attributes[i];
+            state.bindBuffer(GL_ARRAY_BUFFER, resources.get(attribute.buffer));
+            if (attribute.type == ATTRIBUTE_UINT16)
+                glVertexAttribIPointer(attribute.location, attribute.components, GL_UNSIGNED_SHORT, attribute.stride, (void*)(size_t)attribute.offset);
+            else if (attribute.type == ATTRIBUTE_UINT32)
+                glVertexAttribIPointer(attribute.location, attribute.components, GL_UNSIGNED_INT, attribute.stride, (void*)(size_t)attribute.offset);
+            else
+                glVertexAttribPointer(attribute.location, attribute.components, GL_FLOAT, GL_FALSE, attribute.stride, (void*)(size_t)attribute.offset);
+            glEnableVertexAttribArray(attribute.location);
+            if (attribute.divisor != 0)
+                glVertexAttribDivisor(attribute.location, attribute.divisor);
+        }
+        state.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, resources.get(indexBuffer));
+        stats.commands++;
+        return resources.add(GLObject(OBJECT_VERTEX_ARRAY, layout));
+    }
+
+    void setAttributeDivisor(DeviceHandle layout, unsigned int location, unsigned int divisor)
+    {
+        state.bindVertexArray(resources.get(layout));
+        glVertexAttribDivisor(location, divisor);
+        stats.commands++;
+    }
+
+    void destroyVertexLayout(DeviceHandle layout)
+    {
+        retire(layout);
+        stats.commands++;
+    }
+
+    DeviceHandle createProgram(const std::string& vertexPath, const std::string& fragmentPath, const std::string& defines = std::string())
+    {
+        Shader shader(vertexPath.c_str(), fragmentPath.c_str(), defines);
+        stats.commands++;
+        return resources.add(GLObject(OBJECT_PROGRAM, shader.ID));
+    }
+
+    void useProgram(DeviceHandle program)
+    {
+        state.useProgram(resources.get(program));
+        stats.commands++;
+    }
+
+    void bindUniformBlock(DeviceHandle program, const char* block, unsigned int binding)
+    {
+        GLuint id = resources.get(program);
+        GLuint index = glGetUniformBlockIndex(id, block);
+        if (index != GL_INVALID_INDEX)
+            glUniformBlockBinding(id, index, binding);
+        stats.commands++;
+    }
+
+    void setUniform(DeviceHandle program, const char* name, UniformType type, int count, const void* values)
+    {
+        static const GLenum types[] = { GL_INT, GL_FLOAT, GL_FLOAT_VEC2, GL_FLOAT_VEC3, GL_FLOAT_MAT4 };
+        GLuint id = resources.get(program);
+        state.useProgram(id);
+        state.uniform(state.uniformLocation(id, name), types[type], count, values);
+        stats.commands++;
+        stats.uniformUpdates++;
+    }
+
+    void destroyProgram(DeviceHandle program)
+    {
+        retire(program);
+        stats.commands++;
+    }
+
+    void setViewport(int x, int y, int width, int height)
+    {
+        state.viewport(x, y, width, height);
+        stats.commands++;
+    }
+
+    void setViewportIndexed(unsigned int index, float x, float y, float width, float height)
+    {
+        if (extensions.viewportIndexedf != NULL)
+            extensions.viewportIndexedf(index, x, y, width, height);
+        state.viewportChangedElsewhere();
+        stats.commands++;
+    }
+
+    void clear(const glm::vec4& color)
+    {
+        state.clearColor(color.x, color.y, color.z, color.w);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        stats.commands++;
+    }
+
+    void setDepthMode(DepthMode mode)
+    {
+        state.depthFunc(mode == DEPTH_EQUAL_TEST ? GL_EQUAL : GL_LESS);
+        state.depthMask(mode != DEPTH_EQUAL_TEST);
+        state.colorMask(mode != DEPTH_PREPASS);
+        stats.commands++;
+    }
+
+    void setAdditiveBlend(bool enabled)
+    {
+        state.enable(GL_BLEND, enabled);
+        if (enabled)
+            state.blendFunc(GL_ONE, GL_ONE);
+        stats.commands++;
+    }
+
+    void drawIndexedInstanced(DeviceHandle layout, unsigned int indexCount, unsigned int instanceCount, unsigned int firstIndex)
+    {
+        state.bindVertexArray(resources.get(layout));
+        if (state.validating())
+            state.validate("draw");
+        glDrawElementsInstanced(GL_TRIANGLES, indexCount, GL_UNSIGNED_INT, (void*)(size_t)(firstIndex * sizeof(GLuint)), instanceCount);
+        stats.commands++;
+        stats.drawCalls++;
+        stats.instances += instanceCount;
+    }
+
+    // the objects destroyed in this frame are fenced, older ones the GPU is done with deleted
+    void endFrame()
+    {
+        state.endFrame();
+        resources.collect([this](const GLObject& object) { forget(object); });
+        stats = DeviceStats();
+    }
+
+    const DeviceStats& frameStats() const
+    {
+        return stats;
+    }
+
+    GpuMemoryTracker& memory()
+    {
+        return tracker;
+    }
+
+private:
+    GLExtensions extensions;
+    GLStateCache state;
+    GLResources resources;
+    std::unordered_map<GLuint, GLenum> bufferUsage;
+    DeviceStats stats;
+    GpuMemoryTracker tracker;
+
+    void retire(DeviceHandle handle)
+    {
+        resources.release(handle, [this](const GLObject& object)
+        {
+            if (object.objectType() == OBJECT_BUFFER)
+                bufferUsage.erase(object.get());
+        });
+    }
+
+    // the object is being deleted: the state cache and the memory tracker let go of it
+    void forget(const GLObject& object)
+    {
+        switch (object.objectType())
+        {
+        case OBJECT_BUFFER:
+            state.bufferDeleted(object.get());
+            tracker.release(GPU_BUFFER, object.get());
+            break;
+        case OBJECT_TEXTURE:
+            state.textureDeleted(object.get());
+            break;
+        case OBJECT_VERTEX_ARRAY:
+            state.vertexArrayDeleted(object.get());
+            break;
+        case OBJECT_PROGRAM:
+            state.programDeleted(object.get());
+            break;
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,300 @@
+//
+//  gl_resources.h
+//  3D Object Drawing
+//
+
+#ifndef GL_RESOURCES_H
+#define GL_RESOURCES_H
+
+#include <glad/glad.h>
+
+#include "render_device.h"
+
+#include <vector>
+#include <utility>
+#include <cstdio>
+#include <iostream>
+
+enum GLObjectType
+{
+    OBJECT_BUFFER,
+    OBJECT_TEXTURE,
+    OBJECT_VERTEX_ARRAY,
+    OBJECT_PROGRAM
+};
+
+// Owns one GL object and deletes it when destroyed. It moves but does not copy, so there
+// is always exactly one owner of the name.
+class GLObject
+{
+public:
+    GLObject() : type(OBJECT_BUFFER), name(0)
+    {
+    }
+
+    GLObject(GLObjectType objectType, GLuint objectName) : type(objectType), name(objectName)
+    {
+    }
+
+    GLObject(GLObject&& other) noexcept : type(other.type), name(other.name)
+    {
+        other.name = 0;
+    }
+
+    GLObject& operator=(GLObject&& other) noexcept
+    {
+        if (this != &other)
+        {
+            reset();
+            type = other.type;
+            name = other.name;
+            other.name = 0;
+        }
+        return *this;
+    }
+
+    GLObject(const GLObject&) = delete;
+    GLObject& operator=(const GLObject&) = delete;
+
+    ~GLObject()
+    {
+        reset();
+    }
+
+    GLObjectType objectType() const
+    {
+        return type;
+    }
+
+    GLuint get() const
+    {
+        return name;
+    }
+
+    void reset()
+    {
+        if (name == 0)
+            return;
+        switch (type)
+        {
+        case OBJECT_BUFFER:
+            glDeleteBuffers(1, &name);
+            break;
+        case OBJECT_TEXTURE:
+            glDeleteTextures(1, &name);
+            break;
+        case OBJECT_VERTEX_ARRAY:
+            glDeleteVertexArrays(1, &name);
+            break;
+        case OBJECT_PROGRAM:
+            glDeleteProgram(name);
+            break;
+        }
+        name = 0;
+    }
+
+private:
+    GLObjectType type;
+    GLuint name;
+};
+
+// a handle is a slot index in the low bits and the slot's generation in the high bits, so
+// a handle kept after its object was released no longer matches and is caught
+const unsigned int HANDLE_INDEX_BITS = 20;
+const unsigned int HANDLE_INDEX_MASK = (1u << HANDLE_INDEX_BITS) - 1;
+const unsigned int HANDLE_GENERATIONS = 1u << (32 - HANDLE_INDEX_BITS);
+const unsigned int NO_FREE_SLOT = 0xFFFFFFFFu;
+
+struct GLResourceStats
+{
+    size_t live = 0;
+    size_t retired = 0;         // released, waiting for the GPU to finish with them
+    size_t deleted = 0;         // since the start
+    size_t staleLookups = 0;    // handles used after their object was released
+};
+
+// The GL objects of a device, handed out as generation-checked handles (never 0). Releasing
+// a handle ends it at once, but its object is only retired: the commands already issued
+// may still use it, so at the end of the frame a fence is put after them, and the objects
+// are deleted once a later frame finds the fence signalled. Nothing waits for the GPU;
+// replacing a resource mid-stream (a world cell, a resized buffer) never stalls.
+class GLResources
+{
+public:
+    GLResourceStats stats;
+
+    GLResources() : freeHead(NO_FREE_SLOT), warnedStale(false)
+    {
+    }
+
+    DeviceHandle add(GLObject object)
+    {
+        unsigned int index;
+        if (freeHead != NO_FREE_SLOT)
+        {
+            index = freeHead;
+            freeHead = slots[index].nextFree;
+        }
+        else
+        {
+            index = (unsigned int)slots.size();
+            if (index > HANDLE_INDEX_MASK)
+            {
+                std::cout << "ERROR::RESOURCES::OUT_OF_HANDLES: more than " << HANDLE_INDEX_MASK + 1 << " objects alive" << std::endl;
+                return 0;
+            }
+            slots.push_back(Slot());
+        }
+        Slot& slot = slots[index];
+        slot.object = std::move(object);
+        slot.nextFree = NO_FREE_SLOT;
+        stats.live++;
+        return (slot.generation << HANDLE_INDEX_BITS) | index;
+    }
+
+    // the GL name; 0 (which binds nothing) for a handle that is no longer alive
+    GLuint get(DeviceHandle handle)
+    {
+        const Slot* slot = find(handle);
+        if (slot != NULL)
+            return slot->object.get();
+        if (handle != 0)
+            stale(handle);
+        return 0;
+    }
+
+    // onRetire(const GLObject&) is told about the object now, while the slot still holds it
+    template <typename Callback>
+    void release(DeviceHandle handle, Callback onRetire)
+    {
+        Slot* slot = find(handle);
+        if (slot == NULL)
+        {
+            if (handle != 0)
+                stale(handle);
+            return;
+        }
+        onRetire(slot->object);
+        retiring.push_back(std::move(slot->object));
+        slot->generation = slot->generation + 1 == HANDLE_GENERATIONS ? 1 : slot->generation + 1;
+        slot->nextFree = freeHead;
+        freeHead = handle & HANDLE_INDEX_MASK;
+        stats.live--;
+        stats.retired++;
+    }
+
+    // once per frame, after its commands: fences the objects released during the frame and
+    // deletes those of earlier frames whose fence has signalled. onDelete(const GLObject&)
+    // runs just before each deletion.
+    template <typename Callback>
+    void collect(Callback onDelete)
+    {
+        if (!retiring.empty())
+        {
+            batches.push_back(Batch());
+            batches.back().fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            batches.back().objects.swap(retiring);
+        }
+        size_t done = 0;
+        while (done < batches.size())
+        {
+            GLenum status = glClientWaitSync(batches[done].fence, 0, 0);
+            if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+                break;
+            deleteBatch(batches[done], onDelete);
+            done++;
+        }
+        batches.erase(batches.begin(), batches.begin() + done);
+    }
+
+    // at shutdown: waits for the GPU and deletes everything, retired or not; returns the
+    // number of objects that were still alive
+    template <typename Callback>
+    size_t releaseAll(Callback onDelete)
+    {
+        collect(onDelete);
+        for (size_t i = 0; i < batches.size(); i++)
+        {
+            glClientWaitSync(batches[i].fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000ull);
+            deleteBatch(batches[i], onDelete);
+        }
+        batches.clear();
+        size_t leaked = 0;
+        for (size_t i = 0; i < slots.size(); i++)
+        {
+            if (slots[i].object.get() == 0)
+                continue;
+            onDelete(slots[i].object);
+            slots[i].object.reset();
+            leaked++;
+        }
+        stats.live = 0;
+        return leaked;
+    }
+
+private:
+    struct Slot
+    {
+        GLObject object;
+        unsigned int generation = 1;
+        unsigned int nextFree = NO_FREE_SLOT;
+    };
+
+    struct Batch
+    {
+        GLsync fence = NULL;
+        std::vector<GLObject> objects;
+    };
+
+    std::vector<Slot> slots;
+    unsigned int freeHead;
+    std::vector<GLObject> retiring;     // released this frame
+    std::vector<Batch> batches;         // oldest first
+    bool warnedStale;
+
+    Slot* find(DeviceHandle handle)
+    {
+        unsigned int index = handle & HANDLE_INDEX_MASK;
+        if (index >= slots.size())
+            return NULL;
+        Slot& slot = slots[index];
+        if (slot.generation != handle >> HANDLE_INDEX_BITS || slot.object.get() == 0)
+            return NULL;
+        return &slot;
+    }
+
+    void stale(DeviceHandle handle)
+    {
+        stats.staleLookups++;
+        if (warnedStale)
+            return;
+        std::cout << "ERROR::RESOURCES::STALE_HANDLE: handle " << handle << " (slot " << (handle & HANDLE_INDEX_MASK)
+                  << ", generation " << (handle >> HANDLE_INDEX_BITS) << ") was used after it was released" << std::endl;
+        warnedStale = true;
+    }
+
+    template <typename Callback>
+    void deleteBatch(Batch& batch, Callback onDelete)
+    {
+        glDeleteSync(batch.fence);
+        batch.fence = NULL;
+        for (size_t i = 0; i < batch.objects.size(); i++)
+        {
+            onDelete(batch.objects[i]);
+            batch.objects[i].reset();
+            stats.deleted++;
+        }
+        stats.retired -= batch.objects.size();
+        batch.objects.clear();
+    }
+};
+
+inline void printGLResourceStats(const GLResourceStats& stats)
+{
+    std::printf("gl objects: %zu alive, %zu waiting for the GPU to delete, %zu deleted", stats.live, stats.retired, stats.deleted);
+    if (stats.staleLookups > 0)
+        std::printf(", %zu stale handles used", stats.staleLookups);
+    std::printf("\n");
+}
+
+#endif
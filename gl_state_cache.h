@@ -0,0 +1,604 @@
+//
+//  gl_state_cache.h
+//  3D Object Drawing
+//
+
+#ifndef GL_STATE_CACHE_H
+#define GL_STATE_CACHE_H
+
+#include <glad/glad.h>
+
+#include <string>
+#include <vector>
+#include <cstring>
+#include <cstdio>
+#include <iostream>
+#include <unordered_map>
+
+// shadow value of a binding the cache no longer knows (e.g. after its object was deleted)
+const GLuint UNKNOWN_BINDING = 0xFFFFFFFFu;
+const GLint UNKNOWN_STATE = -1;
+
+// texture units and uniform buffer binding points whose bindings are shadowed; calls for
+// higher ones go straight to the driver
+const int CACHED_TEXTURE_UNITS = 16;
+const int CACHED_UNIFORM_BINDINGS = 8;
+
+enum GLStateCallKind
+{
+    STATE_CALL_PROGRAM,
+    STATE_CALL_VERTEX_ARRAY,
+    STATE_CALL_BUFFER,
+    STATE_CALL_TEXTURE,
+    STATE_CALL_CAPABILITY,      // glEnable/glDisable, depth and blend state
+    STATE_CALL_VIEWPORT,        // viewport and clear color
+    STATE_CALL_UNIFORM,
+    STATE_CALL_KIND_COUNT
+};
+
+const char* const STATE_CALL_NAMES[STATE_CALL_KIND_COUNT] = {
+    "program", "vertex array", "buffer", "texture", "capability", "viewport", "uniform"
+};
+
+// state changes since the last endFrame(): issued reached the driver, filtered were dropped
+struct GLStateStats
+{
+    size_t issued[STATE_CALL_KIND_COUNT] = {};
+    size_t filtered[STATE_CALL_KIND_COUNT] = {};
+    size_t mismatches = 0;      // shadow values that disagreed with glGet* (validation only)
+
+    size_t totalIssued() const
+    {
+        size_t total = 0;
+        for (int i = 0; i < STATE_CALL_KIND_COUNT; i++)
+            total += issued[i];
+        return total;
+    }
+
+    size_t totalFiltered() const
+    {
+        size_t total = 0;
+        for (int i = 0; i < STATE_CALL_KIND_COUNT; i++)
+            total += filtered[i];
+        return total;
+    }
+};
+
+// Shadows the GL state the renderers touch (program, vertex array, buffer and texture
+// buffer bindings, enable flags, depth and blend state, viewport, clear color and every
+// uniform value per program) and drops calls that would set what is already set. All GL
+// state changes of the device must go through it, or the shadow goes stale; the
+// validation mode catches that by comparing the shadow with glGet* at every draw.
+class GLStateCache
+{
+public:
+    GLStateStats stats;
+
+    GLStateCache() : validation(false)
+    {
+    }
+
+    // reads the current driver state into the shadow; needs a current context
+    void reset()
+    {
+        program = getInteger(GL_CURRENT_PROGRAM);
+        vertexArray = getInteger(GL_VERTEX_ARRAY_BINDING);
+        arrayBuffer = getInteger(GL_ARRAY_BUFFER_BINDING);
+        // GL_COPY_WRITE_BUFFER_BINDING is only named from 4.2; the 3.1 target enum has the same value
+        copyWriteBuffer = getInteger(GL_COPY_WRITE_BUFFER);
+        uniformBuffer = getInteger(GL_UNIFORM_BUFFER_BINDING);
+        for (int i = 0; i < CACHED_UNIFORM_BINDINGS; i++)
+        {
+            GLint buffer = 0;
+            glGetIntegeri_v(GL_UNIFORM_BUFFER_BINDING, i, &buffer);
+            uniformBindings[i] = buffer;
+        }
+        activeUnit = getInteger(GL_ACTIVE_TEXTURE) - GL_TEXTURE0;
+        for (int i = 0; i < CACHED_TEXTURE_UNITS; i++)
+        {
+            glActiveTexture(GL_TEXTURE0 + i);
+            textureBuffers[i] = getInteger(GL_TEXTURE_BINDING_BUFFER);
+        }
+        glActiveTexture(GL_TEXTURE0 + activeUnit);
+
+        depthTest = glIsEnabled(GL_DEPTH_TEST);
+        blend = glIsEnabled(GL_BLEND);
+        cullFace = glIsEnabled(GL_CULL_FACE);
+        depthFunction = getInteger(GL_DEPTH_FUNC);
+        depthWrite = getInteger(GL_DEPTH_WRITEMASK);
+        colorWrite = getColorWriteMask();
+        blendSource = getInteger(GL_BLEND_SRC_RGB);
+        blendDestination = getInteger(GL_BLEND_DST_RGB);
+        glGetIntegerv(GL_VIEWPORT, viewportRect);
+        glGetFloatv(GL_COLOR_CLEAR_VALUE, clearValue);
+        viewportKnown = true;
+
+        programs.clear();
+    }
+
+    // --validate-gl: compare the shadow with the driver at every draw and frame end
+    void setValidation(bool enabled)
+    {
+        validation = enabled;
+    }
+
+    bool validating() const
+    {
+        return validation;
+    }
+
+    GLuint currentProgram() const
+    {
+        return program;
+    }
+
+    void useProgram(GLuint id)
+    {
+        if (!changed(STATE_CALL_PROGRAM, program, id))
+            return;
+        glUseProgram(id);
+    }
+
+    void bindVertexArray(GLuint id)
+    {
+        if (!changed(STATE_CALL_VERTEX_ARRAY, vertexArray, id))
+            return;
+        glBindVertexArray(id);
+    }
+
+    // GL_ARRAY_BUFFER, GL_COPY_WRITE_BUFFER and GL_UNIFORM_BUFFER are shadowed; the element
+    // array binding belongs to the vertex array and is passed through
+    void bindBuffer(GLenum target, GLuint buffer)
+    {
+        GLuint* shadow = bufferShadow(target);
+        if (shadow != NULL && !changed(STATE_CALL_BUFFER, *shadow, buffer))
+            return;
+        if (shadow == NULL)
+            stats.issued[STATE_CALL_BUFFER]++;
+        glBindBuffer(target, buffer);
+    }
+
+    void bindUniformBufferBase(GLuint binding, GLuint buffer)
+    {
+        if (binding < (GLuint)CACHED_UNIFORM_BINDINGS && uniformBindings[binding] == buffer && uniformBuffer == buffer)
+        {
+            stats.filtered[STATE_CALL_BUFFER]++;
+            return;
+        }
+        stats.issued[STATE_CALL_BUFFER]++;
+        glBindBufferBase(GL_UNIFORM_BUFFER, binding, buffer);
+        if (binding < (GLuint)CACHED_UNIFORM_BINDINGS)
+            uniformBindings[binding] = buffer;
+        uniformBuffer = buffer;     // glBindBufferBase also sets the generic binding
+    }
+
+    // binds a buffer texture on a unit, switching the active unit only when needed
+    void bindTextureBuffer(int unit, GLuint texture)
+    {
+        if (unit >= CACHED_TEXTURE_UNITS)
+        {
+            stats.issued[STATE_CALL_TEXTURE]++;
+            setActiveUnit(unit);
+            glBindTexture(GL_TEXTURE_BUFFER, texture);
+            return;
+        }
+        if (!changed(STATE_CALL_TEXTURE, textureBuffers[unit], texture))
+            return;
+        setActiveUnit(unit);
+        glBindTexture(GL_TEXTURE_BUFFER, texture);
+    }
+
+    int activeTextureUnit() const
+    {
+        return activeUnit;
+    }
+
+    // GL_DEPTH_TEST, GL_BLEND and GL_CULL_FACE are shadowed
+    void enable(GLenum capability, bool enabled)
+    {
+        GLint* shadow = capabilityShadow(capability);
+        if (shadow != NULL && *shadow == (GLint)enabled)
+        {
+            stats.filtered[STATE_CALL_CAPABILITY]++;
+            return;
+        }
+        stats.issued[STATE_CALL_CAPABILITY]++;
+        if (enabled)
+            glEnable(capability);
+        else
+            glDisable(capability);
+        if (shadow != NULL)
+            *shadow = enabled;
+    }
+
+    void depthFunc(GLenum function)
+    {
+        if (!changedState(STATE_CALL_CAPABILITY, depthFunction, (GLint)function))
+            return;
+        glDepthFunc(function);
+    }
+
+    void depthMask(bool write)
+    {
+        if (!changedState(STATE_CALL_CAPABILITY, depthWrite, (GLint)write))
+            return;
+        glDepthMask(write ? GL_TRUE : GL_FALSE);
+    }
+
+    // all four channels together
+    void colorMask(bool write)
+    {
+        if (!changedState(STATE_CALL_CAPABILITY, colorWrite, (GLint)write))
+            return;
+        GLboolean mask = write ? GL_TRUE : GL_FALSE;
+        glColorMask(mask, mask, mask, mask);
+    }
+
+    void blendFunc(GLenum source, GLenum destination)
+    {
+        if (blendSource == (GLint)source && blendDestination == (GLint)destination)
+        {
+            stats.filtered[STATE_CALL_CAPABILITY]++;
+            return;
+        }
+        stats.issued[STATE_CALL_CAPABILITY]++;
+        glBlendFunc(source, destination);
+        blendSource = source;
+        blendDestination = destination;
+    }
+
+    void viewport(int x, int y, int width, int height)
+    {
+        if (viewportKnown && viewportRect[0] == x && viewportRect[1] == y && viewportRect[2] == width && viewportRect[3] == height)
+        {
+            stats.filtered[STATE_CALL_VIEWPORT]++;
+            return;
+        }
+        stats.issued[STATE_CALL_VIEWPORT]++;
+        glViewport(x, y, width, height);
+        viewportRect[0] = x;
+        viewportRect[1] = y;
+        viewportRect[2] = width;
+        viewportRect[3] = height;
+        viewportKnown = true;
+    }
+
+    // glViewportIndexedf goes around the cache; viewport 0 may have changed
+    void viewportChangedElsewhere()
+    {
+        stats.issued[STATE_CALL_VIEWPORT]++;
+        viewportKnown = false;
+    }
+
+    void clearColor(float r, float g, float b, float a)
+    {
+        if (clearValue[0] == r && clearValue[1] == g && clearValue[2] == b && clearValue[3] == a)
+        {
+            stats.filtered[STATE_CALL_VIEWPORT]++;
+            return;
+        }
+        stats.issued[STATE_CALL_VIEWPORT]++;
+        glClearColor(r, g, b, a);
+        clearValue[0] = r;
+        clearValue[1] = g;
+        clearValue[2] = b;
+        clearValue[3] = a;
+    }
+
+    // glGetUniformLocation once per program and name
+    GLint uniformLocation(GLuint id, const char* name)
+    {
+        std::unordered_map<std::string, GLint>& locations = programs[id].locations;
+        lookupName.assign(name);
+        std::unordered_map<std::string, GLint>::const_iterator found = locations.find(lookupName);
+        if (found != locations.end())
+            return found->second;
+        GLint location = glGetUniformLocation(id, name);
+        locations[lookupName] = location;
+        return location;
+    }
+
+    // type is GL_INT, GL_FLOAT, GL_FLOAT_VEC2, GL_FLOAT_VEC3 or GL_FLOAT_MAT4; sets the
+    // uniform of the program in use
+    void uniform(GLint location, GLenum type, int count, const void* values)
+    {
+        if (location < 0)
+            return;
+        size_t bytes = uniformSize(type) * count;
+        CachedUniform& cached = programs[program].values[location];
+        if (cached.type == type && cached.count == count && std::memcmp(&cached.bytes[0], values, bytes) == 0)
+        {
+            stats.filtered[STATE_CALL_UNIFORM]++;
+            return;
+        }
+        stats.issued[STATE_CALL_UNIFORM]++;
+        switch (type)
+        {
+        case GL_INT:
+            glUniform1iv(location, count, (const GLint*)values);
+            break;
+        case GL_FLOAT:
+            glUniform1fv(location, count, (const GLfloat*)values);
+            break;
+        case GL_FLOAT_VEC2:
+            glUniform2fv(location, count, (const GLfloat*)values);
+            break;
+        case GL_FLOAT_VEC3:
+            glUniform3fv(location, count, (const GLfloat*)values);
+            break;
+        case GL_FLOAT_MAT4:
+            glUniformMatrix4fv(location, count, GL_FALSE, (const GLfloat*)values);
+            break;
+        }
+        cached.type = type;
+        cached.count = count;
+        cached.bytes.assign((const char*)values, (const char*)values + bytes);
+    }
+
+    // deleted objects are unbound by the driver; forget them so the next bind is issued
+    void bufferDeleted(GLuint buffer)
+    {
+        GLuint* shadows[] = { &arrayBuffer, &copyWriteBuffer, &uniformBuffer };
+        for (int i = 0; i < 3; i++)
+            if (*shadows[i] == buffer)
+                *shadows[i] = UNKNOWN_BINDING;
+        for (int i = 0; i < CACHED_UNIFORM_BINDINGS; i++)
+            if (uniformBindings[i] == buffer)
+                uniformBindings[i] = UNKNOWN_BINDING;
+    }
+
+    void textureDeleted(GLuint texture)
+    {
+        for (int i = 0; i < CACHED_TEXTURE_UNITS; i++)
+            if (textureBuffers[i] == texture)
+                textureBuffers[i] = UNKNOWN_BINDING;
+    }
+
+    void vertexArrayDeleted(GLuint id)
+    {
+        if (vertexArray == id)
+            vertexArray = UNKNOWN_BINDING;
+    }
+
+    void programDeleted(GLuint id)
+    {
+        programs.erase(id);
+    }
+
+    // compares every shadow value with the driver and reports the differences; returns
+    // true if they all agree
+    bool validate(const char* where)
+    {
+        size_t before = stats.mismatches;
+        check(where, "program", program, getInteger(GL_CURRENT_PROGRAM));
+        check(where, "vertex array", vertexArray, getInteger(GL_VERTEX_ARRAY_BINDING));
+        check(where, "array buffer", arrayBuffer, getInteger(GL_ARRAY_BUFFER_BINDING));
+        check(where, "copy write buffer", copyWriteBuffer, getInteger(GL_COPY_WRITE_BUFFER));
+        check(where, "uniform buffer", uniformBuffer, getInteger(GL_UNIFORM_BUFFER_BINDING));
+        for (int i = 0; i < CACHED_UNIFORM_BINDINGS; i++)
+        {
+            GLint buffer = 0;
+            glGetIntegeri_v(GL_UNIFORM_BUFFER_BINDING, i, &buffer);
+            check(where, "uniform buffer binding", uniformBindings[i], buffer);
+        }
+        GLint unit = getInteger(GL_ACTIVE_TEXTURE) - GL_TEXTURE0;
+        check(where, "active texture", activeUnit, unit);
+        for (int i = 0; i < CACHED_TEXTURE_UNITS; i++)
+        {
+            glActiveTexture(GL_TEXTURE0 + i);
+            check(where, "texture buffer unit", textureBuffers[i], getInteger(GL_TEXTURE_BINDING_BUFFER));
+        }
+        glActiveTexture(GL_TEXTURE0 + unit);
+
+        checkState(where, "depth test", depthTest, glIsEnabled(GL_DEPTH_TEST));
+        checkState(where, "blend", blend, glIsEnabled(GL_BLEND));
+        checkState(where, "cull face", cullFace, glIsEnabled(GL_CULL_FACE));
+        checkState(where, "depth func", depthFunction, getInteger(GL_DEPTH_FUNC));
+        checkState(where, "depth mask", depthWrite, getInteger(GL_DEPTH_WRITEMASK));
+        checkState(where, "color mask", colorWrite, getColorWriteMask());
+        checkState(where, "blend source", blendSource, getInteger(GL_BLEND_SRC_RGB));
+        checkState(where, "blend destination", blendDestination, getInteger(GL_BLEND_DST_RGB));
+        if (viewportKnown)
+        {
+            GLint rect[4];
+            glGetIntegerv(GL_VIEWPORT, rect);
+            for (int i = 0; i < 4; i++)
+                checkState(where, "viewport", viewportRect[i], rect[i]);
+        }
+        GLfloat color[4];
+        glGetFloatv(GL_COLOR_CLEAR_VALUE, color);
+        for (int i = 0; i < 4; i++)
+            if (color[i] != clearValue[i])
+                mismatch(where, "clear color", std::to_string(clearValue[i]), std::to_string(color[i]));
+
+        // uniforms of the program in use; arrays are checked by their first element
+        std::unordered_map<GLuint, ProgramState>::const_iterator state = programs.find(program);
+        if (state != programs.end())
+        {
+            std::unordered_map<GLint, CachedUniform>::const_iterator it;
+            for (it = state->second.values.begin(); it != state->second.values.end(); ++it)
+            {
+                size_t bytes = uniformSize(it->second.type);
+                char actual[64];
+                if (it->second.type == GL_INT)
+                    glGetUniformiv(program, it->first, (GLint*)actual);
+                else
+                    glGetUniformfv(program, it->first, (GLfloat*)actual);
+                if (std::memcmp(actual, &it->second.bytes[0], bytes) != 0)
+                {
+                    std::string name = "uniform at location " + std::to_string(it->first);
+                    if (it->second.type == GL_INT)
+                        mismatch(where, name.c_str(), std::to_string(*(const GLint*)&it->second.bytes[0]), std::to_string(*(const GLint*)actual));
+                    else
+                        mismatch(where, name.c_str(), std::to_string(*(const GLfloat*)&it->second.bytes[0]), std::to_string(*(const GLfloat*)actual));
+                }
+            }
+        }
+        return stats.mismatches == before;
+    }
+
+    void endFrame()
+    {
+        if (validation)
+            validate("end of frame");
+        stats = GLStateStats();
+    }
+
+private:
+    struct CachedUniform
+    {
+        GLenum type = 0;
+        int count = 0;
+        std::vector<char> bytes;
+    };
+
+    struct ProgramState
+    {
+        std::unordered_map<std::string, GLint> locations;
+        std::unordered_map<GLint, CachedUniform> values;
+    };
+
+    bool validation;
+
+    GLuint program;
+    GLuint vertexArray;
+    GLuint arrayBuffer;
+    GLuint copyWriteBuffer;
+    GLuint uniformBuffer;
+    GLuint uniformBindings[CACHED_UNIFORM_BINDINGS];
+    int activeUnit;
+    GLuint textureBuffers[CACHED_TEXTURE_UNITS];
+
+    GLint depthTest, blend, cullFace;
+    GLint depthFunction, depthWrite, colorWrite;
+    GLint blendSource, blendDestination;
+    GLint viewportRect[4];
+    bool viewportKnown;
+    GLfloat clearValue[4];
+
+    std::unordered_map<GLuint, ProgramState> programs;
+    std::string lookupName;     // reused so that looking up a long uniform name does not allocate
+
+    static GLint getInteger(GLenum name)
+    {
+        GLint value = 0;
+        glGetIntegerv(name, &value);
+        return value;
+    }
+
+    // 1 when all four channels are written, as colorMask sets them
+    static GLint getColorWriteMask()
+    {
+        GLboolean mask[4];
+        glGetBooleanv(GL_COLOR_WRITEMASK, mask);
+        return mask[0] && mask[1] && mask[2] && mask[3] ? 1 : 0;
+    }
+
+    static size_t uniformSize(GLenum type)
+    {
+        switch (type)
+        {
+        case GL_FLOAT_VEC2:
+            return 2 * sizeof(GLfloat);
+        case GL_FLOAT_VEC3:
+            return 3 * sizeof(GLfloat);
+        case GL_FLOAT_MAT4:
+            return 16 * sizeof(GLfloat);
+        default:
+            return 4;
+        }
+    }
+
+    // counts the call and updates the shadow; false if the binding is already in place
+    bool changed(GLStateCallKind kind, GLuint& shadow, GLuint value)
+    {
+        if (shadow == value)
+        {
+            stats.filtered[kind]++;
+            return false;
+        }
+        stats.issued[kind]++;
+        shadow = value;
+        return true;
+    }
+
+    bool changedState(GLStateCallKind kind, GLint& shadow, GLint value)
+    {
+        if (shadow == value)
+        {
+            stats.filtered[kind]++;
+            return false;
+        }
+        stats.issued[kind]++;
+        shadow = value;
+        return true;
+    }
+
+    void setActiveUnit(int unit)
+    {
+        if (activeUnit == unit)
+            return;
+        glActiveTexture(GL_TEXTURE0 + unit);
+        activeUnit = unit;
+    }
+
+    GLuint* bufferShadow(GLenum target)
+    {
+        switch (target)
+        {
+        case GL_ARRAY_BUFFER:
+            return &arrayBuffer;
+        case GL_COPY_WRITE_BUFFER:
+            return &copyWriteBuffer;
+        case GL_UNIFORM_BUFFER:
+            return &uniformBuffer;
+        default:
+            return NULL;
+        }
+    }
+
+    GLint* capabilityShadow(GLenum capability)
+    {
+        switch (capability)
+        {
+        case GL_DEPTH_TEST:
+            return &depthTest;
+        case GL_BLEND:
+            return &blend;
+        case GL_CULL_FACE:
+            return &cullFace;
+        default:
+            return NULL;
+        }
+    }
+
+    void check(const char* where, const char* what, GLuint shadow, GLint actual)
+    {
+        if (shadow != UNKNOWN_BINDING && shadow != (GLuint)actual)
+            mismatch(where, what, std::to_string(shadow), std::to_string(actual));
+    }
+
+    void checkState(const char* where, const char* what, GLint shadow, GLint actual)
+    {
+        if (shadow != UNKNOWN_STATE && shadow != actual)
+            mismatch(where, what, std::to_string(shadow), std::to_string(actual));
+    }
+
+    void mismatch(const char* where, const char* what, const std::string& shadow, const std::string& actual)
+    {
+        stats.mismatches++;
+        std::cout << "ERROR::GL_STATE::MISMATCH: " << what << " at " << where << ": cached " << shadow << ", driver " << actual << std::endl;
+    }
+};
+
+inline void printGLStateStats(const GLStateStats& stats)
+{
+    std::cout << "gl state calls issued: " << stats.totalIssued() << "  filtered: " << stats.totalFiltered();
+    for (int i = 0; i < STATE_CALL_KIND_COUNT; i++)
+        std::cout << "  " << STATE_CALL_NAMES[i] << " " << stats.issued[i] << "/" << stats.issued[i] + stats.filtered[i];
+    if (stats.mismatches > 0)
+        std::cout << "  mismatches: " << stats.mismatches;
+    std::cout << std::endl;
+}
+
+#endif
@@ -0,0 +1,338 @@
+//
+//  gpu_culling.h
+//  3D Object Drawing
+//
+
+#ifndef GPU_CULLING_H
+#define GPU_CULLING_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "draw_list.h"
+#include "gl_ext.h"
+#include "gl_render_device.h"
+#include "scene_renderer.h"
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <chrono>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+
+const unsigned int CULL_GROUP_SIZE = 64;    // local_size_x in gpuCulling.comp
+
+// Object record of gpuCulling.comp, std430. The leading fields are laid out as in
+// InstanceData, so the same buffer is the per-instance vertex data of the draws.
+struct GpuObject
+{
+    glm::mat4 model;
+    unsigned short material;
+    unsigned short viewMask;
+    unsigned int drawIndex;
+    unsigned int mesh;          // InstanceMesh
+    unsigned int padding;
+};
+
+static_assert(sizeof(GpuObject) == 80, "GpuObject must match the std430 Object struct in gpuCulling.comp");
+
+// the layout glMultiDrawElementsIndirect reads
+struct DrawElementsIndirectCommand
+{
+    unsigned int count;
+    unsigned int instanceCount;
+    unsigned int firstIndex;
+    int baseVertex;
+    unsigned int baseInstance;
+};
+
+struct GpuCullingStats
+{
+    size_t objects = 0;
+    size_t visible = 0;             // read back from the GPU on request
+    size_t lodRejected = 0;
+    bool countsRead = false;
+    bool indirectCount = false;     // the draw count came from the GPU
+    size_t bytesUploaded = 0;       // object records, only when the list changed
+    double cpuMs = 0.0;             // change check, upload, dispatch and draw submission
+};
+
+// command line switches of GPU culling
+struct GpuCullingOptions
+{
+    bool enabled = false;           // --gpu-cull      cull on the GPU and draw with indirect commands
+    bool fallback = false;          // --gpu-cull-fallback  one command slot per object instead of a GPU draw count
+    float lodPixels = 0.0f;         // --lod-pixels N  skip objects smaller than N pixels on screen
+
+    // false if arg is not one of the switches above
+    bool parseArgs(const std::string& arg, int argc, char** argv, int& i)
+    {
+        if (arg == "--gpu-cull")
+            enabled = true;
+        else if (arg == "--gpu-cull-fallback")
+            enabled = fallback = true;
+        else if (arg == "--lod-pixels" && i + 1 < argc)
+            lodPixels = (float)std::atof(argv[++i]);
+        else
+            return false;
+        return true;
+    }
+
+    static void printUsage()
+    {
+        std::cout << "  --gpu-cull       frustum cull in a compute shader and draw with glMultiDrawElementsIndirectCount\n"
+                  << "  --gpu-cull-fallback --gpu-cull with one indirect command per object, for drivers without a draw count\n"
+                  << "  --lod-pixels N   with --gpu-cull, skip objects covering fewer than N pixels (default 0: none)\n";
+    }
+};
+
+// GPU driven drawing. Every command of the draw list is an object record in a storage
+// buffer; a compute shader tests each against the view frustum, drops the ones too small
+// on screen and appends an indirect draw command (one instance, baseInstance = the object)
+// for each survivor, counting them with an atomic counter. The frame is then one
+// glMultiDrawElementsIndirectCount that takes its draw count from that counter, so the CPU
+// work per frame does not grow with the number of objects once they are uploaded. Without
+// GL 4.6 or GL_ARB_indirect_parameters every object keeps its own command slot, culled
+// ones with no instances, and glMultiDrawElementsIndirect draws them all.
+// Needs the GL device: storage buffers and compute programs are not RenderDevice resources.
+class GpuCulling
+{
+public:
+    GpuCullingStats stats;
+
+    explicit GpuCulling(GLRenderDevice& renderDevice)
+        : device(renderDevice), program(0), objectBuffer(0), commandBuffer(0), counterBuffer(0), layout(0), capacity(0),
+          objectCount(0), useIndirectCount(false)
+    {
+    }
+
+    // nothing to do without --gpu-cull; directGL: the frames go straight to the GL device, not
+    // to the null device or --record. --gpu-cull-fallback draws through per-object slots even
+    // when the count can come from the GPU.
+    bool init(const GpuCullingOptions& options, bool directGL, const VertexAttribute* meshAttributes, int meshAttributeCount, DeviceHandle indexBuffer)
+    {
+        if (!options.enabled)
+            return true;
+        if (!directGL)
+        {
+            std::cout << "ERROR::GPU_CULLING::NEEDS_GL: the culling shader writes OpenGL storage buffers, use --device gl without --record" << std::endl;
+            return false;
+        }
+        const GLExtensions& extensions = device.glExtensions();
+        if (!extensions.computeCulling)
+        {
+            std::cout << "ERROR::GPU_CULLING::UNSUPPORTED: needs compute shaders and glMultiDrawElementsIndirect (OpenGL 4.3)" << std::endl;
+            return false;
+        }
+        useIndirectCount = extensions.indirectCount && !options.fallback;
+        GLuint compiled = compileCompute("gpuCulling.comp");
+        if (compiled == 0)
+            return false;
+        program = device.adopt(GLObject(OBJECT_PROGRAM, compiled));
+
+        objectBuffer = device.createBuffer(VERTEX_BUFFER, 0, NULL, DYNAMIC_BUFFER, MEMORY_INSTANCES);
+        commandBuffer = device.createBuffer(VERTEX_BUFFER, 0, NULL, DYNAMIC_BUFFER, MEMORY_INSTANCES);
+        const unsigned int zeros[2] = { 0, 0 };
+        counterBuffer = device.createBuffer(VERTEX_BUFFER, sizeof(zeros), zeros, DYNAMIC_BUFFER, MEMORY_STAGING);
+
+        std::vector<VertexAttribute> attributes(meshAttributes, meshAttributes + meshAttributeCount);
+        SceneRenderer::appendInstanceAttributes(attributes, objectBuffer, 0, sizeof(GpuObject));
+        layout = device.createVertexLayout(&attributes[0], (int)attributes.size(), indexBuffer);
+        return true;
+    }
+
+    // uploads the list's commands when they changed. With compareContents off only a change
+    // of size counts (scenes that never move); otherwise the commands are compared as well.
+    void setObjects(const DrawList& drawList, bool quadSubstitution, bool compareContents)
+    {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        stats.bytesUploaded = 0;
+        bool changed = drawList.size() != objectCount || quadSubstitution != quadsUploaded;
+        for (size_t i = 0; !changed && compareContents && i < drawList.size(); i++)
+        {
+            changed = objects[i].material != drawList[i].material ||
+                std::memcmp(&objects[i].model, &drawList[i].model, sizeof(glm::mat4)) != 0;
+        }
+        if (changed)
+        {
+            objects.resize(drawList.size());
+            for (size_t i = 0; i < drawList.size(); i++)
+            {
+                GpuObject& object = objects[i];
+                object.model = drawList[i].model;
+                object.material = drawList[i].material;
+                object.viewMask = 1;
+                object.drawIndex = (unsigned int)i;
+                object.mesh = (unsigned int)(quadSubstitution ? instanceMesh(drawList[i].model) : MESH_CUBE);
+                object.padding = 0;
+            }
+            objectCount = drawList.size();
+            quadsUploaded = quadSubstitution;
+            if (objectCount > capacity)
+            {
+                capacity = objectCount;
+                device.setBufferData(objectBuffer, capacity * sizeof(GpuObject), NULL);
+                device.setBufferData(commandBuffer, capacity * sizeof(DrawElementsIndirectCommand), NULL);
+            }
+            if (objectCount > 0)
+                device.updateBuffer(objectBuffer, 0, objectCount * sizeof(GpuObject), &objects[0]);
+            stats.bytesUploaded = objectCount * sizeof(GpuObject);
+        }
+        stats.objects = objectCount;
+        stats.cpuMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // writes this frame's draw commands; lodPixels 0 keeps every object in the frustum.
+    // pixelScale is the screen height in pixels / (2 tan(fov / 2)). Leaves the compute
+    // program bound.
+    void cull(const glm::mat4& viewProjection, const glm::vec3& eye, float lodPixels, float pixelScale)
+    {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        stats.countsRead = false;
+        stats.indirectCount = useIndirectCount;
+        if (objectCount == 0)
+            return;
+
+        GLStateCache& state = device.stateCache();
+        const unsigned int zeros[2] = { 0, 0 };
+        device.updateBuffer(counterBuffer, 0, sizeof(zeros), zeros);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, device.glObject(objectBuffer));
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, device.glObject(commandBuffer));
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, device.glObject(counterBuffer));
+
+        GLuint id = device.glObject(program);
+        state.useProgram(id);
+        int count = (int)objectCount;
+        int append = useIndirectCount ? 1 : 0;
+        state.uniform(state.uniformLocation(id, "objectCount"), GL_INT, 1, &count);
+        state.uniform(state.uniformLocation(id, "viewProjection"), GL_FLOAT_MAT4, 1, &viewProjection[0][0]);
+        state.uniform(state.uniformLocation(id, "appendCommands"), GL_INT, 1, &append);
+        state.uniform(state.uniformLocation(id, "lodPixels"), GL_FLOAT, 1, &lodPixels);
+        state.uniform(state.uniformLocation(id, "pixelScale"), GL_FLOAT, 1, &pixelScale);
+        state.uniform(state.uniformLocation(id, "eye"), GL_FLOAT_VEC3, 1, &eye[0]);
+
+        const GLExtensions& extensions = device.glExtensions();
+        extensions.dispatchCompute((GLuint)((objectCount + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE), 1, 1);
+        extensions.memoryBarrier(GL_COMMAND_BARRIER_BIT);
+        stats.cpuMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // draws the commands written by cull() with the program in use
+    void draw()
+    {
+        if (objectCount == 0)
+            return;
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        GLStateCache& state = device.stateCache();
+        const GLExtensions& extensions = device.glExtensions();
+        state.bindVertexArray(device.glObject(layout));
+        state.bindBuffer(GL_DRAW_INDIRECT_BUFFER, device.glObject(commandBuffer));
+        if (useIndirectCount)
+        {
+            state.bindBuffer(GL_PARAMETER_BUFFER, device.glObject(counterBuffer));
+            extensions.multiDrawElementsIndirectCount(GL_TRIANGLES, GL_UNSIGNED_INT, NULL, 0, (GLsizei)objectCount, 0);
+        }
+        else
+            extensions.multiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, NULL, (GLsizei)objectCount, 0);
+        stats.cpuMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // reads the visible and LOD counts of the last cull back; waits for the GPU
+    void readCounters()
+    {
+        if (objectCount == 0)
+            return;
+        unsigned int counters[2] = { 0, 0 };
+        device.glExtensions().memoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+        device.stateCache().bindBuffer(GL_COPY_WRITE_BUFFER, device.glObject(counterBuffer));
+        glGetBufferSubData(GL_COPY_WRITE_BUFFER, 0, sizeof(counters), counters);
+        stats.visible = counters[0];
+        stats.lodRejected = counters[1];
+        stats.countsRead = true;
+    }
+
+    void release()
+    {
+        if (layout != 0)
+            device.destroyVertexLayout(layout);
+        DeviceHandle buffers[] = { objectBuffer, commandBuffer, counterBuffer };
+        for (int i = 0; i < 3; i++)
+        {
+            if (buffers[i] != 0)
+                device.destroyBuffer(buffers[i]);
+        }
+        if (program != 0)
+            device.destroyProgram(program);
+        layout = objectBuffer = commandBuffer = counterBuffer = 0;
+        program = 0;
+    }
+
+private:
+    GLRenderDevice& device;
+    DeviceHandle program;
+    DeviceHandle objectBuffer;
+    DeviceHandle commandBuffer;
+    DeviceHandle counterBuffer;
+    DeviceHandle layout;
+    size_t capacity;
+    size_t objectCount;
+    bool quadsUploaded = true;
+    bool useIndirectCount;
+    std::vector<GpuObject> objects;     // what the object buffer holds
+
+    static GLuint compileCompute(const char* path)
+    {
+        std::ifstream file(path);
+        if (!file)
+        {
+            std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ: " << path << std::endl;
+            return 0;
+        }
+        std::stringstream stream;
+        stream << file.rdbuf();
+        std::string code = stream.str();
+        const char* source = code.c_str();
+
+        GLint success;
+        char infoLog[1024];
+        GLuint shader = glCreateShader(GL_COMPUTE_SHADER);
+        glShaderSource(shader, 1, &source, NULL);
+        glCompileShader(shader);
+        glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+        if (!success)
+        {
+            glGetShaderInfoLog(shader, 1024, NULL, infoLog);
+            std::cout << "ERROR::SHADER_COMPILATION_ERROR of type: COMPUTE\n" << infoLog << "\n -- --------------------------------------------------- -- " << std::endl;
+            glDeleteShader(shader);
+            return 0;
+        }
+        GLuint id = glCreateProgram();
+        glAttachShader(id, shader);
+        glLinkProgram(id);
+        glDeleteShader(shader);
+        glGetProgramiv(id, GL_LINK_STATUS, &success);
+        if (!success)
+        {
+            glGetProgramInfoLog(id, 1024, NULL, infoLog);
+            std::cout << "ERROR::PROGRAM_LINKING_ERROR of type: PROGRAM\n" << infoLog << "\n -- --------------------------------------------------- -- " << std::endl;
+            glDeleteProgram(id);
+            return 0;
+        }
+        return id;
+    }
+};
+
+inline void printGpuCullingStats(const GpuCullingStats& stats)
+{
+    std::printf("gpu culling: %zu objects, ", stats.objects);
+    if (stats.countsRead)
+        std::printf("%zu visible, %zu dropped by LOD, ", stats.visible, stats.lodRejected);
+    std::printf("%s  uploaded %zu bytes  cpu ms: %.3f\n", stats.indirectCount ? "draw count from the GPU" : "one slot per object",
+        stats.bytesUploaded, stats.cpuMs);
+}
+
+#endif
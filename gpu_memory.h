@@ -0,0 +1,264 @@
+//
+//  gpu_memory.h
+//  3D Object Drawing
+//
+
+#ifndef GPU_MEMORY_H
+#define GPU_MEMORY_H
+
+#include <string>
+#include <unordered_map>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+
+// what an allocation is for; every buffer and texture the application creates has one
+enum MemoryCategory
+{
+    MEMORY_GEOMETRY,        // vertex and index buffers of the meshes
+    MEMORY_INSTANCES,       // per-instance data, object records and indirect commands
+    MEMORY_SHADING,         // materials, lights, light clusters and baked light
+    MEMORY_TARGETS,         // render targets
+    MEMORY_STAGING,         // read back and counters
+    MEMORY_CATEGORY_COUNT
+};
+
+enum GpuResourceType
+{
+    GPU_BUFFER,
+    GPU_TEXTURE
+};
+
+inline const char* memoryCategoryName(MemoryCategory category)
+{
+    static const char* names[] = { "geometry", "instances", "shading", "targets", "staging" };
+    return names[category];
+}
+
+// "instances" -> MEMORY_INSTANCES; MEMORY_CATEGORY_COUNT if there is no such category
+inline MemoryCategory parseMemoryCategory(const std::string& name)
+{
+    for (int c = 0; c < MEMORY_CATEGORY_COUNT; c++)
+    {
+        if (name == memoryCategoryName((MemoryCategory)c))
+            return (MemoryCategory)c;
+    }
+    return MEMORY_CATEGORY_COUNT;
+}
+
+struct MemoryCategoryStats
+{
+    size_t allocations = 0;     // live
+    size_t liveBytes = 0;
+    size_t peakBytes = 0;
+    size_t budgetBytes = 0;     // 0: no budget
+    size_t overBudget = 0;      // allocations and resizes that took it over the budget
+};
+
+struct GpuMemoryStats
+{
+    MemoryCategoryStats categories[MEMORY_CATEGORY_COUNT];
+    size_t liveBytes = 0;
+    size_t peakBytes = 0;
+};
+
+// Sizes of the buffers and textures alive on the GPU, by category, as the code that
+// creates them declares them (the driver's own padding and the window's framebuffer are
+// not seen). The render device reports its buffers, the render graph its targets and the
+// frame capture its pixel buffers. A category may have a budget: going over it prints a
+// warning the first time, and overBudgetBytes() tells the owners of evictable memory (the
+// world streamer) how much to give back.
+class GpuMemoryTracker
+{
+public:
+    GpuMemoryStats stats;
+
+    GpuMemoryTracker()
+    {
+        for (int c = 0; c < MEMORY_CATEGORY_COUNT; c++)
+            warned[c] = false;
+    }
+
+    void setBudget(MemoryCategory category, size_t bytes)
+    {
+        stats.categories[category].budgetBytes = bytes;
+    }
+
+    void allocate(GpuResourceType type, unsigned int name, MemoryCategory category, size_t bytes)
+    {
+        release(type, name);
+        Allocation& allocation = allocations[key(type, name)];
+        allocation.category = category;
+        allocation.bytes = 0;
+        stats.categories[category].allocations++;
+        grow(allocation, bytes);
+    }
+
+    // the store of a buffer was replaced
+    void resize(GpuResourceType type, unsigned int name, size_t bytes)
+    {
+        std::unordered_map<unsigned long long, Allocation>::iterator found = allocations.find(key(type, name));
+        if (found == allocations.end())
+            return;
+        Allocation& allocation = found->second;
+        if (bytes >= allocation.bytes)
+            grow(allocation, bytes);
+        else
+            shrink(allocation, allocation.bytes - bytes);
+    }
+
+    void release(GpuResourceType type, unsigned int name)
+    {
+        std::unordered_map<unsigned long long, Allocation>::iterator found = allocations.find(key(type, name));
+        if (found == allocations.end())
+            return;
+        shrink(found->second, found->second.bytes);
+        stats.categories[found->second.category].allocations--;
+        allocations.erase(found);
+    }
+
+    // how far the category is over its budget; 0 without a budget
+    size_t overBudgetBytes(MemoryCategory category) const
+    {
+        const MemoryCategoryStats& c = stats.categories[category];
+        return c.budgetBytes > 0 && c.liveBytes > c.budgetBytes ? c.liveBytes - c.budgetBytes : 0;
+    }
+
+private:
+    struct Allocation
+    {
+        MemoryCategory category;
+        size_t bytes;
+    };
+
+    std::unordered_map<unsigned long long, Allocation> allocations;
+    bool warned[MEMORY_CATEGORY_COUNT];
+
+    // buffer and texture names are separate name spaces
+    static unsigned long long key(GpuResourceType type, unsigned int name)
+    {
+        return ((unsigned long long)type << 32) | name;
+    }
+
+    void grow(Allocation& allocation, size_t bytes)
+    {
+        MemoryCategoryStats& category = stats.categories[allocation.category];
+        size_t added = bytes - allocation.bytes;
+        allocation.bytes = bytes;
+        category.liveBytes += added;
+        category.peakBytes = std::max(category.peakBytes, category.liveBytes);
+        stats.liveBytes += added;
+        stats.peakBytes = std::max(stats.peakBytes, stats.liveBytes);
+
+        if (category.budgetBytes == 0 || category.liveBytes <= category.budgetBytes || added == 0)
+            return;
+        category.overBudget++;
+        if (!warned[allocation.category])
+        {
+            std::cout << "WARNING::GPU_MEMORY::OVER_BUDGET: " << memoryCategoryName(allocation.category) << " uses "
+                      << category.liveBytes / 1024 << " KB of a " << category.budgetBytes / 1024 << " KB budget" << std::endl;
+            warned[allocation.category] = true;
+        }
+    }
+
+    void shrink(Allocation& allocation, size_t bytes)
+    {
+        MemoryCategoryStats& category = stats.categories[allocation.category];
+        allocation.bytes -= bytes;
+        category.liveBytes -= bytes;
+        stats.liveBytes -= bytes;
+        // warn again the next time it goes over
+        if (category.liveBytes <= category.budgetBytes)
+            warned[allocation.category] = false;
+    }
+};
+
+// --gpu-budget CATEGORY=MB
+inline bool parseMemoryBudget(const std::string& text, MemoryCategory& category, size_t& bytes)
+{
+    size_t equals = text.find('=');
+    if (equals == std::string::npos)
+        return false;
+    category = parseMemoryCategory(text.substr(0, equals));
+    double megabytes = std::atof(text.c_str() + equals + 1);
+    if (category == MEMORY_CATEGORY_COUNT || megabytes <= 0.0)
+        return false;
+    bytes = (size_t)(megabytes * 1024.0 * 1024.0);
+    return true;
+}
+
+// command line switches of the GPU memory report
+struct GpuMemoryOptions
+{
+    bool report = false;                            // --gpu-memory    print the GPU memory by category at exit
+    size_t budgets[MEMORY_CATEGORY_COUNT] = {};     // --gpu-budget CATEGORY=MB  (repeatable) 0: no budget
+
+    // false if arg is not one of the switches above
+    bool parseArgs(const std::string& arg, int argc, char** argv, int& i)
+    {
+        MemoryCategory category;
+        size_t bytes;
+        if (arg == "--gpu-memory")
+            report = true;
+        else if (arg == "--gpu-budget" && i + 1 < argc && parseMemoryBudget(argv[i + 1], category, bytes))
+        {
+            budgets[category] = bytes;
+            i++;
+        }
+        else
+            return false;
+        return true;
+    }
+
+    bool budgeted() const
+    {
+        for (int c = 0; c < MEMORY_CATEGORY_COUNT; c++)
+        {
+            if (budgets[c] > 0)
+                return true;
+        }
+        return false;
+    }
+
+    void setBudgets(GpuMemoryTracker& tracker) const
+    {
+        for (int c = 0; c < MEMORY_CATEGORY_COUNT; c++)
+        {
+            if (budgets[c] > 0)
+                tracker.setBudget((MemoryCategory)c, budgets[c]);
+        }
+    }
+
+    static void printUsage()
+    {
+        std::cout << "  --gpu-memory     print the GPU memory of every category, largest first, at exit (F3 prints it too)\n"
+                  << "  --gpu-budget CATEGORY=MB  warn when geometry|instances|shading|targets|staging goes over MB; repeatable\n";
+    }
+};
+
+// the categories of one device's memory, largest first
+inline void printGpuMemoryReport(const std::string& device, const GpuMemoryStats& stats)
+{
+    int order[MEMORY_CATEGORY_COUNT];
+    for (int c = 0; c < MEMORY_CATEGORY_COUNT; c++)
+        order[c] = c;
+    std::stable_sort(order, order + MEMORY_CATEGORY_COUNT, [&](int a, int b)
+    {
+        return stats.categories[a].liveBytes > stats.categories[b].liveBytes;
+    });
+
+    std::printf("gpu memory on %s: %.1f KB live, peak %.1f KB\n", device.c_str(), stats.liveBytes / 1024.0, stats.peakBytes / 1024.0);
+    for (int i = 0; i < MEMORY_CATEGORY_COUNT; i++)
+    {
+        const MemoryCategoryStats& category = stats.categories[order[i]];
+        std::printf("  %-10s %10.1f KB in %4zu  peak %10.1f KB", memoryCategoryName((MemoryCategory)order[i]),
+            category.liveBytes / 1024.0, category.allocations, category.peakBytes / 1024.0);
+        if (category.budgetBytes > 0)
+            std::printf("  budget %.1f KB (%.0f%%), went over %zu times", category.budgetBytes / 1024.0,
+                100.0 * category.liveBytes / category.budgetBytes, category.overBudget);
+        std::printf("\n");
+    }
+}
+
+#endif
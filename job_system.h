@@ -0,0 +1,150 @@
+//
+//  job_system.h
+//  3D Object Drawing
+//
+
+#ifndef JOB_SYSTEM_H
+#define JOB_SYSTEM_H
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+// Non-owning reference to a callable, like a std::function that never copies or allocates.
+// Only for passing a lambda down a call that finishes before the lambda goes out of scope.
+template<class Signature>
+class FunctionRef;
+
+template<class R, class... Args>
+class FunctionRef<R(Args...)>
+{
+public:
+    template<class F>
+    FunctionRef(const F& function) : object(&function), trampoline(&call<F>)
+    {
+    }
+
+    R operator()(Args... args) const
+    {
+        return trampoline(object, args...);
+    }
+
+private:
+    const void* object;
+    R (*trampoline)(const void*, Args...);
+
+    template<class F>
+    static R call(const void* function, Args... args)
+    {
+        return (*(const F*)function)(args...);
+    }
+};
+
+// A fixed set of worker threads that run one parallel loop at a time. The calling
+// thread takes part in the loop, so a JobSystem with 1 thread runs everything inline.
+class JobSystem
+{
+public:
+    // threads <= 0 picks one per hardware thread
+    explicit JobSystem(int threads = 0) : generation(0), pending(0), running(true)
+    {
+        if (threads <= 0)
+            threads = (int)std::thread::hardware_concurrency();
+        if (threads <= 0)
+            threads = 1;
+        for (int i = 1; i < threads; i++)
+            workers.push_back(std::thread(&JobSystem::workerLoop, this, i));
+    }
+
+    ~JobSystem()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            running = false;
+        }
+        wake.notify_all();
+        for (size_t i = 0; i < workers.size(); i++)
+            workers[i].join();
+    }
+
+    int threadCount() const
+    {
+        return (int)workers.size() + 1;
+    }
+
+    // calls job(worker, begin, end) once per thread with contiguous slices of [0, count)
+    // and returns when every slice is finished; worker is 0..threadCount()-1
+    void parallelFor(size_t count, FunctionRef<void(int, size_t, size_t)> job)
+    {
+        int threads = threadCount();
+        if (threads == 1 || count < 2)
+        {
+            job(0, 0, count);
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            currentJob = &job;
+            currentCount = count;
+            pending = threads - 1;
+            generation++;
+        }
+        wake.notify_all();
+        runSlice(0, job, count);
+
+        std::unique_lock<std::mutex> lock(mutex);
+        finished.wait(lock, [this] { return pending == 0; });
+        currentJob = NULL;
+    }
+
+private:
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable finished;
+    const FunctionRef<void(int, size_t, size_t)>* currentJob = NULL;
+    size_t currentCount = 0;
+    unsigned int generation;
+    int pending;
+    bool running;
+
+    JobSystem(const JobSystem&);
+    JobSystem& operator=(const JobSystem&);
+
+    void runSlice(int worker, const FunctionRef<void(int, size_t, size_t)>& job, size_t count)
+    {
+        size_t threads = (size_t)threadCount();
+        size_t begin = count * worker / threads;
+        size_t end = count * (worker + 1) / threads;
+        if (begin < end)
+            job(worker, begin, end);
+    }
+
+    void workerLoop(int worker)
+    {
+        unsigned int seen = 0;
+        for (;;)
+        {
+            const FunctionRef<void(int, size_t, size_t)>* job;
+            size_t count;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [this, seen] { return !running || generation != seen; });
+                if (!running)
+                    return;
+                seen = generation;
+                job = currentJob;
+                count = currentCount;
+            }
+            runSlice(worker, *job, count);
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                pending--;
+            }
+            finished.notify_one();
+        }
+    }
+};
+
+#endif
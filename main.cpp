@@ -12,41 +12,127 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
-#include "shader.h"
 #include "camera.h"
 #include "basic_camera.h"
+#include "draw_list.h"
+#include "render_device.h"
+#include "gl_render_device.h"
+#include "command_recorder.h"
+#include "multi_view.h"
+#include "scene_renderer.h"
+#include "app_options.h"
+#include "restaurant_generator.h"
+#include "scale_benchmark.h"
+#include "job_system.h"
+#include "clustered_lighting.h"
+#include "static_scene.h"
+#include "baked_lighting.h"
+#include "software_rasterizer.h"
+#include "frame_pacer.h"
+#include "parallel_recorder.h"
+#include "frame_capture.h"
+#include "frame_arena.h"
+#include "redundant_draws.h"
+#include "overdraw.h"
+#include "dynamic_resolution.h"
+#include "world_streaming.h"
+#include "portal_visibility.h"
+#include "gpu_culling.h"
+#include "render_graph.h"
+#include "shader_variants.h"
+#include "simulation.h"
+#include "animation.h"
 
 #include <iostream>
+#include <chrono>
+#include <atomic>
+#include <cstdlib>
+#include <new>
 
 using namespace std;
 
+// every general heap allocation in the program goes through here, so that --count-allocs
+// can check that the frame loop does not allocate; without it nothing is counted. The flag
+// is set once, before any other thread starts.
+bool countingAllocations = false;
+std::atomic<size_t> heapAllocations(0);
+
+void* operator new(std::size_t size)
+{
+    if (countingAllocations)
+        heapAllocations.fetch_add(1, std::memory_order_relaxed);
+    void* memory = std::malloc(size > 0 ? size : 1);
+    if (memory == NULL)
+        throw std::bad_alloc();
+    return memory;
+}
+
+void* operator new[](std::size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void* memory) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete(void* memory, std::size_t) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete[](void* memory) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete[](void* memory, std::size_t) noexcept
+{
+    std::free(memory);
+}
+
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 void mouse_callback(GLFWwindow* window, double xpos, double ypos);
-void makeT(unsigned int VAO, Shader ourShader, glm::mat4 sm, float a, float b, float c, float d);
+void makeT(DrawList& drawList, glm::mat4 sm, float a, float b, float c, float d);
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
+void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods);
 void processInput(GLFWwindow* window);
-void drawTable(unsigned int VAO, Shader ourShader, glm::mat4 sm);
-void drawCHair(unsigned int VAO, Shader ourShader, glm::mat4 sm);
-void drawTiles(unsigned int VAO, Shader ourShader, glm::mat4 sm);
-void makeTool(unsigned int VAO, Shader ourShader, glm::mat4 sm);
+void drawTable(DrawList& drawList, glm::mat4 sm);
+void drawCHair(DrawList& drawList, glm::mat4 sm);
+void drawTiles(DrawList& drawList, glm::mat4 sm);
+void makeTool(DrawList& drawList, glm::mat4 sm);
+// the hand built restaurant is recorded in parts that share no state, so worker threads
+// can record them at the same time; the parts' order is the order of their draws
+enum ScenePart
+{
+    SCENE_FLOOR,
+    SCENE_FURNITURE,
+    SCENE_WALLS,
+    SCENE_STOOLS,
+    SCENE_PART_COUNT
+};
+
+void buildScene(DrawList& drawList);
+void buildScenePart(DrawList& drawList, int part);
+void buildFloor(DrawList& drawList);
+void buildFurniture(DrawList& drawList);
+void buildWalls(DrawList& drawList);
+void buildStools(DrawList& drawList);
+void buildGeneratedScene(DrawList& drawList, const GeneratedScene& scene);
+void buildGeneratedRange(DrawList& drawList, const GeneratedScene& scene, size_t begin, size_t end);
+void buildAnimatedProps(AnimationSystem& animation, DrawList& drawList, const GeneratedScene* scene);
+void renderDrawList(SceneRenderer& sceneRenderer, RenderDevice& device, DeviceHandle depthProgram, DeviceHandle shadedProgram, const DrawList& drawList, bool depthPrepass, bool countOverdraw, const PortalVisibility* portals);
+void renderGpuCulled(SceneRenderer& sceneRenderer, GpuCulling& gpuCulling, RenderDevice& device, DeviceHandle depthProgram, DeviceHandle shadedProgram, const DrawList& drawList, const glm::mat4& viewProjection, const glm::vec3& eye, float lodPixels, float pixelScale, bool depthPrepass, bool countOverdraw);
+void renderWorld(SceneRenderer& sceneRenderer, WorldStreamer& streamer, RenderDevice& device, DeviceHandle depthProgram, DeviceHandle shadedProgram, const glm::mat4& viewProjection, bool depthPrepass, bool countOverdraw);
 // settings
 const unsigned int SCR_WIDTH = 800;
 const unsigned int SCR_HEIGHT = 600;
 
-// modelling transform
+// modelling transform, as drawn (set from the scene state below every frame)
 float rotateAngle_X = 0.0;
 float rotateAngle_Y = 90.0;
 float rotateAngle_Z = 0.0;
-float rotateAxis_X = 0.0;
-float rotateAxis_Y = 0.0;
-float rotateAxis_Z = 1.0;
-float translate_X = 0.0;
-float translate_Y = 0.0;
-float translate_Z = 0.0;
-float scale_X = 0.3;
-float scale_Y = 0.3;
-float scale_Z = 0.3;
-bool fanRotating = false;
 
 // camera
 Camera camera(glm::vec3(0.0f, 0.0f, 3.0f));
@@ -54,25 +140,217 @@ float lastX = SCR_WIDTH / 2.0f;
 float lastY = SCR_HEIGHT / 2.0f;
 bool firstMouse = true;
 
-float eyeX = 0.0, eyeY = 1.0, eyeZ = 3.0;
-float lookAtX = 0.0, lookAtY = 0.0, lookAtZ = 0.0;
 glm::vec3 V = glm::vec3(0.0f, 1.0f, 0.0f);
-BasicCamera basic_camera(eyeX, eyeY, eyeZ, lookAtX, lookAtY, lookAtZ, V);
+BasicCamera basic_camera(0.0, 1.0, 3.0, 0.0, 0.0, 0.0, V);
+
+// split screen surveillance views (F1 cycles 1..4, F2 toggles single pass layered rendering)
+int viewCount = 1;
+bool perViewPasses = false;
+
+// F3 prints the renderer statistics (instances, draw calls, materials) for the next frame
+bool printStats = false;
+
+// F4 toggles clustered lighting of the pendant lamps (single view only)
+bool lightingEnabled = false;
+
+// F5 toggles the offline baked light loaded with --baked (single view only, below clustered lighting)
+bool bakedEnabled = false;
+
+// every draw goes through this device (--device, --record); the resize callback needs it too
+RenderDevice* renderDevice = NULL;
 
 // timing
 float deltaTime = 0.0f;    // time between current frame and last frame
 float lastFrame = 0.0f;
 
-void fanSpinning()
+// What the held keys and the animation change: the look-at camera and the modelling
+// transform. processInput() steps it once a frame; with --sim-thread the simulation thread
+// steps its own copy at a fixed rate instead, and every frame draws a blend of its two
+// newest states.
+struct SceneState
+{
+    glm::vec3 eye, lookAt, up;
+    float rotateAngle_X, rotateAngle_Y, rotateAngle_Z;
+    float rotateAxis_X, rotateAxis_Y, rotateAxis_Z;
+    float translate_X, translate_Y, translate_Z;
+    float scale_X, scale_Y, scale_Z;
+    bool fanRotating;
+};
+
+SceneState sceneState = {
+    glm::vec3(0.0f, 1.0f, 3.0f), glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f),
+    0.0f, 90.0f, 0.0f,
+    0.0f, 0.0f, 1.0f,
+    0.0f, 0.0f, 0.0f,
+    0.3f, 0.3f, 0.3f,
+    false
+};
+
+// --sim-thread: the keys held at the last processInput(), one bit per key (see keyBit)
+bool simulationThreaded = false;
+std::atomic<unsigned long long> simulationKeys(0);
+
+// the keys the scene state reacts to; all of them lie between GLFW_KEY_0 and GLFW_KEY_Z
+const int SIMULATION_KEYS[] = {
+    GLFW_KEY_R, GLFW_KEY_G, GLFW_KEY_I, GLFW_KEY_K, GLFW_KEY_L, GLFW_KEY_J, GLFW_KEY_O, GLFW_KEY_P,
+    GLFW_KEY_C, GLFW_KEY_V, GLFW_KEY_B, GLFW_KEY_N, GLFW_KEY_M, GLFW_KEY_U, GLFW_KEY_X, GLFW_KEY_Y,
+    GLFW_KEY_Z, GLFW_KEY_H, GLFW_KEY_F, GLFW_KEY_T, GLFW_KEY_Q, GLFW_KEY_E, GLFW_KEY_1, GLFW_KEY_2,
+    GLFW_KEY_3, GLFW_KEY_4, GLFW_KEY_5, GLFW_KEY_6, GLFW_KEY_7, GLFW_KEY_8, GLFW_KEY_9
+};
+
+unsigned long long keyBit(int key)
+{
+    return 1ull << (key - GLFW_KEY_0);
+}
+
+bool keyHeld(unsigned long long keys, int key)
+{
+    return (keys & keyBit(key)) != 0;
+}
+
+void fanSpinning(SceneState& state, float dt)
+{
+    state.rotateAngle_Y += 45.0 * dt;
+    state.rotateAxis_X = 0.0;
+    state.rotateAxis_Y = 1.0;
+    state.rotateAxis_Z = 0.0;
+}
+
+// what is drawn: the transform and the look-at camera of a state
+void showSceneState(const SceneState& state)
+{
+    rotateAngle_X = state.rotateAngle_X;
+    rotateAngle_Y = state.rotateAngle_Y;
+    rotateAngle_Z = state.rotateAngle_Z;
+    basic_camera.eye = state.eye;
+    basic_camera.lookAt = state.lookAt;
+    basic_camera.V = state.up;
+}
+
+// the state a fraction t of the way from a to b; the switches are b's
+SceneState blendSceneStates(const SceneState& a, const SceneState& b, float t)
 {
-    rotateAngle_Y += 45.0 * deltaTime;
-    rotateAxis_X = 0.0;
-    rotateAxis_Y = 1.0;
-    rotateAxis_Z = 0.0;
+    SceneState state = b;
+    state.eye = glm::mix(a.eye, b.eye, t);
+    state.lookAt = glm::mix(a.lookAt, b.lookAt, t);
+    state.rotateAngle_X = glm::mix(a.rotateAngle_X, b.rotateAngle_X, t);
+    state.rotateAngle_Y = glm::mix(a.rotateAngle_Y, b.rotateAngle_Y, t);
+    state.rotateAngle_Z = glm::mix(a.rotateAngle_Z, b.rotateAngle_Z, t);
+    state.translate_X = glm::mix(a.translate_X, b.translate_X, t);
+    state.translate_Y = glm::mix(a.translate_Y, b.translate_Y, t);
+    state.translate_Z = glm::mix(a.translate_Z, b.translate_Z, t);
+    state.scale_X = glm::mix(a.scale_X, b.scale_X, t);
+    state.scale_Y = glm::mix(a.scale_Y, b.scale_Y, t);
+    state.scale_Z = glm::mix(a.scale_Z, b.scale_Z, t);
+    return state;
 }
 
-int main()
+void simulate(SceneState& state, unsigned long long keys, float dt);
+
+int main(int argc, char** argv)
 {
+    AppOptions options;
+    if (!parseOptions(argc, argv, options))
+        return 0;
+    countingAllocations = options.countAllocations;
+    viewCount = options.views;
+    perViewPasses = options.perViewPasses;
+    lightingEnabled = options.lights > 0 || options.benchLights;
+
+    // procedural restaurant: generated from the command line switches or loaded from a scene file
+    GeneratedScene generatedScene;
+    bool useGeneratedScene = options.scene.used() || options.benchScale;
+    if (!options.scene.init(generatedScene))
+        return -1;
+    // the Baker tool works on a snapshot of the static draws
+    if (!options.staticOut.empty())
+    {
+        DrawList staticList;
+        if (useGeneratedScene)
+            buildGeneratedScene(staticList, generatedScene);
+        else
+            buildScene(staticList);
+        if (!checkMaterials(staticList.materials))
+            return -1;
+        // the bake is indexed by draw, so it is made for the list the frame loop renders
+        if (!options.keepRedundantDraws)
+        {
+            RedundantDrawFilter staticFilter;
+            staticFilter.filter(staticList);
+        }
+        if (!writeStaticScene(options.staticOut, staticList))
+            return -1;
+        std::cout << staticList.size() << " static draws written to " << options.staticOut << std::endl;
+        return 0;
+    }
+    // a food court for world streaming: one static scene file per cell and an index
+    if (!options.world.buildPath.empty())
+    {
+        WorldConfig worldConfig = options.world.config;
+        worldConfig.seed = options.scene.generator.seed;
+        bool written = writeWorld(options.world.buildPath, worldConfig, [&](DrawList& list, const GeneratedScene& cell)
+        {
+            buildGeneratedScene(list, cell);
+            if (!options.keepRedundantDraws)
+            {
+                RedundantDrawFilter cellFilter;
+                cellFilter.filter(list);
+            }
+        });
+        return written ? 0 : -1;
+    }
+    if (!options.world.valid())
+        return -1;
+    // CPU rasteriser: needs neither a GPU nor a window, so it runs before glfw is touched
+    RasterBenchmark rasterBenchmark;
+    if (!options.softwareOut.empty() || options.benchSoftware)
+    {
+        DrawList softwareList;
+        if (useGeneratedScene)
+            buildGeneratedScene(softwareList, generatedScene);
+        else
+            buildScene(softwareList);
+        if (!checkMaterials(softwareList.materials))
+            return -1;
+        glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
+        glm::mat4 view = basic_camera.createViewMatrix();
+        if (!options.softwareOut.empty())
+        {
+            JobSystem softwareJobs(options.threads);
+            SoftwareRasterizer rasterizer(softwareJobs);
+            rasterizer.resize(SCR_WIDTH, SCR_HEIGHT);
+            rasterizer.render(softwareList, view, projection, glm::vec4(0.2f, 0.3f, 0.3f, 1.0f));
+            if (!rasterizer.writeImage(options.softwareOut))
+                return -1;
+            std::cout << rasterizer.stats.rasterized << " triangles on " << rasterizer.stats.threads << " threads in "
+                      << rasterizer.stats.totalMs << " ms, written to " << options.softwareOut << std::endl;
+        }
+        if (!options.benchSoftware)
+            return 0;
+        rasterBenchmark.runSoftware(softwareList, view, projection, SCR_WIDTH, SCR_HEIGHT, options.threads);
+    }
+
+    // parallel scene recording against one thread; no window needed either
+    if (options.benchRecord)
+    {
+        GeneratedScene benchScene = generatedScene;
+        if (!useGeneratedScene)
+            benchScene = RestaurantGenerator::generate(GeneratorConfig::forObjectCount(100000, options.scene.generator.seed));
+        RecordBenchmark::run(benchScene.objects.size(), [&](DrawList& list, size_t begin, size_t end)
+        {
+            buildGeneratedRange(list, benchScene, begin, end);
+        });
+        return 0;
+    }
+
+    ScaleBenchmark scaleBenchmark(options.scene.generator.seed, options.benchScaleCsv);
+    LightingBenchmark lightBenchmark;
+    JobSystem jobs(options.threads);
+    // transient per-frame data, one arena per worker, reset after every frame
+    FrameArenas frameArenas(jobs.threadCount());
+    ParallelRecorder sceneRecorder(jobs, frameArenas);
+    AllocationCheck allocationCheck;
+
     // glfw: initialize and configure
     // ------------------------------
     glfwInit();
@@ -97,6 +375,7 @@ int main()
     glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
     glfwSetCursorPosCallback(window, mouse_callback);
     glfwSetScrollCallback(window, scroll_callback);
+    glfwSetKeyCallback(window, key_callback);
 
     // tell GLFW to capture our mouse
     //glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
@@ -109,13 +388,177 @@ int main()
         return -1;
     }
 
-    // configure global opengl state
-    // -----------------------------
-    glEnable(GL_DEPTH_TEST);
+    // render device: OpenGL (which also sets the global state, e.g. depth testing), or the
+    // null device that swallows every command; --record tees the stream into a file
+    // -----------------------------------------------------------------------------------
+    GLRenderDevice glDevice;
+    glDevice.stateCache().setValidation(options.validateGL);
+    NullRenderDevice nullDevice;
+    RenderDevice* device = &glDevice;
+    if (options.device == "null")
+        device = &nullDevice;
+    RecordingRenderDevice recorder(*device);
+    if (!options.recordOut.empty())
+    {
+        if (!recorder.open(options.recordOut))
+        {
+            glfwTerminate();
+            return -1;
+        }
+        device = &recorder;
+    }
+    renderDevice = device;
+
+    // GPU memory by category: the device's buffers, plus the render targets and capture
+    // buffers made on the GL context (the same tracker unless the device is the null one)
+    options.gpuMemory.setBudgets(device->memory());
+    options.gpuMemory.setBudgets(glDevice.memory());
+    auto printGpuMemory = [&]()
+    {
+        printGpuMemoryReport(device->name(), device->memory().stats);
+        if (&device->memory() != &glDevice.memory())
+            printGpuMemoryReport(glDevice.name(), glDevice.memory().stats);
+    };
+
+    // frame pacing: swap interval, frame cap, input timing and latency measurement
+    FramePacer pacer(options.pacing);
+
+    // benchmarks measure the frame itself, not the display refresh
+    if (options.benchViews || options.benchScale || options.benchLights || options.benchSoftware || options.capture.benchmark || options.benchOverdraw || options.world.walk || !options.replayIn.empty())
+        glfwSwapInterval(0);
+    else
+        pacer.applyVsync();
+
+    // replay: the recorded frames are played back as fast as the device takes them
+    if (!options.replayIn.empty())
+    {
+        CommandReplay replay;
+        if (!replay.load(options.replayIn))
+        {
+            glfwTerminate();
+            return -1;
+        }
+        std::chrono::steady_clock::time_point replayStart = std::chrono::steady_clock::now();
+        while (!glfwWindowShouldClose(window) && replay.playFrame(*device))
+        {
+            glfwSwapBuffers(window);
+            glfwPollEvents();
+        }
+        double replayMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - replayStart).count();
+        std::cout << "replayed " << replay.playedFrames() << " frames on " << device->name() << " in " << replayMs << " ms ("
+                  << (replay.playedFrames() > 0 ? replayMs / replay.playedFrames() : 0.0) << " ms per frame)" << std::endl;
+        glDevice.release();
+        glfwTerminate();
+        return 0;
+    }
+
+    // frame capture reads the GL back buffer, so it needs the GL device
+    FrameCapture capture(glDevice.memory());
+    CaptureBenchmark captureBenchmark;
+    if (!capture.init(options.capture, options.device == "gl", options.pacing.fpsCap > 0.0 ? options.pacing.fpsCap : 60.0))
+    {
+        glfwTerminate();
+        return -1;
+    }
+    CaptureMode captureMode = capture.capturing() ? CAPTURE_ASYNC : CAPTURE_OFF;
+
+    // overdraw is counted in the GL framebuffer, so it needs the GL device as well
+    OverdrawMeter overdrawMeter;
+    OverdrawBenchmark overdrawBenchmark;
+    if ((options.overdraw || options.benchOverdraw) && options.device != "gl")
+    {
+        std::cout << "ERROR::OVERDRAW::NEEDS_GL: overdraw is read from the OpenGL framebuffer, use --device gl" << std::endl;
+        glfwTerminate();
+        return -1;
+    }
+
+    // dynamic resolution renders into its own framebuffer object, which the device and the
+    // command stream know nothing about
+    DynamicResolution dynamicResolution(glDevice, options.resolution);
+    bool dynamicResolutionEnabled = dynamicResolution.enabled();
+    if (!dynamicResolution.init(options.directGL()))
+    {
+        glfwTerminate();
+        return -1;
+    }
+
+    BakedLighting bakedLighting(*device);
+    if (!options.bakedIn.empty())
+    {
+        if (!bakedLighting.load(options.bakedIn))
+        {
+            glfwTerminate();
+            return -1;
+        }
+        bakedEnabled = true;
+    }
 
     // build and compile our shader zprogram
     // ------------------------------------
-    Shader ourShader("vertexShader.vs", "fragmentShader.fs");
+    DeviceHandle ourShader = device->createProgram("vertexShader.vs", "fragmentShader.fs");
+
+    // optional multi-view path: one instanced pass routed to viewports by gl_ViewportIndex
+    DeviceHandle multiViewShader = device->supportsLayeredViews() ? device->createProgram("multiViewVertexShader.vs", "fragmentShader.fs") : 0;
+    SceneRenderer::bindMaterials(*device, ourShader);
+    if (multiViewShader != 0)
+        SceneRenderer::bindMaterials(*device, multiViewShader);
+    ClusteredLighting::bindSamplers(*device, ourShader);
+    BakedLighting::bindSampler(*device, ourShader);
+
+    // the single view draws with variants of the same shaders specialised on what is switched
+    // on; every one this run can ask for is compiled here, so none is compiled mid-frame
+    ShaderVariants shaderVariants(*device, "vertexShader.vs", "fragmentShader.fs");
+    bool useShaderVariants = !options.noShaderVariants;
+    unsigned int lightingVariant = 0, bakedVariant = 0, depthOnlyVariant = 0, overdrawVariant = 0;
+    if (useShaderVariants)
+    {
+        useShaderVariants = shaderVariants.load([&](DeviceHandle program)
+        {
+            SceneRenderer::bindMaterials(*device, program);
+            ClusteredLighting::bindSamplers(*device, program);
+            BakedLighting::bindSampler(*device, program);
+        });
+    }
+    if (useShaderVariants)
+    {
+        lightingVariant = shaderVariants.feature("CLUSTERED_LIGHTING");
+        bakedVariant = shaderVariants.feature("BAKED_LIGHTING");
+        depthOnlyVariant = shaderVariants.feature("DEPTH_ONLY");
+        overdrawVariant = shaderVariants.feature("OVERDRAW");
+        // F4 and F5 toggle the lighting, so both sides of each are kept ready
+        std::vector<unsigned int> keys;
+        keys.push_back(0);
+        keys.push_back(lightingVariant);
+        if (bakedLighting.loaded())
+        {
+            keys.push_back(bakedVariant);
+            keys.push_back(lightingVariant | bakedVariant);
+        }
+        if (options.depthPrepass || options.benchOverdraw)
+            keys.push_back(depthOnlyVariant);
+        if (options.overdraw || options.benchOverdraw)
+            keys.push_back(overdrawVariant);
+        shaderVariants.precompile(keys);
+    }
+    ClusteredLighting lighting(jobs, *device, frameArenas);
+    lighting.init();
+    int placedLights = 0;   // lamps are hung once the scene bounds are known
+    SceneRenderer sceneRenderer(*device);
+    MultiViewRenderer multiViewRenderer(sceneRenderer, *device, ourShader, multiViewShader);
+    MultiViewBenchmark viewBenchmark;
+    std::vector<ViewDesc> views;    // rebuilt only when the view count changes
+    DrawList drawList;
+    drawList.trackSources = options.listRedundantDraws;
+    RedundantDrawFilter redundantDrawFilter;
+    std::vector<RedundantDraw> redundantDraws;
+    bool listRedundantDraws = options.listRedundantDraws;
+
+    // --animate: the props are drawn after the scene, in the same draw list
+    AnimationSystem animation;
+    if (options.animate && !options.world.path.empty())
+        std::cout << "WARNING::ANIMATION::WORLD: --animate adds props to the restaurant, not to a streamed world" << std::endl;
+    else if (options.animate)
+        buildAnimatedProps(animation, drawList, useGeneratedScene ? &generatedScene : NULL);
 
     // set up vertex data (and buffer(s)) and configure vertex attributes
     // ------------------------------------------------------------------
@@ -264,601 +707,1278 @@ int main()
         glm::vec3(1.5f,  0.2f, -1.5f),
         glm::vec3(-1.3f,  1.0f, -1.5f)
     };*/
-    unsigned int VBO, VAO, EBO;
-    glGenVertexArrays(1, &VAO);
-    glGenBuffers(1, &VBO);
-    glGenBuffers(1, &EBO);
+    DeviceHandle VBO = device->createBuffer(VERTEX_BUFFER, sizeof(cube_vertices), cube_vertices, STATIC_BUFFER, MEMORY_GEOMETRY);
+    DeviceHandle EBO = device->createBuffer(INDEX_BUFFER, sizeof(cube_indices), cube_indices, STATIC_BUFFER, MEMORY_GEOMETRY);
+
+    VertexAttribute cubeAttributes[] = {
+        // position attribute
+        { VBO, 0, 3, ATTRIBUTE_FLOAT, 6 * sizeof(float), 0, 0 },
+        //color attribute
+        { VBO, 1, 3, ATTRIBUTE_FLOAT, 6 * sizeof(float), 12, 0 }
+    };
 
-    glBindVertexArray(VAO);
+    // per-instance model matrix and material index for the instanced scene draw
+    sceneRenderer.init(cubeAttributes, 2, EBO);
+    sceneRenderer.setQuadSubstitution(!options.noQuads);
+
+    // --world: the cells around the camera are loaded on I/O threads and drawn from their own
+    // instance buffers instead of the frame's draw list
+    WorldStreamer worldStreamer(*device, options.world.streaming);
+    bool worldEnabled = !options.world.path.empty();
+    if (worldEnabled && !worldStreamer.open(options.world.path, cubeAttributes, 2, EBO))
+    {
+        glfwTerminate();
+        return -1;
+    }
+    // --portals: the generated scene's rooms are the cells, its doorways the portals
+    PortalVisibility portalVisibility;
+    if (options.portals.enabled)
+        portalVisibility.init(generatedScene);
+    // --gpu-cull: a compute shader culls the draw list and writes the indirect draw commands
+    GpuCulling gpuCulling(glDevice);
+    if (!gpuCulling.init(options.gpuCulling, options.directGL(), cubeAttributes, 2, EBO))
+    {
+        glfwTerminate();
+        return -1;
+    }
+    if (options.gpuCulling.enabled && options.portals.enabled)
+        std::cout << "WARNING::GPU_CULLING::PORTALS_IGNORED: --gpu-cull culls every object against the frustum, --portals is not used" << std::endl;
 
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(cube_vertices), cube_vertices, GL_STATIC_DRAW);
+    // the scripted walk takes fixed steps of a 60 Hz frame, so every run sees the same frames
+    WorldWalk worldWalk(worldStreamer.index().layout, options.world.walkSpeed / 60.0f);
+    WalkReport walkReport;
 
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(cube_indices), cube_indices, GL_STATIC_DRAW);
 
-    // position attribute
-   // glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
-    //glEnableVertexAttribArray(0);
+    //glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
 
-    // position attribute
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
 
-    //color attribute
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)12);
-    glEnableVertexAttribArray(1);
 
+    //ourShader.use();
 
-    //glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+    // the frame's passes: the scene (drawn in the loop), the overdraw read back, the upscale
+    // of the dynamic resolution target and the capture. They are declared again only when
+    // the window size or a mode changes; the passes nobody wants the results of are culled.
+    RenderGraph frameGraph(glDevice.memory());
+    GraphPass scenePass = NO_GRAPH_PASS;
+    int framebufferWidth = 0, framebufferHeight = 0, sceneWidth = 0, sceneHeight = 0;
+    int graphWidth = 0, graphHeight = 0, graphModes = -1;
+    auto declareFrameGraph = [&](bool countOverdraw, bool capturing)
+    {
+        frameGraph.reset();
+        GraphResource backbuffer = frameGraph.importBackbuffer("backbuffer");
+        frameGraph.markOutput(backbuffer);
+        GraphResource color = backbuffer, depth = backbuffer;
+        if (dynamicResolutionEnabled)
+        {
+            GraphTextureDesc colorDesc = { framebufferWidth, framebufferHeight, GRAPH_RGBA8 };
+            GraphTextureDesc depthDesc = { framebufferWidth, framebufferHeight, GRAPH_DEPTH24 };
+            color = frameGraph.createTexture("scene color", colorDesc);
+            depth = frameGraph.createTexture("scene depth", depthDesc);
+        }
 
+        scenePass = frameGraph.addPass("scene", std::function<void()>());
+        frameGraph.write(scenePass, color);
+        frameGraph.write(scenePass, depth);
 
+        GraphPass overdrawPass = frameGraph.addPass("overdraw", [&]() { overdrawMeter.measure(sceneWidth, sceneHeight); });
+        frameGraph.read(overdrawPass, color);
+        if (countOverdraw)
+            frameGraph.setSideEffect(overdrawPass);
 
-    //ourShader.use();
+        if (dynamicResolutionEnabled)
+        {
+            GraphPass upscalePass = frameGraph.addPass("upscale", [&, color]()
+            {
+                const GraphTextureDesc& target = frameGraph.desc(color);
+                dynamicResolution.upscale(frameGraph.texture(color), target.width, target.height, framebufferWidth, framebufferHeight);
+            });
+            frameGraph.read(upscalePass, color);
+            frameGraph.write(upscalePass, backbuffer);
+        }
+
+        GraphPass capturePass = frameGraph.addPass("capture", [&]() { capture.captureFrame(captureMode, framebufferWidth, framebufferHeight); });
+        frameGraph.read(capturePass, backbuffer);
+        if (capturing)
+            frameGraph.setSideEffect(capturePass);
+
+        frameGraph.compile();
+        if (options.dumpGraph)
+            frameGraph.dump();
+    };
+
+    // --sim-thread: the held keys and the animation step on their own thread at a fixed rate
+    SimulationThread<SceneState> simulation(options.simulation.rate);
+    if (options.simulation.threaded && options.world.walk)
+        std::cout << "WARNING::SIMULATION::WALK: --walk moves the camera every frame, so the simulation stays on the render thread" << std::endl;
+    else if (options.simulation.threaded)
+    {
+        simulationThreaded = true;
+        simulation.start(sceneState, [](SceneState& state, float dt)
+        {
+            simulate(state, simulationKeys.load(std::memory_order_relaxed), dt);
+        });
+    }
 
     // render loop
     // -----------
+    int exitCode = 0;
     while (!glfwWindowShouldClose(window))
     {
         // per-frame time logic
         // --------------------
+        size_t frameAllocations = heapAllocations.load(std::memory_order_relaxed);
         float currentFrame = static_cast<float>(glfwGetTime());
         deltaTime = currentFrame - lastFrame;
         lastFrame = currentFrame;
 
-        // input
+        // input (with --late-input it is read after the scene traversal instead)
         // -----
-        processInput(window);
+        if (!pacer.lateInput())
+        {
+            pacer.waitForFrame();
+            processInput(window);
+            pacer.inputSampled();
+        }
 
-        // render
-        // ------
-        glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        // --bench-overdraw: the same frames without and with the depth pre-pass
+        bool depthPrepass = options.depthPrepass;
+        bool countOverdraw = options.overdraw;
+        if (options.benchOverdraw)
+        {
+            if (overdrawBenchmark.done())
+            {
+                overdrawBenchmark.print();
+                break;
+            }
+            overdrawBenchmark.record(deltaTime * 1000.0, overdrawMeter.stats);
+            depthPrepass = overdrawBenchmark.depthPrepass();
+            countOverdraw = overdrawBenchmark.countingFrame();
+        }
 
+        // --bench-capture: the same frames without capture, with glReadPixels, then with the PBO ring
+        if (options.capture.benchmark)
+        {
+            if (captureBenchmark.done())
+            {
+                captureBenchmark.print();
+                break;
+            }
+            captureBenchmark.record(deltaTime * 1000.0, capture.stats);
+            captureMode = captureBenchmark.mode();
+        }
 
-        // activate shader
-        ourShader.use();
+        // both apply to the single camera view; overdraw is counted on black
+        bool singleView = worldEnabled || (!options.benchViews && viewCount == 1);
+        countOverdraw = countOverdraw && singleView;
 
-        // pass projection matrix to shader (note that in this case it could change every frame)
-        glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
-        //glm::mat4 projection = glm::ortho(-2.0f, +2.0f, -1.5f, +1.5f, 0.1f, 100.0f);
-        ourShader.setMat4("projection", projection);
+        // with dynamic resolution the scene goes to an offscreen target of sceneWidth x sceneHeight
+        glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+        int modes = (countOverdraw ? 1 : 0) | (captureMode != CAPTURE_OFF ? 2 : 0);
+        if (framebufferWidth != graphWidth || framebufferHeight != graphHeight || modes != graphModes)
+        {
+            declareFrameGraph(countOverdraw, captureMode != CAPTURE_OFF);
+            graphWidth = framebufferWidth;
+            graphHeight = framebufferHeight;
+            graphModes = modes;
+        }
+        frameGraph.beginFrame();
+        frameGraph.execute(scenePass);
+        sceneWidth = framebufferWidth;
+        sceneHeight = framebufferHeight;
+        if (dynamicResolutionEnabled)
+            dynamicResolution.beginScene(framebufferWidth, framebufferHeight, sceneWidth, sceneHeight);
 
-        // camera/view transformation
-        //glm::mat4 view = camera.GetViewMatrix();
-        glm::mat4 view = basic_camera.createViewMatrix();
-        ourShader.setMat4("view", view);
+        // render
+        // ------
+        device->clear(countOverdraw ? glm::vec4(0.0f, 0.0f, 0.0f, 1.0f) : glm::vec4(0.2f, 0.3f, 0.3f, 1.0f));
 
-        // Modelling Transformation
-        glm::mat4 identityMatrix = glm::mat4(1.0f); // make sure to initialize matrix to identity matrix first
-        glm::mat4 translateMatrix, rotateXMatrix, rotateYMatrix, rotateZMatrix, scaleMatrix, model;
-        float a = 0.0f, b = 0.0f, c = 0.0f, d = 1.0f;
-          
-        translateMatrix = glm::translate(identityMatrix, glm::vec3(0.0f, 0.0f, 0.2f));
-        makeT(VAO, ourShader, translateMatrix, a, b, c, d);
 
-        for (int i = 0; i < 10; i++)
+        // the newest two states of the simulation thread, blended to the present
+        if (simulationThreaded)
         {
-            translateMatrix = translateMatrix * glm::translate(identityMatrix, glm::vec3(0.0f, 0.0f, -0.4f));
-            makeT(VAO, ourShader, translateMatrix, a, b, c, d);
+            float blend;
+            const SimulationSnapshot<SceneState>& snapshot = simulation.latest(blend);
+            showSceneState(blendSceneStates(snapshot.previous, snapshot.current, blend));
         }
 
-        translateMatrix = glm::translate(identityMatrix, glm::vec3(.4f, 0.0f, 0.2f));
-        makeT(VAO, ourShader, translateMatrix, a, b, c, d);
-
-        for (int i = 0; i < 10; i++)
+        // traverse the scene once into this frame's draw list
+        // ------------------------------------------------------
+        if (options.benchScale)
         {
-            translateMatrix = translateMatrix * glm::translate(identityMatrix, glm::vec3(0.0f, 0.0f, -0.4f));
-            makeT(VAO, ourShader, translateMatrix, a, b, c, d);
+            if (scaleBenchmark.done())
+            {
+                scaleBenchmark.print();
+                break;
+            }
+            if (scaleBenchmark.needsScene())
+            {
+                std::chrono::steady_clock::time_point generateStart = std::chrono::steady_clock::now();
+                generatedScene = RestaurantGenerator::generate(scaleBenchmark.config());
+                scaleBenchmark.sceneGenerated(generatedScene, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - generateStart).count());
+                portalVisibility.setScene(generatedScene);
+                placedLights = 0;
+                if (options.animate)
+                {
+                    animation.clear();
+                    buildAnimatedProps(animation, drawList, &generatedScene);
+                }
+            }
+            scaleBenchmark.record(deltaTime * 1000.0, drawList.size(), drawList.commands.capacity() * sizeof(DrawCommand));
         }
 
-        translateMatrix = glm::translate(identityMatrix, glm::vec3(.2f, 0.0f, 0.0f));
-        makeT(VAO, ourShader, translateMatrix, a, b, c, d);
+        std::chrono::steady_clock::time_point traverseStart = std::chrono::steady_clock::now();
+        if (worldEnabled)
+            drawList.clear();
+        else if (useGeneratedScene)
+        {
+            size_t objects = generatedScene.objects.size();
+            size_t parts = (size_t)jobs.threadCount();
+            sceneRecorder.record(parts, [&](DrawList& list, size_t part)
+            {
+                buildGeneratedRange(list, generatedScene, objects * part / parts, objects * (part + 1) / parts);
+            }, drawList);
+        }
+        else
+            sceneRecorder.record(SCENE_PART_COUNT, [](DrawList& list, size_t part) { buildScenePart(list, (int)part); }, drawList);
+        double traverseMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - traverseStart).count();
+        if (!checkMaterials(drawList.materials))
+        {
+            exitCode = -1;
+            break;
+        }
 
-        for (int i = 0; i < 9; i++)
+        // repeated draws are hidden by their first copy; --list-redundant reports them once
+        if (!options.keepRedundantDraws)
         {
-            translateMatrix = translateMatrix * glm::translate(identityMatrix, glm::vec3(0.0f, 0.0f, -0.4f));
-            makeT(VAO, ourShader, translateMatrix, a, b, c, d);
+            redundantDrawFilter.filter(drawList, listRedundantDraws ? &redundantDraws : NULL);
+            if (listRedundantDraws)
+                printRedundantDraws(redundantDraws, redundantDrawFilter.stats.draws);
+            listRedundantDraws = false;
         }
 
+        // animated props go after the scene's draws, which stay the same from frame to frame;
+        // they never repeat each other, so they come after the redundant draw filter
+        size_t staticDraws = drawList.size();
+        if (animation.partCount() > 0)
+        {
+            animation.advance(deltaTime);
+            animation.write(drawList);
+        }
 
+        // pendant lamps: the requested count, or the benchmark's count for this step
+        int wantedLights = options.lights;
+        if (options.benchLights)
+        {
+            if (lightBenchmark.done())
+            {
+                lightBenchmark.print();
+                break;
+            }
+            wantedLights = lightBenchmark.lightCount();
+            lightBenchmark.record(deltaTime * 1000.0, lighting.stats);
+        }
+        if (wantedLights != placedLights && drawList.size() > 0)
+        {
+            lighting.lights = placePendantLights(wantedLights, drawListBounds(drawList), options.scene.generator.seed);
+            placedLights = wantedLights;
+        }
 
-        translateMatrix = glm::translate(identityMatrix, glm::vec3(-.4f, 0.0f, 0.2f));
-        makeT(VAO, ourShader, translateMatrix, a, b, c, d);
-        for (int i = 0; i < 10; i++)
+        // the OpenGL half of --bench-software: the same scene and camera as the CPU runs
+        if (options.benchSoftware)
         {
-            translateMatrix = translateMatrix * glm::translate(identityMatrix, glm::vec3(0.0f, 0.0f, -0.4f));
-            makeT(VAO, ourShader, translateMatrix, a, b, c, d);
+            if (rasterBenchmark.done())
+            {
+                rasterBenchmark.print(device->name());
+                break;
+            }
+            rasterBenchmark.record(deltaTime * 1000.0);
         }
 
-        translateMatrix = glm::translate(identityMatrix, glm::vec3(-.2f, 0.0f, 0.0f));
-        makeT(VAO, ourShader, translateMatrix, a, b, c, d);
-        for (int i = 0; i < 9; i++)
+        // late input: everything above is independent of the camera, so the frame slot is
+        // waited for and input read only now, right before the view matrix is built
+        if (pacer.lateInput())
         {
-            translateMatrix = translateMatrix * glm::translate(identityMatrix, glm::vec3(0.0f, 0.0f, -0.4f));
-            makeT(VAO, ourShader, translateMatrix, a, b, c, d);
+            pacer.waitForFrame();
+            glfwPollEvents();
+            processInput(window);
+            pacer.inputSampled();
         }
 
+        // --walk moves the camera along the corridors; the streamer follows the camera
+        if (options.world.walk)
+        {
+            if (worldWalk.done())
+            {
+                walkReport.print(worldStreamer, worldWalk.pathLength());
+                break;
+            }
+            walkReport.record(deltaTime * 1000.0, worldStreamer.stats);
+            worldWalk.advance(sceneState.eye, sceneState.lookAt);
+            showSceneState(sceneState);
+        }
+        if (worldEnabled)
+            worldStreamer.update(basic_camera.eye);
 
-        translateMatrix = glm::translate(identityMatrix, glm::vec3(-.8f, 0.0f, 0.2f));
-        makeT(VAO, ourShader, translateMatrix, a, b, c, d);
+        if (!singleView)
+        {
+            // the light clusters are built for the single full screen camera
+            device->useProgram(ourShader);
+            device->setInt(ourShader, "lightingEnabled", 0);
+            device->setInt(ourShader, "bakedEnabled", 0);
+            multiViewRenderer.setForcePerViewPasses(perViewPasses);
+            int count = options.benchViews ? viewBenchmark.viewCount() : viewCount;
+            if ((int)views.size() != count)
+                views = surveillanceViews(count);
+            multiViewRenderer.render(drawList, views, camera.Zoom, sceneWidth, sceneHeight);
+
+            if (options.benchViews)
+            {
+                viewBenchmark.record(traverseMs, multiViewRenderer.stats);
+                if (viewBenchmark.done())
+                {
+                    viewBenchmark.print();
+                    glfwSetWindowShouldClose(window, true);
+                }
+            }
+        }
+        else
+        {
+            // the programs of the passes: the variants of what is switched on, or the one
+            // program that branches on uniforms
+            bool bakedApplies = bakedEnabled && bakedLighting.loaded() && bakedLighting.matches(drawList, staticDraws);
+            DeviceHandle shadedProgram = ourShader;
+            DeviceHandle depthProgram = ourShader;
+            if (useShaderVariants)
+            {
+                unsigned int shadedVariant = countOverdraw ? overdrawVariant : (lightingEnabled ? lightingVariant : 0) | (bakedApplies ? bakedVariant : 0);
+                shadedProgram = shaderVariants.program(shadedVariant);
+                depthProgram = depthPrepass ? shaderVariants.program(depthOnlyVariant) : shadedProgram;
+            }
+
+            // pass projection matrix to shader (note that in this case it could change every frame)
+            glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
+            //glm::mat4 projection = glm::ortho(-2.0f, +2.0f, -1.5f, +1.5f, 0.1f, 100.0f);
+
+            // camera/view transformation
+            //glm::mat4 view = camera.GetViewMatrix();
+            glm::mat4 view = basic_camera.createViewMatrix();
+            if (depthProgram != shadedProgram)
+            {
+                device->useProgram(depthProgram);
+                device->setMat4(depthProgram, "projection", projection);
+                device->setMat4(depthProgram, "view", view);
+            }
+
+            // activate shader
+            device->useProgram(shadedProgram);
+            device->setMat4(shadedProgram, "projection", projection);
+            device->setMat4(shadedProgram, "view", view);
+
+            if (lightingEnabled)
+            {
+                lighting.update(view, projection, 0.1f, 100.0f, sceneWidth, sceneHeight);
+                lighting.apply(shadedProgram, glm::vec3(0.25f));
+            }
+            else
+                device->setInt(shadedProgram, "lightingEnabled", 0);
+
+            if (bakedApplies)
+                bakedLighting.apply(shadedProgram);
+            else
+                device->setInt(shadedProgram, "bakedEnabled", 0);
+
+            if (worldEnabled)
+                renderWorld(sceneRenderer, worldStreamer, *device, depthProgram, shadedProgram, projection * view, depthPrepass, countOverdraw);
+            else if (options.gpuCulling.enabled)
+            {
+                // screen height in pixels of an object one unit tall at one unit of distance
+                float pixelScale = sceneHeight / (2.0f * std::tan(glm::radians(camera.Zoom) * 0.5f));
+                gpuCulling.setObjects(drawList, !options.noQuads, !useGeneratedScene || animation.partCount() > 0);
+                renderGpuCulled(sceneRenderer, gpuCulling, *device, depthProgram, shadedProgram, drawList, projection * view, basic_camera.eye, options.gpuCulling.lodPixels, pixelScale, depthPrepass, countOverdraw);
+            }
+            else
+            {
+                // rooms and doorways: only the rooms seen from the camera's room are submitted
+                if (options.portals.enabled)
+                {
+                    portalVisibility.cull(drawList, staticDraws, projection * view, basic_camera.eye);
+                    if (options.portals.debug)
+                        portalVisibility.addDebugMarkers(drawList);
+                }
+                renderDrawList(sceneRenderer, *device, depthProgram, shadedProgram, drawList, depthPrepass, countOverdraw, options.portals.enabled ? &portalVisibility : NULL);
+            }
+        }
+        if (dynamicResolutionEnabled)
+            dynamicResolution.endScene(deltaTime * 1000.0);
+        frameGraph.execute();
 
-        for (int i = 0; i < 10; i++)
+        if (printStats)
         {
-            translateMatrix = translateMatrix * glm::translate(identityMatrix, glm::vec3(0.0f, 0.0f, -0.4f));
-            makeT(VAO, ourShader, translateMatrix, a, b, c, d);
+            printRecordStats(sceneRecorder.stats);
+            if (!options.keepRedundantDraws)
+                printRedundantDrawStats(redundantDrawFilter.stats);
+            printRenderStats(sceneRenderer.stats);
+            if (lightingEnabled)
+                printLightingStats(lighting.stats);
+            if (useShaderVariants)
+                printShaderVariantStats(shaderVariants.stats, shaderVariants.variantCount());
+            if (animation.partCount() > 0)
+                printAnimationStats(animation.stats);
+            printDeviceStats(*device);
+            if (options.device == "gl")
+            {
+                printGLStateStats(glDevice.stateCache().stats);
+                printGLResourceStats(glDevice.resourceStats());
+            }
+            if (pacer.reporting())
+                printPacingReport(pacer.report());
+            if (simulationThreaded)
+                printSimulationReport(simulation.report(), options.simulation.rate);
+            if (captureMode != CAPTURE_OFF)
+                printCaptureStats(capture.stats);
+            if (countOverdraw)
+                printOverdrawStats(overdrawMeter.stats);
+            if (dynamicResolutionEnabled)
+                printResolutionStats(dynamicResolution.stats, options.resolution.budgetMs);
+            if (worldEnabled)
+                printStreamingStats(worldStreamer.stats);
+            if (options.gpuCulling.enabled && singleView && !worldEnabled)
+            {
+                gpuCulling.readCounters();
+                printGpuCullingStats(gpuCulling.stats);
+            }
+            else if (options.portals.enabled && singleView)
+            {
+                printPortalStats(portalVisibility.stats);
+                if (options.portals.debug)
+                    portalVisibility.printVisitedCells();
+            }
+            printRenderGraphStats(frameGraph.stats);
+            printGpuMemory();
+            printArenaStats(frameArenas);
+            printStats = false;
         }
 
+       
 
-        translateMatrix = glm::translate(identityMatrix, glm::vec3(0.8f, 0.0f, 0.2f));
-        makeT(VAO, ourShader, translateMatrix, a, b, c, d);
+      
+        /*
+         translateMatrix = glm::translate(identityMatrix, glm::vec3(translate_X, translate_Y, translate_Z));
+        rotateXMatrix = glm::rotate(identityMatrix, glm::radians(rotateAngle_X), glm::vec3(1.0f, 0.0f, 0.0f));
+        rotateYMatrix = glm::rotate(identityMatrix, glm::radians(rotateAngle_Y), glm::vec3(0.0f, 1.0f, 0.0f));
+        rotateZMatrix = glm::rotate(identityMatrix, glm::radians(rotateAngle_Z), glm::vec3(0.0f, 0.0f, 1.0f));
+        scaleMatrix = glm::scale(identityMatrix, glm::vec3(scale_X, scale_Y, scale_Z));
+        model = translateMatrix * rotateXMatrix * rotateYMatrix * rotateZMatrix * scaleMatrix;
+        */
+        // render boxes
+        //for (unsigned int i = 0; i < 10; i++)
+        //{
+        //    // calculate the model matrix for each object and pass it to shader before drawing
+        //    glm::mat4 model = glm::mat4(1.0f); // make sure to initialize matrix to identity matrix first
+        //    model = glm::translate(model, cubePositions[i]);
+        //    float angle = 20.0f * i;
+        //    model = glm::rotate(model, glm::radians(angle), glm::vec3(1.0f, 0.3f, 0.5f));
+        //    ourShader.setMat4("model", model);
 
-        for (int i = 0; i < 10; i++)
-        {
-            translateMatrix = translateMatrix * glm::translate(identityMatrix, glm::vec3(0.0f, 0.0f, -0.4));
-            makeT(VAO, ourShader, translateMatrix, a, b, c, d);
-        }
+        //    glDrawArrays(GL_TRIANGLES, 0, 36);
+        //}
 
+        // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
+        // -------------------------------------------------------------------------------
+        device->endFrame();
+        glfwSwapBuffers(window);
+        pacer.framePresented();
+        if (!pacer.lateInput())
+            glfwPollEvents();
 
-        translateMatrix = glm::translate(identityMatrix, glm::vec3(-0.4f, 0.0f, 0.2f));
-        makeT(VAO, ourShader, translateMatrix, a, b, c, d);
+        frameArenas.reset();
+        if (options.countAllocations)
+            allocationCheck.record(heapAllocations.load(std::memory_order_relaxed) - frameAllocations);
+    }
 
-        for (int i = 0; i < 10; i++)
-        {
-            translateMatrix = translateMatrix * glm::translate(identityMatrix, glm::vec3(0.0f, 0.0f, -0.4));
-            makeT(VAO, ourShader, translateMatrix, a, b, c, d);
-        }
+    pacer.shutdown();
+    simulation.shutdown();
+    capture.shutdown();
+    if (options.overdraw)
+        printOverdrawSummary(overdrawMeter);
+    if (animation.partCount() > 0)
+        printAnimationStats(animation.stats);
+    if (options.countAllocations)
+    {
+        printAllocationCheck(allocationCheck);
+        printArenaStats(frameArenas);
+    }
+    if (options.gpuMemory.report || options.gpuMemory.budgeted())
+        printGpuMemory();
 
-        translateMatrix = glm::translate(identityMatrix, glm::vec3(-.6f, 0.0f, 0.0f));
-        makeT(VAO, ourShader, translateMatrix, a, b, c, d);
+    // optional: de-allocate all resources once they've outlived their purpose:
+    // ------------------------------------------------------------------------
+    sceneRenderer.release();
+    worldStreamer.release();
+    gpuCulling.release();
+    frameGraph.release();
+    dynamicResolution.shutdown();
+    device->destroyBuffer(VBO);
+    device->destroyBuffer(EBO);
+    lighting.release();
+    bakedLighting.release();
+    shaderVariants.release();
+    device->destroyProgram(ourShader);
+    if (multiViewShader != 0)
+        device->destroyProgram(multiViewShader);
+    glDevice.release();
 
-        for (int i = 0; i < 9; i++)
-        {
-            translateMatrix = translateMatrix * glm::translate(identityMatrix, glm::vec3(0.0f, 0.0f, -0.4f));
-            makeT(VAO, ourShader, translateMatrix, a, b, c, d);
-        }
+    // glfw: terminate, clearing all previously allocated GLFW resources.
+    // ------------------------------------------------------------------
+    glfwTerminate();
+    return exitCode;
+}
 
-        translateMatrix = glm::translate(identityMatrix, glm::vec3(.6f, 0.0f, 0.0f));
-        makeT(VAO, ourShader, translateMatrix, a, b, c, d);
+// records the whole restaurant into drawList; nothing is sent to OpenGL here
+void buildScene(DrawList& drawList)
+{
+    for (int part = 0; part < SCENE_PART_COUNT; part++)
+        buildScenePart(drawList, part);
+}
 
-        for (int i = 0; i < 9; i++)
-        {
-            translateMatrix = translateMatrix * glm::translate(identityMatrix, glm::vec3(0.0f, 0.0f, -0.4f));
-            makeT(VAO, ourShader, translateMatrix, a, b, c, d);
-        }
+void buildScenePart(DrawList& drawList, int part)
+{
+    switch (part)
+    {
+    case SCENE_FLOOR:
+        buildFloor(drawList);
+        break;
+    case SCENE_FURNITURE:
+        buildFurniture(drawList);
+        break;
+    case SCENE_WALLS:
+        buildWalls(drawList);
+        break;
+    case SCENE_STOOLS:
+        buildStools(drawList);
+        break;
+    }
+}
 
-        translateMatrix = glm::translate(identityMatrix, glm::vec3(-1.0f, 0.0f, 0.0f));
-        makeT(VAO, ourShader, translateMatrix, a, b, c, d);
+// floor tiles
+void buildFloor(DrawList& drawList)
+{
+    // Modelling Transformation
+    glm::mat4 identityMatrix = glm::mat4(1.0f); // make sure to initialize matrix to identity matrix first
+    glm::mat4 translateMatrix;
+    float a = 0.0f, b = 0.0f, c = 0.0f, d = 1.0f;
 
-        for (int i = 0; i < 9; i++)
-        {
-            translateMatrix = translateMatrix * glm::translate(identityMatrix, glm::vec3(0.0f, 0.0f, -0.4f));
-            makeT(VAO, ourShader, translateMatrix, a, b, c, d);
-        }
 
-        translateMatrix = glm::translate(identityMatrix, glm::vec3(0.0f, 0.0f, 0.2f));
-        makeT(VAO, ourShader, translateMatrix, a, b, c, d);
+    translateMatrix = glm::translate(identityMatrix, glm::vec3(0.0f, 0.0f, 0.2f));
+    makeT(drawList, translateMatrix, a, b, c, d);
 
-        a = 1.0f, b = 1.0f, c = 1.0f, d = 1.0f;
+    for (int i = 0; i < 10; i++)
+    {
+        translateMatrix = translateMatrix * glm::translate(identityMatrix, glm::vec3(0.0f, 0.0f, -0.4f));
+        makeT(drawList, translateMatrix, a, b, c, d);
+    }
 
-        translateMatrix = glm::translate(identityMatrix, glm::vec3(0.0f, 0.0f, 0.f));
-        makeT(VAO, ourShader, translateMatrix, a, b, c, d);
+    translateMatrix = glm::translate(identityMatrix, glm::vec3(.4f, 0.0f, 0.2f));
+    makeT(drawList, translateMatrix, a, b, c, d);
 
-        for (int i = 0; i < 9; i++)
-        {
-            translateMatrix = translateMatrix * glm::translate(identityMatrix, glm::vec3(0.0f, 0.0f, -0.4f));
-            makeT(VAO, ourShader, translateMatrix, a, b, c, d);
-        }
+    for (int i = 0; i < 10; i++)
+    {
+        translateMatrix = translateMatrix * glm::translate(identityMatrix, glm::vec3(0.0f, 0.0f, -0.4f));
+        makeT(drawList, translateMatrix, a, b, c, d);
+    }
 
-        translateMatrix = glm::translate(identityMatrix, glm::vec3(.4f, 0.0f, 0.0f));
-        makeT(VAO, ourShader, translateMatrix, a, b, c, d);
+    translateMatrix = glm::translate(identityMatrix, glm::vec3(.2f, 0.0f, 0.0f));
+    makeT(drawList, translateMatrix, a, b, c, d);
 
-        for (int i = 0; i < 9; i++)
-        {
-            translateMatrix = translateMatrix * glm::translate(identityMatrix, glm::vec3(0.0f, 0.0f, -0.4f));
-            makeT(VAO, ourShader, translateMatrix, a, b, c, d);
-        }
+    for (int i = 0; i < 9; i++)
+    {
+        translateMatrix = translateMatrix * glm::translate(identityMatrix, glm::vec3(0.0f, 0.0f, -0.4f));
+        makeT(drawList, translateMatrix, a, b, c, d);
+    }
 
-        translateMatrix = glm::translate(identityMatrix, glm::vec3(.2f, 0.0f, 0.2f));
-        makeT(VAO, ourShader, translateMatrix, a, b, c, d);
 
-        for (int i = 0; i < 10; i++)
-        {
-            translateMatrix = translateMatrix * glm::translate(identityMatrix, glm::vec3(0.0f, 0.0f, -0.4f));
-            makeT(VAO, ourShader, translateMatrix, a, b, c, d);
-        }
 
+    translateMatrix = glm::translate(identityMatrix, glm::vec3(-.4f, 0.0f, 0.2f));
+    makeT(drawList, translateMatrix, a, b, c, d);
+    for (int i = 0; i < 10; i++)
+    {
+        translateMatrix = translateMatrix * glm::translate(identityMatrix, glm::vec3(0.0f, 0.0f, -0.4f));
+        makeT(drawList, translateMatrix, a, b, c, d);
+    }
 
+    translateMatrix = glm::translate(identityMatrix, glm::vec3(-.2f, 0.0f, 0.0f));
+    makeT(drawList, translateMatrix, a, b, c, d);
+    for (int i = 0; i < 9; i++)
+    {
+        translateMatrix = translateMatrix * glm::translate(identityMatrix, glm::vec3(0.0f, 0.0f, -0.4f));
+        makeT(drawList, translateMatrix, a, b, c, d);
+    }
 
-        translateMatrix = glm::translate(identityMatrix, glm::vec3(-.4f, 0.0f, 0.0f));
-        makeT(VAO, ourShader, translateMatrix, a, b, c, d);
-        for (int i = 0; i < 9; i++)
-        {
-            translateMatrix = translateMatrix * glm::translate(identityMatrix, glm::vec3(0.0f, 0.0f, -0.4f));
-            makeT(VAO, ourShader, translateMatrix, a, b, c, d);
-        }
 
-        translateMatrix = glm::translate(identityMatrix, glm::vec3(-.2f, 0.0f, 0.2f));
-        makeT(VAO, ourShader, translateMatrix, a, b, c, d);
-        for (int i = 0; i < 10; i++)
-        {
-            translateMatrix = translateMatrix * glm::translate(identityMatrix, glm::vec3(0.0f, 0.0f, -0.4f));
-            makeT(VAO, ourShader, translateMatrix, a, b, c, d);
-        }
+    translateMatrix = glm::translate(identityMatrix, glm::vec3(-.8f, 0.0f, 0.2f));
+    makeT(drawList, translateMatrix, a, b, c, d);
 
+    for (int i = 0; i < 10; i++)
+    {
+        translateMatrix = translateMatrix * glm::translate(identityMatrix, glm::vec3(0.0f, 0.0f, -0.4f));
+        makeT(drawList, translateMatrix, a, b, c, d);
+    }
 
-        translateMatrix = glm::translate(identityMatrix, glm::vec3(-.8f, 0.0f, 0.0f));
-        makeT(VAO, ourShader, translateMatrix, a, b, c, d);
 
-        for (int i = 0; i < 9; i++)
-        {
-            translateMatrix = translateMatrix * glm::translate(identityMatrix, glm::vec3(0.0f, 0.0f, -0.4f));
-            makeT(VAO, ourShader, translateMatrix, a, b, c, d);
-        }
+    translateMatrix = glm::translate(identityMatrix, glm::vec3(0.8f, 0.0f, 0.2f));
+    makeT(drawList, translateMatrix, a, b, c, d);
+
+    for (int i = 0; i < 10; i++)
+    {
+        translateMatrix = translateMatrix * glm::translate(identityMatrix, glm::vec3(0.0f, 0.0f, -0.4));
+        makeT(drawList, translateMatrix, a, b, c, d);
+    }
+
+
+    translateMatrix = glm::translate(identityMatrix, glm::vec3(-0.4f, 0.0f, 0.2f));
+    makeT(drawList, translateMatrix, a, b, c, d);
+
+    for (int i = 0; i < 10; i++)
+    {
+        translateMatrix = translateMatrix * glm::translate(identityMatrix, glm::vec3(0.0f, 0.0f, -0.4));
+        makeT(drawList, translateMatrix, a, b, c, d);
+    }
+
+    translateMatrix = glm::translate(identityMatrix, glm::vec3(-.6f, 0.0f, 0.0f));
+    makeT(drawList, translateMatrix, a, b, c, d);
+
+    for (int i = 0; i < 9; i++)
+    {
+        translateMatrix = translateMatrix * glm::translate(identityMatrix, glm::vec3(0.0f, 0.0f, -0.4f));
+        makeT(drawList, translateMatrix, a, b, c, d);
+    }
+
+    translateMatrix = glm::translate(identityMatrix, glm::vec3(.6f, 0.0f, 0.0f));
+    makeT(drawList, translateMatrix, a, b, c, d);
+
+    for (int i = 0; i < 9; i++)
+    {
+        translateMatrix = translateMatrix * glm::translate(identityMatrix, glm::vec3(0.0f, 0.0f, -0.4f));
+        makeT(drawList, translateMatrix, a, b, c, d);
+    }
+
+    translateMatrix = glm::translate(identityMatrix, glm::vec3(-1.0f, 0.0f, 0.0f));
+    makeT(drawList, translateMatrix, a, b, c, d);
+
+    for (int i = 0; i < 9; i++)
+    {
+        translateMatrix = translateMatrix * glm::translate(identityMatrix, glm::vec3(0.0f, 0.0f, -0.4f));
+        makeT(drawList, translateMatrix, a, b, c, d);
+    }
+
+    translateMatrix = glm::translate(identityMatrix, glm::vec3(0.0f, 0.0f, 0.2f));
+    makeT(drawList, translateMatrix, a, b, c, d);
+
+    a = 1.0f, b = 1.0f, c = 1.0f, d = 1.0f;
+
+    translateMatrix = glm::translate(identityMatrix, glm::vec3(0.0f, 0.0f, 0.f));
+    makeT(drawList, translateMatrix, a, b, c, d);
+
+    for (int i = 0; i < 9; i++)
+    {
+        translateMatrix = translateMatrix * glm::translate(identityMatrix, glm::vec3(0.0f, 0.0f, -0.4f));
+        makeT(drawList, translateMatrix, a, b, c, d);
+    }
+
+    translateMatrix = glm::translate(identityMatrix, glm::vec3(.4f, 0.0f, 0.0f));
+    makeT(drawList, translateMatrix, a, b, c, d);
+
+    for (int i = 0; i < 9; i++)
+    {
+        translateMatrix = translateMatrix * glm::translate(identityMatrix, glm::vec3(0.0f, 0.0f, -0.4f));
+        makeT(drawList, translateMatrix, a, b, c, d);
+    }
+
+    translateMatrix = glm::translate(identityMatrix, glm::vec3(.2f, 0.0f, 0.2f));
+    makeT(drawList, translateMatrix, a, b, c, d);
+
+    for (int i = 0; i < 10; i++)
+    {
+        translateMatrix = translateMatrix * glm::translate(identityMatrix, glm::vec3(0.0f, 0.0f, -0.4f));
+        makeT(drawList, translateMatrix, a, b, c, d);
+    }
+
+
+
+    translateMatrix = glm::translate(identityMatrix, glm::vec3(-.4f, 0.0f, 0.0f));
+    makeT(drawList, translateMatrix, a, b, c, d);
+    for (int i = 0; i < 9; i++)
+    {
+        translateMatrix = translateMatrix * glm::translate(identityMatrix, glm::vec3(0.0f, 0.0f, -0.4f));
+        makeT(drawList, translateMatrix, a, b, c, d);
+    }
+
+    translateMatrix = glm::translate(identityMatrix, glm::vec3(-.2f, 0.0f, 0.2f));
+    makeT(drawList, translateMatrix, a, b, c, d);
+    for (int i = 0; i < 10; i++)
+    {
+        translateMatrix = translateMatrix * glm::translate(identityMatrix, glm::vec3(0.0f, 0.0f, -0.4f));
+        makeT(drawList, translateMatrix, a, b, c, d);
+    }
+
+
+    translateMatrix = glm::translate(identityMatrix, glm::vec3(-.8f, 0.0f, 0.0f));
+    makeT(drawList, translateMatrix, a, b, c, d);
+
+    for (int i = 0; i < 9; i++)
+    {
+        translateMatrix = translateMatrix * glm::translate(identityMatrix, glm::vec3(0.0f, 0.0f, -0.4f));
+        makeT(drawList, translateMatrix, a, b, c, d);
+    }
+
+
+    translateMatrix = glm::translate(identityMatrix, glm::vec3(0.8f, 0.0f, -0.0f));
+    makeT(drawList, translateMatrix, a, b, c, d);
+
+    for (int i = 0; i < 9; i++)
+    {
+        translateMatrix = translateMatrix * glm::translate(identityMatrix, glm::vec3(0.0f, 0.0f, -0.4));
+        makeT(drawList, translateMatrix, a, b, c, d);
+    }
+
+
+    translateMatrix = glm::translate(identityMatrix, glm::vec3(-0.4f, 0.0f, 0.0f));
+    makeT(drawList, translateMatrix, a, b, c, d);
+
+    for (int i = 0; i < 9; i++)
+    {
+        translateMatrix = translateMatrix * glm::translate(identityMatrix, glm::vec3(0.0f, 0.0f, -0.4));
+        makeT(drawList, translateMatrix, a, b, c, d);
+    }
 
+    translateMatrix = glm::translate(identityMatrix, glm::vec3(-.6f, 0.0f, 0.2f));
+    makeT(drawList, translateMatrix, a, b, c, d);
 
-        translateMatrix = glm::translate(identityMatrix, glm::vec3(0.8f, 0.0f, -0.0f));
-        makeT(VAO, ourShader, translateMatrix, a, b, c, d);
+    for (int i = 0; i < 10; i++)
+    {
+        translateMatrix = translateMatrix * glm::translate(identityMatrix, glm::vec3(0.0f, 0.0f, -0.4f));
+        makeT(drawList, translateMatrix, a, b, c, d);
+    }
 
-        for (int i = 0; i < 9; i++)
-        {
-            translateMatrix = translateMatrix * glm::translate(identityMatrix, glm::vec3(0.0f, 0.0f, -0.4));
-            makeT(VAO, ourShader, translateMatrix, a, b, c, d);
-        }
+    translateMatrix = glm::translate(identityMatrix, glm::vec3(.6f, 0.0f, 0.2f));
+    makeT(drawList, translateMatrix, a, b, c, d);
 
+    for (int i = 0; i < 10; i++)
+    {
+        translateMatrix = translateMatrix * glm::translate(identityMatrix, glm::vec3(0.0f, 0.0f, -0.4f));
+        makeT(drawList, translateMatrix, a, b, c, d);
+    }
 
-        translateMatrix = glm::translate(identityMatrix, glm::vec3(-0.4f, 0.0f, 0.0f));
-        makeT(VAO, ourShader, translateMatrix, a, b, c, d);
+    translateMatrix = glm::translate(identityMatrix, glm::vec3(-1.0f, 0.0f, 0.2f));
+    makeT(drawList, translateMatrix, a, b, c, d);
 
-        for (int i = 0; i < 9; i++)
-        {
-            translateMatrix = translateMatrix * glm::translate(identityMatrix, glm::vec3(0.0f, 0.0f, -0.4));
-            makeT(VAO, ourShader, translateMatrix, a, b, c, d);
-        }
+    for (int i = 0; i < 10; i++)
+    {
+        translateMatrix = translateMatrix * glm::translate(identityMatrix, glm::vec3(0.0f, 0.0f, -0.4f));
+        makeT(drawList, translateMatrix, a, b, c, d);
+    }
 
-        translateMatrix = glm::translate(identityMatrix, glm::vec3(-.6f, 0.0f, 0.2f));
-        makeT(VAO, ourShader, translateMatrix, a, b, c, d);
 
-        for (int i = 0; i < 10; i++)
-        {
-            translateMatrix = translateMatrix * glm::translate(identityMatrix, glm::vec3(0.0f, 0.0f, -0.4f));
-            makeT(VAO, ourShader, translateMatrix, a, b, c, d);
-        }
+    translateMatrix = glm::translate(identityMatrix, glm::vec3(-1.4f, 0.0f, 0.2f));
+    makeT(drawList, translateMatrix, a, b, c, d);
 
-        translateMatrix = glm::translate(identityMatrix, glm::vec3(.6f, 0.0f, 0.2f));
-        makeT(VAO, ourShader, translateMatrix, a, b, c, d);
+    for (int i = 0; i < 10; i++)
+    {
+        translateMatrix = translateMatrix * glm::translate(identityMatrix, glm::vec3(0.0f, 0.0f, -0.4f));
+        makeT(drawList, translateMatrix, a, b, c, d);
+    }
 
-        for (int i = 0; i < 10; i++)
-        {
-            translateMatrix = translateMatrix * glm::translate(identityMatrix, glm::vec3(0.0f, 0.0f, -0.4f));
-            makeT(VAO, ourShader, translateMatrix, a, b, c, d);
-        }
 
-        translateMatrix = glm::translate(identityMatrix, glm::vec3(-1.0f, 0.0f, 0.2f));
-        makeT(VAO, ourShader, translateMatrix, a, b, c, d);
 
-        for (int i = 0; i < 10; i++)
-        {
-            translateMatrix = translateMatrix * glm::translate(identityMatrix, glm::vec3(0.0f, 0.0f, -0.4f));
-            makeT(VAO, ourShader, translateMatrix, a, b, c, d);
-        }
+    translateMatrix = glm::translate(identityMatrix, glm::vec3(1.5f, 0.0f, 0.2f));
+    makeT(drawList, translateMatrix, a, b, c, d);
 
+    for (int i = 0; i < 10; i++)
+    {
+        translateMatrix = translateMatrix * glm::translate(identityMatrix, glm::vec3(0.0f, 0.0f, -0.4f));
+        makeT(drawList, translateMatrix, a, b, c, d);
+    }
 
-        translateMatrix = glm::translate(identityMatrix, glm::vec3(-1.4f, 0.0f, 0.2f));
-        makeT(VAO, ourShader, translateMatrix, a, b, c, d);
+    translateMatrix = glm::translate(identityMatrix, glm::vec3(1.3f, 0.0f, 0.0f));
+    makeT(drawList, translateMatrix, a, b, c, d);
 
-        for (int i = 0; i < 10; i++)
-        {
-            translateMatrix = translateMatrix * glm::translate(identityMatrix, glm::vec3(0.0f, 0.0f, -0.4f));
-            makeT(VAO, ourShader, translateMatrix, a, b, c, d);
-        }
+    for (int i = 0; i < 10; i++)
+    {
+        translateMatrix = translateMatrix * glm::translate(identityMatrix, glm::vec3(0.0f, 0.0f, -0.4f));
+        makeT(drawList, translateMatrix, a, b, c, d);
+    }
 
+    translateMatrix = glm::translate(identityMatrix, glm::vec3(1.0f, 0.0f, 0.0f));
+    makeT(drawList, translateMatrix, a, b, c, d);
 
+    for (int i = 0; i < 10; i++)
+    {
+        translateMatrix = translateMatrix * glm::translate(identityMatrix, glm::vec3(0.0f, 0.0f, -0.4f));
+        makeT(drawList, translateMatrix, a, b, c, d);
+    }
 
-        translateMatrix = glm::translate(identityMatrix, glm::vec3(1.5f, 0.0f, 0.2f));
-        makeT(VAO, ourShader, translateMatrix, a, b, c, d);
+    translateMatrix = glm::translate(identityMatrix, glm::vec3(1.0f, 0.0f, 0.0f));
+    makeT(drawList, translateMatrix, a, b, c, d);
 
-        for (int i = 0; i < 10; i++)
-        {
-            translateMatrix = translateMatrix * glm::translate(identityMatrix, glm::vec3(0.0f, 0.0f, -0.4f));
-            makeT(VAO, ourShader, translateMatrix, a, b, c, d);
-        }
+    for (int i = 0; i < 10; i++)
+    {
+        translateMatrix = translateMatrix * glm::translate(identityMatrix, glm::vec3(0.0f, 0.0f, -0.4f));
+        makeT(drawList, translateMatrix, 0.0, 0.0, 0.0, d);
+    }
 
-        translateMatrix = glm::translate(identityMatrix, glm::vec3(1.3f, 0.0f, 0.0f));
-        makeT(VAO, ourShader, translateMatrix, a, b, c, d);
+    translateMatrix = glm::translate(identityMatrix, glm::vec3(-1.2f, 0.0f, 0.0f));
+    makeT(drawList, translateMatrix, a, b, c, d);
 
-        for (int i = 0; i < 10; i++)
-        {
-            translateMatrix = translateMatrix * glm::translate(identityMatrix, glm::vec3(0.0f, 0.0f, -0.4f));
-            makeT(VAO, ourShader, translateMatrix, a, b, c, d);
-        }
+    for (int i = 0; i < 10; i++)
+    {
+        translateMatrix = translateMatrix * glm::translate(identityMatrix, glm::vec3(0.0f, 0.0f, -0.4f));
+        makeT(drawList, translateMatrix, 0.0, 0.0, 0.0, d);
+    }
 
-        translateMatrix = glm::translate(identityMatrix, glm::vec3(1.0f, 0.0f, 0.0f));
-        makeT(VAO, ourShader, translateMatrix, a, b, c, d);
 
-        for (int i = 0; i < 10; i++)
-        {
-            translateMatrix = translateMatrix * glm::translate(identityMatrix, glm::vec3(0.0f, 0.0f, -0.4f));
-            makeT(VAO, ourShader, translateMatrix, a, b, c, d);
-        }
+    translateMatrix = glm::translate(identityMatrix, glm::vec3(1.5f, 0.0f, -0.2f));
+    makeT(drawList, translateMatrix, a, b, c, d);
 
-        translateMatrix = glm::translate(identityMatrix, glm::vec3(1.0f, 0.0f, 0.0f));
-        makeT(VAO, ourShader, translateMatrix, a, b, c, d);
+    translateMatrix = glm::translate(identityMatrix, glm::vec3(1.5f, 0.0f, 0.0f));
+    makeT(drawList, translateMatrix, a, b, c, d);
 
-        for (int i = 0; i < 10; i++)
-        {
-            translateMatrix = translateMatrix * glm::translate(identityMatrix, glm::vec3(0.0f, 0.0f, -0.4f));
-            makeT(VAO, ourShader, translateMatrix, 0.0, 0.0, 0.0, d);
-        }
+    for (int i = 0; i < 10; i++)
+    {
+        translateMatrix = translateMatrix * glm::translate(identityMatrix, glm::vec3(0.0f, 0.0f, -0.4f));
+        makeT(drawList, translateMatrix, 0.0, 0.0, 0.0, d);
+    }
 
-        translateMatrix = glm::translate(identityMatrix, glm::vec3(-1.2f, 0.0f, 0.0f));
-        makeT(VAO, ourShader, translateMatrix, a, b, c, d);
+    translateMatrix = glm::translate(identityMatrix, glm::vec3(-1.5f, 0.0f, 0.0f));
+    makeT(drawList, translateMatrix, a, b, c, d);
 
-        for (int i = 0; i < 10; i++)
-        {
-            translateMatrix = translateMatrix * glm::translate(identityMatrix, glm::vec3(0.0f, 0.0f, -0.4f));
-            makeT(VAO, ourShader, translateMatrix, 0.0, 0.0, 0.0, d);
-        }
+    for (int i = 0; i < 10; i++)
+    {
+        translateMatrix = translateMatrix * glm::translate(identityMatrix, glm::vec3(0.0f, 0.0f, -0.4f));
+        makeT(drawList, translateMatrix, 0.0, 0.0, 0.0, d);
+    }
 
+    translateMatrix = glm::translate(identityMatrix, glm::vec3(-1.3f, 0.0f, 0.2f));
+    makeT(drawList, translateMatrix, a, b, c, d);
 
-        translateMatrix = glm::translate(identityMatrix, glm::vec3(1.5f, 0.0f, -0.2f));
-        makeT(VAO, ourShader, translateMatrix, a, b, c, d);
+    for (int i = 0; i < 10; i++)
+    {
+        translateMatrix = translateMatrix * glm::translate(identityMatrix, glm::vec3(0.0f, 0.0f, -0.4f));
+        makeT(drawList, translateMatrix, 0.0, 0.0, 0.0, d);
+    }
 
-        translateMatrix = glm::translate(identityMatrix, glm::vec3(1.5f, 0.0f, 0.0f));
-        makeT(VAO, ourShader, translateMatrix, a, b, c, d);
+    translateMatrix = glm::translate(identityMatrix, glm::vec3(1.3f, 0.0f, 0.2f));
+    makeT(drawList, translateMatrix, a, b, c, d);
 
-        for (int i = 0; i < 10; i++)
-        {
-            translateMatrix = translateMatrix * glm::translate(identityMatrix, glm::vec3(0.0f, 0.0f, -0.4f));
-            makeT(VAO, ourShader, translateMatrix, 0.0, 0.0, 0.0, d);
-        }
+    for (int i = 0; i < 10; i++)
+    {
+        translateMatrix = translateMatrix * glm::translate(identityMatrix, glm::vec3(0.0f, 0.0f, -0.4f));
+        makeT(drawList, translateMatrix, 0.0, 0.0, 0.0, d);
+    }
+}
 
-        translateMatrix = glm::translate(identityMatrix, glm::vec3(-1.5f, 0.0f, 0.0f));
-        makeT(VAO, ourShader, translateMatrix, a, b, c, d);
+// chairs and tables
+void buildFurniture(DrawList& drawList)
+{
+    glm::mat4 identityMatrix = glm::mat4(1.0f);
+    glm::mat4 translateMatrix, rotateXMatrix, rotateYMatrix, rotateZMatrix, scaleMatrix;
 
-        for (int i = 0; i < 10; i++)
-        {
-            translateMatrix = translateMatrix * glm::translate(identityMatrix, glm::vec3(0.0f, 0.0f, -0.4f));
-            makeT(VAO, ourShader, translateMatrix, 0.0, 0.0, 0.0, d);
-        }
+    translateMatrix = glm::translate(identityMatrix, glm::vec3(0.5f, -.7f, .95f));
+    rotateYMatrix = glm::rotate(identityMatrix, glm::radians(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    rotateZMatrix = glm::rotate(identityMatrix, glm::radians(rotateAngle_Z), glm::vec3(0.0f, 0.0f, 1.0f));
+    scaleMatrix = glm::scale(identityMatrix, glm::vec3(1.3f, 1.0f, 0.7f));
+    drawCHair(drawList, rotateYMatrix* translateMatrix* scaleMatrix);
+    
+    translateMatrix = translateMatrix * glm::translate(identityMatrix, glm::vec3(-0.0, 0.0, 0.0));
 
-        translateMatrix = glm::translate(identityMatrix, glm::vec3(-1.3f, 0.0f, 0.2f));
-        makeT(VAO, ourShader, translateMatrix, a, b, c, d);
+    for (int i = 0; i < 2; i++)
+    {
+        translateMatrix = translateMatrix * glm::translate(identityMatrix, glm::vec3(0.0f, 0.0f,-2.0f));
+        drawCHair(drawList, rotateYMatrix * translateMatrix * scaleMatrix);
+    }
+   
 
-        for (int i = 0; i < 10; i++)
-        {
-            translateMatrix = translateMatrix * glm::translate(identityMatrix, glm::vec3(0.0f, 0.0f, -0.4f));
-            makeT(VAO, ourShader, translateMatrix, 0.0, 0.0, 0.0, d);
-        }
+    
+    translateMatrix = glm::translate(identityMatrix, glm::vec3(.6f, -0.2f, 1.0f));
+    rotateYMatrix = glm::rotate(identityMatrix, glm::radians(-1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    rotateXMatrix = glm::rotate(identityMatrix, glm::radians(3.0f), glm::vec3(1.0f, 0.0f, 0.0f));
+    rotateZMatrix = glm::rotate(identityMatrix, glm::radians(rotateAngle_Z), glm::vec3(0.0f, 0.0f, 1.0f));
+    scaleMatrix = glm::scale(identityMatrix, glm::vec3(0.7f, 0.6f, 0.5f));
+    drawTable(drawList, rotateXMatrix* rotateYMatrix *  translateMatrix*scaleMatrix);
 
-        translateMatrix = glm::translate(identityMatrix, glm::vec3(1.3f, 0.0f, 0.2f));
-        makeT(VAO, ourShader, translateMatrix, a, b, c, d);
+    //translateMatrix = translateMatrix * glm::translate(identityMatrix, glm::vec3(-0.0, 0.0, 0.0));
 
-        for (int i = 0; i < 10; i++)
-        {
-            translateMatrix = translateMatrix * glm::translate(identityMatrix, glm::vec3(0.0f, 0.0f, -0.4f));
-            makeT(VAO, ourShader, translateMatrix, 0.0, 0.0, 0.0, d);
-        }
+    for (int i = 0; i < 2; i++)
+    {
+        translateMatrix = translateMatrix * glm::translate(identityMatrix, glm::vec3(0.0f, 0.0f, -2.0f));
+        drawTable(drawList, translateMatrix* scaleMatrix);
+    }
+}
 
+// counter, shelves and walls
+void buildWalls(DrawList& drawList)
+{
+    DrawSource source(drawList, __FUNCTION__);
+    glm::mat4 identityMatrix = glm::mat4(1.0f);
+    glm::mat4 translateMatrix, scaleMatrix, model;
 
+   translateMatrix = glm::translate(identityMatrix, glm::vec3(-.90,-.4, -3.0));
+    scaleMatrix = glm::scale(identityMatrix, glm::vec3(0.4, 0.7,10.0));
+    model = translateMatrix * scaleMatrix;
 
+    drawList.add(model, glm::vec4(0.9, 0.6f, 0.4f, 1.0f));
 
-        translateMatrix = glm::translate(identityMatrix, glm::vec3(0.5f, -.7f, .95f));
-        rotateYMatrix = glm::rotate(identityMatrix, glm::radians(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-        rotateZMatrix = glm::rotate(identityMatrix, glm::radians(rotateAngle_Z), glm::vec3(0.0f, 0.0f, 1.0f));
-        scaleMatrix = glm::scale(identityMatrix, glm::vec3(1.3f, 1.0f, 0.7f));
-        drawCHair(VAO, ourShader, rotateYMatrix* translateMatrix* scaleMatrix);
-        
-        translateMatrix = translateMatrix * glm::translate(identityMatrix, glm::vec3(-0.0, 0.0, 0.0));
+    translateMatrix = glm::translate(identityMatrix, glm::vec3(-1.0, -.0, -3.0));
+    scaleMatrix = glm::scale(identityMatrix, glm::vec3(0.8, 0.1, 10.0));
+    model = translateMatrix * scaleMatrix;
 
-        for (int i = 0; i < 2; i++)
-        {
-            translateMatrix = translateMatrix * glm::translate(identityMatrix, glm::vec3(0.0f, 0.0f,-2.0f));
-            drawCHair(VAO, ourShader, rotateYMatrix * translateMatrix * scaleMatrix);
-        }
-       
+    drawList.add(model, glm::vec4(0.0, 0.0f, 0.0f, 0.0f));
 
-        
-        translateMatrix = glm::translate(identityMatrix, glm::vec3(.6f, -0.2f, 1.0f));
-        rotateYMatrix = glm::rotate(identityMatrix, glm::radians(-1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-        rotateXMatrix = glm::rotate(identityMatrix, glm::radians(3.0f), glm::vec3(1.0f, 0.0f, 0.0f));
-        rotateZMatrix = glm::rotate(identityMatrix, glm::radians(rotateAngle_Z), glm::vec3(0.0f, 0.0f, 1.0f));
-        scaleMatrix = glm::scale(identityMatrix, glm::vec3(0.7f, 0.6f, 0.5f));
-        drawTable(VAO, ourShader, rotateXMatrix* rotateYMatrix *  translateMatrix*scaleMatrix);
 
-        //translateMatrix = translateMatrix * glm::translate(identityMatrix, glm::vec3(-0.0, 0.0, 0.0));
 
-        for (int i = 0; i < 2; i++)
-        {
-            translateMatrix = translateMatrix * glm::translate(identityMatrix, glm::vec3(0.0f, 0.0f, -2.0f));
-            drawTable(VAO, ourShader, translateMatrix* scaleMatrix);
-        }
 
+    translateMatrix = glm::translate(identityMatrix, glm::vec3(-1.3, 1.1, -3.0));
+    scaleMatrix = glm::scale(identityMatrix, glm::vec3(0.3, 0.1, 10.0));
+    model = translateMatrix * scaleMatrix;
 
+    drawList.add(model, glm::vec4(0.0, 0.0f, 0.0f, 1.0f));
 
-       translateMatrix = glm::translate(identityMatrix, glm::vec3(-.90,-.4, -3.0));
-        scaleMatrix = glm::scale(identityMatrix, glm::vec3(0.4, 0.7,10.0));
-        model = translateMatrix * scaleMatrix;
 
-        ourShader.setMat4("model", model);
-        ourShader.setVec4("color", glm::vec4(0.9, 0.6f, 0.4f, 1.0f));
-        glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
 
-        translateMatrix = glm::translate(identityMatrix, glm::vec3(-1.0, -.0, -3.0));
-        scaleMatrix = glm::scale(identityMatrix, glm::vec3(0.8, 0.1, 10.0));
-        model = translateMatrix * scaleMatrix;
+    translateMatrix = glm::translate(identityMatrix, glm::vec3(-1.3, .50, -3.0));
+    scaleMatrix = glm::scale(identityMatrix, glm::vec3(0.3, 0.1, 10.0));
+    model = translateMatrix * scaleMatrix;
 
-        ourShader.setMat4("model", model);
-        ourShader.setVec4("color", glm::vec4(0.0, 0.0f, 0.0f, 0.0f));
-        glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
+    drawList.add(model, glm::vec4(0.0, 0.0f, 0.0f, 1.0f));
 
 
+    translateMatrix = glm::translate(identityMatrix, glm::vec3(-1.3, .85, -3.0));
+    scaleMatrix = glm::scale(identityMatrix, glm::vec3(0.3, 0.1, 10.0));
+    model = translateMatrix * scaleMatrix;
 
+    drawList.add(model, glm::vec4(0.0, 0.0f, 0.0f, 1.0f));
 
-        translateMatrix = glm::translate(identityMatrix, glm::vec3(-1.3, 1.1, -3.0));
-        scaleMatrix = glm::scale(identityMatrix, glm::vec3(0.3, 0.1, 10.0));
-        model = translateMatrix * scaleMatrix;
 
-        ourShader.setMat4("model", model);
-        ourShader.setVec4("color", glm::vec4(0.0, 0.0f, 0.0f, 1.0f));
-        glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
 
 
+    translateMatrix = glm::translate(identityMatrix, glm::vec3(-1.6, -1.1, -5.0));
+    scaleMatrix = glm::scale(identityMatrix, glm::vec3(8.0, 7.0, 1.0));
+    model = translateMatrix * scaleMatrix;
 
-        translateMatrix = glm::translate(identityMatrix, glm::vec3(-1.3, .50, -3.0));
-        scaleMatrix = glm::scale(identityMatrix, glm::vec3(0.3, 0.1, 10.0));
-        model = translateMatrix * scaleMatrix;
+    drawList.add(model, glm::vec4(0.7, 0.0f, 0.7f, 1.0f));
 
-        ourShader.setMat4("model", model);
-        ourShader.setVec4("color", glm::vec4(0.0, 0.0f, 0.0f, 1.0f));
-        glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
+    translateMatrix = glm::translate(identityMatrix, glm::vec3(-0.1, 0.5, -2.5));
+    scaleMatrix = glm::scale(identityMatrix, glm::vec3(0.6, 0.6, 1.0));
+    model = translateMatrix * scaleMatrix;
 
+    drawList.add(model, glm::vec4(0.1, 0.0f, 0.4f, 0.0f));
 
-        translateMatrix = glm::translate(identityMatrix, glm::vec3(-1.3, .85, -3.0));
-        scaleMatrix = glm::scale(identityMatrix, glm::vec3(0.3, 0.1, 10.0));
-        model = translateMatrix * scaleMatrix;
 
-        ourShader.setMat4("model", model);
-        ourShader.setVec4("color", glm::vec4(0.0, 0.0f, 0.0f, 1.0f));
-        glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
+    translateMatrix = glm::translate(identityMatrix, glm::vec3(-2.3, -1.0, -5.5));
+    scaleMatrix = glm::scale(identityMatrix, glm::vec3(1.0, 7.0, 16.0));
+    model = translateMatrix * scaleMatrix;
 
+    drawList.add(model, glm::vec4(0.5, 0.0f, 0.5f, 1.0f));
 
 
 
-        translateMatrix = glm::translate(identityMatrix, glm::vec3(-1.6, -1.1, -5.0));
-        scaleMatrix = glm::scale(identityMatrix, glm::vec3(8.0, 7.0, 1.0));
-        model = translateMatrix * scaleMatrix;
+    translateMatrix = glm::translate(identityMatrix, glm::vec3(1.7, -1.0, -4.5));
+    scaleMatrix = glm::scale(identityMatrix, glm::vec3(.5, 7.0, 16.0));
+    model = translateMatrix * scaleMatrix;
 
-        ourShader.setMat4("model", model);
-        ourShader.setVec4("color", glm::vec4(0.7, 0.0f, 0.7f, 1.0f));
-        glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
+    drawList.add(model, glm::vec4(0.4, 0.0f, 0.4f, 1.0f));
+}
 
-        translateMatrix = glm::translate(identityMatrix, glm::vec3(-0.1, 0.5, -2.5));
-        scaleMatrix = glm::scale(identityMatrix, glm::vec3(0.6, 0.6, 1.0));
-        model = translateMatrix * scaleMatrix;
+// bar stools
+void buildStools(DrawList& drawList)
+{
+    glm::mat4 identityMatrix = glm::mat4(1.0f);
+    glm::mat4 translateMatrix;
 
-        ourShader.setMat4("model", model);
-        ourShader.setVec4("color", glm::vec4(0.1, 0.0f, 0.4f, 0.0f));
-        glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
+    translateMatrix = glm::translate(identityMatrix, glm::vec3(-0.6,0.2,1.3));
 
+    makeTool(drawList,
+        translateMatrix);
 
-        translateMatrix = glm::translate(identityMatrix, glm::vec3(-2.3, -1.0, -5.5));
-        scaleMatrix = glm::scale(identityMatrix, glm::vec3(1.0, 7.0, 16.0));
-        model = translateMatrix * scaleMatrix;
+    for (int i = 0; i < 4; i++)
+    {
+        translateMatrix = translateMatrix * glm::translate(identityMatrix, glm::vec3(0.0f, 0.0f, -0.9f));
+        makeTool(drawList,
+            translateMatrix);
+    }
+}
 
-        ourShader.setMat4("model", model);
-        ourShader.setVec4("color", glm::vec4(0.5, 0.0f, 0.5f, 1.0f));
-        glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
+// records a generated restaurant through the same helpers the hand built scene uses
+void buildGeneratedScene(DrawList& drawList, const GeneratedScene& scene)
+{
+    buildGeneratedRange(drawList, scene, 0, scene.objects.size());
+}
 
+// records objects [begin, end) of a generated restaurant
+void buildGeneratedRange(DrawList& drawList, const GeneratedScene& scene, size_t begin, size_t end)
+{
+    DrawSource source(drawList, __FUNCTION__);
+    for (size_t i = begin; i < end; i++)
+    {
+        const SceneObject& object = scene.objects[i];
+        glm::mat4 model = object.transform();
+        switch (object.type)
+        {
+        case OBJECT_TILE:
+            makeT(drawList, model, object.color.x, object.color.y, object.color.z, object.color.w);
+            break;
+        case OBJECT_TABLE:
+            drawTable(drawList, model);
+            break;
+        case OBJECT_CHAIR:
+            drawCHair(drawList, model);
+            break;
+        case OBJECT_STOOL:
+            makeTool(drawList, model);
+            break;
+        case OBJECT_WALL:
+            drawList.add(model, object.color);
+            break;
+        }
+    }
+}
 
+// a ceiling fan hanging rodLength below the ceiling: a rod, a hub and four blades turning
+// about the vertical through center
+void addCeilingFan(AnimationSystem& animation, DrawList& drawList, const glm::vec3& center, float rodLength, float phase)
+{
+    glm::mat4 identityMatrix = glm::mat4(1.0f);
+    glm::mat4 placement = glm::translate(identityMatrix, center);
+    glm::mat4 shape = glm::translate(identityMatrix, glm::vec3(-0.02f, 0.0f, -0.02f)) * glm::scale(identityMatrix, glm::vec3(0.08f, rodLength / 0.5f, 0.08f));
+    animation.addPart(drawList, placement, shape, glm::vec4(0.2f, 0.2f, 0.2f, 1.0f));
+
+    const float turnsPerSecond = 0.75f;
+    shape = glm::translate(identityMatrix, glm::vec3(-0.1f, -0.06f, -0.1f)) * glm::scale(identityMatrix, glm::vec3(0.4f, 0.12f, 0.4f));
+    unsigned int hub = animation.addPart(drawList, placement, shape, glm::vec4(0.25f, 0.25f, 0.25f, 1.0f));
+    animation.spin(hub, ANIMATE_ROTATION, 360.0f, turnsPerSecond, phase);
+    for (int blade = 0; blade < 4; blade++)
+    {
+        shape = glm::rotate(identityMatrix, glm::radians(90.0f * blade), glm::vec3(0.0f, 1.0f, 0.0f))
+            * glm::translate(identityMatrix, glm::vec3(0.1f, -0.04f, -0.06f)) * glm::scale(identityMatrix, glm::vec3(1.4f, 0.03f, 0.24f));
+        unsigned int part = animation.addPart(drawList, placement, shape, glm::vec4(0.55f, 0.35f, 0.2f, 1.0f));
+        animation.spin(part, ANIMATE_ROTATION, 360.0f, turnsPerSecond, phase);
+    }
+}
 
-        translateMatrix = glm::translate(identityMatrix, glm::vec3(1.7, -1.0, -4.5));
-        scaleMatrix = glm::scale(identityMatrix, glm::vec3(.5, 7.0, 16.0));
-        model = translateMatrix * scaleMatrix;
+// a tray on the top of a table placed by the rigid transform table (drawTable's frame
+// before its scale), sliding across it and filling up from steel to gold
+void addTray(AnimationSystem& animation, DrawList& drawList, const glm::mat4& table, float phase)
+{
+    glm::mat4 identityMatrix = glm::mat4(1.0f);
+    glm::mat4 placement = table * glm::translate(identityMatrix, glm::vec3(0.35f, 0.06f, 0.25f));
+    glm::mat4 shape = glm::translate(identityMatrix, glm::vec3(-0.12f, 0.0f, -0.08f)) * glm::scale(identityMatrix, glm::vec3(0.48f, 0.04f, 0.32f));
+    unsigned int tray = animation.addPart(drawList, placement, shape, glm::vec4(0.7f, 0.7f, 0.75f, 1.0f), glm::vec3(0.0f, 1.0f, 0.0f), glm::vec3(1.0f, 0.0f, 0.0f));
+    animation.setColorRamp(drawList, tray, glm::vec4(0.9f, 0.6f, 0.15f, 1.0f));
+    const float slide[] = { -0.2f, 0.2f };
+    animation.keyframes(tray, ANIMATE_TRANSLATION, slide, 2, 4.0f, phase);
+    const float fill[] = { 0.0f, 1.0f };
+    animation.keyframes(tray, ANIMATE_COLOR, fill, 2, 8.0f, phase);
+}
 
-        ourShader.setMat4("model", model);
-        ourShader.setVec4("color", glm::vec4(0.4, 0.0f, 0.4f, 1.0f));
-        glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
-       
-        translateMatrix = glm::translate(identityMatrix, glm::vec3(-0.6,0.2,1.3));
+// a door hinged at one end of a doorway, opening into the room, standing open and closing
+void addDoor(AnimationSystem& animation, DrawList& drawList, const AABB& opening, float phase)
+{
+    glm::mat4 identityMatrix = glm::mat4(1.0f);
+    glm::vec3 size = opening.max - opening.min;
+    glm::vec3 middle = (opening.min + opening.max) * 0.5f;
+    float height = std::min(size.y, 2.1f);
+    glm::mat4 placement;
+    float width;
+    if (size.x >= size.z)
+    {
+        placement = glm::translate(identityMatrix, glm::vec3(opening.min.x, opening.min.y, middle.z));
+        width = size.x;
+    }
+    else
+    {
+        placement = glm::translate(identityMatrix, glm::vec3(middle.x, opening.min.y, opening.min.z)) * glm::rotate(identityMatrix, glm::radians(-90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+        width = size.z;
+    }
+    glm::mat4 shape = glm::translate(identityMatrix, glm::vec3(0.01f, 0.0f, -0.02f)) * glm::scale(identityMatrix, glm::vec3((width - 0.02f) / 0.5f, height / 0.5f, 0.08f));
+    unsigned int door = animation.addPart(drawList, placement, shape, glm::vec4(0.45f, 0.28f, 0.15f, 1.0f));
+    const float swing[] = { 0.0f, 0.0f, 80.0f, 80.0f };
+    animation.keyframes(door, ANIMATE_ROTATION, swing, 4, 8.0f, phase);
+}
 
-        makeTool(VAO, ourShader,
-            translateMatrix);
+// --animate: a fan over every table and a tray on it, and a door in every doorway of a
+// generated scene; the hand built restaurant has its three tables and no doorways
+void buildAnimatedProps(AnimationSystem& animation, DrawList& drawList, const GeneratedScene* scene)
+{
+    glm::mat4 identityMatrix = glm::mat4(1.0f);
+    const float goldenRatio = 0.618034f;    // spreads the phases evenly
+    int props = 0;
+    if (scene == NULL)
+    {
+        // the tables of buildFurniture
+        glm::mat4 tables[3];
+        tables[0] = glm::rotate(identityMatrix, glm::radians(3.0f), glm::vec3(1.0f, 0.0f, 0.0f)) * glm::rotate(identityMatrix, glm::radians(-1.0f), glm::vec3(0.0f, 1.0f, 0.0f))
+            * glm::translate(identityMatrix, glm::vec3(.6f, -0.2f, 1.0f));
+        tables[1] = glm::translate(identityMatrix, glm::vec3(.6f, -0.2f, -1.0f));
+        tables[2] = glm::translate(identityMatrix, glm::vec3(.6f, -0.2f, -3.0f));
+        for (int i = 0; i < 3; i++, props++)
+        {
+            float phase = props * goldenRatio;
+            addTray(animation, drawList, tables[i], phase);
+            glm::vec3 top = glm::vec3(tables[i] * glm::vec4(0.35f, 0.06f, 0.25f, 1.0f));
+            addCeilingFan(animation, drawList, top + glm::vec3(0.0f, 1.5f, 0.0f), 0.3f, phase);
+        }
+        return;
+    }
 
-        for (int i = 0; i < 4; i++)
+    for (size_t i = 0; i < scene->objects.size(); i++)
+    {
+        const SceneObject& object = scene->objects[i];
+        if (object.type != OBJECT_TABLE)
+            continue;
+        glm::mat4 table = glm::translate(identityMatrix, object.position) * glm::rotate(identityMatrix, glm::radians(object.yaw), glm::vec3(0.0f, 1.0f, 0.0f));
+        float phase = props * goldenRatio;
+        addTray(animation, drawList, table, phase);
+
+        // the fan hangs 0.4 below the ceiling of the table's room
+        glm::vec3 top = glm::vec3(table * glm::vec4(0.35f, 0.06f, 0.25f, 1.0f));
+        float ceiling = top.y + 2.0f;
+        for (size_t r = 0; r < scene->rooms.size(); r++)
         {
-            translateMatrix = translateMatrix * glm::translate(identityMatrix, glm::vec3(0.0f, 0.0f, -0.9f));
-            makeTool(VAO, ourShader,
-                translateMatrix);
+            const AABB& room = scene->rooms[r].bounds;
+            if (top.x >= room.min.x && top.x <= room.max.x && top.z >= room.min.z && top.z <= room.max.z)
+            {
+                ceiling = room.max.y;
+                break;
+            }
         }
+        addCeilingFan(animation, drawList, glm::vec3(top.x, ceiling - 0.4f, top.z), 0.4f, phase);
+        props++;
+    }
+    for (size_t i = 0; i < scene->portals.size(); i++, props++)
+        addDoor(animation, drawList, scene->portals[i].opening, props * goldenRatio);
+}
 
-       
+// submits every recorded command with the single camera as one instanced draw; materials
+// come from the uniform buffer, so no uniforms change between objects. With the depth
+// pre-pass the scene is drawn twice: depth only, then shaded with GL_EQUAL so that every
+// pixel runs the fragment shader once, whatever order the boxes come in. countOverdraw
+// draws the fragment count instead of the colors (see overdraw.h). With portals only the
+// commands they found visible are submitted. The depth pass and the shaded pass may use
+// different programs (shader variants); both have the camera set.
+void renderDrawList(SceneRenderer& sceneRenderer, RenderDevice& device, DeviceHandle depthProgram, DeviceHandle shadedProgram, const DrawList& drawList, bool depthPrepass, bool countOverdraw, const PortalVisibility* portals)
+{
+    sceneRenderer.beginFrame(drawList.materials);
+    if (portals != NULL)
+        sceneRenderer.uploadInstances(drawList, portals->visible, portals->masks);
+    else
+        sceneRenderer.uploadInstances(drawList);
 
-      
-        /*
-         translateMatrix = glm::translate(identityMatrix, glm::vec3(translate_X, translate_Y, translate_Z));
-        rotateXMatrix = glm::rotate(identityMatrix, glm::radians(rotateAngle_X), glm::vec3(1.0f, 0.0f, 0.0f));
-        rotateYMatrix = glm::rotate(identityMatrix, glm::radians(rotateAngle_Y), glm::vec3(0.0f, 1.0f, 0.0f));
-        rotateZMatrix = glm::rotate(identityMatrix, glm::radians(rotateAngle_Z), glm::vec3(0.0f, 0.0f, 1.0f));
-        scaleMatrix = glm::scale(identityMatrix, glm::vec3(scale_X, scale_Y, scale_Z));
-        model = translateMatrix * rotateXMatrix * rotateYMatrix * rotateZMatrix * scaleMatrix;
-        */
-        // render boxes
-        //for (unsigned int i = 0; i < 10; i++)
-        //{
-        //    // calculate the model matrix for each object and pass it to shader before drawing
-        //    glm::mat4 model = glm::mat4(1.0f); // make sure to initialize matrix to identity matrix first
-        //    model = glm::translate(model, cubePositions[i]);
-        //    float angle = 20.0f * i;
-        //    model = glm::rotate(model, glm::radians(angle), glm::vec3(1.0f, 0.3f, 0.5f));
-        //    ourShader.setMat4("model", model);
+    if (depthPrepass)
+    {
+        device.useProgram(depthProgram);
+        device.setInt(depthProgram, "viewBit", 1);
+        device.setInt(depthProgram, "fragmentOutput", FRAGMENT_NONE);
+        device.setDepthMode(DEPTH_PREPASS);
+        sceneRenderer.draw();
+        device.setDepthMode(DEPTH_EQUAL_TEST);
+    }
+    device.useProgram(shadedProgram);
+    device.setInt(shadedProgram, "viewBit", 1);
+    device.setInt(shadedProgram, "fragmentOutput", countOverdraw ? FRAGMENT_OVERDRAW : FRAGMENT_SHADED);
+    if (countOverdraw)
+        device.setAdditiveBlend(true);
+    sceneRenderer.draw();
+
+    if (countOverdraw)
+        device.setAdditiveBlend(false);
+    if (depthPrepass)
+        device.setDepthMode(DEPTH_TEST_WRITE);
+}
 
-        //    glDrawArrays(GL_TRIANGLES, 0, 36);
-        //}
+// the same passes with the commands a compute shader wrote: the list is culled on the GPU
+// once per frame, and every pass draws what survived with one indirect multi-draw
+void renderGpuCulled(SceneRenderer& sceneRenderer, GpuCulling& gpuCulling, RenderDevice& device, DeviceHandle depthProgram, DeviceHandle shadedProgram, const DrawList& drawList, const glm::mat4& viewProjection, const glm::vec3& eye, float lodPixels, float pixelScale, bool depthPrepass, bool countOverdraw)
+{
+    sceneRenderer.beginFrame(drawList.materials);
+    gpuCulling.cull(viewProjection, eye, lodPixels, pixelScale);
 
-        // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
-        // -------------------------------------------------------------------------------
-        glfwSwapBuffers(window);
-        glfwPollEvents();
+    if (depthPrepass)
+    {
+        device.useProgram(depthProgram);
+        device.setInt(depthProgram, "viewBit", 1);
+        device.setInt(depthProgram, "fragmentOutput", FRAGMENT_NONE);
+        device.setDepthMode(DEPTH_PREPASS);
+        gpuCulling.draw();
+        device.setDepthMode(DEPTH_EQUAL_TEST);
     }
+    device.useProgram(shadedProgram);
+    device.setInt(shadedProgram, "viewBit", 1);
+    device.setInt(shadedProgram, "fragmentOutput", countOverdraw ? FRAGMENT_OVERDRAW : FRAGMENT_SHADED);
+    if (countOverdraw)
+        device.setAdditiveBlend(true);
+    gpuCulling.draw();
+
+    if (countOverdraw)
+        device.setAdditiveBlend(false);
+    if (depthPrepass)
+        device.setDepthMode(DEPTH_TEST_WRITE);
+}
 
-    // optional: de-allocate all resources once they've outlived their purpose:
-    // ------------------------------------------------------------------------
-    glDeleteVertexArrays(1, &VAO);
-    glDeleteBuffers(1, &VBO);
-    glDeleteBuffers(1, &EBO);
+// the same passes for the resident cells of a streamed world; the world has its own
+// material table, and the cells their own instance buffers
+void renderWorld(SceneRenderer& sceneRenderer, WorldStreamer& streamer, RenderDevice& device, DeviceHandle depthProgram, DeviceHandle shadedProgram, const glm::mat4& viewProjection, bool depthPrepass, bool countOverdraw)
+{
+    sceneRenderer.beginFrame(streamer.materialTable());
 
-    // glfw: terminate, clearing all previously allocated GLFW resources.
-    // ------------------------------------------------------------------
-    glfwTerminate();
-    return 0;
+    if (depthPrepass)
+    {
+        device.useProgram(depthProgram);
+        device.setInt(depthProgram, "viewBit", 1);
+        device.setInt(depthProgram, "fragmentOutput", FRAGMENT_NONE);
+        device.setDepthMode(DEPTH_PREPASS);
+        streamer.draw(viewProjection);
+        device.setDepthMode(DEPTH_EQUAL_TEST);
+    }
+    device.useProgram(shadedProgram);
+    device.setInt(shadedProgram, "viewBit", 1);
+    device.setInt(shadedProgram, "fragmentOutput", countOverdraw ? FRAGMENT_OVERDRAW : FRAGMENT_SHADED);
+    if (countOverdraw)
+        device.setAdditiveBlend(true);
+    streamer.draw(viewProjection);
+
+    if (countOverdraw)
+        device.setAdditiveBlend(false);
+    if (depthPrepass)
+        device.setDepthMode(DEPTH_TEST_WRITE);
 }
 
-void makeT(unsigned int VAO, Shader ourShader, glm::mat4 sm, float a, float b, float c, float d) {
+void makeT(DrawList& drawList, glm::mat4 sm, float a, float b, float c, float d) {
+    DrawSource source(drawList, __FUNCTION__);
     // Modelling Transformation
     glm::mat4 identityMatrix = glm::mat4(1.0f); // make sure to initialize matrix to identity matrix first
     glm::mat4 translateMatrix, rotateXMatrix, rotateYMatrix, rotateZMatrix, scaleMatrix, model;
     translateMatrix = glm::translate(identityMatrix, glm::vec3(0.0, -1.0, -0.1));
     scaleMatrix = glm::scale(identityMatrix, glm::vec3(0.4, 0.0, 0.4));
     model = sm * translateMatrix * scaleMatrix;
-    ourShader.setMat4("model", model);
-    ourShader.setVec4("color", glm::vec4(a, b, c, d));
-
-    glBindVertexArray(VAO);
-    glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
+    drawList.add(model, glm::vec4(a, b, c, d));
 
 
 }
-void drawTiles(unsigned int VAO, Shader ourShader, glm::mat4 sm)
+void drawTiles(DrawList& drawList, glm::mat4 sm)
 {
+    DrawSource source(drawList, __FUNCTION__);
     glm::mat4 identityMatrix = glm::mat4(1.0f); // make sure to initialize matrix to identity matrix first
     glm::mat4 translateMatrix, rotateXMatrix, rotateYMatrix, rotateZMatrix, scaleMatrix, model;
     translateMatrix = glm::translate(identityMatrix, glm::vec3(0.0, 0.0,-1.0));
     rotateXMatrix = glm::rotate(identityMatrix, glm::radians(90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
     scaleMatrix = glm::scale(identityMatrix, glm::vec3(0.5F, 0.0f, 0.5f));
     model = sm  * scaleMatrix;
-    ourShader.setMat4("model", model);
-    //ourShader.setVec3("aColor", glm::vec3(0.2f, 0.1f, 0.4f));
-    glBindVertexArray(VAO);
-    glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
+    drawList.add(model, glm::vec4(0.2f, 0.1f, 0.4f, 1.0f));
 
     translateMatrix = glm::translate(identityMatrix, glm::vec3(-0.24f, -0.1f, 0.51f));
     rotateXMatrix = glm::rotate(identityMatrix, glm::radians(-90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
     scaleMatrix = glm::scale(identityMatrix, glm::vec3(0.5F, 1.0f, 0.2f));
     model = sm * translateMatrix * scaleMatrix;
-    ourShader.setMat4("model", model);
-    //ourShader.setVec3("aColor", glm::vec3(0.2f, 0.1f, 0.4f));
-    glBindVertexArray(VAO);
-    glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
+    drawList.add(model, glm::vec4(0.2f, 0.1f, 0.4f, 1.0f));
 
 
 
@@ -931,8 +2051,9 @@ void drawTiles(unsigned int VAO, Shader ourShader, glm::mat4 sm)
     glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);*/
 
 }
-void drawCHair(unsigned int VAO, Shader ourShader, glm::mat4 sm)
+void drawCHair(DrawList& drawList, glm::mat4 sm)
 {
+    DrawSource source(drawList, __FUNCTION__);
     glm::mat4 identityMatrix = glm::mat4(1.0f); // make sure to initialize matrix to identity matrix first
     glm::mat4 translateMatrix, rotateXMatrix, rotateYMatrix, rotateZMatrix, scaleMatrix, model, rotateX1Matrix, rotateX2Matrix;
     translateMatrix = glm::translate(identityMatrix, glm::vec3(0.1,- 0.2, -1.1));
@@ -941,10 +2062,7 @@ void drawCHair(unsigned int VAO, Shader ourShader, glm::mat4 sm)
     rotateZMatrix = glm::rotate(identityMatrix, glm::radians(rotateAngle_Z), glm::vec3(0.0f, 0.0f, 1.0f));
     scaleMatrix = glm::scale(identityMatrix, glm::vec3(1.5, 0.6, 1.5));
     model =sm*  translateMatrix * scaleMatrix;
-    ourShader.setMat4("model", model);
-    ourShader.setVec4("color", glm::vec4(1.0f, 0.1f, 0.0f,1.0f));
-    glBindVertexArray(VAO);
-    glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
+    drawList.add(model, glm::vec4(1.0f, 0.1f, 0.0f,1.0f));
 
     translateMatrix = glm::translate(identityMatrix, glm::vec3(0.1f, -0.2f, -1.1));
     rotateXMatrix = glm::rotate(identityMatrix, glm::radians(rotateAngle_X), glm::vec3(1.0f, 0.0f, 0.0f));
@@ -952,13 +2070,11 @@ void drawCHair(unsigned int VAO, Shader ourShader, glm::mat4 sm)
     rotateZMatrix = glm::rotate(identityMatrix, glm::radians(rotateAngle_Z), glm::vec3(0.0f, 0.0f, 1.0f));
     scaleMatrix = glm::scale(identityMatrix, glm::vec3(0.2, 1.6, 1.5));
     model = sm * translateMatrix * rotateYMatrix *scaleMatrix;
-    ourShader.setMat4("model", model);
-    ourShader.setVec4("color", glm::vec4(0.5, 0.1f, 0.0f, 1.0f));
-    glBindVertexArray(VAO);
-    glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
+    drawList.add(model, glm::vec4(0.5, 0.1f, 0.0f, 1.0f));
 }
-void drawTable(unsigned int VAO, Shader ourShader, glm::mat4 sm)
+void drawTable(DrawList& drawList, glm::mat4 sm)
 {
+    DrawSource source(drawList, __FUNCTION__);
 
     glm::mat4 identityMatrix = glm::mat4(1.0f); // make sure to initialize matrix to identity matrix first
     glm::mat4 translateMatrix, rotateXMatrix, rotateYMatrix, rotateZMatrix, scaleMatrix, model, rotateX1Matrix, rotateX2Matrix;
@@ -966,102 +2082,63 @@ void drawTable(unsigned int VAO, Shader ourShader, glm::mat4 sm)
     translateMatrix = glm::translate(identityMatrix, glm::vec3(-0.125f, 0.0f, 0.0f));
     scaleMatrix = glm::scale(identityMatrix, glm::vec3(2.5f, 0.2f, 2.0f));
     model = sm * translateMatrix * scaleMatrix;
-    ourShader.setMat4("model", model);
-    ourShader.setVec4("color", glm::vec4(0.9, 0.6f, 0.4f, 1.0f));
-
-    glBindVertexArray(VAO);
-    glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
+    drawList.add(model, glm::vec4(0.9, 0.6f, 0.4f, 1.0f));
 
 
     scaleMatrix = glm::scale(identityMatrix, glm::vec3(0.2f, -2.0f, 0.2f));
     model = sm * scaleMatrix;
-    ourShader.setMat4("model", model);
-    ourShader.setVec4("color", glm::vec4(0.5, 0.3f, 0.1f, 1.0f));
-
-    glBindVertexArray(VAO);
-    glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
+    drawList.add(model, glm::vec4(0.5, 0.3f, 0.1f, 1.0f));
 
 
     translateMatrix = glm::translate(identityMatrix, glm::vec3(0.0f, 0.0f, 0.9f));
     scaleMatrix = glm::scale(identityMatrix, glm::vec3(0.2f, -2.0f, 0.2f));
     model = sm * translateMatrix * scaleMatrix;
-    ourShader.setMat4("model", model);
-    ourShader.setVec4("color", glm::vec4(0.5, 0.3f, 0.1f, 1.0f));
-
-    glBindVertexArray(VAO);
-    glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
+    drawList.add(model, glm::vec4(0.5, 0.3f, 0.1f, 1.0f));
 
 
     translateMatrix = glm::translate(identityMatrix, glm::vec3(0.9f, 0.0f, 0.9f));
     scaleMatrix = glm::scale(identityMatrix, glm::vec3(0.2f, -2.0f, 0.2f));
     model = sm * translateMatrix * scaleMatrix;
-    ourShader.setMat4("model", model);
-    ourShader.setVec4("color", glm::vec4(0.5, 0.3f, 0.1f, 1.0f));
-
-    glBindVertexArray(VAO);
-    glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
+    drawList.add(model, glm::vec4(0.5, 0.3f, 0.1f, 1.0f));
 
 
     translateMatrix = glm::translate(identityMatrix, glm::vec3(0.9f, 0.0f, 0.0f));
     scaleMatrix = glm::scale(identityMatrix, glm::vec3(0.2f, -2.0f, 0.2f));
     model = sm * translateMatrix * scaleMatrix;
-    ourShader.setMat4("model", model);
-    ourShader.setVec4("color", glm::vec4(0.5, 0.3f, 0.1f, 1.0f));
-
-    glBindVertexArray(VAO);
-    glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
+    drawList.add(model, glm::vec4(0.5, 0.3f, 0.1f, 1.0f));
 
     rotateXMatrix = glm::rotate(identityMatrix, glm::radians(-10.0f), glm::vec3(1.0f, 0.0f, 0.0f));
     translateMatrix = glm::translate(identityMatrix, glm::vec3(-0.125f, 0.0f, 0.0f));
     scaleMatrix = glm::scale(identityMatrix, glm::vec3(2.5f, 0.2f, 2.0f));
     model = sm * translateMatrix * scaleMatrix;
-    ourShader.setMat4("model", model);
-    ourShader.setVec4("color", glm::vec4(0.5, 0.3f, 0.1f, 1.0f));
-
-    glBindVertexArray(VAO);
-    glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
+    drawList.add(model, glm::vec4(0.5, 0.3f, 0.1f, 1.0f));
 
 
     scaleMatrix = glm::scale(identityMatrix, glm::vec3(0.2f, -2.0f, 0.2f));
     model = sm * scaleMatrix;
-    ourShader.setMat4("model", model);
-    ourShader.setVec4("color", glm::vec4(0.5, 0.3f, 0.1f, 1.0f));
-
-    glBindVertexArray(VAO);
-    glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
+    drawList.add(model, glm::vec4(0.5, 0.3f, 0.1f, 1.0f));
 
 
     translateMatrix = glm::translate(identityMatrix, glm::vec3(0.0f, 0.0f, 0.9f));
     scaleMatrix = glm::scale(identityMatrix, glm::vec3(0.2f, -2.0f, 0.2f));
     model = sm * translateMatrix * scaleMatrix;
-    ourShader.setMat4("model", model);
-    ourShader.setVec4("color", glm::vec4(0.5, 0.3f, 0.1f, 1.0f));
-
-    glBindVertexArray(VAO);
-    glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
+    drawList.add(model, glm::vec4(0.5, 0.3f, 0.1f, 1.0f));
 
 
     translateMatrix = glm::translate(identityMatrix, glm::vec3(0.9f, 0.0f, 0.9f));
     scaleMatrix = glm::scale(identityMatrix, glm::vec3(0.2f, -2.0f, 0.2f));
     model = sm * translateMatrix * scaleMatrix;
-    ourShader.setMat4("model", model);
-    ourShader.setVec4("color", glm::vec4(0.5, 0.3f, 0.1f, 1.0f));
-
-    glBindVertexArray(VAO);
-    glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
+    drawList.add(model, glm::vec4(0.5, 0.3f, 0.1f, 1.0f));
 
 
     translateMatrix = glm::translate(identityMatrix, glm::vec3(0.9f, 0.0f, 0.0f));
     scaleMatrix = glm::scale(identityMatrix, glm::vec3(0.2f, -2.0f, 0.2f));
     model = sm * translateMatrix * scaleMatrix;
-    ourShader.setMat4("model", model);
-    ourShader.setVec4("color", glm::vec4(0.5, 0.3f, 0.1f, 1.0f));
-
-    glBindVertexArray(VAO);
-    glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
+    drawList.add(model, glm::vec4(0.5, 0.3f, 0.1f, 1.0f));
 }
 
-void makeTool(unsigned int VAO, Shader ourShader, glm::mat4 sm) {
+void makeTool(DrawList& drawList, glm::mat4 sm) {
+    DrawSource source(drawList, __FUNCTION__);
     // Modelling Transformation
   
     /*translateMatrix = glm::translate(identityMatrix, glm::vec3(translate_X, translate_Y, translate_Z));
@@ -1100,30 +2177,18 @@ void makeTool(unsigned int VAO, Shader ourShader, glm::mat4 sm) {
     translateMatrix = glm::translate(identityMatrix, glm::vec3(0.0, -1.0, -0.1));
     scaleMatrix = glm::scale(identityMatrix, glm::vec3(0.4, 0.0, 0.4));
     model = sm * translateMatrix * scaleMatrix;
-    ourShader.setMat4("model", model);
-    ourShader.setVec4("color", glm::vec4(0.3, 0.4, 1.0, 0.0));
-
-    glBindVertexArray(VAO);
-    glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
+    drawList.add(model, glm::vec4(0.3, 0.4, 1.0, 0.0));
 
     translateMatrix = glm::translate(identityMatrix, glm::vec3(0.07, -1.0, 0.0));
     scaleMatrix = glm::scale(identityMatrix, glm::vec3(0.1, 1.0, 0.1));
     model = sm * translateMatrix * scaleMatrix;
-    ourShader.setMat4("model", model);
-    ourShader.setVec4("color", glm::vec4(1.0, 1.0, 1.0, 1.0));
-
-    glBindVertexArray(VAO);
-    glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
+    drawList.add(model, glm::vec4(1.0, 1.0, 1.0, 1.0));
 
 
     translateMatrix = glm::translate(identityMatrix, glm::vec3(0.0, -0.5, 0.0));
     scaleMatrix = glm::scale(identityMatrix, glm::vec3(0.4, 0.4, 0.4));
     model = sm * translateMatrix * scaleMatrix;
-    ourShader.setMat4("model", model);
-    ourShader.setVec4("color", glm::vec4(1.0, 0.0, 1.0, 1.0));
-
-    glBindVertexArray(VAO);
-    glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
+    drawList.add(model, glm::vec4(1.0, 0.0, 1.0, 1.0));
 
 
 
@@ -1149,140 +2214,147 @@ void processInput(GLFWwindow* window)
         camera.ProcessKeyboard(RIGHT, deltaTime);
     }
 
-    if (glfwGetKey(window, GLFW_KEY_R) == GLFW_PRESS)
+    if (glfwGetKey(window, GLFW_KEY_N) == GLFW_PRESS)
     {
-        if (rotateAxis_X) rotateAngle_X -= 1;
-        else if (rotateAxis_Y) rotateAngle_Y -= 1;
-        else rotateAngle_Z -= 1;
+        camera.ProcessKeyboard(YAW_R, deltaTime);
     }
-    if (glfwGetKey(window, GLFW_KEY_G) == GLFW_PRESS)
+    if (glfwGetKey(window, GLFW_KEY_M) == GLFW_PRESS)
     {
-        if (fanRotating) {
-            fanRotating = false;
-        }
-        else {
-            fanRotating = true;
-            fanSpinning();
-        }
-
+        camera.ProcessKeyboard(YAW_L, deltaTime);
     }
-    if (glfwGetKey(window, GLFW_KEY_I) == GLFW_PRESS) translate_Y += 0.01;
-    if (glfwGetKey(window, GLFW_KEY_K) == GLFW_PRESS) translate_Y -= 0.01;
-    if (glfwGetKey(window, GLFW_KEY_L) == GLFW_PRESS) translate_X += 0.01;
-    if (glfwGetKey(window, GLFW_KEY_J) == GLFW_PRESS) translate_X -= 0.01;
-    if (glfwGetKey(window, GLFW_KEY_O) == GLFW_PRESS) translate_Z += 0.01;
-    if (glfwGetKey(window, GLFW_KEY_P) == GLFW_PRESS) translate_Z -= 0.01;
-    if (glfwGetKey(window, GLFW_KEY_C) == GLFW_PRESS) scale_X += 0.01;
-    if (glfwGetKey(window, GLFW_KEY_V) == GLFW_PRESS) scale_X -= 0.01;
-    if (glfwGetKey(window, GLFW_KEY_B) == GLFW_PRESS) scale_Y += 0.01;
-    if (glfwGetKey(window, GLFW_KEY_N) == GLFW_PRESS) scale_Y -= 0.01;
-    if (glfwGetKey(window, GLFW_KEY_M) == GLFW_PRESS) scale_Z += 0.01;
-    if (glfwGetKey(window, GLFW_KEY_U) == GLFW_PRESS) scale_Z -= 0.01;
 
-    if (glfwGetKey(window, GLFW_KEY_X) == GLFW_PRESS)
+    // the held keys step the scene state: here, or on the simulation thread with --sim-thread
+    unsigned long long keys = 0;
+    for (size_t i = 0; i < sizeof(SIMULATION_KEYS) / sizeof(SIMULATION_KEYS[0]); i++)
     {
-        rotateAngle_X += 1;
-        rotateAxis_X = 1.0;
-        rotateAxis_Y = 0.0;
-        rotateAxis_Z = 0.0;
+        if (glfwGetKey(window, SIMULATION_KEYS[i]) == GLFW_PRESS)
+            keys |= keyBit(SIMULATION_KEYS[i]);
     }
-    if (glfwGetKey(window, GLFW_KEY_Y) == GLFW_PRESS)
+    if (simulationThreaded)
+        simulationKeys.store(keys, std::memory_order_relaxed);
+    else
     {
-        rotateAngle_Y += 1;
-        rotateAxis_X = 0.0;
-        rotateAxis_Y = 1.0;
-        rotateAxis_Z = 0.0;
+        simulate(sceneState, keys, deltaTime);
+        showSceneState(sceneState);
     }
-    if (glfwGetKey(window, GLFW_KEY_Z) == GLFW_PRESS)
+}
+
+// one step of the scene state by dt seconds with the given keys held (see keyBit)
+// -------------------------------------------------------------------------------
+void simulate(SceneState& state, unsigned long long keys, float dt)
+{
+    if (keyHeld(keys, GLFW_KEY_R))
     {
-        rotateAngle_Z += 1;
-        rotateAxis_X = 0.0;
-        rotateAxis_Y = 0.0;
-        rotateAxis_Z = 1.0;
+        if (state.rotateAxis_X) state.rotateAngle_X -= 1;
+        else if (state.rotateAxis_Y) state.rotateAngle_Y -= 1;
+        else state.rotateAngle_Z -= 1;
     }
+    if (keyHeld(keys, GLFW_KEY_G))
+    {
+        if (state.fanRotating) {
+            state.fanRotating = false;
+        }
+        else {
+            state.fanRotating = true;
+            fanSpinning(state, dt);
+        }
 
-    if (glfwGetKey(window, GLFW_KEY_H) == GLFW_PRESS)
+    }
+    if (keyHeld(keys, GLFW_KEY_I)) state.translate_Y += 0.01;
+    if (keyHeld(keys, GLFW_KEY_K)) state.translate_Y -= 0.01;
+    if (keyHeld(keys, GLFW_KEY_L)) state.translate_X += 0.01;
+    if (keyHeld(keys, GLFW_KEY_J)) state.translate_X -= 0.01;
+    if (keyHeld(keys, GLFW_KEY_O)) state.translate_Z += 0.01;
+    if (keyHeld(keys, GLFW_KEY_P)) state.translate_Z -= 0.01;
+    if (keyHeld(keys, GLFW_KEY_C)) state.scale_X += 0.01;
+    if (keyHeld(keys, GLFW_KEY_V)) state.scale_X -= 0.01;
+    if (keyHeld(keys, GLFW_KEY_B)) state.scale_Y += 0.01;
+    if (keyHeld(keys, GLFW_KEY_N)) state.scale_Y -= 0.01;
+    if (keyHeld(keys, GLFW_KEY_M)) state.scale_Z += 0.01;
+    if (keyHeld(keys, GLFW_KEY_U)) state.scale_Z -= 0.01;
+
+    if (keyHeld(keys, GLFW_KEY_X))
     {
-        eyeX += 2.5 * deltaTime;
-        basic_camera.changeEye(eyeX, eyeY, eyeZ);
+        state.rotateAngle_X += 1;
+        state.rotateAxis_X = 1.0;
+        state.rotateAxis_Y = 0.0;
+        state.rotateAxis_Z = 0.0;
     }
-    if (glfwGetKey(window, GLFW_KEY_F) == GLFW_PRESS)
+    if (keyHeld(keys, GLFW_KEY_Y))
     {
-        eyeX -= 2.5 * deltaTime;
-        basic_camera.changeEye(eyeX, eyeY, eyeZ);
+        state.rotateAngle_Y += 1;
+        state.rotateAxis_X = 0.0;
+        state.rotateAxis_Y = 1.0;
+        state.rotateAxis_Z = 0.0;
     }
-    if (glfwGetKey(window, GLFW_KEY_T) == GLFW_PRESS)
+    if (keyHeld(keys, GLFW_KEY_Z))
     {
-        eyeZ += 2.5 * deltaTime;
-        basic_camera.changeEye(eyeX, eyeY, eyeZ);
+        state.rotateAngle_Z += 1;
+        state.rotateAxis_X = 0.0;
+        state.rotateAxis_Y = 0.0;
+        state.rotateAxis_Z = 1.0;
     }
-    if (glfwGetKey(window, GLFW_KEY_G) == GLFW_PRESS)
+
+    if (keyHeld(keys, GLFW_KEY_H))
     {
-        eyeZ -= 2.5 * deltaTime;
-        basic_camera.changeEye(eyeX, eyeY, eyeZ);
+        state.eye.x += 2.5 * dt;
     }
-    if (glfwGetKey(window, GLFW_KEY_Q) == GLFW_PRESS)
+    if (keyHeld(keys, GLFW_KEY_F))
     {
-        eyeY += 2.5 * deltaTime;
-        basic_camera.changeEye(eyeX, eyeY, eyeZ);
+        state.eye.x -= 2.5 * dt;
     }
-    if (glfwGetKey(window, GLFW_KEY_E) == GLFW_PRESS)
+    if (keyHeld(keys, GLFW_KEY_T))
     {
-        eyeY -= 2.5 * deltaTime;
-        basic_camera.changeEye(eyeX, eyeY, eyeZ);
+        state.eye.z += 2.5 * dt;
     }
-    if (glfwGetKey(window, GLFW_KEY_1) == GLFW_PRESS)
+    if (keyHeld(keys, GLFW_KEY_G))
     {
-        lookAtX += 2.5 * deltaTime;
-        basic_camera.changeLookAt(lookAtX, lookAtY, lookAtZ);
+        state.eye.z -= 2.5 * dt;
     }
-    if (glfwGetKey(window, GLFW_KEY_2) == GLFW_PRESS)
+    if (keyHeld(keys, GLFW_KEY_Q))
     {
-        lookAtX -= 2.5 * deltaTime;
-        basic_camera.changeLookAt(lookAtX, lookAtY, lookAtZ);
+        state.eye.y += 2.5 * dt;
     }
-    if (glfwGetKey(window, GLFW_KEY_3) == GLFW_PRESS)
+    if (keyHeld(keys, GLFW_KEY_E))
     {
-        lookAtY += 2.5 * deltaTime;
-        basic_camera.changeLookAt(lookAtX, lookAtY, lookAtZ);
+        state.eye.y -= 2.5 * dt;
     }
-    if (glfwGetKey(window, GLFW_KEY_4) == GLFW_PRESS)
+    if (keyHeld(keys, GLFW_KEY_1))
     {
-        lookAtY -= 2.5 * deltaTime;
-        basic_camera.changeLookAt(lookAtX, lookAtY, lookAtZ);
+        state.lookAt.x += 2.5 * dt;
     }
-    if (glfwGetKey(window, GLFW_KEY_5) == GLFW_PRESS)
+    if (keyHeld(keys, GLFW_KEY_2))
     {
-        lookAtZ += 2.5 * deltaTime;
-        basic_camera.changeLookAt(lookAtX, lookAtY, lookAtZ);
+        state.lookAt.x -= 2.5 * dt;
     }
-    if (glfwGetKey(window, GLFW_KEY_6) == GLFW_PRESS)
+    if (keyHeld(keys, GLFW_KEY_3))
     {
-        lookAtZ -= 2.5 * deltaTime;
-        basic_camera.changeLookAt(lookAtX, lookAtY, lookAtZ);
+        state.lookAt.y += 2.5 * dt;
     }
-    if (glfwGetKey(window, GLFW_KEY_7) == GLFW_PRESS)
+    if (keyHeld(keys, GLFW_KEY_4))
     {
-        basic_camera.changeViewUpVector(glm::vec3(1.0f, 0.0f, 0.0f));
+        state.lookAt.y -= 2.5 * dt;
     }
-    if (glfwGetKey(window, GLFW_KEY_8) == GLFW_PRESS)
+    if (keyHeld(keys, GLFW_KEY_5))
     {
-        basic_camera.changeViewUpVector(glm::vec3(0.0f, 1.0f, 0.0f));
+        state.lookAt.z += 2.5 * dt;
     }
-    if (glfwGetKey(window, GLFW_KEY_9) == GLFW_PRESS)
+    if (keyHeld(keys, GLFW_KEY_6))
     {
-        basic_camera.changeViewUpVector(glm::vec3(0.0f, 0.0f, 1.0f));
+        state.lookAt.z -= 2.5 * dt;
     }
-
-    if (glfwGetKey(window, GLFW_KEY_N) == GLFW_PRESS)
+    if (keyHeld(keys, GLFW_KEY_7))
     {
-        camera.ProcessKeyboard(YAW_R, deltaTime);
+        state.up = glm::vec3(1.0f, 0.0f, 0.0f);
     }
-    if (glfwGetKey(window, GLFW_KEY_M) == GLFW_PRESS)
+    if (keyHeld(keys, GLFW_KEY_8))
     {
-        camera.ProcessKeyboard(YAW_L, deltaTime);
+        state.up = glm::vec3(0.0f, 1.0f, 0.0f);
+    }
+    if (keyHeld(keys, GLFW_KEY_9))
+    {
+        state.up = glm::vec3(0.0f, 0.0f, 1.0f);
     }
-
 }
 
 // glfw: whenever the window size changed (by OS or user resize) this callback function executes
@@ -1291,7 +2363,8 @@ void framebuffer_size_callback(GLFWwindow* window, int width, int height)
 {
     // make sure the viewport matches the new window dimensions; note that width and
     // height will be significantly larger than specified on retina displays.
-    glViewport(0, 0, width, height);
+    if (renderDevice != NULL)
+        renderDevice->setViewport(0, 0, width, height);
 }
 
 
@@ -1318,6 +2391,37 @@ void mouse_callback(GLFWwindow* window, double xposIn, double yposIn)
     camera.ProcessMouseMovement(xoffset, yoffset);
 }
 
+// glfw: toggles that must fire once per key press rather than every frame the key is held
+// -----------------------------------------------------------------------------------------
+void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods)
+{
+    if (action != GLFW_PRESS)
+        return;
+
+    if (key == GLFW_KEY_F1)
+    {
+        viewCount = viewCount % MAX_VIEWS + 1;
+        std::cout << "views: " << viewCount << std::endl;
+    }
+    if (key == GLFW_KEY_F2)
+    {
+        perViewPasses = !perViewPasses;
+        std::cout << (perViewPasses ? "multi-view: one pass per view" : "multi-view: single layered pass") << std::endl;
+    }
+    if (key == GLFW_KEY_F3)
+        printStats = true;
+    if (key == GLFW_KEY_F4)
+    {
+        lightingEnabled = !lightingEnabled;
+        std::cout << (lightingEnabled ? "clustered lighting on" : "clustered lighting off") << std::endl;
+    }
+    if (key == GLFW_KEY_F5)
+    {
+        bakedEnabled = !bakedEnabled;
+        std::cout << (bakedEnabled ? "baked lighting on" : "baked lighting off") << std::endl;
+    }
+}
+
 // glfw: whenever the mouse scroll wheel scrolls, this callback is called
 // ----------------------------------------------------------------------
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset)
@@ -0,0 +1,121 @@
+//
+//  material_table.h
+//  3D Object Drawing
+//
+
+#ifndef MATERIAL_TABLE_H
+#define MATERIAL_TABLE_H
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <unordered_map>
+#include <cstring>
+#include <iostream>
+
+// std140 sized; must match the Materials block in fragmentShader.fs. 1024 entries of 16 bytes
+// keep the block inside the 16 KB GL_MAX_UNIFORM_BLOCK_SIZE every GL 3.3 driver guarantees.
+const unsigned int MAX_MATERIALS = 1024;
+
+struct Material
+{
+    glm::vec4 color;
+};
+
+// Deduplicates material parameters into a table that the renderer mirrors in a uniform
+// buffer. Draws refer to a material by its 16-bit index instead of setting a color uniform
+// before every draw. The table only grows, so the renderer uploads just the new tail.
+class MaterialTable
+{
+public:
+    MaterialTable() : overflowed(false)
+    {
+    }
+
+    // returns the index of an identical material, adding one if none exists
+    unsigned short intern(const glm::vec4& color)
+    {
+        Key key;
+        std::memcpy(key.bits, &color[0], sizeof(key.bits));
+        std::unordered_map<Key, unsigned short, KeyHash>::const_iterator found = lookup.find(key);
+        if (found != lookup.end())
+            return found->second;
+
+        if (materials.size() >= MAX_MATERIALS)
+        {
+            overflowed = true;
+            return 0;
+        }
+
+        Material material;
+        material.color = color;
+        unsigned short index = (unsigned short)materials.size();
+        materials.push_back(material);
+        lookup[key] = index;
+        return index;
+    }
+
+    // a color did not fit and was given material 0 instead
+    bool full() const
+    {
+        return overflowed;
+    }
+
+    // a table whose colors are copied into this one was full, so this one misses some too
+    void markFull()
+    {
+        overflowed = true;
+    }
+
+    size_t size() const
+    {
+        return materials.size();
+    }
+
+    const Material& operator[](size_t i) const
+    {
+        return materials[i];
+    }
+
+    const Material* data() const
+    {
+        return materials.empty() ? NULL : &materials[0];
+    }
+
+private:
+    struct Key
+    {
+        unsigned int bits[4];
+
+        bool operator==(const Key& other) const
+        {
+            return std::memcmp(bits, other.bits, sizeof(bits)) == 0;
+        }
+    };
+
+    struct KeyHash
+    {
+        size_t operator()(const Key& key) const
+        {
+            size_t hash = 2166136261u;
+            for (int i = 0; i < 4; i++)
+                hash = (hash ^ key.bits[i]) * 16777619u;
+            return hash;
+        }
+    };
+
+    std::vector<Material> materials;
+    std::unordered_map<Key, unsigned short, KeyHash> lookup;
+    bool overflowed;
+};
+
+// a scene whose colors did not all fit in the table would be drawn with wrong materials
+inline bool checkMaterials(const MaterialTable& materials)
+{
+    if (!materials.full())
+        return true;
+    std::cout << "ERROR::MATERIALS::TABLE_FULL: the scene has more than " << MAX_MATERIALS << " distinct colors" << std::endl;
+    return false;
+}
+
+#endif
@@ -0,0 +1,35 @@
+#version 410 core
+#extension GL_ARB_shader_viewport_layer_array : enable
+#extension GL_AMD_vertex_shader_viewport_index : enable
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aColor;
+layout (location = 2) in mat4 instanceModel;
+layout (location = 6) in int instanceMaterial;
+layout (location = 7) in int instanceViewMask;
+
+flat out int materialIndex;
+out vec3 viewPosition;     // clustered lighting is single view only; lightingEnabled stays 0 here
+out vec3 bakedColor;        // likewise the baked light, indexed by the unculled instance
+
+// every object is repeated viewCount times in a row (attribute divisor = viewCount);
+// repeat i is routed to viewport i
+uniform mat4 viewProjection[4];
+uniform int viewCount;
+
+void main()
+{
+    int viewIndex = gl_InstanceID % viewCount;
+    gl_ViewportIndex = viewIndex;
+    materialIndex = instanceMaterial;
+    viewPosition = vec3(0.0f);
+    bakedColor = vec3(1.0f);
+    if ((instanceViewMask & (1 << viewIndex)) == 0)
+    {
+        // culled for this view: place the vertex outside the clip volume
+        gl_Position = vec4(2.0f, 2.0f, 2.0f, 1.0f);
+    }
+    else
+    {
+        gl_Position = viewProjection[viewIndex] * instanceModel * vec4(aPos, 1.0f);
+    }
+}
@@ -0,0 +1,279 @@
+//
+//  multi_view.h
+//  3D Object Drawing
+//
+
+#ifndef MULTI_VIEW_H
+#define MULTI_VIEW_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "basic_camera.h"
+#include "draw_list.h"
+#include "frustum.h"
+#include "render_device.h"
+#include "scene_renderer.h"
+
+#include <vector>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+
+const int MAX_VIEWS = 4;
+
+// a camera and the part of the window it is shown in (normalized 0..1 coordinates)
+struct ViewDesc
+{
+    BasicCamera camera;
+    float x, y, width, height;
+};
+
+struct MultiViewStats
+{
+    int views = 0;
+    bool layered = false;
+    size_t commands = 0;
+    size_t culled = 0;          // rejected by every view
+    size_t drawCalls = 0;
+    double cullMs = 0.0;
+    double submitMs = 0.0;
+};
+
+// Renders a DrawList into up to four views. Commands are culled once against all view
+// frusta, producing a per-command view mask that travels with the instance data. When the
+// device supports layered views (GL_ARB_shader_viewport_layer_array) the visible set is
+// drawn in a single instanced call, each object repeated once per view and routed to its
+// viewport by gl_ViewportIndex; otherwise each view draws the same instances in its own pass.
+class MultiViewRenderer
+{
+public:
+    MultiViewStats stats;
+
+    // layeredProgram is 0 when the device cannot route instances to viewports
+    MultiViewRenderer(SceneRenderer& renderer, RenderDevice& renderDevice, DeviceHandle singleViewProgram, DeviceHandle layeredProgram)
+        : sceneRenderer(renderer), device(renderDevice), singleProgram(singleViewProgram), multiProgram(layeredProgram),
+          layeredSupported(layeredProgram != 0 && renderDevice.supportsLayeredViews())
+    {
+    }
+
+    bool layered() const
+    {
+        return layeredSupported && !forcePerViewPasses;
+    }
+
+    void setForcePerViewPasses(bool force)
+    {
+        forcePerViewPasses = force;
+    }
+
+    void render(const DrawList& drawList, const std::vector<ViewDesc>& views, float fovDegrees, int framebufferWidth, int framebufferHeight)
+    {
+        typedef std::chrono::steady_clock clock;
+        int viewCount = (int)views.size();
+        if (viewCount > MAX_VIEWS)
+            viewCount = MAX_VIEWS;
+
+        stats = MultiViewStats();
+        stats.views = viewCount;
+        stats.layered = layered();
+        stats.commands = drawList.size();
+
+        // per-view matrices and frusta
+        clock::time_point start = clock::now();
+        glm::mat4 viewMatrices[MAX_VIEWS];
+        glm::mat4 projections[MAX_VIEWS];
+        glm::mat4 viewProjections[MAX_VIEWS];
+        Frustum frusta[MAX_VIEWS];
+        for (int v = 0; v < viewCount; v++)
+        {
+            BasicCamera camera = views[v].camera;
+            float aspect = (views[v].width * framebufferWidth) / (views[v].height * framebufferHeight);
+            viewMatrices[v] = camera.createViewMatrix();
+            projections[v] = glm::perspective(glm::radians(fovDegrees), aspect, 0.1f, 100.0f);
+            viewProjections[v] = projections[v] * viewMatrices[v];
+            frusta[v] = Frustum(viewProjections[v]);
+        }
+
+        // cull once against the union of the frusta
+        visible.clear();
+        masks.clear();
+        for (size_t i = 0; i < drawList.size(); i++)
+        {
+            AABB box = cubeWorldBounds(drawList[i].model);
+            int mask = 0;
+            for (int v = 0; v < viewCount; v++)
+            {
+                if (frusta[v].intersects(box))
+                    mask |= 1 << v;
+            }
+            if (mask == 0)
+            {
+                stats.culled++;
+                continue;
+            }
+            visible.push_back((unsigned int)i);
+            masks.push_back(mask);
+        }
+        clock::time_point culled = clock::now();
+
+        sceneRenderer.beginFrame(drawList.materials);
+        sceneRenderer.uploadInstances(drawList, visible, masks);
+        if (stats.layered)
+            submitLayered(views, viewCount, viewProjections, framebufferWidth, framebufferHeight);
+        else
+            submitPerView(views, viewCount, viewMatrices, projections, framebufferWidth, framebufferHeight);
+        stats.drawCalls = sceneRenderer.stats.drawCalls;
+
+        // leave a single full window viewport behind for whoever draws next
+        device.setViewport(0, 0, framebufferWidth, framebufferHeight);
+        clock::time_point submitted = clock::now();
+
+        stats.cullMs = std::chrono::duration<double, std::milli>(culled - start).count();
+        stats.submitMs = std::chrono::duration<double, std::milli>(submitted - culled).count();
+    }
+
+private:
+    SceneRenderer& sceneRenderer;
+    RenderDevice& device;
+    DeviceHandle singleProgram;
+    DeviceHandle multiProgram;
+    bool layeredSupported;
+    bool forcePerViewPasses = false;
+
+    std::vector<unsigned int> visible;
+    std::vector<int> masks;
+
+    void submitLayered(const std::vector<ViewDesc>& views, int viewCount, const glm::mat4* viewProjections, int framebufferWidth, int framebufferHeight)
+    {
+        for (int v = 0; v < viewCount; v++)
+        {
+            device.setViewportIndexed(v, views[v].x * framebufferWidth, views[v].y * framebufferHeight,
+                views[v].width * framebufferWidth, views[v].height * framebufferHeight);
+        }
+
+        device.useProgram(multiProgram);
+        device.setMat4Array(multiProgram, "viewProjection", viewProjections, viewCount);
+        device.setInt(multiProgram, "viewCount", viewCount);
+        sceneRenderer.draw(viewCount);
+    }
+
+    void submitPerView(const std::vector<ViewDesc>& views, int viewCount, const glm::mat4* viewMatrices, const glm::mat4* projections, int framebufferWidth, int framebufferHeight)
+    {
+        device.useProgram(singleProgram);
+        for (int v = 0; v < viewCount; v++)
+        {
+            device.setViewport((int)(views[v].x * framebufferWidth), (int)(views[v].y * framebufferHeight),
+                (int)(views[v].width * framebufferWidth), (int)(views[v].height * framebufferHeight));
+            device.setMat4(singleProgram, "projection", projections[v]);
+            device.setMat4(singleProgram, "view", viewMatrices[v]);
+            device.setInt(singleProgram, "viewBit", 1 << v);
+            sceneRenderer.draw();
+        }
+    }
+};
+
+// Steps the view count from 1 to MAX_VIEWS, averaging the CPU cost of each step over a
+// fixed number of frames, then prints one row per view count.
+class MultiViewBenchmark
+{
+public:
+    MultiViewBenchmark(int warmupFrames = 30, int measuredFrames = 300)
+        : warmup(warmupFrames), measured(measuredFrames)
+    {
+    }
+
+    bool done() const
+    {
+        return step >= MAX_VIEWS;
+    }
+
+    int viewCount() const
+    {
+        return step + 1;
+    }
+
+    void record(double traverseMs, const MultiViewStats& frame)
+    {
+        if (done())
+            return;
+        frameInStep++;
+        if (frameInStep > warmup)
+        {
+            Row& row = rows[step];
+            row.layered = frame.layered;
+            row.traverseMs += traverseMs;
+            row.cullMs += frame.cullMs;
+            row.submitMs += frame.submitMs;
+            row.drawCalls += (double)frame.drawCalls;
+            row.culled += (double)frame.culled;
+        }
+        if (frameInStep == warmup + measured)
+        {
+            step++;
+            frameInStep = 0;
+        }
+    }
+
+    void print() const
+    {
+        std::cout << "views  path       traverse ms  cull ms  submit ms  total ms  draws  culled" << std::endl;
+        for (int i = 0; i < MAX_VIEWS; i++)
+        {
+            const Row& row = rows[i];
+            double n = (double)measured;
+            double total = (row.traverseMs + row.cullMs + row.submitMs) / n;
+            std::printf("%5d  %-9s  %11.3f  %7.3f  %9.3f  %8.3f  %5.0f  %6.0f\n", i + 1, row.layered ? "layered" : "per-view",
+                row.traverseMs / n, row.cullMs / n, row.submitMs / n, total, row.drawCalls / n, row.culled / n);
+        }
+    }
+
+private:
+    struct Row
+    {
+        bool layered = false;
+        double traverseMs = 0.0;
+        double cullMs = 0.0;
+        double submitMs = 0.0;
+        double drawCalls = 0.0;
+        double culled = 0.0;
+    };
+
+    int warmup;
+    int measured;
+    int step = 0;
+    int frameInStep = 0;
+    Row rows[MAX_VIEWS];
+};
+
+// the four surveillance angles of the dining hall, laid out as a 2x2 split screen
+inline std::vector<ViewDesc> surveillanceViews(int count)
+{
+    std::vector<ViewDesc> views;
+    ViewDesc entrance = { BasicCamera(0.0f, 1.5f, 3.0f, 0.0f, -0.5f, -2.0f), 0.0f, 0.5f, 0.5f, 0.5f };
+    ViewDesc kitchenPass = { BasicCamera(0.0f, 1.5f, -4.5f, 0.0f, -0.5f, 0.0f), 0.5f, 0.5f, 0.5f, 0.5f };
+    ViewDesc diningLeft = { BasicCamera(-1.8f, 1.2f, 0.5f, 0.5f, -0.8f, -2.5f), 0.0f, 0.0f, 0.5f, 0.5f };
+    ViewDesc diningRight = { BasicCamera(1.6f, 1.2f, 0.5f, -0.5f, -0.8f, -2.5f), 0.5f, 0.0f, 0.5f, 0.5f };
+    views.push_back(entrance);
+    views.push_back(kitchenPass);
+    views.push_back(diningLeft);
+    views.push_back(diningRight);
+
+    if (count < 1)
+        count = 1;
+    if (count > MAX_VIEWS)
+        count = MAX_VIEWS;
+    views.resize(count);
+    if (count == 1)
+    {
+        views[0].x = 0.0f; views[0].y = 0.0f; views[0].width = 1.0f; views[0].height = 1.0f;
+    }
+    else if (count == 2)
+    {
+        views[0].x = 0.0f; views[0].y = 0.0f; views[0].width = 0.5f; views[0].height = 1.0f;
+        views[1].x = 0.5f; views[1].y = 0.0f; views[1].width = 0.5f; views[1].height = 1.0f;
+    }
+    return views;
+}
+
+#endif
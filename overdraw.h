@@ -0,0 +1,174 @@
+//
+//  overdraw.h
+//  3D Object Drawing
+//
+
+#ifndef OVERDRAW_H
+#define OVERDRAW_H
+
+#include <glad/glad.h>
+
+#include <vector>
+#include <chrono>
+#include <cstdio>
+#include <algorithm>
+
+// values of the fragmentOutput uniform in fragmentShader.fs
+enum FragmentOutput
+{
+    FRAGMENT_SHADED,
+    FRAGMENT_NONE,          // depth pre-pass; color writes are masked off anyway
+    FRAGMENT_OVERDRAW       // one step per fragment, summed by additive blending
+};
+
+// fragments shaded per pixel in one frame
+struct OverdrawStats
+{
+    size_t pixels = 0;
+    size_t coveredPixels = 0;       // pixels with at least one fragment
+    size_t fragments = 0;
+    int maxLayers = 0;
+    size_t saturatedPixels = 0;     // 255 or more fragments: the count is clamped there
+    double readMs = 0.0;
+
+    double average() const
+    {
+        return pixels > 0 ? (double)fragments / pixels : 0.0;
+    }
+
+    double coveredAverage() const
+    {
+        return coveredPixels > 0 ? (double)fragments / coveredPixels : 0.0;
+    }
+};
+
+// Reads the overdraw count back from the framebuffer. In overdraw mode every fragment that
+// passes the depth test adds 1/255 to the red channel of a black target (and 1/8 to green
+// for the on-screen picture), so after the scene is drawn the red byte of each pixel is
+// the number of fragments shaded there. The read waits for the GPU; it is a measurement
+// mode, not something to leave on. Needs the GL device and pack buffer binding 0.
+class OverdrawMeter
+{
+public:
+    OverdrawStats stats;            // the last measured frame
+
+    size_t frames = 0;
+    double averageSum = 0.0;
+    double coveredAverageSum = 0.0;
+    int worstLayers = 0;
+
+    void measure(int width, int height)
+    {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        stats = OverdrawStats();
+        if (width <= 0 || height <= 0)
+            return;
+        pixels.resize((size_t)width * height * 4);
+        glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, &pixels[0]);
+
+        stats.pixels = (size_t)width * height;
+        for (size_t i = 0; i < stats.pixels; i++)
+        {
+            int layers = pixels[i * 4];
+            if (layers == 0)
+                continue;
+            stats.coveredPixels++;
+            stats.fragments += layers;
+            stats.maxLayers = std::max(stats.maxLayers, layers);
+            if (layers == 255)
+                stats.saturatedPixels++;
+        }
+        stats.readMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+        frames++;
+        averageSum += stats.average();
+        coveredAverageSum += stats.coveredAverage();
+        worstLayers = std::max(worstLayers, stats.maxLayers);
+    }
+
+private:
+    std::vector<unsigned char> pixels;
+};
+
+inline void printOverdrawStats(const OverdrawStats& stats)
+{
+    std::printf("overdraw: %.3f fragments per pixel, %.3f per covered pixel (%zu of %zu covered), max %d%s  read ms: %.3f\n",
+        stats.average(), stats.coveredAverage(), stats.coveredPixels, stats.pixels, stats.maxLayers,
+        stats.saturatedPixels > 0 ? " (saturated)" : "", stats.readMs);
+}
+
+// averaged over every measured frame, for --overdraw runs
+inline void printOverdrawSummary(const OverdrawMeter& meter)
+{
+    if (meter.frames == 0)
+        return;
+    std::printf("overdraw over %zu frames: %.3f fragments per pixel, %.3f per covered pixel, max %d\n", meter.frames,
+        meter.averageSum / meter.frames, meter.coveredAverageSum / meter.frames, meter.worstLayers);
+}
+
+// Renders without and then with the depth pre-pass. The first frame of each step counts
+// the overdraw, the next warm-up frames let that readback drain, then the frame time is
+// averaged over the measured frames. Prints one row per step.
+class OverdrawBenchmark
+{
+public:
+    OverdrawBenchmark(int warmupFrames = 30, int measuredFrames = 120)
+        : warmup(warmupFrames), measured(measuredFrames), step(0), frameInStep(0)
+    {
+        for (int i = 0; i < 2; i++)
+            frameMs[i] = 0.0;
+    }
+
+    bool done() const
+    {
+        return step >= 2;
+    }
+
+    bool depthPrepass() const
+    {
+        return step == 1;
+    }
+
+    // the frame being drawn is drawn in overdraw mode and read back
+    bool countingFrame() const
+    {
+        return !done() && frameInStep == 1;
+    }
+
+    // frame time of the previous frame and the meter's last measurement
+    void record(double ms, const OverdrawStats& counted)
+    {
+        if (done())
+            return;
+        frameInStep++;
+        if (frameInStep == 2)
+            overdraw[step] = counted;
+        if (frameInStep > warmup)
+            frameMs[step] += ms / measured;
+        if (frameInStep == warmup + measured)
+        {
+            step++;
+            frameInStep = 0;
+        }
+    }
+
+    void print() const
+    {
+        std::printf("depth pre-pass  frame ms  overdraw  per covered pixel  max\n");
+        for (int i = 0; i < 2; i++)
+        {
+            std::printf("%-14s  %8.3f  %8.3f  %17.3f  %3d\n", i == 0 ? "off" : "on", frameMs[i],
+                overdraw[i].average(), overdraw[i].coveredAverage(), overdraw[i].maxLayers);
+        }
+    }
+
+private:
+    int warmup;
+    int measured;
+    int step;
+    int frameInStep;
+    double frameMs[2];
+    OverdrawStats overdraw[2];
+};
+
+#endif
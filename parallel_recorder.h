@@ -0,0 +1,197 @@
+//
+//  parallel_recorder.h
+//  3D Object Drawing
+//
+
+#ifndef PARALLEL_RECORDER_H
+#define PARALLEL_RECORDER_H
+
+#include "draw_list.h"
+#include "job_system.h"
+#include "frame_arena.h"
+
+#include <vector>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <algorithm>
+#include <iostream>
+
+struct RecordStats
+{
+    int threads = 0;
+    size_t parts = 0;
+    size_t commands = 0;
+    double recordMs = 0.0;      // workers traversing their parts
+    double mergeMs = 0.0;       // material remapping and copying into the frame's list
+};
+
+// Records the scene on the job system's threads. The scene is split into parts that
+// share nothing; each part is recorded into its own DrawList with its own material table,
+// then the parts are concatenated into the frame's list in part order with their material
+// indices remapped. The result is the list a single thread would have recorded, whatever
+// the thread count, so rendering stays deterministic.
+class ParallelRecorder
+{
+public:
+    RecordStats stats;
+
+    ParallelRecorder(JobSystem& jobSystem, FrameArenas& frameArenas) : jobs(jobSystem), arenas(frameArenas), target(NULL)
+    {
+    }
+
+    // recordPart(list, part) records part 0..partCount-1 into an empty list; out is replaced.
+    // Scratch space comes from worker 0's frame arena.
+    void record(size_t partCount, FunctionRef<void(DrawList&, size_t)> recordPart, DrawList& out)
+    {
+        stats = RecordStats();
+        stats.threads = jobs.threadCount();
+        stats.parts = partCount;
+        if (parts.size() < partCount)
+            parts.resize(partCount);
+
+        // the remap tables are only valid for the list they were built against
+        if (target != &out)
+        {
+            for (size_t i = 0; i < parts.size(); i++)
+                parts[i].remap.clear();
+            target = &out;
+        }
+
+        std::chrono::steady_clock::time_point recordStart = std::chrono::steady_clock::now();
+        jobs.parallelFor(partCount, [&](int, size_t begin, size_t end)
+        {
+            for (size_t part = begin; part < end; part++)
+            {
+                parts[part].list.clear();
+                parts[part].list.trackSources = out.trackSources;
+                recordPart(parts[part].list, part);
+            }
+        });
+        std::chrono::steady_clock::time_point mergeStart = std::chrono::steady_clock::now();
+        stats.recordMs = std::chrono::duration<double, std::milli>(mergeStart - recordStart).count();
+
+        // interning in part order gives the materials the indices a single thread would;
+        // a part's table only grows, so only its new entries are looked up
+        FrameVector<size_t> offsets(partCount, 0, ArenaAllocator<size_t>(arenas[0]));
+        size_t total = 0;
+        for (size_t part = 0; part < partCount; part++)
+        {
+            Part& p = parts[part];
+            for (size_t i = p.remap.size(); i < p.list.materials.size(); i++)
+                p.remap.push_back(out.materials.intern(p.list.materials[i].color));
+            if (p.list.materials.full())
+                out.materials.markFull();
+            offsets[part] = total;
+            total += p.list.size();
+        }
+
+        out.commands.resize(total);
+        if (out.trackSources)
+            out.sources.resize(total);
+        jobs.parallelFor(partCount, [&](int, size_t begin, size_t end)
+        {
+            for (size_t part = begin; part < end; part++)
+            {
+                const Part& p = parts[part];
+                DrawCommand* destination = total > 0 ? &out.commands[offsets[part]] : NULL;
+                for (size_t i = 0; i < p.list.size(); i++)
+                {
+                    destination[i].model = p.list[i].model;
+                    destination[i].material = p.remap[p.list[i].material];
+                }
+                if (out.trackSources)
+                    std::copy(p.list.sources.begin(), p.list.sources.end(), out.sources.begin() + offsets[part]);
+            }
+        });
+        stats.commands = total;
+        stats.mergeMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - mergeStart).count();
+    }
+
+private:
+    struct Part
+    {
+        DrawList list;
+        std::vector<unsigned short> remap;      // part material index -> frame list index
+    };
+
+    JobSystem& jobs;
+    FrameArenas& arenas;
+    std::vector<Part> parts;
+    const DrawList* target;
+
+    ParallelRecorder(const ParallelRecorder&);
+    ParallelRecorder& operator=(const ParallelRecorder&);
+};
+
+inline void printRecordStats(const RecordStats& stats)
+{
+    std::cout << "recorded " << stats.commands << " commands in " << stats.parts << " parts on " << stats.threads << " threads"
+              << "  record ms: " << stats.recordMs << "  merge ms: " << stats.mergeMs << std::endl;
+}
+
+// true if both lists hold the same draws with the same colors in the same order
+inline bool sameDraws(const DrawList& a, const DrawList& b)
+{
+    if (a.size() != b.size())
+        return false;
+    for (size_t i = 0; i < a.size(); i++)
+    {
+        if (std::memcmp(&a[i].model, &b[i].model, sizeof(glm::mat4)) != 0)
+            return false;
+        if (std::memcmp(&a.materials[a[i].material].color, &b.materials[b[i].material].color, sizeof(glm::vec4)) != 0)
+            return false;
+    }
+    return true;
+}
+
+// Times the scene traversal of a large generated restaurant on one thread into one list,
+// then with the parallel recorder on 1, 2, 4 and 8 worker threads, checking that every
+// run records exactly the single threaded list.
+class RecordBenchmark
+{
+public:
+    // recordRange(list, begin, end) records objects [begin, end) of the scene
+    static void run(size_t objectCount, const std::function<void(DrawList&, size_t, size_t)>& recordRange, int repeats = 20)
+    {
+        DrawList reference;
+        double sequentialMs = 0.0;
+        for (int r = 0; r < repeats; r++)
+        {
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            reference.clear();
+            recordRange(reference, 0, objectCount);
+            sequentialMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / repeats;
+        }
+        std::printf("%zu objects, %zu draws; single threaded traversal %.3f ms\n", objectCount, reference.size(), sequentialMs);
+        std::printf("threads  record ms  merge ms  total ms  saved ms  speedup  identical\n");
+
+        const int threadCounts[] = { 1, 2, 4, 8 };
+        for (int t = 0; t < 4; t++)
+        {
+            JobSystem jobs(threadCounts[t]);
+            FrameArenas arenas(jobs.threadCount());
+            ParallelRecorder recorder(jobs, arenas);
+            DrawList list;
+            // parallelFor hands each thread one contiguous slice, so one part per thread
+            size_t partCount = (size_t)jobs.threadCount();
+            double recordMs = 0.0, mergeMs = 0.0;
+            for (int r = 0; r < repeats; r++)
+            {
+                recorder.record(partCount, [&](DrawList& part, size_t index)
+                {
+                    recordRange(part, objectCount * index / partCount, objectCount * (index + 1) / partCount);
+                }, list);
+                arenas.reset();
+                recordMs += recorder.stats.recordMs / repeats;
+                mergeMs += recorder.stats.mergeMs / repeats;
+            }
+            double totalMs = recordMs + mergeMs;
+            std::printf("%7d  %9.3f  %8.3f  %8.3f  %8.3f  %6.2fx  %s\n", threadCounts[t], recordMs, mergeMs, totalMs,
+                sequentialMs - totalMs, totalMs > 0.0 ? sequentialMs / totalMs : 0.0, sameDraws(reference, list) ? "yes" : "NO");
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,83 @@
+//
+//  point_light.h
+//  3D Object Drawing
+//
+
+#ifndef POINT_LIGHT_H
+#define POINT_LIGHT_H
+
+#include <glm/glm.hpp>
+
+#include "draw_list.h"
+
+#include <vector>
+#include <random>
+#include <cmath>
+
+struct PointLight
+{
+    glm::vec3 position;
+    float radius;           // the light has no effect past this distance
+    glm::vec3 color;
+    float intensity;
+};
+
+// windowed falloff shared by the clustered shader and the baker: 1 at the light, 0 at radius
+inline float lightFalloff(float distanceSquared, float radius)
+{
+    float window = glm::clamp(1.0f - distanceSquared / (radius * radius), 0.0f, 1.0f);
+    return window * window;
+}
+
+// warm pendant lamps hung in a jittered grid just below the top of bounds
+inline std::vector<PointLight> placePendantLights(int count, const AABB& bounds, unsigned int seed)
+{
+    std::vector<PointLight> lights;
+    if (count <= 0)
+        return lights;
+
+    std::mt19937 random(seed);
+    std::uniform_real_distribution<float> jitter(-0.3f, 0.3f);
+    std::uniform_real_distribution<float> warmth(0.0f, 0.25f);
+
+    glm::vec3 size = bounds.max - bounds.min;
+    int columns = (int)std::ceil(std::sqrt(count * size.x / glm::max(size.z, 0.01f)));
+    columns = glm::max(columns, 1);
+    int rows = (count + columns - 1) / columns;
+    float spacingX = size.x / columns;
+    float spacingZ = size.z / rows;
+    float height = glm::max(size.y, 1.0f);
+
+    for (int i = 0; i < count; i++)
+    {
+        int column = i % columns;
+        int row = i / columns;
+        PointLight light;
+        light.position.x = bounds.min.x + (column + 0.5f + jitter(random)) * spacingX;
+        light.position.y = bounds.max.y - 0.1f * height;
+        light.position.z = bounds.min.z + (row + 0.5f + jitter(random)) * spacingZ;
+        light.radius = 1.2f * height;
+        float w = warmth(random);
+        light.color = glm::vec3(1.0f, 0.85f - w, 0.6f - w);
+        light.intensity = 0.5f;
+        lights.push_back(light);
+    }
+    return lights;
+}
+
+// union of the world boxes of every command in a draw list
+inline AABB drawListBounds(const DrawList& drawList)
+{
+    AABB bounds;
+    bounds.min = glm::vec3(1e30f);
+    bounds.max = glm::vec3(-1e30f);
+    for (size_t i = 0; i < drawList.size(); i++)
+    {
+        AABB box = cubeWorldBounds(drawList[i].model);
+        bounds.min = glm::min(bounds.min, box.min);
+        bounds.max = glm::max(bounds.max, box.max);
+    }
+    return bounds;
+}
+
+#endif
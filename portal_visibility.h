@@ -0,0 +1,468 @@
+//
+//  portal_visibility.h
+//  3D Object Drawing
+//
+
+#ifndef PORTAL_VISIBILITY_H
+#define PORTAL_VISIBILITY_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "draw_list.h"
+#include "frustum.h"
+#include "restaurant_generator.h"
+
+#include <vector>
+#include <string>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <algorithm>
+
+// portals seen through portals seen through ... at most this deep
+const int MAX_PORTAL_DEPTH = 64;
+
+// a box thinner than this along x or z, and WALL_RATIO times longer along the other, is a
+// wall: it belongs to the cells on both of its sides
+const float WALL_THICKNESS = 0.25f;
+const float WALL_RATIO = 4.0f;
+const float SIDE_PROBE = 0.05f;     // how far beyond a wall or doorway its sides are looked up
+
+// debug view: the floor of a visited room, by the number of portals it was seen through
+const glm::vec4 PORTAL_DEBUG_COLORS[] = {
+    glm::vec4(0.2f, 0.9f, 0.2f, 1.0f),      // the camera's room
+    glm::vec4(0.9f, 0.9f, 0.1f, 1.0f),      // through one portal
+    glm::vec4(1.0f, 0.5f, 0.0f, 1.0f)       // through two or more
+};
+
+// part of the screen in normalized device coordinates
+struct ScreenRect
+{
+    float x0, y0, x1, y1;
+
+    bool empty() const
+    {
+        return x0 >= x1 || y0 >= y1;
+    }
+
+    bool contains(const ScreenRect& r) const
+    {
+        return r.x0 >= x0 && r.y0 >= y0 && r.x1 <= x1 && r.y1 <= y1;
+    }
+};
+
+struct PortalStats
+{
+    int cells = 0;                  // rooms plus the outside
+    int portals = 0;
+    int cameraCell = 0;
+    int visitedCells = 0;
+    size_t portalsTraversed = 0;
+    size_t objects = 0;
+    size_t cellRejected = 0;        // in no visited cell
+    size_t frustumRejected = 0;     // in a visited cell, outside the part of it seen through its portals
+    size_t submitted = 0;
+    double cullMs = 0.0;
+};
+
+// command line switches of portal culling
+struct PortalOptions
+{
+    bool enabled = false;           // --portals       submit only the objects in rooms visible through doorways
+    bool debug = false;             // --portal-debug  paint the floors of the visited rooms (implies --portals)
+
+    // false if arg is not one of the switches above
+    bool parseArgs(const std::string& arg, int, char**, int&)
+    {
+        if (arg == "--portals")
+            enabled = true;
+        else if (arg == "--portal-debug")
+            enabled = debug = true;
+        else
+            return false;
+        return true;
+    }
+
+    static void printUsage()
+    {
+        std::cout << "  --portals        draw only the rooms of a generated scene visible through doorways\n"
+                  << "  --portal-debug   --portals, painting the floor of every room that was visited\n";
+    }
+};
+
+// Cell-and-portal visibility. The rooms of a generated scene are the cells, with one more
+// cell for everything outside them, and its doorways are the portals between the cells on
+// either side. Every frame the camera's cell is located and the visibility flood-filled
+// from it: a portal is passed if its screen rectangle overlaps the part of the screen the
+// current cell is seen through, and the cell behind it is then seen through the overlap
+// only. An object is submitted if it lies in a visited cell and inside the frustum
+// narrowed to that cell's rectangle. Cells are axis aligned boxes, as the generator makes
+// them; a scene without rooms is a single cell and nothing is rejected. The rooms have no
+// ceilings, so the open top of each is one more portal from the outside, passed only by a
+// camera above it.
+class PortalVisibility
+{
+public:
+    PortalStats stats;
+    std::vector<unsigned int> visible;      // indices of the submitted commands
+    std::vector<int> masks;                 // their view masks (view 0), for SceneRenderer
+
+    PortalVisibility() : assigned(0), eyeHeight(0.0f)
+    {
+        setScene(GeneratedScene());
+    }
+
+    // the rooms, the outside included
+    int cellCount() const
+    {
+        return (int)cells.size();
+    }
+
+    // setScene, warning if the scene has no rooms to cull by
+    void init(const GeneratedScene& scene)
+    {
+        setScene(scene);
+        if (cellCount() == 1)
+            std::cout << "WARNING::PORTALS::NO_ROOMS: the scene defines no rooms, so everything is one cell" << std::endl;
+    }
+
+    void setScene(const GeneratedScene& scene)
+    {
+        cells.clear();
+        portals.clear();
+        for (size_t i = 0; i < scene.rooms.size(); i++)
+        {
+            Cell cell;
+            cell.bounds = scene.rooms[i].bounds;
+            cells.push_back(cell);
+        }
+        Cell outside;
+        outside.bounds.min = glm::vec3(-1e30f);
+        outside.bounds.max = glm::vec3(1e30f);
+        cells.push_back(outside);
+
+        for (size_t i = 0; i < scene.portals.size(); i++)
+        {
+            Portal portal;
+            portal.opening = scene.portals[i].opening;
+            if (!sides(portal.opening, portal.cells[0], portal.cells[1]) || portal.cells[0] == portal.cells[1])
+            {
+                std::cout << "WARNING::PORTALS::DEAD_END: portal " << i << " does not join two cells, ignoring it" << std::endl;
+                continue;
+            }
+            addPortal(portal);
+        }
+        for (size_t i = 0; i < scene.rooms.size(); i++)
+        {
+            Portal roof;
+            roof.opening = scene.rooms[i].bounds;
+            roof.opening.min.y = roof.opening.max.y;
+            roof.cells[0] = (int)i;
+            roof.cells[1] = (int)cells.size() - 1;
+            roof.fromAbove = true;
+            addPortal(roof);
+        }
+        cellRects.resize(cells.size());
+        cellDepth.resize(cells.size());
+        cellFrusta.resize(cells.size());
+        assigned = 0;
+        membership.clear();
+    }
+
+    // the commands from dynamicFirst on move (animated props) and are assigned to their
+    // cells again every frame; the ones before it stay in their rooms and are assigned
+    // once per size of that static part
+    void cull(const DrawList& drawList, size_t dynamicFirst, const glm::mat4& viewProjection, const glm::vec3& eye)
+    {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        size_t staticCount = std::min(dynamicFirst, drawList.size());
+        if (membership.size() < drawList.size() * 2)
+        {
+            membership.resize(drawList.size() * 2);
+            visible.reserve(drawList.size() + cells.size());
+            masks.reserve(drawList.size() + cells.size());
+        }
+        if (assigned != staticCount)
+        {
+            assign(drawList, 0, staticCount, false);
+            assigned = staticCount;
+        }
+        assign(drawList, staticCount, drawList.size(), true);
+
+        stats = PortalStats();
+        stats.cells = (int)cells.size();
+        stats.portals = (int)portals.size();
+        stats.objects = drawList.size();
+        stats.cameraCell = cellAt(eye);
+        eyeHeight = eye.y;
+
+        for (size_t c = 0; c < cells.size(); c++)
+            cellDepth[c] = -1;
+        ScreenRect screen = { -1.0f, -1.0f, 1.0f, 1.0f };
+        flood(stats.cameraCell, screen, 0, -1, viewProjection);
+
+        for (size_t c = 0; c < cells.size(); c++)
+        {
+            if (cellDepth[c] < 0)
+                continue;
+            stats.visitedCells++;
+            cellFrusta[c] = Frustum(narrow(cellRects[c]) * viewProjection);
+        }
+
+        visible.clear();
+        masks.clear();
+        for (size_t i = 0; i < drawList.size(); i++)
+        {
+            int first = membership[i * 2], second = membership[i * 2 + 1];
+            if (cellDepth[first] < 0 && cellDepth[second] < 0)
+            {
+                stats.cellRejected++;
+                continue;
+            }
+            AABB box = cubeWorldBounds(drawList[i].model);
+            if ((cellDepth[first] >= 0 && cellFrusta[first].intersects(box)) || (cellDepth[second] >= 0 && cellFrusta[second].intersects(box)))
+            {
+                visible.push_back((unsigned int)i);
+                masks.push_back(1);
+            }
+            else
+                stats.frustumRejected++;
+        }
+        stats.submitted = visible.size();
+        stats.cullMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // debug view: paints the floor of every visited room by how it was reached and submits
+    // it with the visible commands
+    void addDebugMarkers(DrawList& drawList)
+    {
+        for (size_t c = 0; c + 1 < cells.size(); c++)
+        {
+            if (cellDepth[c] < 0)
+                continue;
+            const AABB& room = cells[c].bounds;
+            glm::vec3 size = room.max - room.min;
+            glm::vec3 center((room.min.x + room.max.x) * 0.5f, room.min.y + 0.01f, (room.min.z + room.max.z) * 0.5f);
+            glm::vec3 cube = CUBE_MAX - CUBE_MIN;
+            glm::mat4 model = glm::translate(glm::mat4(1.0f), center);
+            model = glm::scale(model, glm::vec3(0.9f * size.x / cube.x, 0.0f, 0.9f * size.z / cube.z));
+            model = glm::translate(model, -(CUBE_MIN + CUBE_MAX) * 0.5f);
+            visible.push_back((unsigned int)drawList.size());
+            masks.push_back(1);
+            drawList.add(model, PORTAL_DEBUG_COLORS[std::min(cellDepth[c], 2)]);
+        }
+    }
+
+    void printVisitedCells() const
+    {
+        std::printf("portal cells visited:");
+        for (size_t c = 0; c < cells.size(); c++)
+        {
+            if (cellDepth[c] < 0)
+                continue;
+            if (c + 1 == cells.size())
+                std::printf(" outside");
+            else
+                std::printf(" room %zu", c);
+            std::printf(" (depth %d, [%.2f %.2f]x[%.2f %.2f])", cellDepth[c], cellRects[c].x0, cellRects[c].x1, cellRects[c].y0, cellRects[c].y1);
+        }
+        std::printf("\n");
+    }
+
+private:
+    struct Cell
+    {
+        AABB bounds;
+        std::vector<int> portals;
+    };
+
+    struct Portal
+    {
+        AABB opening;
+        int cells[2];
+        bool fromAbove = false;     // a room's open top
+    };
+
+    std::vector<Cell> cells;                // the last one is the outside
+    std::vector<Portal> portals;
+    std::vector<int> membership;            // two cells per command, the same one twice for most
+    size_t assigned;
+    std::vector<ScreenRect> cellRects;      // union of the rectangles each cell was seen through
+    std::vector<int> cellDepth;             // fewest portals to the cell, -1 if not visited
+    std::vector<Frustum> cellFrusta;
+    float eyeHeight;
+
+    static bool inside(const AABB& box, const glm::vec3& point)
+    {
+        return point.x >= box.min.x && point.x <= box.max.x && point.y >= box.min.y && point.y <= box.max.y
+            && point.z >= box.min.z && point.z <= box.max.z;
+    }
+
+    void addPortal(const Portal& portal)
+    {
+        cells[portal.cells[0]].portals.push_back((int)portals.size());
+        cells[portal.cells[1]].portals.push_back((int)portals.size());
+        portals.push_back(portal);
+    }
+
+    int cellAt(const glm::vec3& point) const
+    {
+        for (size_t c = 0; c + 1 < cells.size(); c++)
+        {
+            if (inside(cells[c].bounds, point))
+                return (int)c;
+        }
+        return (int)cells.size() - 1;
+    }
+
+    // the cells just beyond the two large faces of a thin box; false if it is not thin
+    bool sides(const AABB& box, int& front, int& back) const
+    {
+        glm::vec3 size = box.max - box.min;
+        glm::vec3 center = (box.min + box.max) * 0.5f;
+        glm::vec3 offset(0.0f);
+        if (size.z < WALL_THICKNESS && size.x >= WALL_RATIO * size.z)
+            offset.z = size.z * 0.5f + SIDE_PROBE;
+        else if (size.x < WALL_THICKNESS && size.z >= WALL_RATIO * size.x)
+            offset.x = size.x * 0.5f + SIDE_PROBE;
+        else
+            return false;
+        front = cellAt(center + offset);
+        back = cellAt(center - offset);
+        return true;
+    }
+
+    // the cell a box sticking out of room reaches into: the one holding a corner of the box
+    // outside the room, at the box's middle height; the outside if it only sticks out
+    // through the floor or the ceiling
+    int beyond(const AABB& room, const AABB& box) const
+    {
+        float y = (box.min.y + box.max.y) * 0.5f;
+        for (int corner = 0; corner < 4; corner++)
+        {
+            glm::vec3 p((corner & 1) ? box.max.x : box.min.x, y, (corner & 2) ? box.max.z : box.min.z);
+            if (!inside(room, p))
+                return cellAt(p);
+        }
+        return (int)cells.size() - 1;
+    }
+
+    // a moving command still well inside the room it was in keeps it, without a search
+    void assign(const DrawList& drawList, size_t first, size_t end, bool moving)
+    {
+        for (size_t i = first; i < end; i++)
+        {
+            AABB box = cubeWorldBounds(drawList[i].model);
+            int previous = membership[i * 2];
+            if (moving && previous == membership[i * 2 + 1] && previous + 1 < (int)cells.size()
+                && inside(cells[previous].bounds, box.min - glm::vec3(SIDE_PROBE, 0.0f, SIDE_PROBE))
+                && inside(cells[previous].bounds, box.max + glm::vec3(SIDE_PROBE, 0.0f, SIDE_PROBE)))
+                continue;
+            int front, back;
+            if (!sides(box, front, back))
+                front = back = cellAt((box.min + box.max) * 0.5f);
+            // furniture poking out through a wall can be seen from the other side as well
+            if (front == back && front + 1 < (int)cells.size() && !(inside(cells[front].bounds, box.min) && inside(cells[front].bounds, box.max)))
+                back = beyond(cells[front].bounds, box);
+            membership[i * 2] = front;
+            membership[i * 2 + 1] = back;
+        }
+    }
+
+    // screen rectangle of a portal; empty if it is behind the camera, the whole screen if it
+    // crosses the eye plane (the camera is standing in the doorway)
+    static ScreenRect project(const AABB& box, const glm::mat4& viewProjection)
+    {
+        ScreenRect rect = { 1.0f, 1.0f, -1.0f, -1.0f };
+        int behind = 0;
+        for (int corner = 0; corner < 8; corner++)
+        {
+            glm::vec3 p((corner & 1) ? box.max.x : box.min.x, (corner & 2) ? box.max.y : box.min.y, (corner & 4) ? box.max.z : box.min.z);
+            glm::vec4 clip = viewProjection * glm::vec4(p, 1.0f);
+            if (clip.w <= 1e-4f)
+            {
+                behind++;
+                continue;
+            }
+            rect.x0 = std::min(rect.x0, clip.x / clip.w);
+            rect.y0 = std::min(rect.y0, clip.y / clip.w);
+            rect.x1 = std::max(rect.x1, clip.x / clip.w);
+            rect.y1 = std::max(rect.y1, clip.y / clip.w);
+        }
+        if (behind == 8)
+            return rect;
+        if (behind > 0)
+        {
+            ScreenRect screen = { -1.0f, -1.0f, 1.0f, 1.0f };
+            return screen;
+        }
+        return rect;
+    }
+
+    void flood(int cell, const ScreenRect& rect, int depth, int fromPortal, const glm::mat4& viewProjection)
+    {
+        if (cellDepth[cell] < 0)
+        {
+            cellRects[cell] = rect;
+            cellDepth[cell] = depth;
+        }
+        else
+        {
+            ScreenRect& seen = cellRects[cell];
+            seen.x0 = std::min(seen.x0, rect.x0);
+            seen.y0 = std::min(seen.y0, rect.y0);
+            seen.x1 = std::max(seen.x1, rect.x1);
+            seen.y1 = std::max(seen.y1, rect.y1);
+            cellDepth[cell] = std::min(cellDepth[cell], depth);
+        }
+        if (depth == MAX_PORTAL_DEPTH)
+            return;
+
+        const std::vector<int>& cellPortals = cells[cell].portals;
+        for (size_t i = 0; i < cellPortals.size(); i++)
+        {
+            if (cellPortals[i] == fromPortal)
+                continue;
+            const Portal& portal = portals[cellPortals[i]];
+            if (portal.fromAbove && eyeHeight <= portal.opening.max.y)
+                continue;
+            ScreenRect through = project(portal.opening, viewProjection);
+            through.x0 = std::max(through.x0, rect.x0);
+            through.y0 = std::max(through.y0, rect.y0);
+            through.x1 = std::min(through.x1, rect.x1);
+            through.y1 = std::min(through.y1, rect.y1);
+            if (through.empty())
+                continue;
+            int next = portal.cells[0] == cell ? portal.cells[1] : portal.cells[0];
+            // nothing new to see if the cell was already seen through a larger rectangle
+            if (cellDepth[next] >= 0 && cellRects[next].contains(through))
+                continue;
+            stats.portalsTraversed++;
+            flood(next, through, depth + 1, cellPortals[i], viewProjection);
+        }
+    }
+
+    // maps a screen rectangle to the whole clip space, so that the frustum of the result
+    // is the camera frustum narrowed to the rectangle
+    static glm::mat4 narrow(const ScreenRect& rect)
+    {
+        glm::mat4 m(1.0f);
+        float sx = 2.0f / (rect.x1 - rect.x0);
+        float sy = 2.0f / (rect.y1 - rect.y0);
+        m[0][0] = sx;
+        m[1][1] = sy;
+        m[3][0] = -sx * (rect.x0 + rect.x1) * 0.5f;
+        m[3][1] = -sy * (rect.y0 + rect.y1) * 0.5f;
+        return m;
+    }
+};
+
+inline void printPortalStats(const PortalStats& stats)
+{
+    std::printf("portals: camera in %s %d, %d of %d cells visited through %zu portals (of %d)  objects: %zu submitted, %zu in unvisited cells, %zu outside the narrowed frustum  cull ms: %.3f\n",
+        stats.cameraCell + 1 == stats.cells ? "outside, cell" : "room", stats.cameraCell, stats.visitedCells, stats.cells, stats.portalsTraversed, stats.portals,
+        stats.submitted, stats.cellRejected, stats.frustumRejected, stats.cullMs);
+}
+
+#endif
@@ -0,0 +1,191 @@
+//
+//  redundant_draws.h
+//  3D Object Drawing
+//
+
+#ifndef REDUNDANT_DRAWS_H
+#define REDUNDANT_DRAWS_H
+
+#include "draw_list.h"
+
+#include <vector>
+#include <chrono>
+#include <cstdio>
+#include <cmath>
+#include <algorithm>
+
+// model matrix entries are compared on a 1/65536 grid, well below anything visible
+const float REDUNDANT_DRAW_QUANTUM = 65536.0f;
+// every draw is the cube mesh for now; the mesh takes part in the key all the same
+const unsigned int CUBE_MESH_ID = 0;
+const unsigned int EMPTY_DRAW_SLOT = 0xFFFFFFFFu;
+
+struct RedundantDrawStats
+{
+    size_t draws = 0;
+    size_t dropped = 0;
+    double filterMs = 0.0;
+};
+
+// one dropped draw: its index in the list before filtering and the draw it repeats
+struct RedundantDraw
+{
+    size_t index;
+    size_t original;
+    const char* source;
+    const char* originalSource;
+    glm::vec3 position;
+};
+
+// Drops draws that repeat an earlier draw of the same mesh with the same (quantised) model
+// matrix. The depth test is GL_LESS and instances are rasterised in list order, so the
+// earlier copy wins every pixel and the later one only costs vertex and fragment work that
+// the depth test throws away, whatever its color. The list is compacted in place and keeps
+// its order. The hash table outlives the frame, so filtering does not allocate once it has
+// grown to the scene.
+class RedundantDrawFilter
+{
+public:
+    RedundantDrawStats stats;
+
+    // duplicates are listed in found when it is given
+    void filter(DrawList& drawList, std::vector<RedundantDraw>* found = NULL)
+    {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        stats = RedundantDrawStats();
+        stats.draws = drawList.size();
+
+        size_t tableSize = 16;
+        while (tableSize < drawList.size() * 2)
+            tableSize *= 2;
+        slots.assign(tableSize, EMPTY_DRAW_SLOT);
+        keyHash.resize(tableSize);
+
+        std::vector<DrawCommand>& commands = drawList.commands;
+        bool sources = drawList.trackSources && drawList.sources.size() == commands.size();
+        size_t kept = 0;
+        for (size_t i = 0; i < commands.size(); i++)
+        {
+            Key key = makeKey(CUBE_MESH_ID, commands[i].model);
+            size_t slot = (size_t)(key.hash & (tableSize - 1));
+            bool duplicate = false;
+            while (slots[slot] != EMPTY_DRAW_SLOT)
+            {
+                const DrawCommand& other = commands[slots[slot]];
+                if (keyHash[slot] == key.hash && sameKey(key, makeKey(CUBE_MESH_ID, other.model)))
+                {
+                    duplicate = true;
+                    break;
+                }
+                slot = (slot + 1) & (tableSize - 1);
+            }
+
+            if (duplicate)
+            {
+                if (found != NULL)
+                {
+                    RedundantDraw draw;
+                    draw.index = i;
+                    draw.original = originalIndex[slots[slot]];
+                    draw.source = sources ? drawList.sources[i] : NULL;
+                    draw.originalSource = sources ? drawList.sources[slots[slot]] : NULL;
+                    draw.position = glm::vec3(commands[i].model[3]);
+                    found->push_back(draw);
+                }
+                stats.dropped++;
+                continue;
+            }
+
+            // the draw moves to its compacted place; the table points there
+            if (kept != i)
+            {
+                commands[kept] = commands[i];
+                if (sources)
+                    drawList.sources[kept] = drawList.sources[i];
+            }
+            if (found != NULL)
+            {
+                if (originalIndex.size() <= kept)
+                    originalIndex.resize(kept + 1);
+                originalIndex[kept] = i;
+            }
+            slots[slot] = (unsigned int)kept;
+            keyHash[slot] = key.hash;
+            kept++;
+        }
+        commands.resize(kept);
+        if (sources)
+            drawList.sources.resize(kept);
+        stats.filterMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+private:
+    struct Key
+    {
+        long long values[17];   // mesh, then the matrix entries column by column
+        unsigned long long hash;
+    };
+
+    std::vector<unsigned int> slots;        // compacted command index per slot
+    std::vector<unsigned long long> keyHash;    // hash of the command in each slot
+    std::vector<size_t> originalIndex;      // compacted index -> index before filtering
+
+    static Key makeKey(unsigned int mesh, const glm::mat4& model)
+    {
+        Key key;
+        key.values[0] = mesh;
+        const float* entries = &model[0][0];
+        unsigned long long hash = 1469598103934665603ull;
+        hash = (hash ^ mesh) * 1099511628211ull;
+        for (int i = 0; i < 16; i++)
+        {
+            // +0.0 and -0.0 quantise alike
+            key.values[i + 1] = (long long)std::floor((double)entries[i] * REDUNDANT_DRAW_QUANTUM + 0.5);
+            hash = (hash ^ (unsigned long long)key.values[i + 1]) * 1099511628211ull;
+        }
+        key.hash = hash;
+        return key;
+    }
+
+    static bool sameKey(const Key& a, const Key& b)
+    {
+        return std::equal(a.values, a.values + 17, b.values);
+    }
+};
+
+const size_t MAX_LISTED_REDUNDANT_DRAWS = 50;
+
+// the duplicates of one frame, then how many each source function produced
+inline void printRedundantDraws(const std::vector<RedundantDraw>& draws, size_t drawCount)
+{
+    std::printf("%zu of %zu draws repeat an earlier draw with the same transform\n", draws.size(), drawCount);
+    for (size_t i = 0; i < draws.size() && i < MAX_LISTED_REDUNDANT_DRAWS; i++)
+    {
+        const RedundantDraw& draw = draws[i];
+        std::printf("  draw %zu (%s) repeats draw %zu (%s) at (%.3f, %.3f, %.3f)\n", draw.index, draw.source ? draw.source : "?",
+            draw.original, draw.originalSource ? draw.originalSource : "?", draw.position.x, draw.position.y, draw.position.z);
+    }
+    if (draws.size() > MAX_LISTED_REDUNDANT_DRAWS)
+        std::printf("  ... %zu more\n", draws.size() - MAX_LISTED_REDUNDANT_DRAWS);
+
+    // per source function; sources are string literals, so the pointers identify them
+    std::vector<std::pair<const char*, size_t> > perSource;
+    for (size_t i = 0; i < draws.size(); i++)
+    {
+        size_t s = 0;
+        while (s < perSource.size() && perSource[s].first != draws[i].source)
+            s++;
+        if (s == perSource.size())
+            perSource.push_back(std::make_pair(draws[i].source, (size_t)0));
+        perSource[s].second++;
+    }
+    for (size_t s = 0; s < perSource.size(); s++)
+        std::printf("  %s: %zu redundant draws\n", perSource[s].first ? perSource[s].first : "?", perSource[s].second);
+}
+
+inline void printRedundantDrawStats(const RedundantDrawStats& stats)
+{
+    std::printf("redundant draws dropped: %zu of %zu  filter ms: %.3f\n", stats.dropped, stats.draws, stats.filterMs);
+}
+
+#endif
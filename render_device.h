@@ -0,0 +1,351 @@
+//
+//  render_device.h
+//  3D Object Drawing
+//
+
+#ifndef RENDER_DEVICE_H
+#define RENDER_DEVICE_H
+
+#include <glm/glm.hpp>
+
+#include "gpu_memory.h"
+
+#include <string>
+#include <cstddef>
+#include <iostream>
+
+// names a buffer, texture, vertex layout or program of one device; 0 is never a valid handle
+typedef unsigned int DeviceHandle;
+
+enum BufferKind
+{
+    VERTEX_BUFFER,
+    INDEX_BUFFER,       // 32-bit indices
+    UNIFORM_BUFFER,
+    TEXTURE_BUFFER
+};
+
+enum BufferUsage
+{
+    STATIC_BUFFER,
+    DYNAMIC_BUFFER,
+    STREAM_BUFFER
+};
+
+enum TextureBufferFormat
+{
+    TEXTURE_RGBA32F,
+    TEXTURE_RG32UI,
+    TEXTURE_R16UI,
+    TEXTURE_RGBA8
+};
+
+enum AttributeType
+{
+    ATTRIBUTE_FLOAT,
+    ATTRIBUTE_UINT16,   // read as an integer in the shader
+    ATTRIBUTE_UINT32    // likewise
+};
+
+// depth and color writes of the draws that follow
+enum DepthMode
+{
+    DEPTH_TEST_WRITE,   // GL_LESS, depth and color written (the default)
+    DEPTH_PREPASS,      // GL_LESS, depth written, color masked off
+    DEPTH_EQUAL_TEST    // GL_EQUAL against a pre-pass, color written, depth left alone
+};
+
+enum UniformType
+{
+    UNIFORM_INT,
+    UNIFORM_FLOAT,
+    UNIFORM_VEC2,
+    UNIFORM_VEC3,
+    UNIFORM_MAT4
+};
+
+struct VertexAttribute
+{
+    DeviceHandle buffer;
+    unsigned int location;
+    int components;
+    AttributeType type;
+    unsigned int stride;
+    unsigned int offset;
+    unsigned int divisor;   // 0 per vertex, n advances every n instances
+};
+
+// what went to the device since the last endFrame()
+struct DeviceStats
+{
+    size_t commands = 0;
+    size_t drawCalls = 0;
+    size_t instances = 0;
+    size_t bytesUploaded = 0;
+    size_t uniformUpdates = 0;
+};
+
+// Everything the renderers ask of the graphics API: buffers, texture buffers, vertex
+// layouts, programs with their uniforms, viewports and instanced indexed draws. The GL
+// device talks to the driver; the null device accepts and counts commands without doing
+// anything, so the CPU side can be profiled on its own; the recording device writes the
+// stream to a file while passing it on (see command_recorder.h).
+class RenderDevice
+{
+public:
+    virtual ~RenderDevice()
+    {
+    }
+
+    virtual std::string name() const = 0;
+
+    // gl_ViewportIndex may be written from the vertex shader (single pass multi-view)
+    virtual bool supportsLayeredViews() const = 0;
+
+    // category: what the memory report files the buffer under (gpu_memory.h)
+    virtual DeviceHandle createBuffer(BufferKind kind, size_t bytes, const void* data, BufferUsage usage, MemoryCategory category) = 0;
+    // replaces the whole store, which also orphans the previous one; data may be NULL
+    virtual void setBufferData(DeviceHandle buffer, size_t bytes, const void* data) = 0;
+    virtual void updateBuffer(DeviceHandle buffer, size_t offset, size_t bytes, const void* data) = 0;
+    virtual void bindUniformBuffer(unsigned int binding, DeviceHandle buffer) = 0;
+    virtual void destroyBuffer(DeviceHandle buffer) = 0;
+
+    virtual DeviceHandle createTextureBuffer(DeviceHandle buffer, TextureBufferFormat format) = 0;
+    virtual void bindTextureBuffer(unsigned int unit, DeviceHandle texture) = 0;
+    virtual void destroyTexture(DeviceHandle texture) = 0;
+
+    virtual DeviceHandle createVertexLayout(const VertexAttribute* attributes, int count, DeviceHandle indexBuffer) = 0;
+    virtual void setAttributeDivisor(DeviceHandle layout, unsigned int location, unsigned int divisor) = 0;
+    virtual void destroyVertexLayout(DeviceHandle layout) = 0;
+
+    // defines: "#define" lines put into both sources after their #version line (shader_variants.h)
+    virtual DeviceHandle createProgram(const std::string& vertexPath, const std::string& fragmentPath, const std::string& defines = std::string()) = 0;
+    virtual void useProgram(DeviceHandle program) = 0;
+    // points a uniform block at a uniform buffer binding (GLSL 330 has no layout(binding))
+    virtual void bindUniformBlock(DeviceHandle program, const char* block, unsigned int binding) = 0;
+    // program must be in use
+    virtual void setUniform(DeviceHandle program, const char* name, UniformType type, int count, const void* values) = 0;
+    virtual void destroyProgram(DeviceHandle program) = 0;
+
+    virtual void setViewport(int x, int y, int width, int height) = 0;
+    virtual void setViewportIndexed(unsigned int index, float x, float y, float width, float height) = 0;
+    // clears color and depth
+    virtual void clear(const glm::vec4& color) = 0;
+    virtual void setDepthMode(DepthMode mode) = 0;
+    // adds fragment colors to the target (GL_ONE, GL_ONE) instead of replacing it
+    virtual void setAdditiveBlend(bool enabled) = 0;
+    // triangles of a vertex layout's index buffer, starting at index firstIndex
+    virtual void drawIndexedInstanced(DeviceHandle layout, unsigned int indexCount, unsigned int instanceCount, unsigned int firstIndex) = 0;
+    virtual void endFrame() = 0;
+
+    virtual const DeviceStats& frameStats() const = 0;
+    // the buffers alive on this device, and everything else the frame allocates on the GPU
+    virtual GpuMemoryTracker& memory() = 0;
+
+    void setInt(DeviceHandle program, const char* name, int value)
+    {
+        setUniform(program, name, UNIFORM_INT, 1, &value);
+    }
+
+    void setFloat(DeviceHandle program, const char* name, float value)
+    {
+        setUniform(program, name, UNIFORM_FLOAT, 1, &value);
+    }
+
+    void setVec2(DeviceHandle program, const char* name, const glm::vec2& value)
+    {
+        setUniform(program, name, UNIFORM_VEC2, 1, &value[0]);
+    }
+
+    void setVec3(DeviceHandle program, const char* name, const glm::vec3& value)
+    {
+        setUniform(program, name, UNIFORM_VEC3, 1, &value[0]);
+    }
+
+    void setMat4(DeviceHandle program, const char* name, const glm::mat4& value)
+    {
+        setUniform(program, name, UNIFORM_MAT4, 1, &value[0][0]);
+    }
+
+    void setMat4Array(DeviceHandle program, const char* name, const glm::mat4* values, int count)
+    {
+        setUniform(program, name, UNIFORM_MAT4, count, &values[0][0][0]);
+    }
+};
+
+// Hands out handles and counts what it is given, but never touches a driver: frame times
+// with it are the cost of our own traversal, culling and command building.
+class NullRenderDevice : public RenderDevice
+{
+public:
+    NullRenderDevice() : nextHandle(1)
+    {
+    }
+
+    std::string name() const
+    {
+        return "null";
+    }
+
+    bool supportsLayeredViews() const
+    {
+        return true;
+    }
+
+    DeviceHandle createBuffer(BufferKind, size_t bytes, const void*, BufferUsage, MemoryCategory category)
+    {
+        stats.commands++;
+        stats.bytesUploaded += bytes;
+        tracker.allocate(GPU_BUFFER, nextHandle, category, bytes);
+        return nextHandle++;
+    }
+
+    void setBufferData(DeviceHandle buffer, size_t bytes, const void* data)
+    {
+        tracker.resize(GPU_BUFFER, buffer, bytes);
+        stats.commands++;
+        if (data != NULL)
+            stats.bytesUploaded += bytes;
+    }
+
+    void updateBuffer(DeviceHandle, size_t, size_t bytes, const void*)
+    {
+        stats.commands++;
+        stats.bytesUploaded += bytes;
+    }
+
+    void bindUniformBuffer(unsigned int, DeviceHandle)
+    {
+        stats.commands++;
+    }
+
+    void destroyBuffer(DeviceHandle buffer)
+    {
+        tracker.release(GPU_BUFFER, buffer);
+        stats.commands++;
+    }
+
+    DeviceHandle createTextureBuffer(DeviceHandle, TextureBufferFormat)
+    {
+        stats.commands++;
+        return nextHandle++;
+    }
+
+    void bindTextureBuffer(unsigned int, DeviceHandle)
+    {
+        stats.commands++;
+    }
+
+    void destroyTexture(DeviceHandle)
+    {
+        stats.commands++;
+    }
+
+    DeviceHandle createVertexLayout(const VertexAttribute*, int, DeviceHandle)
+    {
+        stats.commands++;
+        return nextHandle++;
+    }
+
+    void setAttributeDivisor(DeviceHandle, unsigned int, unsigned int)
+    {
+        stats.commands++;
+    }
+
+    void destroyVertexLayout(DeviceHandle)
+    {
+        stats.commands++;
+    }
+
+    DeviceHandle createProgram(const std::string&, const std::string&, const std::string& = std::string())
+    {
+        stats.commands++;
+        return nextHandle++;
+    }
+
+    void useProgram(DeviceHandle)
+    {
+        stats.commands++;
+    }
+
+    void bindUniformBlock(DeviceHandle, const char*, unsigned int)
+    {
+        stats.commands++;
+    }
+
+    void setUniform(DeviceHandle, const char*, UniformType, int, const void*)
+    {
+        stats.commands++;
+        stats.uniformUpdates++;
+    }
+
+    void destroyProgram(DeviceHandle)
+    {
+        stats.commands++;
+    }
+
+    void setViewport(int, int, int, int)
+    {
+        stats.commands++;
+    }
+
+    void setViewportIndexed(unsigned int, float, float, float, float)
+    {
+        stats.commands++;
+    }
+
+    void clear(const glm::vec4&)
+    {
+        stats.commands++;
+    }
+
+    void setDepthMode(DepthMode)
+    {
+        stats.commands++;
+    }
+
+    void setAdditiveBlend(bool)
+    {
+        stats.commands++;
+    }
+
+    void drawIndexedInstanced(DeviceHandle, unsigned int, unsigned int instanceCount, unsigned int)
+    {
+        stats.commands++;
+        stats.drawCalls++;
+        stats.instances += instanceCount;
+    }
+
+    void endFrame()
+    {
+        stats = DeviceStats();
+    }
+
+    const DeviceStats& frameStats() const
+    {
+        return stats;
+    }
+
+    GpuMemoryTracker& memory()
+    {
+        return tracker;
+    }
+
+private:
+    DeviceHandle nextHandle;
+    DeviceStats stats;
+    GpuMemoryTracker tracker;
+};
+
+inline void printDeviceStats(const RenderDevice& device)
+{
+    const DeviceStats& stats = device.frameStats();
+    std::cout << "device: " << device.name()
+              << "  commands: " << stats.commands
+              << "  draw calls: " << stats.drawCalls
+              << "  instances: " << stats.instances
+              << "  bytes uploaded: " << stats.bytesUploaded
+              << "  uniform updates: " << stats.uniformUpdates << std::endl;
+}
+
+#endif
@@ -0,0 +1,605 @@
+//
+//  render_graph.h
+//  3D Object Drawing
+//
+
+#ifndef RENDER_GRAPH_H
+#define RENDER_GRAPH_H
+
+#include <glad/glad.h>
+
+#include "gpu_memory.h"
+
+#include <vector>
+#include <string>
+#include <functional>
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+
+typedef int GraphResource;
+typedef int GraphPass;
+
+const GraphPass NO_GRAPH_PASS = -1;
+
+enum GraphFormat
+{
+    GRAPH_RGBA8,
+    GRAPH_RGBA16F,
+    GRAPH_DEPTH24
+};
+
+struct GraphTextureDesc
+{
+    int width;
+    int height;
+    GraphFormat format;
+
+    bool operator==(const GraphTextureDesc& other) const
+    {
+        return width == other.width && height == other.height && format == other.format;
+    }
+};
+
+inline size_t graphTextureBytes(const GraphTextureDesc& desc)
+{
+    size_t texel = desc.format == GRAPH_RGBA16F ? 8 : 4;
+    return (size_t)desc.width * desc.height * texel;
+}
+
+inline const char* graphFormatName(GraphFormat format)
+{
+    return format == GRAPH_RGBA8 ? "RGBA8" : (format == GRAPH_RGBA16F ? "RGBA16F" : "DEPTH24");
+}
+
+struct RenderGraphStats
+{
+    size_t passes = 0;
+    size_t culled = 0;
+    size_t transients = 0;          // transient textures declared
+    size_t textures = 0;            // textures they were given after aliasing
+    size_t bytes = 0;               // memory of those textures
+    size_t unaliasedBytes = 0;      // the same if every transient had its own texture
+    size_t peakBytes = 0;           // most transient memory in use at one pass
+    size_t compiles = 0;
+    size_t texturesCreated = 0;     // by all compiles; textures of the right size are kept
+};
+
+// A frame graph. Passes declare the textures they read and write; compile() drops the
+// passes whose results reach neither an output nor a side effect, orders the rest so that
+// every read comes after the writes before it in declaration order (and every write after
+// the reads of the old contents), and gives the transient textures GL textures. Two
+// transients of the same size and format share one texture when no pass sits inside both
+// of their lifetimes. The textures are kept across compiles, so the graph is declared
+// again only when its shape changes (window size, modes) and a resize frees exactly the
+// textures of the old size.
+// A pass without a body is run by the caller: execute(pass) runs everything ordered before
+// it, binds its targets and returns. Draw targets are the transients a pass writes, or the
+// window's framebuffer; the read framebuffer holds the transients it reads. The textures
+// are counted as render targets in the GPU memory tracker.
+class RenderGraph
+{
+public:
+    RenderGraphStats stats;
+
+    explicit RenderGraph(GpuMemoryTracker& memoryTracker) : memory(memoryTracker), compiled(false), next(0), boundDraw(0), boundRead(0)
+    {
+    }
+
+    // forgets the passes and resources; the textures stay for the next compile
+    void reset()
+    {
+        destroyFramebuffers();
+        passes.clear();
+        resources.clear();
+        order.clear();
+        compiled = false;
+    }
+
+    // the window's framebuffer
+    GraphResource importBackbuffer(const char* name)
+    {
+        return addResource(name, false, GraphTextureDesc());
+    }
+
+    GraphResource createTexture(const char* name, const GraphTextureDesc& desc)
+    {
+        return addResource(name, true, desc);
+    }
+
+    GraphPass addPass(const char* name, const std::function<void()>& body)
+    {
+        Pass pass;
+        pass.name = name;
+        pass.body = body;
+        passes.push_back(pass);
+        return (GraphPass)passes.size() - 1;
+    }
+
+    void read(GraphPass pass, GraphResource resource)
+    {
+        passes[pass].reads.push_back(resource);
+    }
+
+    void write(GraphPass pass, GraphResource resource)
+    {
+        if (std::find(passes[pass].writes.begin(), passes[pass].writes.end(), resource) == passes[pass].writes.end())
+            passes[pass].writes.push_back(resource);
+    }
+
+    // the pass does something outside the graph (a read back, a file) and is never culled
+    void setSideEffect(GraphPass pass)
+    {
+        passes[pass].sideEffect = true;
+    }
+
+    // the resource's contents are wanted at the end of the frame
+    void markOutput(GraphResource resource)
+    {
+        resources[resource].output = true;
+    }
+
+    bool isCompiled() const
+    {
+        return compiled;
+    }
+
+    bool isCulled(GraphPass pass) const
+    {
+        return !passes[pass].live;
+    }
+
+    // the GL texture of a transient; valid after compile()
+    GLuint texture(GraphResource resource) const
+    {
+        return resources[resource].physical >= 0 ? pool[resources[resource].physical].texture : 0;
+    }
+
+    const GraphTextureDesc& desc(GraphResource resource) const
+    {
+        return resources[resource].desc;
+    }
+
+    bool compile()
+    {
+        compiled = false;
+        size_t compiles = stats.compiles + 1, texturesCreated = stats.texturesCreated;
+        stats = RenderGraphStats();
+        stats.compiles = compiles;
+        stats.texturesCreated = texturesCreated;
+        if (!orderPasses())
+            return false;
+        cullPasses();
+        assignTextures();
+        createFramebuffers();
+        compiled = true;
+        return true;
+    }
+
+    // starts a frame: nothing of the compiled order has run yet
+    void beginFrame()
+    {
+        next = 0;
+    }
+
+    // runs the passes in order up to the given one, which is left to the caller with its
+    // targets bound; NO_GRAPH_PASS runs the rest of the frame and binds the window's
+    // framebuffer again, for reading as well
+    void execute(GraphPass until = NO_GRAPH_PASS)
+    {
+        while (next < order.size())
+        {
+            GraphPass pass = order[next++];
+            bindTargets(passes[pass]);
+            if (pass == until)
+                return;
+            if (passes[pass].body)
+                passes[pass].body();
+        }
+        if (boundDraw != 0 || boundRead != 0)
+        {
+            glBindFramebuffer(GL_FRAMEBUFFER, 0);
+            boundDraw = boundRead = 0;
+        }
+    }
+
+    // the compiled order, the culled passes and where every transient lives
+    void dump() const
+    {
+        std::printf("render graph: %zu passes, %zu culled\n", stats.passes, stats.culled);
+        for (size_t i = 0; i < order.size(); i++)
+        {
+            const Pass& pass = passes[order[i]];
+            std::printf("  %zu. %-10s", i + 1, pass.name.c_str());
+            printResources(" reads", pass.reads);
+            printResources(" writes", pass.writes);
+            std::printf("%s%s\n", pass.body ? "" : "  (run by the caller)", pass.sideEffect ? "  (side effect)" : "");
+        }
+        for (size_t i = 0; i < passes.size(); i++)
+        {
+            if (!passes[i].live)
+                std::printf("  -  %-10s culled: nothing reads what it writes\n", passes[i].name.c_str());
+        }
+        for (size_t i = 0; i < resources.size(); i++)
+        {
+            const Resource& resource = resources[i];
+            if (!resource.transient)
+            {
+                std::printf("  %-12s imported%s\n", resource.name.c_str(), resource.output ? ", output" : "");
+                continue;
+            }
+            if (resource.physical < 0)
+            {
+                std::printf("  %-12s unused\n", resource.name.c_str());
+                continue;
+            }
+            std::printf("  %-12s %dx%d %-7s passes %d-%d  texture %d  %zu KB\n", resource.name.c_str(), resource.desc.width, resource.desc.height,
+                graphFormatName(resource.desc.format), resource.first + 1, resource.last + 1, resource.physical, graphTextureBytes(resource.desc) / 1024);
+        }
+        std::printf("transient memory: %zu KB in %zu textures for %zu transients (%zu KB without aliasing, at most %zu KB in use at one pass)\n",
+            stats.bytes / 1024, stats.textures, stats.transients, stats.unaliasedBytes / 1024, stats.peakBytes / 1024);
+    }
+
+    void release()
+    {
+        destroyFramebuffers();
+        for (size_t i = 0; i < pool.size(); i++)
+            destroyTexture(pool[i].texture);
+        pool.clear();
+        reset();
+    }
+
+private:
+    struct Resource
+    {
+        std::string name;
+        bool transient;
+        bool output;
+        GraphTextureDesc desc;
+        int first;          // first and last position in the order that uses it
+        int last;
+        int physical;       // index in pool
+    };
+
+    struct Pass
+    {
+        std::string name;
+        std::function<void()> body;
+        std::vector<GraphResource> reads;
+        std::vector<GraphResource> writes;
+        std::vector<GraphPass> after;       // passes that must run first
+        bool sideEffect = false;
+        bool live = false;
+        GLuint drawFramebuffer = 0;
+        GLuint readFramebuffer = 0;
+    };
+
+    struct PooledTexture
+    {
+        GraphTextureDesc desc;
+        GLuint texture;
+        int busyUntil;      // last position of the transients given this texture by this compile
+        bool used;
+    };
+
+    std::vector<Pass> passes;
+    std::vector<Resource> resources;
+    std::vector<GraphPass> order;
+    std::vector<PooledTexture> pool;
+    std::vector<GLuint> framebuffers;
+    GpuMemoryTracker& memory;
+    bool compiled;
+    size_t next;
+    GLuint boundDraw;
+    GLuint boundRead;
+
+    GraphResource addResource(const char* name, bool transient, const GraphTextureDesc& desc)
+    {
+        Resource resource = { name, transient, false, desc, -1, -1, -1 };
+        resources.push_back(resource);
+        return (GraphResource)resources.size() - 1;
+    }
+
+    // declaration order gives the dependencies: a read waits for the last write before it,
+    // a write for the last write and the reads since. Kahn's sort, taking the earliest
+    // declared pass that is ready, so independent passes keep their declared order.
+    bool orderPasses()
+    {
+        std::vector<int> lastWriter(resources.size(), -1);
+        std::vector<std::vector<int> > readersSince(resources.size());
+        for (size_t p = 0; p < passes.size(); p++)
+        {
+            Pass& pass = passes[p];
+            pass.after.clear();
+            for (size_t r = 0; r < pass.reads.size(); r++)
+            {
+                if (lastWriter[pass.reads[r]] >= 0)
+                    pass.after.push_back(lastWriter[pass.reads[r]]);
+            }
+            for (size_t w = 0; w < pass.writes.size(); w++)
+            {
+                GraphResource resource = pass.writes[w];
+                if (lastWriter[resource] >= 0)
+                    pass.after.push_back(lastWriter[resource]);
+                pass.after.insert(pass.after.end(), readersSince[resource].begin(), readersSince[resource].end());
+            }
+            for (size_t r = 0; r < pass.reads.size(); r++)
+                readersSince[pass.reads[r]].push_back((int)p);
+            for (size_t w = 0; w < pass.writes.size(); w++)
+            {
+                lastWriter[pass.writes[w]] = (int)p;
+                readersSince[pass.writes[w]].clear();
+            }
+            // a pass reading what it writes does not wait for itself
+            pass.after.erase(std::remove(pass.after.begin(), pass.after.end(), (int)p), pass.after.end());
+        }
+
+        order.clear();
+        std::vector<bool> placed(passes.size(), false);
+        while (order.size() < passes.size())
+        {
+            size_t ready = passes.size();
+            for (size_t p = 0; p < passes.size() && ready == passes.size(); p++)
+            {
+                if (placed[p])
+                    continue;
+                bool waiting = false;
+                for (size_t a = 0; a < passes[p].after.size() && !waiting; a++)
+                    waiting = !placed[passes[p].after[a]];
+                if (!waiting)
+                    ready = p;
+            }
+            if (ready == passes.size())
+            {
+                std::cout << "ERROR::RENDER_GRAPH::CYCLE: the passes depend on each other" << std::endl;
+                order.clear();
+                return false;
+            }
+            placed[ready] = true;
+            order.push_back((GraphPass)ready);
+        }
+        return true;
+    }
+
+    // live: side effects, writers of outputs, and the passes a live pass waits for.
+    // Walking the order backwards sees every pass after the ones that wait for it.
+    void cullPasses()
+    {
+        for (size_t p = 0; p < passes.size(); p++)
+        {
+            Pass& pass = passes[p];
+            pass.live = pass.sideEffect;
+            for (size_t w = 0; w < pass.writes.size() && !pass.live; w++)
+                pass.live = resources[pass.writes[w]].output;
+        }
+        for (size_t i = order.size(); i-- > 0;)
+        {
+            const Pass& pass = passes[order[i]];
+            if (!pass.live)
+                continue;
+            for (size_t a = 0; a < pass.after.size(); a++)
+                passes[pass.after[a]].live = true;
+        }
+
+        std::vector<GraphPass> liveOrder;
+        for (size_t i = 0; i < order.size(); i++)
+        {
+            if (passes[order[i]].live)
+                liveOrder.push_back(order[i]);
+        }
+        stats.passes = passes.size();
+        stats.culled = order.size() - liveOrder.size();
+        order.swap(liveOrder);
+    }
+
+    // lifetimes over the live order, then each transient, earliest first, takes a texture
+    // of its size and format that is free from its first pass on; new textures only when
+    // none is
+    void assignTextures()
+    {
+        for (size_t r = 0; r < resources.size(); r++)
+            resources[r].first = resources[r].last = resources[r].physical = -1;
+        for (size_t i = 0; i < order.size(); i++)
+        {
+            const Pass& pass = passes[order[i]];
+            for (int list = 0; list < 2; list++)
+            {
+                const std::vector<GraphResource>& used = list == 0 ? pass.reads : pass.writes;
+                for (size_t r = 0; r < used.size(); r++)
+                {
+                    Resource& resource = resources[used[r]];
+                    if (resource.first < 0)
+                        resource.first = (int)i;
+                    resource.last = (int)i;
+                }
+            }
+        }
+
+        std::vector<GraphResource> transients;
+        for (size_t r = 0; r < resources.size(); r++)
+        {
+            if (resources[r].transient && resources[r].first >= 0)
+                transients.push_back((GraphResource)r);
+        }
+        std::stable_sort(transients.begin(), transients.end(), [this](GraphResource a, GraphResource b)
+        {
+            return resources[a].first < resources[b].first;
+        });
+
+        for (size_t t = 0; t < pool.size(); t++)
+        {
+            pool[t].busyUntil = -1;
+            pool[t].used = false;
+        }
+        for (size_t i = 0; i < transients.size(); i++)
+        {
+            Resource& resource = resources[transients[i]];
+            int chosen = -1;
+            for (size_t t = 0; t < pool.size() && chosen < 0; t++)
+            {
+                if (pool[t].desc == resource.desc && pool[t].busyUntil < resource.first)
+                    chosen = (int)t;
+            }
+            if (chosen < 0)
+            {
+                PooledTexture texture = { resource.desc, createTexture(resource.desc), -1, false };
+                pool.push_back(texture);
+                chosen = (int)pool.size() - 1;
+                stats.texturesCreated++;
+            }
+            pool[chosen].busyUntil = resource.last;
+            pool[chosen].used = true;
+            resource.physical = chosen;
+        }
+
+        // textures no transient wanted this time (an old window size) are freed
+        std::vector<int> remap(pool.size(), -1);
+        std::vector<PooledTexture> kept;
+        for (size_t t = 0; t < pool.size(); t++)
+        {
+            if (pool[t].used)
+            {
+                remap[t] = (int)kept.size();
+                kept.push_back(pool[t]);
+            }
+            else
+                destroyTexture(pool[t].texture);
+        }
+        pool.swap(kept);
+        for (size_t i = 0; i < transients.size(); i++)
+            resources[transients[i]].physical = remap[resources[transients[i]].physical];
+
+        stats.transients = transients.size();
+        stats.textures = pool.size();
+        for (size_t t = 0; t < pool.size(); t++)
+            stats.bytes += graphTextureBytes(pool[t].desc);
+        for (size_t t = 0; t < transients.size(); t++)
+            stats.unaliasedBytes += graphTextureBytes(resources[transients[t]].desc);
+        for (size_t i = 0; i < order.size(); i++)
+        {
+            size_t inUse = 0;
+            for (size_t t = 0; t < transients.size(); t++)
+            {
+                const Resource& resource = resources[transients[t]];
+                if (resource.first <= (int)i && resource.last >= (int)i)
+                    inUse += graphTextureBytes(resource.desc);
+            }
+            stats.peakBytes = std::max(stats.peakBytes, inUse);
+        }
+    }
+
+    GLuint createTexture(const GraphTextureDesc& desc)
+    {
+        // the texture goes on the active unit, where the state cache expects nothing of GL_TEXTURE_2D
+        GLuint texture;
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        if (desc.format == GRAPH_DEPTH24)
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, desc.width, desc.height, 0, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, NULL);
+        else if (desc.format == GRAPH_RGBA16F)
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, desc.width, desc.height, 0, GL_RGBA, GL_FLOAT, NULL);
+        else
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, desc.width, desc.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+        GLint filter = desc.format == GRAPH_DEPTH24 ? GL_NEAREST : GL_LINEAR;
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        memory.allocate(GPU_TEXTURE, texture, MEMORY_TARGETS, graphTextureBytes(desc));
+        return texture;
+    }
+
+    void destroyTexture(GLuint texture)
+    {
+        glDeleteTextures(1, &texture);
+        memory.release(GPU_TEXTURE, texture);
+    }
+
+    // one framebuffer object per live pass and direction that touches transients
+    void createFramebuffers()
+    {
+        destroyFramebuffers();
+        for (size_t i = 0; i < order.size(); i++)
+        {
+            Pass& pass = passes[order[i]];
+            pass.drawFramebuffer = framebufferOf(pass.writes, pass.name);
+            pass.readFramebuffer = framebufferOf(pass.reads, pass.name);
+            if (pass.readFramebuffer == 0)
+                pass.readFramebuffer = pass.drawFramebuffer;
+        }
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        boundDraw = boundRead = 0;
+    }
+
+    GLuint framebufferOf(const std::vector<GraphResource>& attached, const std::string& passName)
+    {
+        GLuint color = 0, depth = 0;
+        for (size_t r = 0; r < attached.size(); r++)
+        {
+            const Resource& resource = resources[attached[r]];
+            if (!resource.transient)
+                continue;
+            if (resource.desc.format == GRAPH_DEPTH24)
+                depth = texture(attached[r]);
+            else if (color == 0)
+                color = texture(attached[r]);
+        }
+        if (color == 0 && depth == 0)
+            return 0;
+
+        GLuint framebuffer;
+        glGenFramebuffers(1, &framebuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        if (color != 0)
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, color, 0);
+        else
+            glDrawBuffer(GL_NONE);
+        if (depth != 0)
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depth, 0);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cout << "ERROR::RENDER_GRAPH::FRAMEBUFFER_INCOMPLETE: " << passName << std::endl;
+        framebuffers.push_back(framebuffer);
+        return framebuffer;
+    }
+
+    void destroyFramebuffers()
+    {
+        if (!framebuffers.empty())
+            glDeleteFramebuffers((GLsizei)framebuffers.size(), &framebuffers[0]);
+        framebuffers.clear();
+        boundDraw = boundRead = 0;      // deleting a bound framebuffer binds the window's
+    }
+
+    void bindTargets(const Pass& pass)
+    {
+        if (pass.drawFramebuffer != boundDraw)
+        {
+            glBindFramebuffer(GL_DRAW_FRAMEBUFFER, pass.drawFramebuffer);
+            boundDraw = pass.drawFramebuffer;
+        }
+        if (pass.readFramebuffer != boundRead)
+        {
+            glBindFramebuffer(GL_READ_FRAMEBUFFER, pass.readFramebuffer);
+            boundRead = pass.readFramebuffer;
+        }
+    }
+
+    void printResources(const char* label, const std::vector<GraphResource>& list) const
+    {
+        if (list.empty())
+            return;
+        std::printf("%s", label);
+        for (size_t i = 0; i < list.size(); i++)
+            std::printf("%s %s", i == 0 ? "" : ",", resources[list[i]].name.c_str());
+    }
+};
+
+inline void printRenderGraphStats(const RenderGraphStats& stats)
+{
+    std::printf("render graph: %zu passes (%zu culled)  transient textures: %zu for %zu, %zu KB (%zu without aliasing, peak %zu)  compiles: %zu  textures created: %zu\n",
+        stats.passes - stats.culled, stats.culled, stats.textures, stats.transients, stats.bytes / 1024, stats.unaliasedBytes / 1024,
+        stats.peakBytes / 1024, stats.compiles, stats.texturesCreated);
+}
+
+#endif
@@ -0,0 +1,441 @@
+//
+//  restaurant_generator.h
+//  3D Object Drawing
+//
+
+#ifndef RESTAURANT_GENERATOR_H
+#define RESTAURANT_GENERATOR_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "draw_list.h"
+
+#include <vector>
+#include <random>
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <cstdlib>
+#include <cmath>
+#include <algorithm>
+
+// the furniture kinds the draw helpers in main.cpp know how to build
+enum SceneObjectType {
+    OBJECT_TILE,
+    OBJECT_TABLE,
+    OBJECT_CHAIR,
+    OBJECT_STOOL,
+    OBJECT_WALL
+};
+
+const char* const SCENE_OBJECT_NAMES[] = { "tile", "table", "chair", "stool", "wall" };
+const int SCENE_OBJECT_TYPES = 5;
+
+// wall colors are picked from WALL_SHADES x WALL_SHADES shades of red and blue, so a
+// generated scene of any size fits the material table
+const int WALL_SHADES = 4;
+
+// placement of one object: model = translate(position) * rotateY(yaw) * scale(scale)
+struct SceneObject
+{
+    SceneObjectType type;
+    glm::vec3 position;
+    float yaw;
+    glm::vec3 scale;
+    glm::vec4 color;
+
+    glm::mat4 transform() const
+    {
+        glm::mat4 identityMatrix = glm::mat4(1.0f);
+        glm::mat4 translateMatrix = glm::translate(identityMatrix, position);
+        glm::mat4 rotateYMatrix = glm::rotate(identityMatrix, glm::radians(yaw), glm::vec3(0.0f, 1.0f, 0.0f));
+        glm::mat4 scaleMatrix = glm::scale(identityMatrix, scale);
+        return translateMatrix * rotateYMatrix * scaleMatrix;
+    }
+};
+
+struct SceneRoom
+{
+    AABB bounds;
+};
+
+// a doorway: the gap in a wall, as thick as the wall; the rooms (or the outside) it joins
+// are the ones on either side of it (see portal_visibility.h)
+struct ScenePortal
+{
+    AABB opening;
+};
+
+struct GeneratedScene
+{
+    unsigned int seed = 0;
+    std::vector<SceneRoom> rooms;
+    std::vector<ScenePortal> portals;
+    std::vector<SceneObject> objects;
+
+    size_t count(SceneObjectType type) const
+    {
+        size_t n = 0;
+        for (size_t i = 0; i < objects.size(); i++)
+        {
+            if (objects[i].type == type)
+                n++;
+        }
+        return n;
+    }
+};
+
+struct GeneratorConfig
+{
+    unsigned int seed = 1;
+    int rooms = 4;
+    int tablesPerRoom = 6;
+    int chairsPerTable = 4;
+    int stoolsPerRoom = 5;
+    int tilesPerRoomSide = 20;      // the floor of each room is tilesPerRoomSide x tilesPerRoomSide tiles
+    float roomWidth = 4.0f;
+    float roomDepth = 6.0f;
+    float roomHeight = 3.0f;
+
+    int objectsPerRoom() const
+    {
+        // an inner room: four walls, each split around a doorway
+        return tilesPerRoomSide * tilesPerRoomSide + tablesPerRoom * (1 + chairsPerTable) + stoolsPerRoom + 8;
+    }
+
+    // picks a room count so the layout holds roughly targetObjects objects
+    static GeneratorConfig forObjectCount(size_t targetObjects, unsigned int seed)
+    {
+        GeneratorConfig config;
+        config.seed = seed;
+        size_t rooms = targetObjects / config.objectsPerRoom();
+        config.rooms = rooms < 1 ? 1 : (int)rooms;
+        return config;
+    }
+};
+
+// Lays out rooms on a square grid. Each room gets a checkered tile floor, walls with a
+// doorway to the front and to every neighbouring room, tables with chairs around them and
+// a row of bar stools along the back wall. The same seed always produces the same layout.
+class RestaurantGenerator
+{
+public:
+    static GeneratedScene generate(const GeneratorConfig& config)
+    {
+        GeneratedScene scene;
+        scene.seed = config.seed;
+        std::mt19937 rng(config.seed);
+
+        int columns = (int)std::ceil(std::sqrt((double)config.rooms));
+        scene.objects.reserve((size_t)config.rooms * config.objectsPerRoom());
+        for (int room = 0; room < config.rooms; room++)
+        {
+            int column = room % columns;
+            glm::vec3 origin(column * config.roomWidth, 0.0f, -(room / columns) * config.roomDepth);
+            RoomDoorways doorways;
+            doorways.frontRow = room < columns;
+            doorways.back = room + columns < config.rooms;
+            doorways.left = column > 0;
+            doorways.right = column + 1 < columns && room + 1 < config.rooms;
+            generateRoom(config, origin, doorways, rng, scene);
+        }
+        return scene;
+    }
+
+private:
+    // the front doorway leads outside from the front row and into the room in front from
+    // the others; back, left and right only have one if there is a room on that side
+    struct RoomDoorways
+    {
+        bool frontRow = false;
+        bool back = false;
+        bool left = false;
+        bool right = false;
+    };
+
+    static void generateRoom(const GeneratorConfig& config, const glm::vec3& origin, const RoomDoorways& doorways, std::mt19937& rng, GeneratedScene& scene)
+    {
+        std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+        const float floorY = -1.0f;
+        float width = config.roomWidth;
+        float depth = config.roomDepth;
+
+        SceneRoom room;
+        room.bounds.min = origin + glm::vec3(0.0f, floorY, -depth);
+        room.bounds.max = origin + glm::vec3(width, floorY + config.roomHeight, 0.0f);
+        scene.rooms.push_back(room);
+
+        // floor; makeT draws a 0.2 x 0.2 tile, so scale it up to the cell size
+        int n = config.tilesPerRoomSide;
+        float cellX = width / n;
+        float cellZ = depth / n;
+        for (int i = 0; i < n; i++)
+        {
+            for (int j = 0; j < n; j++)
+            {
+                float shade = ((i + j) % 2 == 0) ? 0.0f : 1.0f;
+                SceneObject tile = { OBJECT_TILE, origin + glm::vec3(i * cellX, 0.0f, -j * cellZ + 0.1f), 0.0f,
+                    glm::vec3(cellX / 0.2f, 1.0f, cellZ / 0.2f), glm::vec4(shade, shade, shade, 1.0f) };
+                scene.objects.push_back(tile);
+            }
+        }
+
+        // walls: back, left, right and front, split around their doorways. Neighbouring
+        // rooms each have their own wall, so a doorway between them goes through both; the
+        // room behind and the room to the right add the portal of the one they share.
+        glm::vec4 wallColor(wallShade(unit(rng)), 0.0f, wallShade(unit(rng)), 1.0f);
+        float t = 0.1f;
+        float doorway = 1.0f;
+        float side = (width - doorway) * 0.5f;
+        float sideZ = (depth - doorway) * 0.5f;
+        float top = floorY + config.roomHeight;
+        addWall(scene, config, origin + glm::vec3(0.0f, floorY, -depth), true, width, doorways.back, doorway, wallColor);
+        addWall(scene, config, origin + glm::vec3(0.0f, floorY, -depth), false, depth, doorways.left, doorway, wallColor);
+        addWall(scene, config, origin + glm::vec3(width - t, floorY, -depth), false, depth, doorways.right, doorway, wallColor);
+        addWall(scene, config, origin + glm::vec3(0.0f, floorY, -t), true, width, true, doorway, wallColor);
+        ScenePortal front;
+        front.opening.min = origin + glm::vec3(side, floorY, -t);
+        front.opening.max = origin + glm::vec3(width - side, top, doorways.frontRow ? 0.0f : t);
+        scene.portals.push_back(front);
+        if (doorways.left)
+        {
+            ScenePortal left;
+            left.opening.min = origin + glm::vec3(-t, floorY, -depth + sideZ);
+            left.opening.max = origin + glm::vec3(t, top, -sideZ);
+            scene.portals.push_back(left);
+        }
+
+        // tables on a jittered grid in the front two thirds of the room, chairs facing them
+        int tableColumns = (int)std::ceil(std::sqrt((double)config.tablesPerRoom));
+        int tableRows = tableColumns > 0 ? (config.tablesPerRoom + tableColumns - 1) / tableColumns : 0;
+        float spacingX = width / (tableColumns + 1);
+        float spacingZ = depth * 0.66f / (tableRows + 1);
+        for (int table = 0; table < config.tablesPerRoom; table++)
+        {
+            glm::vec3 center = origin + glm::vec3((table % tableColumns + 1) * spacingX + 0.1f * (unit(rng) - 0.5f), -0.2f,
+                -(table / tableColumns + 1) * spacingZ + 0.1f * (unit(rng) - 0.5f));
+            SceneObject tableObject = { OBJECT_TABLE, center, 0.0f, glm::vec3(0.7f, 0.6f, 0.5f), glm::vec4(0.9f, 0.6f, 0.4f, 1.0f) };
+            scene.objects.push_back(tableObject);
+
+            for (int chair = 0; chair < config.chairsPerTable; chair++)
+            {
+                float angle = 360.0f * chair / config.chairsPerTable;
+                float radians = glm::radians(angle);
+                glm::vec3 offset(0.45f * std::sin(radians), -0.5f, 0.45f * std::cos(radians));
+                SceneObject chairObject = { OBJECT_CHAIR, center + offset, angle, glm::vec3(1.3f, 1.0f, 0.7f), glm::vec4(1.0f, 0.1f, 0.0f, 1.0f) };
+                scene.objects.push_back(chairObject);
+            }
+        }
+
+        // bar stools along the back wall
+        for (int stool = 0; stool < config.stoolsPerRoom; stool++)
+        {
+            float x = (stool + 1) * width / (config.stoolsPerRoom + 1);
+            SceneObject stoolObject = { OBJECT_STOOL, origin + glm::vec3(x, 0.2f, -depth + 0.8f), 0.0f, glm::vec3(1.0f), glm::vec4(0.3f, 0.4f, 1.0f, 1.0f) };
+            scene.objects.push_back(stoolObject);
+        }
+    }
+
+    // 0.4 to 0.7 in WALL_SHADES steps
+    static float wallShade(float random)
+    {
+        int step = std::min((int)(random * WALL_SHADES), WALL_SHADES - 1);
+        return 0.4f + 0.3f * step / (WALL_SHADES - 1);
+    }
+
+    // a wall from start along x (or z) for length, in two pieces around a doorway in its
+    // middle if it has one; the wall cube is 0.5 on a side
+    static void addWall(GeneratedScene& scene, const GeneratorConfig& config, const glm::vec3& start, bool alongX, float length,
+        bool hasDoorway, float doorway, const glm::vec4& color)
+    {
+        const float t = 0.1f;
+        float piece = hasDoorway ? (length - doorway) * 0.5f : length;
+        glm::vec3 axis = alongX ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f, 0.0f, 1.0f);
+        glm::vec3 scale = alongX ? glm::vec3(piece / 0.5f, config.roomHeight / 0.5f, t / 0.5f) : glm::vec3(t / 0.5f, config.roomHeight / 0.5f, piece / 0.5f);
+        SceneObject wall = { OBJECT_WALL, start, 0.0f, scale, color };
+        scene.objects.push_back(wall);
+        if (hasDoorway)
+        {
+            wall.position = start + axis * (length - piece);
+            scene.objects.push_back(wall);
+        }
+    }
+};
+
+// Scene files are plain text, one record per line:
+//   seed <n>
+//   room <minX> <minY> <minZ> <maxX> <maxY> <maxZ>
+//   portal <minX> <minY> <minZ> <maxX> <maxY> <maxZ>
+//   <type> <x> <y> <z> <yaw> <sx> <sy> <sz> <r> <g> <b> <a>
+inline bool saveScene(const std::string& path, const GeneratedScene& scene)
+{
+    std::ofstream file(path.c_str());
+    if (!file)
+    {
+        std::cout << "ERROR::SCENE::FILE_NOT_WRITABLE: " << path << std::endl;
+        return false;
+    }
+    // enough digits for floats to survive the round trip bit for bit
+    file.precision(9);
+    file << "seed " << scene.seed << "\n";
+    for (size_t i = 0; i < scene.rooms.size(); i++)
+    {
+        const AABB& b = scene.rooms[i].bounds;
+        file << "room " << b.min.x << " " << b.min.y << " " << b.min.z << " " << b.max.x << " " << b.max.y << " " << b.max.z << "\n";
+    }
+    for (size_t i = 0; i < scene.portals.size(); i++)
+    {
+        const AABB& b = scene.portals[i].opening;
+        file << "portal " << b.min.x << " " << b.min.y << " " << b.min.z << " " << b.max.x << " " << b.max.y << " " << b.max.z << "\n";
+    }
+    for (size_t i = 0; i < scene.objects.size(); i++)
+    {
+        const SceneObject& o = scene.objects[i];
+        file << SCENE_OBJECT_NAMES[o.type] << " " << o.position.x << " " << o.position.y << " " << o.position.z << " " << o.yaw << " "
+             << o.scale.x << " " << o.scale.y << " " << o.scale.z << " "
+             << o.color.x << " " << o.color.y << " " << o.color.z << " " << o.color.w << "\n";
+    }
+    return true;
+}
+
+inline bool loadScene(const std::string& path, GeneratedScene& scene)
+{
+    std::ifstream file(path.c_str());
+    if (!file)
+    {
+        std::cout << "ERROR::SCENE::FILE_NOT_SUCCESSFULLY_READ: " << path << std::endl;
+        return false;
+    }
+    scene = GeneratedScene();
+    std::string line;
+    while (std::getline(file, line))
+    {
+        std::istringstream in(line);
+        std::string keyword;
+        if (!(in >> keyword))
+            continue;
+        if (keyword == "seed")
+        {
+            in >> scene.seed;
+            continue;
+        }
+        if (keyword == "room")
+        {
+            SceneRoom room;
+            in >> room.bounds.min.x >> room.bounds.min.y >> room.bounds.min.z >> room.bounds.max.x >> room.bounds.max.y >> room.bounds.max.z;
+            scene.rooms.push_back(room);
+            continue;
+        }
+        if (keyword == "portal")
+        {
+            ScenePortal portal;
+            in >> portal.opening.min.x >> portal.opening.min.y >> portal.opening.min.z >> portal.opening.max.x >> portal.opening.max.y >> portal.opening.max.z;
+            scene.portals.push_back(portal);
+            continue;
+        }
+
+        int type = -1;
+        for (int t = 0; t < SCENE_OBJECT_TYPES; t++)
+        {
+            if (keyword == SCENE_OBJECT_NAMES[t])
+                type = t;
+        }
+        SceneObject o;
+        if (type < 0 || !(in >> o.position.x >> o.position.y >> o.position.z >> o.yaw >> o.scale.x >> o.scale.y >> o.scale.z
+                              >> o.color.x >> o.color.y >> o.color.z >> o.color.w))
+        {
+            std::cout << "ERROR::SCENE::BAD_RECORD: " << line << std::endl;
+            return false;
+        }
+        o.type = (SceneObjectType)type;
+        scene.objects.push_back(o);
+    }
+    return true;
+}
+
+// command line switches of the procedural restaurant
+struct SceneOptions
+{
+    bool generate = false;          // --generate      (implied by any of the generator switches below)
+    GeneratorConfig generator;      // --seed N, --rooms N, --tables N, --chairs N, --stools N, --tiles N
+    std::string loadPath;           // --scene FILE    load a generated scene file
+    std::string savePath;           // --save-scene FILE
+
+    // false if arg is not one of the switches above
+    bool parseArgs(const std::string& arg, int argc, char** argv, int& i)
+    {
+        if (arg == "--generate")
+            generate = true;
+        else if (arg == "--scene" && i + 1 < argc)
+            loadPath = argv[++i];
+        else if (i + 1 < argc && (arg == "--seed" || arg == "--rooms" || arg == "--tables" || arg == "--chairs" || arg == "--stools"
+                                  || arg == "--tiles" || arg == "--save-scene"))
+        {
+            // any of these asks for a generated restaurant
+            generate = true;
+            const char* value = argv[++i];
+            if (arg == "--seed")
+                generator.seed = (unsigned int)std::strtoul(value, NULL, 10);
+            else if (arg == "--rooms")
+                generator.rooms = std::atoi(value);
+            else if (arg == "--tables")
+                generator.tablesPerRoom = std::atoi(value);
+            else if (arg == "--chairs")
+                generator.chairsPerTable = std::atoi(value);
+            else if (arg == "--stools")
+                generator.stoolsPerRoom = std::atoi(value);
+            else if (arg == "--tiles")
+                generator.tilesPerRoomSide = std::atoi(value);
+            else
+                savePath = value;
+        }
+        else
+            return false;
+        return true;
+    }
+
+    // the scene is generated or loaded instead of the hand built one
+    bool used() const
+    {
+        return generate || !loadPath.empty();
+    }
+
+    // loads or generates the scene, then writes it out if asked to
+    bool init(GeneratedScene& scene) const
+    {
+        if (!loadPath.empty())
+        {
+            if (!loadScene(loadPath, scene))
+                return false;
+        }
+        else if (generate)
+        {
+            scene = RestaurantGenerator::generate(generator);
+            std::cout << "generated " << scene.objects.size() << " objects in " << scene.rooms.size() << " rooms" << std::endl;
+        }
+        if (!savePath.empty())
+        {
+            if (!saveScene(savePath, scene))
+                return false;
+            std::cout << "scene written to " << savePath << std::endl;
+        }
+        return true;
+    }
+
+    static void printUsage()
+    {
+        std::cout << "  --generate       render a procedurally generated restaurant\n"
+                  << "  --seed N         generator seed (default 1)\n"
+                  << "  --rooms N        generated rooms (default 4)\n"
+                  << "  --tables N       tables per room (default 6)\n"
+                  << "  --chairs N       chairs per table (default 4)\n"
+                  << "  --stools N       bar stools per room (default 5)\n"
+                  << "  --tiles N        floor tiles along each room side (default 20)\n"
+                  << "  --scene FILE     render a scene file written by --save-scene\n"
+                  << "  --save-scene F   write the generated scene to F\n";
+    }
+};
+
+#endif
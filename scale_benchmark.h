@@ -0,0 +1,115 @@
+//
+//  scale_benchmark.h
+//  3D Object Drawing
+//
+
+#ifndef SCALE_BENCHMARK_H
+#define SCALE_BENCHMARK_H
+
+#include "restaurant_generator.h"
+#include "mem_stats.h"
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <cstdio>
+#include <iostream>
+
+// Renders generated restaurants of increasing size and records frame time and memory
+// use for each. Results are printed as a table and written to a CSV file for plotting.
+class ScaleBenchmark
+{
+public:
+    ScaleBenchmark(unsigned int benchSeed, const std::string& csv, int warmupFrames = 10, int measuredFrames = 60)
+        : seed(benchSeed), csvPath(csv), warmup(warmupFrames), measured(measuredFrames)
+    {
+        size_t counts[] = { 1000, 10000, 100000, 1000000 };
+        for (size_t i = 0; i < sizeof(counts) / sizeof(counts[0]); i++)
+        {
+            Row row;
+            row.targetObjects = counts[i];
+            rows.push_back(row);
+        }
+    }
+
+    bool done() const
+    {
+        return step >= rows.size();
+    }
+
+    // true on the first frame of a step: the caller should regenerate with config()
+    bool needsScene() const
+    {
+        return !done() && frameInStep == 0;
+    }
+
+    GeneratorConfig config() const
+    {
+        return GeneratorConfig::forObjectCount(rows[step].targetObjects, seed);
+    }
+
+    void sceneGenerated(const GeneratedScene& scene, double generateMs)
+    {
+        Row& row = rows[step];
+        row.objects = scene.objects.size();
+        row.generateMs = generateMs;
+    }
+
+    void record(double frameMs, size_t drawCommands, size_t drawListBytes)
+    {
+        if (done())
+            return;
+        Row& row = rows[step];
+        frameInStep++;
+        if (frameInStep > warmup)
+        {
+            row.frameMs += frameMs / measured;
+            row.drawCommands = drawCommands;
+            row.drawListBytes = drawListBytes;
+        }
+        if (frameInStep == warmup + measured)
+        {
+            row.residentBytes = processResidentBytes();
+            step++;
+            frameInStep = 0;
+        }
+    }
+
+    void print() const
+    {
+        std::ofstream csv(csvPath.c_str());
+        csv << "objects,draws,generate_ms,frame_ms,draw_list_mb,resident_mb\n";
+        std::cout << "  objects    draws  generate ms  frame ms  draw list MB  resident MB" << std::endl;
+        for (size_t i = 0; i < rows.size(); i++)
+        {
+            const Row& row = rows[i];
+            double listMb = row.drawListBytes / (1024.0 * 1024.0);
+            double residentMb = row.residentBytes / (1024.0 * 1024.0);
+            std::printf("%9zu  %7zu  %11.1f  %8.2f  %12.1f  %11.1f\n", row.objects, row.drawCommands, row.generateMs, row.frameMs, listMb, residentMb);
+            csv << row.objects << "," << row.drawCommands << "," << row.generateMs << "," << row.frameMs << "," << listMb << "," << residentMb << "\n";
+        }
+        std::cout << "written to " << csvPath << std::endl;
+    }
+
+private:
+    struct Row
+    {
+        size_t targetObjects = 0;
+        size_t objects = 0;
+        size_t drawCommands = 0;
+        size_t drawListBytes = 0;
+        size_t residentBytes = 0;
+        double generateMs = 0.0;
+        double frameMs = 0.0;
+    };
+
+    unsigned int seed;
+    std::string csvPath;
+    int warmup;
+    int measured;
+    size_t step = 0;
+    int frameInStep = 0;
+    std::vector<Row> rows;
+};
+
+#endif
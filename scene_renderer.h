@@ -0,0 +1,263 @@
+//
+//  scene_renderer.h
+//  3D Object Drawing
+//
+
+#ifndef SCENE_RENDERER_H
+#define SCENE_RENDERER_H
+
+#include <glm/glm.hpp>
+
+#include "draw_list.h"
+#include "material_table.h"
+#include "render_device.h"
+
+#include <vector>
+#include <cstddef>
+#include <iostream>
+
+const unsigned int MATERIALS_BINDING = 0;
+
+// per-instance vertex data, attribute locations 2-8 in vertexShader.vs
+struct InstanceData
+{
+    glm::mat4 model;            // locations 2-5
+    unsigned short material;    // location 6, 16-bit material index
+    unsigned short viewMask;    // location 7, views this instance is visible in
+    unsigned int drawIndex;     // location 8, index in the draw list (the baked light is stored by it)
+};
+
+struct RenderStats
+{
+    size_t instances = 0;
+    size_t drawCalls = 0;
+    size_t uniqueMaterials = 0;
+    size_t materialBytesUploaded = 0;
+    size_t uniformUpdatesAvoided = 0;   // model + color uniforms the per-draw loop used to set
+    size_t quads = 0;                   // zero-thickness boxes drawn as one face
+    size_t flatBoxes = 0;               // boxes flat along two or more axes, not drawn
+    size_t trianglesSaved = 0;
+};
+
+// Owns the GPU side of a DrawList: the per-instance buffers, the cube's vertex layouts and
+// the uniform buffer mirroring the material table. Every draw is the cube mesh and reads its
+// material by index, so the list goes out as one instanced draw call per mesh: the cube, or
+// one of its faces for boxes scaled to nothing along an axis (see instanceMesh). The faces
+// are ranges of the cube's own index buffer, so no extra geometry is uploaded.
+class SceneRenderer
+{
+public:
+    RenderStats stats;
+
+    explicit SceneRenderer(RenderDevice& renderDevice)
+        : device(renderDevice), materialBuffer(0), uploadedMaterials(0), quadSubstitution(true)
+    {
+    }
+
+    // builds a vertex layout per mesh from the cube mesh attributes (locations 0-1) and
+    // that mesh's per-instance ones
+    void init(const VertexAttribute* meshAttributes, int meshAttributeCount, DeviceHandle indexBuffer)
+    {
+        materialBuffer = device.createBuffer(UNIFORM_BUFFER, MAX_MATERIALS * sizeof(Material), NULL, DYNAMIC_BUFFER, MEMORY_SHADING);
+        device.bindUniformBuffer(MATERIALS_BINDING, materialBuffer);
+
+        for (int mesh = 0; mesh < INSTANCE_MESH_COUNT; mesh++)
+        {
+            Batch& batch = batches[mesh];
+            batch.instanceBuffer = device.createBuffer(VERTEX_BUFFER, 0, NULL, STREAM_BUFFER, MEMORY_INSTANCES);
+
+            std::vector<VertexAttribute> attributes(meshAttributes, meshAttributes + meshAttributeCount);
+            appendInstanceAttributes(attributes, batch.instanceBuffer, 0);
+            batch.layout = device.createVertexLayout(&attributes[0], (int)attributes.size(), indexBuffer);
+        }
+    }
+
+    // the per-instance attributes (locations 2-8) of InstanceData records starting at byte
+    // firstByte of buffer; records with the same leading fields may be stride bytes apart
+    static void appendInstanceAttributes(std::vector<VertexAttribute>& attributes, DeviceHandle buffer, unsigned int firstByte,
+        unsigned int stride = sizeof(InstanceData))
+    {
+        for (unsigned int column = 0; column < 4; column++)
+        {
+            VertexAttribute attribute = { buffer, 2 + column, 4, ATTRIBUTE_FLOAT, stride, firstByte + (unsigned int)(sizeof(glm::vec4) * column), 1 };
+            attributes.push_back(attribute);
+        }
+        VertexAttribute material = { buffer, 6, 1, ATTRIBUTE_UINT16, stride, firstByte + (unsigned int)offsetof(InstanceData, material), 1 };
+        VertexAttribute viewMask = { buffer, 7, 1, ATTRIBUTE_UINT16, stride, firstByte + (unsigned int)offsetof(InstanceData, viewMask), 1 };
+        VertexAttribute drawIndex = { buffer, 8, 1, ATTRIBUTE_UINT32, stride, firstByte + (unsigned int)offsetof(InstanceData, drawIndex), 1 };
+        attributes.push_back(material);
+        attributes.push_back(viewMask);
+        attributes.push_back(drawIndex);
+    }
+
+    // off draws every box as a whole cube, whatever its scale
+    void setQuadSubstitution(bool enabled)
+    {
+        quadSubstitution = enabled;
+    }
+
+    // points a program's Materials block at the table
+    static void bindMaterials(RenderDevice& device, DeviceHandle program)
+    {
+        device.bindUniformBlock(program, "Materials", MATERIALS_BINDING);
+    }
+
+    void beginFrame(const MaterialTable& materials)
+    {
+        stats = RenderStats();
+        stats.uniqueMaterials = materials.size();
+
+        // the table only grows, so only the new tail has to go up
+        if (uploadedMaterials < materials.size())
+        {
+            size_t bytes = (materials.size() - uploadedMaterials) * sizeof(Material);
+            device.updateBuffer(materialBuffer, uploadedMaterials * sizeof(Material), bytes, materials.data() + uploadedMaterials);
+            uploadedMaterials = materials.size();
+            stats.materialBytesUploaded = bytes;
+        }
+    }
+
+    // uploads the whole list, visible in view 0 only
+    void uploadInstances(const DrawList& drawList)
+    {
+        clearBatches();
+        for (size_t i = 0; i < drawList.size(); i++)
+            addInstance(drawList[i], (unsigned int)i, 1);
+        upload();
+    }
+
+    // uploads a subset of the list with a per-instance view mask
+    void uploadInstances(const DrawList& drawList, const std::vector<unsigned int>& visible, const std::vector<int>& masks)
+    {
+        clearBatches();
+        for (size_t i = 0; i < visible.size(); i++)
+            addInstance(drawList[visible[i]], visible[i], (unsigned short)masks[i]);
+        upload();
+    }
+
+    size_t instanceCount() const
+    {
+        size_t count = 0;
+        for (int mesh = 0; mesh < INSTANCE_MESH_COUNT; mesh++)
+            count += batches[mesh].instances.size();
+        return count;
+    }
+
+    // repeat = n draws every instance n times in a row (gl_InstanceID % n selects the view)
+    void draw(int repeat = 1)
+    {
+        for (int mesh = 0; mesh < INSTANCE_MESH_COUNT; mesh++)
+        {
+            Batch& batch = batches[mesh];
+            if (batch.instances.empty())
+                continue;
+            if (repeat != 1)
+                setInstanceDivisor(batch, repeat);
+            device.drawIndexedInstanced(batch.layout, MESH_RANGES[mesh].indexCount, (unsigned int)(batch.instances.size() * repeat), MESH_RANGES[mesh].firstIndex);
+            if (repeat != 1)
+                setInstanceDivisor(batch, 1);
+            stats.drawCalls++;
+        }
+    }
+
+    void release()
+    {
+        for (int mesh = 0; mesh < INSTANCE_MESH_COUNT; mesh++)
+        {
+            Batch& batch = batches[mesh];
+            if (batch.layout != 0)
+                device.destroyVertexLayout(batch.layout);
+            if (batch.instanceBuffer != 0)
+                device.destroyBuffer(batch.instanceBuffer);
+            batch.layout = batch.instanceBuffer = 0;
+        }
+        if (materialBuffer != 0)
+            device.destroyBuffer(materialBuffer);
+        materialBuffer = 0;
+    }
+
+private:
+    // the instances drawn with one mesh
+    struct Batch
+    {
+        DeviceHandle layout = 0;
+        DeviceHandle instanceBuffer = 0;
+        size_t instanceCapacity = 0;
+        std::vector<InstanceData> instances;
+    };
+
+    RenderDevice& device;
+    Batch batches[INSTANCE_MESH_COUNT];
+    DeviceHandle materialBuffer;
+    size_t uploadedMaterials;
+    bool quadSubstitution;
+
+    SceneRenderer(const SceneRenderer&);
+    SceneRenderer& operator=(const SceneRenderer&);
+
+    void clearBatches()
+    {
+        for (int mesh = 0; mesh < INSTANCE_MESH_COUNT; mesh++)
+            batches[mesh].instances.clear();
+    }
+
+    void addInstance(const DrawCommand& command, unsigned int drawIndex, unsigned short viewMask)
+    {
+        InstanceMesh mesh = quadSubstitution ? instanceMesh(command.model) : MESH_CUBE;
+        if (mesh == MESH_NONE)
+        {
+            stats.flatBoxes++;
+            stats.trianglesSaved += CUBE_INDEX_COUNT / 3;
+            return;
+        }
+        if (mesh != MESH_CUBE)
+        {
+            stats.quads++;
+            stats.trianglesSaved += (CUBE_INDEX_COUNT - MESH_RANGES[mesh].indexCount) / 3;
+        }
+        InstanceData instance;
+        instance.model = command.model;
+        instance.material = command.material;
+        instance.viewMask = viewMask;
+        instance.drawIndex = drawIndex;
+        batches[mesh].instances.push_back(instance);
+    }
+
+    void upload()
+    {
+        for (int mesh = 0; mesh < INSTANCE_MESH_COUNT; mesh++)
+        {
+            Batch& batch = batches[mesh];
+            stats.instances += batch.instances.size();
+            stats.uniformUpdatesAvoided += 2 * batch.instances.size();
+            if (batch.instances.empty())
+                continue;
+
+            // respecifying the store orphans last frame's copy instead of waiting for the GPU to finish with it
+            if (batch.instances.size() > batch.instanceCapacity)
+                batch.instanceCapacity = batch.instances.size() + batch.instances.size() / 2;
+            device.setBufferData(batch.instanceBuffer, batch.instanceCapacity * sizeof(InstanceData), NULL);
+            device.updateBuffer(batch.instanceBuffer, 0, batch.instances.size() * sizeof(InstanceData), &batch.instances[0]);
+        }
+    }
+
+    void setInstanceDivisor(Batch& batch, unsigned int divisor)
+    {
+        for (unsigned int location = 2; location <= 8; location++)
+            device.setAttributeDivisor(batch.layout, location, divisor);
+    }
+};
+
+inline void printRenderStats(const RenderStats& stats)
+{
+    std::cout << "instances: " << stats.instances
+              << "  draw calls: " << stats.drawCalls
+              << "  unique materials: " << stats.uniqueMaterials
+              << "  uniform updates avoided: " << stats.uniformUpdatesAvoided
+              << "  material bytes uploaded: " << stats.materialBytesUploaded << std::endl;
+    std::cout << "zero-thickness boxes drawn as quads: " << stats.quads
+              << "  flat boxes skipped: " << stats.flatBoxes
+              << "  triangles saved: " << stats.trianglesSaved << std::endl;
+}
+
+#endif
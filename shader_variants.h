@@ -0,0 +1,183 @@
+//
+//  shader_variants.h
+//  3D Object Drawing
+//
+
+#ifndef SHADER_VARIANTS_H
+#define SHADER_VARIANTS_H
+
+#include "render_device.h"
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <unordered_map>
+#include <functional>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+
+const int MAX_SHADER_FEATURES = 16;
+
+struct ShaderVariantStats
+{
+    size_t compiledAtLoad = 0;
+    size_t compiledLate = 0;        // compiled by a lookup that missed: a stall in the frame
+    double compileMs = 0.0;         // CPU time of all compiles, including the driver's
+    size_t lookups = 0;
+    size_t hits = 0;
+
+    double hitRate() const
+    {
+        return lookups > 0 ? 100.0 * hits / lookups : 100.0;
+    }
+};
+
+// Specialised programs of one vertex/fragment shader pair. The shaders declare their
+// feature keys with "#pragma feature NAME" lines (unknown pragmas are ignored by GLSL); a
+// variant is the set of features it has, a bit mask in declaration order. It is compiled
+// with "#define SHADER_VARIANT" and a #define per feature put after the #version line, so
+// the shaders can turn their runtime switches into constants. The programs are kept by
+// key; precompile() builds the ones a scene will use while it loads, and a later lookup
+// that misses compiles on the spot and says so.
+class ShaderVariants
+{
+public:
+    ShaderVariantStats stats;
+
+    ShaderVariants(RenderDevice& renderDevice, const std::string& vertexShaderPath, const std::string& fragmentShaderPath)
+        : device(renderDevice), vertexPath(vertexShaderPath), fragmentPath(fragmentShaderPath)
+    {
+    }
+
+    // reads the feature declarations; prepare runs on every new program (uniform blocks,
+    // samplers), before it is handed out
+    bool load(const std::function<void(DeviceHandle)>& prepare)
+    {
+        prepareProgram = prepare;
+        features.clear();
+        if (!readFeatures(vertexPath) || !readFeatures(fragmentPath))
+            return false;
+        return true;
+    }
+
+    // the key bit of a declared feature; 0, with a warning, for one no shader declares
+    unsigned int feature(const char* name) const
+    {
+        for (size_t i = 0; i < features.size(); i++)
+        {
+            if (features[i] == name)
+                return 1u << i;
+        }
+        std::cout << "WARNING::SHADER_VARIANTS::UNKNOWN_FEATURE: " << name << " is not declared by " << vertexPath << " or " << fragmentPath << std::endl;
+        return 0;
+    }
+
+    void precompile(const std::vector<unsigned int>& keys)
+    {
+        for (size_t i = 0; i < keys.size(); i++)
+        {
+            if (programs.find(keys[i]) == programs.end())
+            {
+                compile(keys[i]);
+                stats.compiledAtLoad++;
+            }
+        }
+    }
+
+    DeviceHandle program(unsigned int key)
+    {
+        stats.lookups++;
+        std::unordered_map<unsigned int, DeviceHandle>::const_iterator found = programs.find(key);
+        if (found != programs.end())
+        {
+            stats.hits++;
+            return found->second;
+        }
+        std::cout << "WARNING::SHADER_VARIANTS::COMPILED_MID_FRAME: " << defines(key) << "was not precompiled" << std::endl;
+        stats.compiledLate++;
+        return compile(key);
+    }
+
+    size_t variantCount() const
+    {
+        return programs.size();
+    }
+
+    // the lines put into the sources for a key
+    std::string defines(unsigned int key) const
+    {
+        std::string text = "#define SHADER_VARIANT\n";
+        for (size_t i = 0; i < features.size(); i++)
+        {
+            if (key & (1u << i))
+                text += "#define " + features[i] + "\n";
+        }
+        return text;
+    }
+
+    void release()
+    {
+        for (std::unordered_map<unsigned int, DeviceHandle>::const_iterator it = programs.begin(); it != programs.end(); ++it)
+            device.destroyProgram(it->second);
+        programs.clear();
+    }
+
+private:
+    RenderDevice& device;
+    std::string vertexPath;
+    std::string fragmentPath;
+    std::vector<std::string> features;
+    std::unordered_map<unsigned int, DeviceHandle> programs;
+    std::function<void(DeviceHandle)> prepareProgram;
+
+    bool readFeatures(const std::string& path)
+    {
+        std::ifstream file(path.c_str());
+        if (!file)
+        {
+            std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ: " << path << std::endl;
+            return false;
+        }
+        std::string line;
+        while (std::getline(file, line))
+        {
+            std::istringstream words(line);
+            std::string directive, kind, name;
+            if (!(words >> directive >> kind >> name) || directive != "#pragma" || kind != "feature")
+                continue;
+            bool known = false;
+            for (size_t i = 0; i < features.size(); i++)
+                known = known || features[i] == name;
+            if (known)
+                continue;
+            if ((int)features.size() == MAX_SHADER_FEATURES)
+            {
+                std::cout << "ERROR::SHADER_VARIANTS::TOO_MANY_FEATURES: " << path << " declares more than " << MAX_SHADER_FEATURES << std::endl;
+                return false;
+            }
+            features.push_back(name);
+        }
+        return true;
+    }
+
+    DeviceHandle compile(unsigned int key)
+    {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        DeviceHandle handle = device.createProgram(vertexPath, fragmentPath, defines(key));
+        if (prepareProgram)
+            prepareProgram(handle);
+        stats.compileMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        programs[key] = handle;
+        return handle;
+    }
+};
+
+inline void printShaderVariantStats(const ShaderVariantStats& stats, size_t variants)
+{
+    std::printf("shader variants: %zu (%zu precompiled, %zu compiled mid-frame) in %.1f ms  lookups: %zu  hit rate: %.1f%%\n",
+        variants, stats.compiledAtLoad, stats.compiledLate, stats.compileMs, stats.lookups, stats.hitRate());
+}
+
+#endif
@@ -0,0 +1,332 @@
+//
+//  simulation.h
+//  3D Object Drawing
+//
+
+#ifndef SIMULATION_H
+#define SIMULATION_H
+
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <functional>
+#include <algorithm>
+#include <string>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+
+// the middle slot's index, and the bit that says the writer put something new there
+const unsigned int TRIPLE_BUFFER_INDEX = 3;
+const unsigned int TRIPLE_BUFFER_FRESH = 4;
+
+// One writer and one reader hand over whole values without locks and without waiting for
+// each other. Each side keeps a slot of its own; the writer fills its slot and swaps it
+// with the middle one, and the reader swaps its slot with the middle one when that holds
+// something it has not seen. Neither ever touches the slot the other is using, and the
+// reader always gets the newest value, skipping the ones it was too slow for.
+template <typename T>
+class TripleBuffer
+{
+public:
+    TripleBuffer() : middle(1), backIndex(0), frontIndex(2)
+    {
+    }
+
+    // writer
+    T& back()
+    {
+        return slots[backIndex];
+    }
+
+    void publish()
+    {
+        backIndex = middle.exchange(backIndex | TRIPLE_BUFFER_FRESH, std::memory_order_acq_rel) & TRIPLE_BUFFER_INDEX;
+    }
+
+    // reader: takes the newest published value; false if there was none since the last one
+    bool update()
+    {
+        if ((middle.load(std::memory_order_relaxed) & TRIPLE_BUFFER_FRESH) == 0)
+            return false;
+        frontIndex = middle.exchange(frontIndex, std::memory_order_acq_rel) & TRIPLE_BUFFER_INDEX;
+        return true;
+    }
+
+    const T& front() const
+    {
+        return slots[frontIndex];
+    }
+
+    // before the writer starts: every slot holds value
+    void fill(const T& value)
+    {
+        for (int i = 0; i < 3; i++)
+            slots[i] = value;
+    }
+
+private:
+    std::atomic<unsigned int> middle;
+    unsigned int backIndex;
+    unsigned int frontIndex;
+    T slots[3];
+};
+
+// the two newest states of a simulation, as published after a tick; never changed once published
+template <typename State>
+struct SimulationSnapshot
+{
+    State previous;
+    State current;
+    unsigned long long tick = 0;
+    double time = 0.0;              // seconds since the start at which current was due
+};
+
+struct SimulationReport
+{
+    double seconds = 0.0;
+    double tickRate = 0.0;          // simulation ticks per second
+    double renderRate = 0.0;        // frames per second that drew a snapshot
+    double stepMs = 0.0;            // average time of one tick
+    double ageMs = 0.0;             // average age of the newest snapshot when a frame took it
+    double maxAgeMs = 0.0;
+    size_t repeatedFrames = 0;      // frames that found no new snapshot
+    unsigned long long droppedTicks = 0;    // ticks skipped because the simulation fell behind
+};
+
+// command line switches of the simulation thread
+struct SimulationOptions
+{
+    bool threaded = false;          // --sim-thread    run input handling and animation on their own thread at a fixed rate
+    double rate = 60.0;             // --sim-rate HZ   ticks per second of the simulation thread
+
+    // false if arg is not one of the switches above
+    bool parseArgs(const std::string& arg, int argc, char** argv, int& i)
+    {
+        if (arg == "--sim-thread")
+            threaded = true;
+        else if (arg == "--sim-rate" && i + 1 < argc)
+            rate = std::atof(argv[++i]);
+        else
+            return false;
+        return true;
+    }
+
+    static void printUsage()
+    {
+        std::cout << "  --sim-thread     simulate on a separate thread and draw snapshots of its state\n"
+                  << "  --sim-rate HZ    simulation ticks per second with --sim-thread (default 60)\n";
+    }
+};
+
+// ticks the simulation skips rather than running back to back when it falls this far behind
+const int SIMULATION_MAX_CATCH_UP = 5;
+
+inline void printSimulationReport(const SimulationReport& report, double ticksPerSecond)
+{
+    std::printf("simulation: %.1f ticks/s (target %.0f, %.3f ms per tick), render: %.1f frames/s over %.1f s\n",
+        report.tickRate, ticksPerSecond, report.stepMs, report.renderRate, report.seconds);
+    std::printf("  snapshot age when drawn: %.2f ms average, %.2f ms max; %zu frames without a new snapshot",
+        report.ageMs, report.maxAgeMs, report.repeatedFrames);
+    if (report.droppedTicks > 0)
+        std::printf(", %llu ticks dropped", report.droppedTicks);
+    std::printf("\n");
+}
+
+// Runs a simulation on its own thread at a fixed timestep and publishes a snapshot of its
+// last two states after every tick through a triple buffer. The renderer takes the newest
+// snapshot each frame and blends from previous to current by how far the present is past
+// the time current was due, so it draws one tick in the past but moves smoothly at any
+// frame rate, and a slow frame never holds up a tick. The thread sleeps in 1 ms steps
+// and yields through the last one, since OS sleeps can be that coarse.
+template <typename State>
+class SimulationThread
+{
+public:
+    explicit SimulationThread(double ticksPerSecond)
+        : rate(ticksPerSecond > 0.0 ? ticksPerSecond : 60.0), running(false), ticks(0), stepNanoseconds(0), droppedTicks(0)
+    {
+        begin = std::chrono::steady_clock::now();
+    }
+
+    ~SimulationThread()
+    {
+        stop();
+    }
+
+    // step(state, seconds) advances the state by one tick on the simulation thread
+    void start(const State& initial, const std::function<void(State&, float)>& stepFunction)
+    {
+        stop();
+        step = stepFunction;
+        SimulationSnapshot<State> first;
+        first.previous = initial;
+        first.current = initial;
+        first.time = now();
+        snapshots.fill(first);
+        sinceStart = Marks();
+        sinceStart.time = first.time;
+        sinceReport = sinceStart;
+        running = true;
+        worker = std::thread(&SimulationThread::simulationLoop, this, initial, first.time);
+    }
+
+    void stop()
+    {
+        running = false;
+        if (worker.joinable())
+            worker.join();
+    }
+
+    // render thread: the newest snapshot, and in blend how far to go from previous to current
+    const SimulationSnapshot<State>& latest(float& blend)
+    {
+        if (!snapshots.update())
+        {
+            sinceStart.repeatedFrames++;
+            sinceReport.repeatedFrames++;
+        }
+        const SimulationSnapshot<State>& snapshot = snapshots.front();
+        double age = now() - snapshot.time;
+        blend = (float)std::min(std::max(age * rate, 0.0), 1.0);
+        sinceStart.addFrame(age);
+        sinceReport.addFrame(age);
+        return snapshot;
+    }
+
+    // render thread: since the previous report (or the start)
+    SimulationReport report()
+    {
+        SimulationReport result = measure(sinceReport);
+        sinceReport = Marks();
+        sinceReport.time = now();
+        sinceReport.ticks = ticks.load(std::memory_order_relaxed);
+        sinceReport.stepNanoseconds = stepNanoseconds.load(std::memory_order_relaxed);
+        sinceReport.droppedTicks = droppedTicks.load(std::memory_order_relaxed);
+        return result;
+    }
+
+    // render thread: since the start
+    SimulationReport summary() const
+    {
+        return measure(sinceStart);
+    }
+
+    // at exit: stops the thread and prints the summary, if it was started
+    void shutdown()
+    {
+        if (!worker.joinable())
+            return;
+        stop();
+        printSimulationReport(summary(), rate);
+    }
+
+private:
+    double rate;
+    std::chrono::steady_clock::time_point begin;
+    std::function<void(State&, float)> step;
+    TripleBuffer<SimulationSnapshot<State> > snapshots;
+    std::thread worker;
+    std::atomic<bool> running;
+
+    // written by the simulation thread
+    std::atomic<unsigned long long> ticks;
+    std::atomic<unsigned long long> stepNanoseconds;
+    std::atomic<unsigned long long> droppedTicks;
+
+    // the render thread's counts, and the simulation's at the time they began
+    struct Marks
+    {
+        double time = 0.0;
+        unsigned long long ticks = 0;
+        unsigned long long stepNanoseconds = 0;
+        unsigned long long droppedTicks = 0;
+        size_t frames = 0;
+        size_t repeatedFrames = 0;
+        double ageSum = 0.0;
+        double ageMax = 0.0;
+
+        void addFrame(double age)
+        {
+            frames++;
+            ageSum += age;
+            ageMax = std::max(ageMax, age);
+        }
+    };
+
+    Marks sinceStart;
+    Marks sinceReport;
+
+    double now() const
+    {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    }
+
+    SimulationReport measure(const Marks& marks) const
+    {
+        unsigned long long tickCount = ticks.load(std::memory_order_relaxed) - marks.ticks;
+        SimulationReport result;
+        result.seconds = now() - marks.time;
+        if (result.seconds > 0.0)
+        {
+            result.tickRate = tickCount / result.seconds;
+            result.renderRate = marks.frames / result.seconds;
+        }
+        if (tickCount > 0)
+            result.stepMs = (stepNanoseconds.load(std::memory_order_relaxed) - marks.stepNanoseconds) / 1.0e6 / tickCount;
+        if (marks.frames > 0)
+            result.ageMs = 1000.0 * marks.ageSum / marks.frames;
+        result.maxAgeMs = 1000.0 * marks.ageMax;
+        result.repeatedFrames = marks.repeatedFrames;
+        result.droppedTicks = droppedTicks.load(std::memory_order_relaxed) - marks.droppedTicks;
+        return result;
+    }
+
+    void waitUntil(double time)
+    {
+        while (running && time - now() > 0.002)
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        while (running && now() < time)
+            std::this_thread::yield();
+    }
+
+    void simulationLoop(State state, double due)
+    {
+        const double period = 1.0 / rate;
+        const float seconds = (float)period;
+        unsigned long long tick = 0;
+        while (running)
+        {
+            due += period;
+            waitUntil(due);
+            if (!running)
+                break;
+            // far behind (a stall, a debugger): move the schedule rather than run a burst of ticks
+            double lag = now() - due;
+            if (lag > SIMULATION_MAX_CATCH_UP * period)
+            {
+                unsigned long long skipped = (unsigned long long)(lag / period);
+                due += skipped * period;
+                droppedTicks.fetch_add(skipped, std::memory_order_relaxed);
+            }
+
+            State previous = state;
+            std::chrono::steady_clock::time_point stepStart = std::chrono::steady_clock::now();
+            step(state, seconds);
+            std::chrono::steady_clock::duration stepTime = std::chrono::steady_clock::now() - stepStart;
+            tick++;
+
+            SimulationSnapshot<State>& snapshot = snapshots.back();
+            snapshot.previous = previous;
+            snapshot.current = state;
+            snapshot.tick = tick;
+            snapshot.time = due;
+            snapshots.publish();
+
+            stepNanoseconds.fetch_add((unsigned long long)std::chrono::duration_cast<std::chrono::nanoseconds>(stepTime).count(), std::memory_order_relaxed);
+            ticks.store(tick, std::memory_order_relaxed);
+        }
+    }
+};
+
+#endif
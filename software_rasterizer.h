@@ -0,0 +1,545 @@
+//
+//  software_rasterizer.h
+//  3D Object Drawing
+//
+
+#ifndef SOFTWARE_RASTERIZER_H
+#define SOFTWARE_RASTERIZER_H
+
+#include <glm/glm.hpp>
+
+#include "draw_list.h"
+#include "job_system.h"
+
+#include <vector>
+#include <string>
+#include <atomic>
+#include <thread>
+#include <algorithm>
+#include <cmath>
+#include <chrono>
+#include <fstream>
+#include <cstdio>
+#include <iostream>
+
+// SSE2 is always there on x64 and on any x86 compiler targeting it; other CPUs use the scalar loop
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#include <emmintrin.h>
+#define SOFTWARE_RASTER_SSE2
+#endif
+
+const int RASTER_TILE_SIZE = 64;
+const int RASTER_SUBPIXEL_BITS = 4;        // same as the minimum GL_SUBPIXEL_BITS
+const int RASTER_SUBPIXEL_ONE = 1 << RASTER_SUBPIXEL_BITS;
+const int MAX_RASTER_SIZE = 2048;          // keeps every edge function value inside 32 bits
+
+struct RasterStats
+{
+    int threads = 0;
+    size_t triangles = 0;       // submitted: 12 per draw
+    size_t clipped = 0;         // triangles that crossed a frustum plane
+    size_t rasterized = 0;      // set up after clipping and culling empty ones
+    size_t binEntries = 0;      // triangle references over all tiles
+    double geometryMs = 0.0;    // transform, clip, set up and bin
+    double rasterMs = 0.0;      // clear and fill the tiles
+    double totalMs = 0.0;
+};
+
+// CPU renderer for machines without a GPU. It draws a DrawList the way the flat shaded GL
+// path does (cube triangles, model/view/projection, one color per draw, depth test LESS)
+// into its own color and depth buffers:
+//  1. geometry: draws are split over the job system; each worker transforms, clips and
+//     sets up its triangles and bins them into the 64x64 pixel tiles they overlap
+//  2. raster: workers take whole tiles, so no two threads ever touch the same pixel; a tile
+//     walks the bins of worker 0, 1, ... in order, which keeps submission order for ties
+// Edge functions are exact integers on a 1/16 pixel grid with a top-left fill rule, so
+// shared edges have no cracks or double hits; SSE2 evaluates four pixels at a time.
+class SoftwareRasterizer
+{
+public:
+    explicit SoftwareRasterizer(JobSystem& jobSystem) : jobs(jobSystem), width(0), height(0), stride(0), tilesX(0), tilesY(0)
+    {
+    }
+
+    // the color and depth buffers are padded to whole tiles
+    void resize(int framebufferWidth, int framebufferHeight)
+    {
+        width = glm::clamp(framebufferWidth, 1, MAX_RASTER_SIZE);
+        height = glm::clamp(framebufferHeight, 1, MAX_RASTER_SIZE);
+        tilesX = (width + RASTER_TILE_SIZE - 1) / RASTER_TILE_SIZE;
+        tilesY = (height + RASTER_TILE_SIZE - 1) / RASTER_TILE_SIZE;
+        stride = tilesX * RASTER_TILE_SIZE;
+        color.assign((size_t)stride * tilesY * RASTER_TILE_SIZE, 0);
+        depth.assign((size_t)stride * tilesY * RASTER_TILE_SIZE, 1.0f);
+    }
+
+    void render(const DrawList& drawList, const glm::mat4& view, const glm::mat4& projection, const glm::vec4& clearColor)
+    {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        int threads = jobs.threadCount();
+        if ((int)workers.size() != threads)
+            workers.assign(threads, Worker());
+        for (int w = 0; w < threads; w++)
+        {
+            workers[w].triangles.clear();
+            workers[w].bins.resize((size_t)tilesX * tilesY);
+            for (size_t tile = 0; tile < workers[w].bins.size(); tile++)
+                workers[w].bins[tile].clear();
+            workers[w].clipped = 0;
+        }
+
+        glm::mat4 viewProjection = projection * view;
+        jobs.parallelFor(drawList.size(), [&](int worker, size_t begin, size_t end)
+        {
+            for (size_t i = begin; i < end; i++)
+            {
+                const DrawCommand& command = drawList[i];
+                drawCube(workers[worker], viewProjection * command.model, packColor(drawList.materials[command.material].color));
+            }
+        });
+        std::chrono::steady_clock::time_point geometryEnd = std::chrono::steady_clock::now();
+
+        unsigned int clearPixel = packColor(clearColor);
+        std::atomic<int> nextTile(0);
+        int tileCount = tilesX * tilesY;
+        jobs.parallelFor((size_t)threads, [&](int, size_t, size_t)
+        {
+            for (int tile = nextTile++; tile < tileCount; tile = nextTile++)
+                drawTile(tile, clearPixel);
+        });
+        std::chrono::steady_clock::time_point rasterEnd = std::chrono::steady_clock::now();
+
+        stats = RasterStats();
+        stats.threads = threads;
+        stats.triangles = drawList.size() * CUBE_INDEX_COUNT / 3;
+        for (int w = 0; w < threads; w++)
+        {
+            stats.clipped += workers[w].clipped;
+            stats.rasterized += workers[w].triangles.size();
+            for (size_t tile = 0; tile < workers[w].bins.size(); tile++)
+                stats.binEntries += workers[w].bins[tile].size();
+        }
+        stats.geometryMs = std::chrono::duration<double, std::milli>(geometryEnd - start).count();
+        stats.rasterMs = std::chrono::duration<double, std::milli>(rasterEnd - geometryEnd).count();
+        stats.totalMs = std::chrono::duration<double, std::milli>(rasterEnd - start).count();
+    }
+
+    // binary PPM, top row first like a screenshot
+    bool writeImage(const std::string& path) const
+    {
+        std::ofstream file(path.c_str(), std::ios::binary);
+        if (!file)
+        {
+            std::cout << "ERROR::SOFTWARE_RASTERIZER::FILE_NOT_WRITABLE: " << path << std::endl;
+            return false;
+        }
+        file << "P6\n" << width << " " << height << "\n255\n";
+        std::vector<unsigned char> row((size_t)width * 3);
+        for (int y = height - 1; y >= 0; y--)
+        {
+            const unsigned int* pixels = &color[(size_t)y * stride];
+            for (int x = 0; x < width; x++)
+            {
+                row[x * 3 + 0] = (unsigned char)(pixels[x] & 0xFF);
+                row[x * 3 + 1] = (unsigned char)((pixels[x] >> 8) & 0xFF);
+                row[x * 3 + 2] = (unsigned char)((pixels[x] >> 16) & 0xFF);
+            }
+            file.write((const char*)&row[0], row.size());
+        }
+        return (bool)file;
+    }
+
+    int imageWidth() const
+    {
+        return width;
+    }
+
+    int imageHeight() const
+    {
+        return height;
+    }
+
+    RasterStats stats;
+
+private:
+    // a screen space triangle ready to fill: E(x, y) = a * x + b * y + c at the center of
+    // pixel (x, y) is >= 0 inside for all three edges, depth is a plane over pixel centers
+    struct Triangle
+    {
+        int edgeA[3];
+        int edgeB[3];
+        long long edgeC[3];     // at pixel (0, 0), which may lie far outside the triangle
+        float depth0;
+        float depthX;
+        float depthY;
+        int minX, minY, maxX, maxY;
+        unsigned int color;
+    };
+
+    struct Worker
+    {
+        std::vector<Triangle> triangles;
+        std::vector<std::vector<unsigned int> > bins;   // per tile, indices into triangles
+        size_t clipped = 0;
+    };
+
+    JobSystem& jobs;
+    int width;
+    int height;
+    int stride;
+    int tilesX;
+    int tilesY;
+    std::vector<unsigned int> color;    // RGBA8, bottom row first like OpenGL
+    std::vector<float> depth;
+    std::vector<Worker> workers;
+
+    SoftwareRasterizer(const SoftwareRasterizer&);
+    SoftwareRasterizer& operator=(const SoftwareRasterizer&);
+
+    // float to unorm8 like Mesa: multiply in float, round half to even
+    static unsigned int packColor(const glm::vec4& c)
+    {
+        unsigned int packed = 0;
+        for (int channel = 0; channel < 4; channel++)
+            packed |= (unsigned int)std::lrint(glm::clamp(c[channel], 0.0f, 1.0f) * 255.0f) << (channel * 8);
+        return packed;
+    }
+
+    void drawCube(Worker& worker, const glm::mat4& mvp, unsigned int pixel)
+    {
+        glm::vec4 clip[CUBE_VERTEX_COUNT];
+        for (unsigned int v = 0; v < CUBE_VERTEX_COUNT; v++)
+            clip[v] = mvp * glm::vec4(CUBE_VERTICES[v], 1.0f);
+
+        for (unsigned int i = 0; i < CUBE_INDEX_COUNT; i += 3)
+        {
+            const glm::vec4& a = clip[CUBE_INDICES[i]];
+            const glm::vec4& b = clip[CUBE_INDICES[i + 1]];
+            const glm::vec4& c = clip[CUBE_INDICES[i + 2]];
+            unsigned int outsideAll = outcode(a) & outcode(b) & outcode(c);
+            unsigned int outsideAny = outcode(a) | outcode(b) | outcode(c);
+            if (outsideAll != 0)
+                continue;
+            if (outsideAny == 0)
+            {
+                setupTriangle(worker, a, b, c, pixel);
+                continue;
+            }
+
+            // Sutherland-Hodgman against the planes the triangle crosses, then a fan
+            worker.clipped++;
+            glm::vec4 polygon[9] = { a, b, c };
+            int count = clipPolygon(polygon, 3, outsideAny);
+            for (int v = 1; v + 1 < count; v++)
+                setupTriangle(worker, polygon[0], polygon[v], polygon[v + 1], pixel);
+        }
+    }
+
+    // one bit per frustum plane: -x, +x, -y, +y, -z, +z
+    static float planeDistance(const glm::vec4& v, int plane)
+    {
+        float coordinate = plane < 2 ? v.x : (plane < 4 ? v.y : v.z);
+        return (plane & 1) ? v.w - coordinate : v.w + coordinate;
+    }
+
+    static unsigned int outcode(const glm::vec4& v)
+    {
+        unsigned int code = 0;
+        for (int plane = 0; plane < 6; plane++)
+        {
+            if (planeDistance(v, plane) < 0.0f)
+                code |= 1u << plane;
+        }
+        return code;
+    }
+
+    // the intersection is always interpolated from the inside vertex, so the two triangles
+    // sharing a clipped edge get bit identical new vertices
+    static int clipPolygon(glm::vec4* polygon, int count, unsigned int planes)
+    {
+        glm::vec4 input[9];
+        for (int plane = 0; plane < 6 && count > 0; plane++)
+        {
+            if ((planes & (1u << plane)) == 0)
+                continue;
+            for (int v = 0; v < count; v++)
+                input[v] = polygon[v];
+            int inputCount = count;
+            count = 0;
+            for (int v = 0; v < inputCount; v++)
+            {
+                const glm::vec4& current = input[v];
+                const glm::vec4& next = input[(v + 1) % inputCount];
+                float currentDistance = planeDistance(current, plane);
+                float nextDistance = planeDistance(next, plane);
+                if (currentDistance >= 0.0f)
+                    polygon[count++] = current;
+                if ((currentDistance >= 0.0f) != (nextDistance >= 0.0f))
+                {
+                    if (currentDistance >= 0.0f)
+                        polygon[count++] = current + (next - current) * (currentDistance / (currentDistance - nextDistance));
+                    else
+                        polygon[count++] = next + (current - next) * (nextDistance / (nextDistance - currentDistance));
+                }
+            }
+        }
+        return count;
+    }
+
+    void setupTriangle(Worker& worker, const glm::vec4& a, const glm::vec4& b, const glm::vec4& c, unsigned int pixel)
+    {
+        // viewport transform onto the subpixel grid
+        const glm::vec4* clip[3] = { &a, &b, &c };
+        long long x[3], y[3];
+        float z[3];
+        for (int v = 0; v < 3; v++)
+        {
+            float inverseW = 1.0f / clip[v]->w;
+            x[v] = (long long)std::floor((clip[v]->x * inverseW * 0.5f + 0.5f) * width * RASTER_SUBPIXEL_ONE + 0.5f);
+            y[v] = (long long)std::floor((clip[v]->y * inverseW * 0.5f + 0.5f) * height * RASTER_SUBPIXEL_ONE + 0.5f);
+            z[v] = clip[v]->z * inverseW * 0.5f + 0.5f;
+        }
+
+        // both windings are drawn (no face culling in the GL path); make it counter clockwise
+        long long area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+        if (area == 0)
+            return;
+        if (area < 0)
+        {
+            std::swap(x[1], x[2]);
+            std::swap(y[1], y[2]);
+            std::swap(z[1], z[2]);
+            area = -area;
+        }
+
+        Triangle triangle;
+        const long long half = RASTER_SUBPIXEL_ONE / 2;
+        for (int edge = 0; edge < 3; edge++)
+        {
+            int from = edge, to = (edge + 1) % 3;
+            long long dx = x[to] - x[from];
+            long long dy = y[to] - y[from];
+            // top-left rule: pixels exactly on a right or bottom edge belong to the neighbour
+            bool topLeft = dy < 0 || (dy == 0 && dx < 0);
+            triangle.edgeA[edge] = (int)(-dy * RASTER_SUBPIXEL_ONE);
+            triangle.edgeB[edge] = (int)(dx * RASTER_SUBPIXEL_ONE);
+            triangle.edgeC[edge] = (dx * (half - y[from]) - dy * (half - x[from]) - (topLeft ? 0 : 1));
+        }
+
+        long long minX = std::min(x[0], std::min(x[1], x[2])), maxX = std::max(x[0], std::max(x[1], x[2]));
+        long long minY = std::min(y[0], std::min(y[1], y[2])), maxY = std::max(y[0], std::max(y[1], y[2]));
+        triangle.minX = std::max(0, (int)((minX - half + RASTER_SUBPIXEL_ONE - 1) >> RASTER_SUBPIXEL_BITS));
+        triangle.minY = std::max(0, (int)((minY - half + RASTER_SUBPIXEL_ONE - 1) >> RASTER_SUBPIXEL_BITS));
+        triangle.maxX = std::min(width - 1, (int)((maxX - half) >> RASTER_SUBPIXEL_BITS));
+        triangle.maxY = std::min(height - 1, (int)((maxY - half) >> RASTER_SUBPIXEL_BITS));
+        if (triangle.minX > triangle.maxX || triangle.minY > triangle.maxY)
+            return;
+
+        // depth plane in pixels, sampled at pixel centers
+        float scale = 1.0f / RASTER_SUBPIXEL_ONE;
+        float x0 = x[0] * scale, y0 = y[0] * scale;
+        float x1 = x[1] * scale - x0, y1 = y[1] * scale - y0;
+        float x2 = x[2] * scale - x0, y2 = y[2] * scale - y0;
+        float inverseArea = 1.0f / (x1 * y2 - x2 * y1);
+        triangle.depthX = ((z[1] - z[0]) * y2 - (z[2] - z[0]) * y1) * inverseArea;
+        triangle.depthY = ((z[2] - z[0]) * x1 - (z[1] - z[0]) * x2) * inverseArea;
+        triangle.depth0 = z[0] + triangle.depthX * (0.5f - x0) + triangle.depthY * (0.5f - y0);
+        triangle.color = pixel;
+
+        unsigned int index = (unsigned int)worker.triangles.size();
+        worker.triangles.push_back(triangle);
+        for (int tileY = triangle.minY / RASTER_TILE_SIZE; tileY <= triangle.maxY / RASTER_TILE_SIZE; tileY++)
+        {
+            for (int tileX = triangle.minX / RASTER_TILE_SIZE; tileX <= triangle.maxX / RASTER_TILE_SIZE; tileX++)
+                worker.bins[tileY * tilesX + tileX].push_back(index);
+        }
+    }
+
+    void drawTile(int tile, unsigned int clearPixel)
+    {
+        int tileX = (tile % tilesX) * RASTER_TILE_SIZE;
+        int tileY = (tile / tilesX) * RASTER_TILE_SIZE;
+        for (int y = tileY; y < tileY + RASTER_TILE_SIZE; y++)
+        {
+            size_t row = (size_t)y * stride + tileX;
+            std::fill(color.begin() + row, color.begin() + row + RASTER_TILE_SIZE, clearPixel);
+            std::fill(depth.begin() + row, depth.begin() + row + RASTER_TILE_SIZE, 1.0f);
+        }
+
+        for (size_t w = 0; w < workers.size(); w++)
+        {
+            const std::vector<unsigned int>& bin = workers[w].bins[tile];
+            for (size_t i = 0; i < bin.size(); i++)
+                fillTriangle(workers[w].triangles[bin[i]], tileX, tileY);
+        }
+    }
+
+    // inside the triangle's bounding box every edge value fits in 32 bits
+    static int edgeAt(const Triangle& t, int edge, int x, int y)
+    {
+        return (int)((long long)t.edgeA[edge] * x + (long long)t.edgeB[edge] * y + t.edgeC[edge]);
+    }
+
+    void fillTriangle(const Triangle& t, int tileX, int tileY)
+    {
+        // whole groups of four pixels; the tile is a multiple of four wide and the padding
+        // keeps the last group inside the buffers
+        int minX = std::max(t.minX, tileX) & ~3;
+        int maxX = std::min(t.maxX, tileX + RASTER_TILE_SIZE - 1);
+        int minY = std::max(t.minY, tileY);
+        int maxY = std::min(t.maxY, tileY + RASTER_TILE_SIZE - 1);
+
+#ifdef SOFTWARE_RASTER_SSE2
+        __m128i laneEdge[3], stepEdge[3];
+        for (int e = 0; e < 3; e++)
+        {
+            laneEdge[e] = _mm_setr_epi32(0, t.edgeA[e], 2 * t.edgeA[e], 3 * t.edgeA[e]);
+            stepEdge[e] = _mm_set1_epi32(4 * t.edgeA[e]);
+        }
+        __m128 laneDepth = _mm_setr_ps(0.0f, t.depthX, 2.0f * t.depthX, 3.0f * t.depthX);
+        __m128 stepDepth = _mm_set1_ps(4.0f * t.depthX);
+        __m128i pixel = _mm_set1_epi32((int)t.color);
+
+        for (int y = minY; y <= maxY; y++)
+        {
+            __m128i edge0 = _mm_add_epi32(_mm_set1_epi32(edgeAt(t, 0, minX, y)), laneEdge[0]);
+            __m128i edge1 = _mm_add_epi32(_mm_set1_epi32(edgeAt(t, 1, minX, y)), laneEdge[1]);
+            __m128i edge2 = _mm_add_epi32(_mm_set1_epi32(edgeAt(t, 2, minX, y)), laneEdge[2]);
+            __m128 z = _mm_add_ps(_mm_set1_ps(t.depth0 + t.depthX * minX + t.depthY * y), laneDepth);
+            size_t row = (size_t)y * stride;
+            for (int x = minX; x <= maxX; x += 4)
+            {
+                // a pixel is outside if any edge value is negative: OR the sign bits
+                __m128i outside = _mm_or_si128(edge0, _mm_or_si128(edge1, edge2));
+                if (_mm_movemask_ps(_mm_castsi128_ps(outside)) != 0xF)
+                {
+                    float* depthOut = &depth[row + x];
+                    unsigned int* colorOut = &color[row + x];
+                    __m128 stored = _mm_loadu_ps(depthOut);
+                    __m128 pass = _mm_andnot_ps(_mm_castsi128_ps(_mm_srai_epi32(outside, 31)), _mm_cmplt_ps(z, stored));
+                    _mm_storeu_ps(depthOut, _mm_or_ps(_mm_and_ps(pass, z), _mm_andnot_ps(pass, stored)));
+                    __m128i passMask = _mm_castps_si128(pass);
+                    __m128i old = _mm_loadu_si128((const __m128i*)colorOut);
+                    _mm_storeu_si128((__m128i*)colorOut, _mm_or_si128(_mm_and_si128(passMask, pixel), _mm_andnot_si128(passMask, old)));
+                }
+                edge0 = _mm_add_epi32(edge0, stepEdge[0]);
+                edge1 = _mm_add_epi32(edge1, stepEdge[1]);
+                edge2 = _mm_add_epi32(edge2, stepEdge[2]);
+                z = _mm_add_ps(z, stepDepth);
+            }
+        }
+#else
+        for (int y = minY; y <= maxY; y++)
+        {
+            int edge0 = edgeAt(t, 0, minX, y);
+            int edge1 = edgeAt(t, 1, minX, y);
+            int edge2 = edgeAt(t, 2, minX, y);
+            float z = t.depth0 + t.depthX * minX + t.depthY * y;
+            size_t row = (size_t)y * stride;
+            for (int x = minX; x <= maxX; x++)
+            {
+                if ((edge0 | edge1 | edge2) >= 0 && z < depth[row + x])
+                {
+                    depth[row + x] = z;
+                    color[row + x] = t.color;
+                }
+                edge0 += t.edgeA[0];
+                edge1 += t.edgeA[1];
+                edge2 += t.edgeA[2];
+                z += t.depthX;
+            }
+        }
+#endif
+    }
+};
+
+// --bench-software: the CPU rasteriser on 1, 2, 4 ... threads, then the same scene through
+// OpenGL for the same number of frames. Run it with LIBGL_ALWAYS_SOFTWARE=1 (or on a machine
+// without a GPU) to compare against Mesa's llvmpipe.
+class RasterBenchmark
+{
+public:
+    RasterBenchmark(int warmupFrames = 10, int measuredFrames = 60)
+        : warmup(warmupFrames), measured(measuredFrames), glFrame(0), glMs(0.0)
+    {
+    }
+
+    void runSoftware(const DrawList& drawList, const glm::mat4& view, const glm::mat4& projection, int width, int height, int maxThreads)
+    {
+        if (maxThreads <= 0)
+            maxThreads = (int)std::thread::hardware_concurrency();
+        if (maxThreads <= 0)
+            maxThreads = 1;
+        std::vector<int> threadCounts;
+        for (int threads = 1; threads < maxThreads; threads *= 2)
+            threadCounts.push_back(threads);
+        threadCounts.push_back(maxThreads);
+
+        for (size_t i = 0; i < threadCounts.size(); i++)
+        {
+            JobSystem jobs(threadCounts[i]);
+            SoftwareRasterizer rasterizer(jobs);
+            rasterizer.resize(width, height);
+            Row row;
+            row.threads = threadCounts[i];
+            for (int frame = 0; frame < warmup + measured; frame++)
+            {
+                rasterizer.render(drawList, view, projection, glm::vec4(0.2f, 0.3f, 0.3f, 1.0f));
+                if (frame < warmup)
+                    continue;
+                row.geometryMs += rasterizer.stats.geometryMs / measured;
+                row.rasterMs += rasterizer.stats.rasterMs / measured;
+                row.totalMs += rasterizer.stats.totalMs / measured;
+            }
+            row.triangles = rasterizer.stats.rasterized;
+            row.binEntries = rasterizer.stats.binEntries;
+            rows.push_back(row);
+        }
+        std::cout << "software rasteriser: " << drawList.size() << " draws at " << width << "x" << height << std::endl;
+    }
+
+    bool done() const
+    {
+        return glFrame >= warmup + measured;
+    }
+
+    // one OpenGL frame of the same scene
+    void record(double frameMs)
+    {
+        if (done())
+            return;
+        glFrame++;
+        if (glFrame > warmup)
+            glMs += frameMs / measured;
+    }
+
+    void print(const std::string& deviceName) const
+    {
+        std::cout << "threads  geometry ms  raster ms  frame ms  triangles  bin entries" << std::endl;
+        for (size_t i = 0; i < rows.size(); i++)
+        {
+            const Row& row = rows[i];
+            std::printf("%7d  %11.3f  %9.3f  %8.3f  %9zu  %11zu\n", row.threads, row.geometryMs, row.rasterMs, row.totalMs, row.triangles, row.binEntries);
+        }
+        std::printf("%s: %.3f ms per frame\n", deviceName.c_str(), glMs);
+    }
+
+private:
+    struct Row
+    {
+        int threads = 0;
+        double geometryMs = 0.0;
+        double rasterMs = 0.0;
+        double totalMs = 0.0;
+        size_t triangles = 0;
+        size_t binEntries = 0;
+    };
+
+    int warmup;
+    int measured;
+    int glFrame;
+    double glMs;
+    std::vector<Row> rows;
+};
+
+#endif
@@ -0,0 +1,109 @@
+//
+//  static_scene.h
+//  3D Object Drawing
+//
+
+#ifndef STATIC_SCENE_H
+#define STATIC_SCENE_H
+
+#include <glm/glm.hpp>
+
+#include "draw_list.h"
+
+#include <string>
+#include <fstream>
+#include <iostream>
+
+// Binary snapshot of a recorded DrawList, written by the app (--export-static) and read by
+// the offline baker. Little endian, as written by the machine that exports it:
+//   char[4] "RSTS", uint32 version, uint32 materials, uint32 commands
+//   materials x vec4 color
+//   commands x (mat4 model, uint16 material, uint16 padding)
+const char STATIC_SCENE_MAGIC[4] = { 'R', 'S', 'T', 'S' };
+const unsigned int STATIC_SCENE_VERSION = 1;
+
+// FNV-1a over the model matrices of the first count draws; the baker stores it so the app
+// can tell whether a bake still matches the scene it is drawing
+inline unsigned int drawListHash(const DrawList& drawList, size_t count)
+{
+    unsigned int hash = 2166136261u;
+    for (size_t i = 0; i < count && i < drawList.size(); i++)
+    {
+        const unsigned char* bytes = (const unsigned char*)&drawList[i].model;
+        for (size_t b = 0; b < sizeof(glm::mat4); b++)
+            hash = (hash ^ bytes[b]) * 16777619u;
+    }
+    return hash;
+}
+
+inline unsigned int drawListHash(const DrawList& drawList)
+{
+    return drawListHash(drawList, drawList.size());
+}
+
+inline bool writeStaticScene(const std::string& path, const DrawList& drawList)
+{
+    std::ofstream file(path.c_str(), std::ios::binary);
+    if (!file)
+    {
+        std::cout << "ERROR::STATIC_SCENE::FILE_NOT_WRITABLE: " << path << std::endl;
+        return false;
+    }
+    unsigned int header[3] = { STATIC_SCENE_VERSION, (unsigned int)drawList.materials.size(), (unsigned int)drawList.size() };
+    file.write(STATIC_SCENE_MAGIC, sizeof(STATIC_SCENE_MAGIC));
+    file.write((const char*)header, sizeof(header));
+    for (size_t i = 0; i < drawList.materials.size(); i++)
+        file.write((const char*)&drawList.materials[i].color, sizeof(glm::vec4));
+    for (size_t i = 0; i < drawList.size(); i++)
+    {
+        unsigned short material[2] = { drawList[i].material, 0 };
+        file.write((const char*)&drawList[i].model, sizeof(glm::mat4));
+        file.write((const char*)material, sizeof(material));
+    }
+    return (bool)file;
+}
+
+// replaces drawList with the file's commands; material indices are preserved
+inline bool readStaticScene(const std::string& path, DrawList& drawList)
+{
+    std::ifstream file(path.c_str(), std::ios::binary);
+    if (!file)
+    {
+        std::cout << "ERROR::STATIC_SCENE::FILE_NOT_SUCCESSFULLY_READ: " << path << std::endl;
+        return false;
+    }
+    char magic[4];
+    unsigned int header[3];
+    file.read(magic, sizeof(magic));
+    file.read((char*)header, sizeof(header));
+    if (!file || std::string(magic, 4) != std::string(STATIC_SCENE_MAGIC, 4) || header[0] != STATIC_SCENE_VERSION)
+    {
+        std::cout << "ERROR::STATIC_SCENE::BAD_HEADER: " << path << std::endl;
+        return false;
+    }
+
+    std::vector<glm::vec4> colors(header[1]);
+    for (size_t i = 0; i < colors.size(); i++)
+        file.read((char*)&colors[i], sizeof(glm::vec4));
+
+    drawList = DrawList();
+    for (size_t i = 0; i < colors.size(); i++)
+        drawList.materials.intern(colors[i]);
+    for (unsigned int i = 0; i < header[2]; i++)
+    {
+        DrawCommand command;
+        unsigned short material[2];
+        file.read((char*)&command.model, sizeof(glm::mat4));
+        file.read((char*)material, sizeof(material));
+        command.material = material[0] < colors.size() ? material[0] : 0;
+        drawList.commands.push_back(command);
+    }
+    if (!file)
+    {
+        std::cout << "ERROR::STATIC_SCENE::TRUNCATED: " << path << std::endl;
+        return false;
+    }
+    return checkMaterials(drawList.materials);
+}
+
+#endif
@@ -0,0 +1,34 @@
+#version 330 core
+in vec2 screenUV;
+
+// the scene rendered at a fraction of the window, see dynamic_resolution.h
+uniform sampler2D sceneColor;
+uniform vec2 sceneScale;    // rendered size / texture size
+uniform vec2 texelSize;     // 1 / texture size
+uniform float sharpness;    // 0 = plain bilinear
+
+out vec4 FragColor;
+
+vec3 sampleScene(vec2 uv)
+{
+    // the texture is bigger than the rendered part; keep the filter inside it
+    return texture(sceneColor, clamp(uv, texelSize * 0.5f, sceneScale - texelSize * 0.5f)).rgb;
+}
+
+void main()
+{
+    vec2 uv = screenUV * sceneScale;
+    vec3 center = sampleScene(uv);
+    vec3 north = sampleScene(uv + vec2(0.0f, texelSize.y));
+    vec3 south = sampleScene(uv - vec2(0.0f, texelSize.y));
+    vec3 east = sampleScene(uv + vec2(texelSize.x, 0.0f));
+    vec3 west = sampleScene(uv - vec2(texelSize.x, 0.0f));
+
+    // unsharp mask against the neighbours one source texel away, limited to their range
+    // so that edges do not ring
+    vec3 blurred = (north + south + east + west) * 0.25f;
+    vec3 sharpened = center + (center - blurred) * sharpness;
+    vec3 low = min(center, min(min(north, south), min(east, west)));
+    vec3 high = max(center, max(max(north, south), max(east, west)));
+    FragColor = vec4(clamp(sharpened, low, high), 1.0f);
+}
@@ -0,0 +1,10 @@
+#version 330 core
+// one triangle that covers the screen, built from gl_VertexID alone (no vertex attributes)
+out vec2 screenUV;
+
+void main()
+{
+    vec2 corner = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+    screenUV = corner;
+    gl_Position = vec4(corner * 2.0f - 1.0f, 0.0f, 1.0f);
+}
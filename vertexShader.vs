@@ -1,16 +1,51 @@
 #version 330 core
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aColor;
+layout (location = 2) in mat4 instanceModel;
+layout (location = 6) in int instanceMaterial;
+layout (location = 7) in int instanceViewMask;
+layout (location = 8) in int instanceDrawIndex;     // the instance's index in the draw list
 
-out vec4 color;
+flat out int materialIndex;
+out vec3 viewPosition;     // for clustered lighting
+out vec3 bakedColor;
+
+// the depth pre-pass and the shaded pass may be different variants (shader_variants.h),
+// and GL_EQUAL needs them to agree on every depth
+invariant gl_Position;
 
 
-uniform mat4 model;
 uniform mat4 view;
 uniform mat4 projection;
+uniform int viewBit;
+
+// per-vertex light from the offline baker, see baked_lighting.h (RGBA8, scaled by BAKED_LIGHT_SCALE)
+#pragma feature BAKED_LIGHTING
+#ifdef SHADER_VARIANT
+#ifdef BAKED_LIGHTING
+const int bakedEnabled = 1;
+#else
+const int bakedEnabled = 0;
+#endif
+#else
+uniform int bakedEnabled;
+#endif
+uniform samplerBuffer bakedLight;
 
 void main()
 {
-    gl_Position = projection * view * model * vec4(aPos, 1.0f);
-    color = vec4(aColor, 1.0f);
+    materialIndex = instanceMaterial;
+    viewPosition = vec3(view * instanceModel * vec4(aPos, 1.0f));
+    // draws after the baked ones (animated props) are not in the bake and stay unlit
+    int bakedTexel = instanceDrawIndex * 24 + gl_VertexID;
+    bakedColor = bakedEnabled != 0 && bakedTexel < textureSize(bakedLight) ? texelFetch(bakedLight, bakedTexel).rgb * 2.0f : vec3(1.0f);
+    if ((instanceViewMask & viewBit) == 0)
+    {
+        // not visible in the view being drawn: place the vertex outside the clip volume
+        gl_Position = vec4(2.0f, 2.0f, 2.0f, 1.0f);
+    }
+    else
+    {
+        gl_Position = projection * view * instanceModel * vec4(aPos, 1.0f);
+    }
 }
@@ -0,0 +1,264 @@
+//
+//  vertex_baker.h
+//  3D Object Drawing
+//
+
+#ifndef VERTEX_BAKER_H
+#define VERTEX_BAKER_H
+
+#include <glm/glm.hpp>
+
+#include "draw_list.h"
+#include "point_light.h"
+#include "box_bvh.h"
+#include "job_system.h"
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+
+// outward normal of each face of CUBE_VERTICES
+const glm::vec3 CUBE_FACE_NORMALS[6] = {
+    glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f),
+    glm::vec3(-1.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f)
+};
+
+// Baked file, one RGBA8 texel per cube vertex of every draw in draw list order:
+//   char[4] "RBAK", uint32 version, uint32 vertices, uint32 scene hash (drawListHash)
+//   vertices x uint32: rgb = light / BAKED_LIGHT_SCALE, a = ambient occlusion
+const char BAKE_MAGIC[4] = { 'R', 'B', 'A', 'K' };
+const unsigned int BAKE_VERSION = 1;
+const float BAKED_LIGHT_SCALE = 2.0f;  // must match vertexShader.vs
+
+struct BakeSettings
+{
+    int aoRays = 64;
+    float aoDistance = 0.4f;        // occluders further than this do not darken
+    float ambient = 0.3f;           // sky term, scaled by the occlusion
+    unsigned int seed = 1;
+};
+
+struct BakeStats
+{
+    size_t vertices = 0;
+    size_t rays = 0;
+    int threads = 0;
+    double buildMs = 0.0;
+    double bakeMs = 0.0;
+};
+
+// small deterministic generator so every vertex gets the same samples on any thread count
+struct BakeRandom
+{
+    unsigned int state;
+
+    explicit BakeRandom(unsigned int seed) : state(seed * 747796405u + 2891336453u)
+    {
+        next();
+    }
+
+    unsigned int next()
+    {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return state;
+    }
+
+    float uniform()
+    {
+        return (next() >> 8) * (1.0f / 16777216.0f);
+    }
+};
+
+// Ray traces direct light from the lamps (with shadows) and ambient occlusion at every cube
+// vertex of a static draw list. Work is split over the job system by vertex ranges.
+class VertexBaker
+{
+public:
+    static BakeStats bake(const DrawList& drawList, const std::vector<PointLight>& lights, const BakeSettings& settings,
+        JobSystem& jobs, std::vector<unsigned int>& texels)
+    {
+        BakeStats stats;
+        stats.threads = jobs.threadCount();
+        stats.vertices = drawList.size() * CUBE_VERTEX_COUNT;
+
+        std::chrono::steady_clock::time_point buildStart = std::chrono::steady_clock::now();
+        BoxBVH bvh;
+        bvh.build(drawList);
+        stats.buildMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - buildStart).count();
+
+        std::chrono::steady_clock::time_point bakeStart = std::chrono::steady_clock::now();
+        texels.assign(stats.vertices, 0);
+        std::vector<size_t> workerRays(jobs.threadCount(), 0);
+        jobs.parallelFor(drawList.size(), [&](int worker, size_t begin, size_t end)
+        {
+            for (size_t command = begin; command < end; command++)
+                workerRays[worker] += bakeCube(drawList[command].model, command, bvh, lights, settings, &texels[command * CUBE_VERTEX_COUNT]);
+        });
+        for (size_t i = 0; i < workerRays.size(); i++)
+            stats.rays += workerRays[i];
+        stats.bakeMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - bakeStart).count();
+        return stats;
+    }
+
+private:
+    static unsigned int pack(const glm::vec3& light, float occlusion)
+    {
+        glm::vec3 scaled = glm::clamp(light / BAKED_LIGHT_SCALE, 0.0f, 1.0f) * 255.0f + 0.5f;
+        unsigned int a = (unsigned int)(glm::clamp(occlusion, 0.0f, 1.0f) * 255.0f + 0.5f);
+        return (unsigned int)scaled.x | ((unsigned int)scaled.y << 8) | ((unsigned int)scaled.z << 16) | (a << 24);
+    }
+
+    // ambient occlusion and shadowed lamp light at one surface point; adds the rays cast
+    static glm::vec3 shade(const glm::vec3& position, const glm::vec3& normal, const BoxBVH& bvh, const std::vector<PointLight>& lights,
+        const BakeSettings& settings, unsigned int sampleSeed, float& occlusion, size_t& rays)
+    {
+        glm::vec3 tangent = glm::normalize(glm::cross(std::fabs(normal.y) < 0.9f ? glm::vec3(0.0f, 1.0f, 0.0f) : glm::vec3(1.0f, 0.0f, 0.0f), normal));
+        glm::vec3 bitangent = glm::cross(normal, tangent);
+        BakeRandom random(sampleSeed);
+
+        // cosine weighted hemisphere: the unoccluded fraction is the ambient visibility
+        int open = 0;
+        for (int ray = 0; ray < settings.aoRays; ray++)
+        {
+            float u = random.uniform();
+            float angle = 6.28318531f * random.uniform();
+            float r = std::sqrt(u);
+            glm::vec3 direction = tangent * (r * std::cos(angle)) + bitangent * (r * std::sin(angle)) + normal * std::sqrt(1.0f - u);
+            if (!bvh.occluded(position, direction, settings.aoDistance))
+                open++;
+        }
+        rays += settings.aoRays;
+        occlusion = settings.aoRays > 0 ? (float)open / settings.aoRays : 1.0f;
+
+        glm::vec3 light(settings.ambient * occlusion);
+        for (size_t i = 0; i < lights.size(); i++)
+        {
+            glm::vec3 toLight = lights[i].position - position;
+            float distanceSquared = glm::dot(toLight, toLight);
+            if (distanceSquared >= lights[i].radius * lights[i].radius)
+                continue;
+            float distance = std::sqrt(distanceSquared);
+            glm::vec3 direction = toLight / distance;
+            float lambert = glm::dot(normal, direction);
+            if (lambert <= 0.0f)
+                continue;
+            rays++;
+            if (bvh.occluded(position, direction, distance))
+                continue;
+            light += lights[i].color * lights[i].intensity * lightFalloff(distanceSquared, lights[i].radius) * lambert;
+        }
+        return light;
+    }
+
+    // returns the number of rays cast
+    static size_t bakeCube(const glm::mat4& model, size_t command, const BoxBVH& bvh, const std::vector<PointLight>& lights,
+        const BakeSettings& settings, unsigned int* out)
+    {
+        // Face normals come from the model's columns: the face across local axis a has the
+        // normal cross(column a+1, column a+2), flipped for mirroring matrices. Many parts of
+        // the restaurant are cubes squashed to zero thickness (floor tiles, seat pads); their
+        // two big faces coincide, so they are baked two sided and keep the brighter side.
+        glm::vec3 columns[3] = { glm::vec3(model[0]), glm::vec3(model[1]), glm::vec3(model[2]) };
+        float determinant = glm::dot(columns[0], glm::cross(columns[1], columns[2]));
+        bool flattened = std::fabs(determinant) < 1e-9f;
+        float handedness = determinant < 0.0f ? -1.0f : 1.0f;
+
+        size_t rays = 0;
+        for (int face = 0; face < 6; face++)
+        {
+            const glm::vec3& localNormal = CUBE_FACE_NORMALS[face];
+            int axis = localNormal.x != 0.0f ? 0 : (localNormal.y != 0.0f ? 1 : 2);
+            glm::vec3 normal = glm::cross(columns[(axis + 1) % 3], columns[(axis + 2) % 3]);
+            float area = glm::length(normal);
+
+            glm::vec3 faceCenter(0.0f);
+            for (int corner = 0; corner < 4; corner++)
+                faceCenter += CUBE_VERTICES[face * 4 + corner] * 0.25f;
+
+            for (int corner = 0; corner < 4; corner++)
+            {
+                unsigned int vertex = face * 4 + corner;
+                // a face squashed to a line or point is never visible
+                if (area < 1e-9f)
+                {
+                    out[vertex] = pack(glm::vec3(settings.ambient), 1.0f);
+                    continue;
+                }
+                glm::vec3 n = normal / area * (flattened ? 1.0f : handedness * localNormal[axis]);
+
+                // pulled slightly towards the face center and off the surface, so the sample
+                // neither sits exactly on the edge shared with a neighbour nor hits its own cube
+                glm::vec3 local = glm::mix(CUBE_VERTICES[vertex], faceCenter, 0.05f);
+                glm::vec3 surface = glm::vec3(model * glm::vec4(local, 1.0f));
+                unsigned int sampleSeed = (unsigned int)(command * CUBE_VERTEX_COUNT + vertex) ^ settings.seed * 2654435761u;
+
+                float occlusion;
+                glm::vec3 light = shade(surface + n * 1e-3f, n, bvh, lights, settings, sampleSeed, occlusion, rays);
+                if (flattened)
+                {
+                    float backOcclusion;
+                    glm::vec3 back = shade(surface - n * 1e-3f, -n, bvh, lights, settings, sampleSeed, backOcclusion, rays);
+                    if (back.x + back.y + back.z > light.x + light.y + light.z)
+                    {
+                        light = back;
+                        occlusion = backOcclusion;
+                    }
+                }
+                out[vertex] = pack(light, occlusion);
+            }
+        }
+        return rays;
+    }
+};
+
+inline bool saveBake(const std::string& path, unsigned int sceneHash, const std::vector<unsigned int>& texels)
+{
+    std::ofstream file(path.c_str(), std::ios::binary);
+    if (!file)
+    {
+        std::cout << "ERROR::BAKE::FILE_NOT_WRITABLE: " << path << std::endl;
+        return false;
+    }
+    unsigned int header[3] = { BAKE_VERSION, (unsigned int)texels.size(), sceneHash };
+    file.write(BAKE_MAGIC, sizeof(BAKE_MAGIC));
+    file.write((const char*)header, sizeof(header));
+    if (!texels.empty())
+        file.write((const char*)&texels[0], texels.size() * sizeof(unsigned int));
+    return (bool)file;
+}
+
+inline bool loadBake(const std::string& path, unsigned int& sceneHash, std::vector<unsigned int>& texels)
+{
+    std::ifstream file(path.c_str(), std::ios::binary);
+    if (!file)
+    {
+        std::cout << "ERROR::BAKE::FILE_NOT_SUCCESSFULLY_READ: " << path << std::endl;
+        return false;
+    }
+    char magic[4];
+    unsigned int header[3];
+    file.read(magic, sizeof(magic));
+    file.read((char*)header, sizeof(header));
+    if (!file || std::string(magic, 4) != std::string(BAKE_MAGIC, 4) || header[0] != BAKE_VERSION)
+    {
+        std::cout << "ERROR::BAKE::BAD_HEADER: " << path << std::endl;
+        return false;
+    }
+    sceneHash = header[2];
+    texels.resize(header[1]);
+    if (!texels.empty())
+        file.read((char*)&texels[0], texels.size() * sizeof(unsigned int));
+    if (!file)
+    {
+        std::cout << "ERROR::BAKE::TRUNCATED: " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+#endif
@@ -0,0 +1,941 @@
+//
+//  world_streaming.h
+//  3D Object Drawing
+//
+
+#ifndef WORLD_STREAMING_H
+#define WORLD_STREAMING_H
+
+#include <glm/glm.hpp>
+
+#include "draw_list.h"
+#include "material_table.h"
+#include "render_device.h"
+#include "scene_renderer.h"
+#include "static_scene.h"
+#include "restaurant_generator.h"
+#include "frustum.h"
+
+#include <vector>
+#include <string>
+#include <deque>
+#include <map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <functional>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <algorithm>
+
+// A food court: venues (each a generated four room restaurant, the size of the hand built
+// scene) on a grid with corridors between them, on one or more floors.
+struct WorldConfig
+{
+    unsigned int seed = 1;
+    int venues = 24;
+    int floors = 2;
+    float floorHeight = 4.0f;
+    float corridor = 4.0f;      // walkway in front of every row and beside every column
+    float cellSize = 8.0f;      // streaming cells are cellSize x cellSize on each floor
+};
+
+// where the venues went; stored in the world index so that the walk can follow the corridors
+struct WorldLayout
+{
+    int venues = 0;
+    int floors = 1;
+    int columns = 1;
+    int rows = 1;
+    float pitchX = 0.0f;        // venue width + corridor
+    float pitchZ = 0.0f;        // venue depth + corridor
+    float floorHeight = 4.0f;
+    float corridor = 4.0f;
+};
+
+inline GeneratorConfig venueConfig(unsigned int seed)
+{
+    GeneratorConfig config;
+    config.seed = seed;
+    config.rooms = 4;
+    return config;
+}
+
+inline WorldLayout worldLayout(const WorldConfig& config)
+{
+    GeneratorConfig venue = venueConfig(config.seed);
+    int roomColumns = (int)std::ceil(std::sqrt((double)venue.rooms));
+    int roomRows = (venue.rooms + roomColumns - 1) / roomColumns;
+    int perFloor = (config.venues + config.floors - 1) / config.floors;
+
+    WorldLayout layout;
+    layout.venues = config.venues;
+    layout.floors = config.floors;
+    layout.columns = (int)std::ceil(std::sqrt((double)perFloor));
+    layout.rows = (perFloor + layout.columns - 1) / layout.columns;
+    layout.pitchX = roomColumns * venue.roomWidth + config.corridor;
+    layout.pitchZ = roomRows * venue.roomDepth + config.corridor;
+    layout.floorHeight = config.floorHeight;
+    layout.corridor = config.corridor;
+    return layout;
+}
+
+// every venue of the world in one scene, with world positions
+inline GeneratedScene generateWorld(const WorldConfig& config)
+{
+    WorldLayout layout = worldLayout(config);
+    int perFloor = layout.columns * layout.rows;
+    GeneratedScene world;
+    world.seed = config.seed;
+    for (int v = 0; v < config.venues; v++)
+    {
+        int slot = v % perFloor;
+        glm::vec3 origin((slot % layout.columns) * layout.pitchX, (v / perFloor) * layout.floorHeight, -(slot / layout.columns) * layout.pitchZ);
+        GeneratedScene venue = RestaurantGenerator::generate(venueConfig(config.seed + v));
+        for (size_t i = 0; i < venue.rooms.size(); i++)
+        {
+            SceneRoom room = venue.rooms[i];
+            room.bounds.min += origin;
+            room.bounds.max += origin;
+            world.rooms.push_back(room);
+        }
+        for (size_t i = 0; i < venue.portals.size(); i++)
+        {
+            ScenePortal portal = venue.portals[i];
+            portal.opening.min += origin;
+            portal.opening.max += origin;
+            world.portals.push_back(portal);
+        }
+        for (size_t i = 0; i < venue.objects.size(); i++)
+        {
+            SceneObject object = venue.objects[i];
+            object.position += origin;
+            world.objects.push_back(object);
+        }
+    }
+    return world;
+}
+
+// one streaming cell as listed in the world index
+struct WorldCell
+{
+    int floor = 0;
+    int x = 0;
+    int z = 0;
+    size_t instances = 0;
+    AABB bounds;
+    std::string file;           // static scene file (static_scene.h) next to the index
+};
+
+struct WorldIndex
+{
+    WorldLayout layout;
+    float cellSize = 8.0f;
+    std::vector<WorldCell> cells;
+};
+
+// World index files are plain text:
+//   world 1
+//   layout <venues> <floors> <columns> <rows> <pitchX> <pitchZ> <floorHeight> <corridor>
+//   cellsize <size>
+//   cell <floor> <x> <z> <instances> <minX> <minY> <minZ> <maxX> <maxY> <maxZ> <file>
+// and every cell is a static scene file of its own draws, so cells load independently.
+// recordScene records a (partial) generated scene into a draw list, as buildGeneratedScene does.
+inline bool writeWorld(const std::string& indexPath, const WorldConfig& config, const std::function<void(DrawList&, const GeneratedScene&)>& recordScene)
+{
+    GeneratedScene world = generateWorld(config);
+    WorldLayout layout = worldLayout(config);
+
+    // objects go to the cell their origin falls in; floors are told apart by height
+    std::map<std::pair<int, std::pair<int, int> >, GeneratedScene> cells;
+    for (size_t i = 0; i < world.objects.size(); i++)
+    {
+        const SceneObject& object = world.objects[i];
+        int floor = (int)std::floor(object.position.y / config.floorHeight + 0.5f);
+        int x = (int)std::floor(object.position.x / config.cellSize);
+        int z = (int)std::floor(object.position.z / config.cellSize);
+        cells[std::make_pair(floor, std::make_pair(x, z))].objects.push_back(object);
+    }
+
+    std::ofstream index(indexPath.c_str());
+    if (!index)
+    {
+        std::cout << "ERROR::WORLD::FILE_NOT_WRITABLE: " << indexPath << std::endl;
+        return false;
+    }
+    std::string directory = indexPath.substr(0, indexPath.find_last_of("/\\") + 1);
+    std::string base = indexPath.substr(directory.size());
+    base = base.substr(0, base.find_last_of('.'));
+
+    index.precision(9);
+    index << "world 1\n";
+    index << "layout " << layout.venues << " " << layout.floors << " " << layout.columns << " " << layout.rows << " "
+          << layout.pitchX << " " << layout.pitchZ << " " << layout.floorHeight << " " << layout.corridor << "\n";
+    index << "cellsize " << config.cellSize << "\n";
+
+    size_t instances = 0;
+    std::map<std::pair<int, std::pair<int, int> >, GeneratedScene>::const_iterator it;
+    for (it = cells.begin(); it != cells.end(); ++it)
+    {
+        DrawList list;
+        recordScene(list, it->second);
+        AABB bounds;
+        bounds.min = glm::vec3(1e30f);
+        bounds.max = glm::vec3(-1e30f);
+        for (size_t i = 0; i < list.size(); i++)
+        {
+            AABB box = cubeWorldBounds(list[i].model);
+            bounds.min = glm::min(bounds.min, box.min);
+            bounds.max = glm::max(bounds.max, box.max);
+        }
+
+        char name[64];
+        std::snprintf(name, sizeof(name), "_%d_%d_%d.rsts", it->first.first, it->first.second.first, it->first.second.second);
+        std::string file = base + name;
+        if (!writeStaticScene(directory + file, list))
+            return false;
+        index << "cell " << it->first.first << " " << it->first.second.first << " " << it->first.second.second << " " << list.size() << " "
+              << bounds.min.x << " " << bounds.min.y << " " << bounds.min.z << " " << bounds.max.x << " " << bounds.max.y << " " << bounds.max.z
+              << " " << file << "\n";
+        instances += list.size();
+    }
+    std::printf("wrote %zu venues on %d floors: %zu cells, %zu draws, to %s\n", (size_t)config.venues, config.floors, cells.size(), instances, indexPath.c_str());
+    return (bool)index;
+}
+
+inline bool loadWorldIndex(const std::string& path, WorldIndex& world)
+{
+    std::ifstream file(path.c_str());
+    if (!file)
+    {
+        std::cout << "ERROR::WORLD::FILE_NOT_SUCCESSFULLY_READ: " << path << std::endl;
+        return false;
+    }
+    std::string directory = path.substr(0, path.find_last_of("/\\") + 1);
+    world = WorldIndex();
+    std::string line;
+    while (std::getline(file, line))
+    {
+        std::istringstream in(line);
+        std::string keyword;
+        if (!(in >> keyword) || keyword == "world")
+            continue;
+        bool ok = true;
+        if (keyword == "layout")
+        {
+            WorldLayout& l = world.layout;
+            ok = (bool)(in >> l.venues >> l.floors >> l.columns >> l.rows >> l.pitchX >> l.pitchZ >> l.floorHeight >> l.corridor);
+        }
+        else if (keyword == "cellsize")
+            ok = (bool)(in >> world.cellSize);
+        else if (keyword == "cell")
+        {
+            WorldCell cell;
+            ok = (bool)(in >> cell.floor >> cell.x >> cell.z >> cell.instances >> cell.bounds.min.x >> cell.bounds.min.y >> cell.bounds.min.z
+                           >> cell.bounds.max.x >> cell.bounds.max.y >> cell.bounds.max.z >> cell.file);
+            cell.file = directory + cell.file;
+            world.cells.push_back(cell);
+        }
+        else
+            ok = false;
+        if (!ok)
+        {
+            std::cout << "ERROR::WORLD::BAD_RECORD: " << line << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+// A cell read from disk and turned into instance data on an I/O thread: instances are
+// grouped by mesh (see instanceMesh) and carry the cell's own material indices.
+struct LoadedCell
+{
+    size_t cell = 0;
+    bool ok = false;
+    double readMs = 0.0;
+    std::vector<InstanceData> instances;
+    unsigned int meshCounts[INSTANCE_MESH_COUNT];
+    std::vector<glm::vec4> colors;
+};
+
+// Background I/O: worker threads take cell requests in the order they were made, read and
+// convert the cells and queue them for the render thread, which picks them up with
+// collect() without waiting.
+class CellLoader
+{
+public:
+    CellLoader() : running(false)
+    {
+    }
+
+    ~CellLoader()
+    {
+        stop();
+    }
+
+    void start(int threads)
+    {
+        running = true;
+        for (int i = 0; i < (threads > 0 ? threads : 1); i++)
+            workers.push_back(std::thread(&CellLoader::loadLoop, this));
+    }
+
+    void stop()
+    {
+        if (!running)
+            return;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            running = false;
+        }
+        wake.notify_all();
+        for (size_t i = 0; i < workers.size(); i++)
+            workers[i].join();
+        workers.clear();
+    }
+
+    void request(size_t cell, const std::string& path)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            requests.push_back(std::make_pair(cell, path));
+        }
+        wake.notify_one();
+    }
+
+    // moves the finished cells to out
+    void collect(std::vector<LoadedCell>& out)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        while (!finished.empty())
+        {
+            out.push_back(LoadedCell());
+            swapCell(out.back(), finished.front());
+            finished.pop_front();
+        }
+    }
+
+private:
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::deque<std::pair<size_t, std::string> > requests;
+    std::deque<LoadedCell> finished;
+    bool running;
+
+    static void swapCell(LoadedCell& a, LoadedCell& b)
+    {
+        std::swap(a.cell, b.cell);
+        std::swap(a.ok, b.ok);
+        std::swap(a.readMs, b.readMs);
+        a.instances.swap(b.instances);
+        a.colors.swap(b.colors);
+        for (int mesh = 0; mesh < INSTANCE_MESH_COUNT; mesh++)
+            std::swap(a.meshCounts[mesh], b.meshCounts[mesh]);
+    }
+
+    void loadLoop()
+    {
+        for (;;)
+        {
+            std::pair<size_t, std::string> job;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [this] { return !requests.empty() || !running; });
+                if (!running)
+                    return;
+                job = requests.front();
+                requests.pop_front();
+            }
+
+            LoadedCell loaded;
+            loaded.cell = job.first;
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            DrawList list;
+            loaded.ok = readStaticScene(job.second, list);
+            if (loaded.ok)
+                convert(list, loaded);
+            loaded.readMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+            std::lock_guard<std::mutex> lock(mutex);
+            finished.push_back(LoadedCell());
+            swapCell(finished.back(), loaded);
+        }
+    }
+
+    // instances grouped by mesh, flat boxes dropped; drawIndex is the draw's index in the cell
+    static void convert(const DrawList& list, LoadedCell& loaded)
+    {
+        std::vector<InstanceMesh> meshes(list.size());
+        for (int mesh = 0; mesh < INSTANCE_MESH_COUNT; mesh++)
+            loaded.meshCounts[mesh] = 0;
+        for (size_t i = 0; i < list.size(); i++)
+        {
+            meshes[i] = instanceMesh(list[i].model);
+            if (meshes[i] != MESH_NONE)
+                loaded.meshCounts[meshes[i]]++;
+        }
+        unsigned int next[INSTANCE_MESH_COUNT];
+        unsigned int total = 0;
+        for (int mesh = 0; mesh < INSTANCE_MESH_COUNT; mesh++)
+        {
+            next[mesh] = total;
+            total += loaded.meshCounts[mesh];
+        }
+        loaded.instances.resize(total);
+        for (size_t i = 0; i < list.size(); i++)
+        {
+            if (meshes[i] == MESH_NONE)
+                continue;
+            InstanceData& instance = loaded.instances[next[meshes[i]]++];
+            instance.model = list[i].model;
+            instance.material = list[i].material;
+            instance.viewMask = 1;
+            instance.drawIndex = (unsigned int)i;
+        }
+        for (size_t i = 0; i < list.materials.size(); i++)
+            loaded.colors.push_back(list.materials[i].color);
+    }
+};
+
+struct StreamingSettings
+{
+    float radius = 16.0f;                   // cells closer than this to the camera are wanted
+    size_t budgetBytes = 16 * 1024 * 1024;  // instance data held on the GPU and staged on the CPU
+    size_t uploadBytesPerFrame = 256 * 1024;
+    int ioThreads = 2;
+    int maxPendingLoads = 8;                // requests in flight; the nearest cells go first
+};
+
+// command line switches of the food court: building it, streaming it and walking through it
+struct WorldOptions
+{
+    std::string buildPath;          // --build-world FILE.world  write a world of static cell files and exit
+    WorldConfig config;             // --venues N, --floors N; the seed is the generator's --seed
+    std::string path;               // --world FILE.world  stream the world around the camera
+    bool walk = false;              // --walk          scripted walk through the world, then a report
+    float walkSpeed = 6.0f;         // --walk-speed M  meters per second, at a fixed 60 steps per second
+    StreamingSettings streaming;    // --stream-radius M, --stream-budget MB, --upload-kb KB
+
+    // false if arg is not one of the switches above
+    bool parseArgs(const std::string& arg, int argc, char** argv, int& i)
+    {
+        if (arg == "--build-world" && i + 1 < argc)
+            buildPath = argv[++i];
+        else if (arg == "--venues" && i + 1 < argc)
+            config.venues = std::max(std::atoi(argv[++i]), 1);
+        else if (arg == "--floors" && i + 1 < argc)
+            config.floors = std::max(std::atoi(argv[++i]), 1);
+        else if (arg == "--world" && i + 1 < argc)
+            path = argv[++i];
+        else if (arg == "--walk")
+            walk = true;
+        else if (arg == "--walk-speed" && i + 1 < argc)
+            walkSpeed = (float)std::atof(argv[++i]);
+        else if (arg == "--stream-radius" && i + 1 < argc)
+            streaming.radius = (float)std::atof(argv[++i]);
+        else if (arg == "--stream-budget" && i + 1 < argc)
+            streaming.budgetBytes = (size_t)(std::atof(argv[++i]) * 1024.0 * 1024.0);
+        else if (arg == "--upload-kb" && i + 1 < argc)
+            streaming.uploadBytesPerFrame = std::max((size_t)(std::atof(argv[++i]) * 1024.0), sizeof(InstanceData));
+        else
+            return false;
+        return true;
+    }
+
+    // the walk follows the corridors of a streamed world
+    bool valid() const
+    {
+        if (walk && path.empty())
+        {
+            std::cout << "ERROR::WORLD::NO_WORLD: --walk needs a world, use --world FILE.world" << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    static void printUsage()
+    {
+        std::cout << "  --build-world F  write a food court of generated venues as streaming cells to F.world and exit\n"
+                  << "  --venues N       venues in the world (default 24)\n"
+                  << "  --floors N       floors the venues are spread over (default 2)\n"
+                  << "  --world FILE     stream a world written by --build-world around the camera\n"
+                  << "  --walk           walk the world's corridors, print the streaming report and exit\n"
+                  << "  --walk-speed M   walking speed in meters per second (default 6)\n"
+                  << "  --stream-radius M  load the cells within M meters of the camera (default 16)\n"
+                  << "  --stream-budget MB  instance memory kept resident (default 16)\n"
+                  << "  --upload-kb KB   instance data uploaded to the GPU per frame (default 256)\n";
+    }
+};
+
+struct StreamingStats
+{
+    size_t residentCells = 0;
+    size_t residentBytes = 0;       // GPU instance buffers of resident cells
+    size_t stagedBytes = 0;         // loaded cells waiting for their upload to finish
+    size_t peakBytes = 0;
+    size_t wantedCells = 0;
+    size_t pendingLoads = 0;
+    size_t loads = 0;               // cells that became resident
+    size_t failedLoads = 0;
+    size_t evictions = 0;
+    size_t uploadedBytes = 0;       // this frame
+    size_t totalUploadedBytes = 0;
+    size_t overBudgetFrames = 0;    // the wanted cells alone did not fit
+    size_t cellsDrawn = 0;
+    size_t instancesDrawn = 0;
+    size_t drawCalls = 0;
+    double lastReadMs = 0.0;
+    double lastLatencyMs = 0.0;
+};
+
+// Keeps the cells around the camera resident. Every frame it:
+//  - requests the wanted cells that are not loaded, nearest first, from the I/O threads;
+//  - takes the cells the I/O threads finished, remaps their materials into the world's
+//    material table and starts their upload;
+//  - uploads at most uploadBytesPerFrame of instance data, so that a burst of loads is
+//    spread over several frames instead of stalling one;
+//  - evicts the resident cells that were wanted least recently while the instance data
+//    is over the memory budget, or the device's instance memory over its --gpu-budget.
+// Cells are drawn with one instanced draw per mesh from their own buffers once their
+// upload is complete, after a frustum test on their bounds.
+class WorldStreamer
+{
+public:
+    StreamingStats stats;
+    std::vector<double> loadLatencies;      // request to resident, per loaded cell
+    std::vector<double> readTimes;          // I/O thread read and convert time
+
+    WorldStreamer(RenderDevice& renderDevice, const StreamingSettings& streamingSettings)
+        : device(renderDevice), settings(streamingSettings), meshAttributeCount(0), indexBuffer(0), frame(0), materialsWarned(false)
+    {
+    }
+
+    ~WorldStreamer()
+    {
+        loader.stop();
+    }
+
+    bool open(const std::string& indexPath, const VertexAttribute* attributes, int attributeCount, DeviceHandle meshIndexBuffer)
+    {
+        if (!loadWorldIndex(indexPath, world))
+            return false;
+        meshAttributes.assign(attributes, attributes + attributeCount);
+        meshAttributeCount = attributeCount;
+        indexBuffer = meshIndexBuffer;
+        cells.resize(world.cells.size());
+        candidates.reserve(cells.size());
+        loaded.reserve(cells.size());
+        loader.start(settings.ioThreads);
+        std::printf("world: %zu cells, %d venues on %d floors\n", world.cells.size(), world.layout.venues, world.layout.floors);
+        return true;
+    }
+
+    const WorldIndex& index() const
+    {
+        return world;
+    }
+
+    const MaterialTable& materialTable() const
+    {
+        return materials;
+    }
+
+    void update(const glm::vec3& eye)
+    {
+        frame++;
+        stats.uploadedBytes = 0;
+        takeLoadedCells();
+        requestWantedCells(eye);
+        uploadSlices();
+        evict();
+
+        stats.residentCells = 0;
+        stats.residentBytes = 0;
+        stats.stagedBytes = 0;
+        for (size_t i = 0; i < cells.size(); i++)
+        {
+            if (cells[i].state == CELL_RESIDENT)
+            {
+                stats.residentCells++;
+                stats.residentBytes += cells[i].bytes;
+            }
+            else if (cells[i].state == CELL_UPLOADING)
+                stats.stagedBytes += cells[i].bytes;
+        }
+        stats.peakBytes = std::max(stats.peakBytes, stats.residentBytes + stats.stagedBytes);
+    }
+
+    // the resident cells inside the view; the Materials block must hold materialTable()
+    void draw(const glm::mat4& viewProjection)
+    {
+        Frustum frustum(viewProjection);
+        stats.cellsDrawn = stats.instancesDrawn = stats.drawCalls = 0;
+        for (size_t i = 0; i < cells.size(); i++)
+        {
+            const Cell& cell = cells[i];
+            if (cell.state != CELL_RESIDENT || !frustum.intersects(world.cells[i].bounds))
+                continue;
+            stats.cellsDrawn++;
+            for (int mesh = 0; mesh < INSTANCE_MESH_COUNT; mesh++)
+            {
+                if (cell.meshCounts[mesh] == 0)
+                    continue;
+                device.drawIndexedInstanced(cell.layouts[mesh], MESH_RANGES[mesh].indexCount, cell.meshCounts[mesh], MESH_RANGES[mesh].firstIndex);
+                stats.instancesDrawn += cell.meshCounts[mesh];
+                stats.drawCalls++;
+            }
+        }
+    }
+
+    void release()
+    {
+        loader.stop();
+        for (size_t i = 0; i < cells.size(); i++)
+            releaseCell(cells[i]);
+    }
+
+private:
+    enum CellState
+    {
+        CELL_UNLOADED,
+        CELL_LOADING,       // with the I/O threads
+        CELL_UPLOADING,     // instance data on the CPU, going up in slices
+        CELL_RESIDENT
+    };
+
+    struct Cell
+    {
+        CellState state = CELL_UNLOADED;
+        size_t bytes = 0;
+        size_t uploaded = 0;
+        size_t lastWanted = 0;
+        float distance = 0.0f;
+        std::chrono::steady_clock::time_point requested;
+        std::vector<InstanceData> instances;    // only while uploading
+        unsigned int meshCounts[INSTANCE_MESH_COUNT] = { 0, 0, 0, 0 };
+        DeviceHandle buffer = 0;
+        DeviceHandle layouts[INSTANCE_MESH_COUNT] = { 0, 0, 0, 0 };
+    };
+
+    RenderDevice& device;
+    StreamingSettings settings;
+    WorldIndex world;
+    std::vector<Cell> cells;
+    MaterialTable materials;
+    CellLoader loader;
+    std::vector<VertexAttribute> meshAttributes;
+    int meshAttributeCount;
+    DeviceHandle indexBuffer;
+    size_t frame;
+    bool materialsWarned;
+
+    std::vector<size_t> candidates;         // reused every frame
+    std::vector<LoadedCell> loaded;
+    std::vector<VertexAttribute> attributes;
+
+    WorldStreamer(const WorldStreamer&);
+    WorldStreamer& operator=(const WorldStreamer&);
+
+    static float distanceTo(const AABB& box, const glm::vec3& point)
+    {
+        glm::vec3 closest = glm::clamp(point, box.min, box.max);
+        return glm::length(point - closest);
+    }
+
+    void takeLoadedCells()
+    {
+        loaded.clear();
+        loader.collect(loaded);
+        for (size_t i = 0; i < loaded.size(); i++)
+        {
+            Cell& cell = cells[loaded[i].cell];
+            stats.pendingLoads--;
+            readTimes.push_back(loaded[i].readMs);
+            stats.lastReadMs = loaded[i].readMs;
+            if (!loaded[i].ok)
+            {
+                stats.failedLoads++;
+                cell.state = CELL_UNLOADED;
+                continue;
+            }
+
+            // the cell's material indices become world material indices
+            unsigned short remap[MAX_MATERIALS];
+            for (size_t m = 0; m < loaded[i].colors.size() && m < MAX_MATERIALS; m++)
+                remap[m] = materials.intern(loaded[i].colors[m]);
+            if (materials.full() && !materialsWarned)
+            {
+                std::cout << "WARNING::STREAMING::MATERIALS_FULL: the world has more than " << MAX_MATERIALS << " colors, drawing the rest with material 0" << std::endl;
+                materialsWarned = true;
+            }
+            for (size_t n = 0; n < loaded[i].instances.size(); n++)
+                loaded[i].instances[n].material = remap[loaded[i].instances[n].material];
+
+            cell.instances.swap(loaded[i].instances);
+            for (int mesh = 0; mesh < INSTANCE_MESH_COUNT; mesh++)
+                cell.meshCounts[mesh] = loaded[i].meshCounts[mesh];
+            cell.bytes = cell.instances.size() * sizeof(InstanceData);
+            cell.uploaded = 0;
+            cell.buffer = device.createBuffer(VERTEX_BUFFER, cell.bytes, NULL, STATIC_BUFFER, MEMORY_INSTANCES);
+            cell.state = CELL_UPLOADING;
+        }
+    }
+
+    void requestWantedCells(const glm::vec3& eye)
+    {
+        candidates.clear();
+        stats.wantedCells = 0;
+        for (size_t i = 0; i < cells.size(); i++)
+        {
+            cells[i].distance = distanceTo(world.cells[i].bounds, eye);
+            if (cells[i].distance > settings.radius)
+                continue;
+            cells[i].lastWanted = frame;
+            stats.wantedCells++;
+            if (cells[i].state == CELL_UNLOADED)
+                candidates.push_back(i);
+        }
+        std::sort(candidates.begin(), candidates.end(), [this](size_t a, size_t b) { return cells[a].distance < cells[b].distance; });
+        for (size_t c = 0; c < candidates.size() && stats.pendingLoads < (size_t)settings.maxPendingLoads; c++)
+        {
+            Cell& cell = cells[candidates[c]];
+            cell.state = CELL_LOADING;
+            cell.requested = std::chrono::steady_clock::now();
+            loader.request(candidates[c], world.cells[candidates[c]].file);
+            stats.pendingLoads++;
+        }
+    }
+
+    // nearest cells first, until this frame's upload budget is spent
+    void uploadSlices()
+    {
+        candidates.clear();
+        for (size_t i = 0; i < cells.size(); i++)
+        {
+            if (cells[i].state == CELL_UPLOADING)
+                candidates.push_back(i);
+        }
+        std::sort(candidates.begin(), candidates.end(), [this](size_t a, size_t b) { return cells[a].distance < cells[b].distance; });
+
+        size_t budget = settings.uploadBytesPerFrame;
+        for (size_t c = 0; c < candidates.size() && budget > 0; c++)
+        {
+            Cell& cell = cells[candidates[c]];
+            size_t slice = std::min(budget, cell.bytes - cell.uploaded);
+            if (slice > 0)
+                device.updateBuffer(cell.buffer, cell.uploaded, slice, (const char*)&cell.instances[0] + cell.uploaded);
+            cell.uploaded += slice;
+            budget -= slice;
+            stats.uploadedBytes += slice;
+            stats.totalUploadedBytes += slice;
+            if (cell.uploaded == cell.bytes)
+                finishUpload(cell);
+        }
+    }
+
+    void finishUpload(Cell& cell)
+    {
+        unsigned int first = 0;
+        for (int mesh = 0; mesh < INSTANCE_MESH_COUNT; mesh++)
+        {
+            if (cell.meshCounts[mesh] > 0)
+            {
+                attributes.assign(meshAttributes.begin(), meshAttributes.end());
+                SceneRenderer::appendInstanceAttributes(attributes, cell.buffer, first * (unsigned int)sizeof(InstanceData));
+                cell.layouts[mesh] = device.createVertexLayout(&attributes[0], (int)attributes.size(), indexBuffer);
+            }
+            first += cell.meshCounts[mesh];
+        }
+        std::vector<InstanceData>().swap(cell.instances);
+        cell.state = CELL_RESIDENT;
+        stats.loads++;
+        stats.lastLatencyMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - cell.requested).count();
+        loadLatencies.push_back(stats.lastLatencyMs);
+    }
+
+    // least recently wanted resident cells go first; cells wanted this frame stay. Cells
+    // are also evicted while the device's instance memory is over its budget (gpu_memory.h).
+    void evict()
+    {
+        size_t total = 0;
+        for (size_t i = 0; i < cells.size(); i++)
+        {
+            if (cells[i].state == CELL_RESIDENT || cells[i].state == CELL_UPLOADING)
+                total += cells[i].bytes;
+        }
+        size_t overDeviceBudget = device.memory().overBudgetBytes(MEMORY_INSTANCES);
+        while (total > settings.budgetBytes || overDeviceBudget > 0)
+        {
+            size_t victim = cells.size();
+            for (size_t i = 0; i < cells.size(); i++)
+            {
+                if (cells[i].state != CELL_RESIDENT || cells[i].lastWanted == frame)
+                    continue;
+                if (victim == cells.size() || cells[i].lastWanted < cells[victim].lastWanted)
+                    victim = i;
+            }
+            if (victim == cells.size())
+            {
+                stats.overBudgetFrames++;
+                break;
+            }
+            total -= cells[victim].bytes;
+            overDeviceBudget -= std::min(overDeviceBudget, cells[victim].bytes);
+            releaseCell(cells[victim]);
+            stats.evictions++;
+        }
+    }
+
+    void releaseCell(Cell& cell)
+    {
+        for (int mesh = 0; mesh < INSTANCE_MESH_COUNT; mesh++)
+        {
+            if (cell.layouts[mesh] != 0)
+                device.destroyVertexLayout(cell.layouts[mesh]);
+            cell.layouts[mesh] = 0;
+        }
+        if (cell.buffer != 0)
+            device.destroyBuffer(cell.buffer);
+        cell.buffer = 0;
+        std::vector<InstanceData>().swap(cell.instances);
+        cell.bytes = cell.uploaded = 0;
+        if (cell.state != CELL_LOADING)
+            cell.state = CELL_UNLOADED;
+    }
+};
+
+inline void printStreamingStats(const StreamingStats& stats)
+{
+    std::printf("streaming: %zu resident cells (%.2f MB, %.2f MB staged), %zu wanted, %zu loading  drawn: %zu cells, %zu instances, %zu draw calls  uploaded %.1f KB\n",
+        stats.residentCells, stats.residentBytes / 1048576.0, stats.stagedBytes / 1048576.0, stats.wantedCells, stats.pendingLoads,
+        stats.cellsDrawn, stats.instancesDrawn, stats.drawCalls, stats.uploadedBytes / 1024.0);
+}
+
+// A scripted walk along the corridors: in front of every row of venues, snaking from one
+// row to the next, then up to the next floor, at a fixed speed per frame so that every run
+// takes the same path.
+class WorldWalk
+{
+public:
+    WorldWalk(const WorldLayout& layout, float metersPerFrame) : step(metersPerFrame), travelled(0.0f), length(0.0f)
+    {
+        float eyeHeight = 1.0f;     // the height of the hand built camera's eye
+        float left = -layout.corridor * 0.5f;
+        float right = layout.columns * layout.pitchX - layout.corridor * 0.5f;
+        bool leftToRight = true;
+        for (int floor = 0; floor < layout.floors; floor++)
+        {
+            float y = floor * layout.floorHeight + eyeHeight;
+            for (int r = 0; r < layout.rows; r++)
+            {
+                int row = floor % 2 == 0 ? r : layout.rows - 1 - r;
+                float z = -row * layout.pitchZ + layout.corridor * 0.5f;
+                points.push_back(glm::vec3(leftToRight ? left : right, y, z));
+                points.push_back(glm::vec3(leftToRight ? right : left, y, z));
+                leftToRight = !leftToRight;
+            }
+        }
+        for (size_t i = 1; i < points.size(); i++)
+            length += glm::length(points[i] - points[i - 1]);
+    }
+
+    bool done() const
+    {
+        return travelled >= length;
+    }
+
+    // moves one frame along the path and returns the eye and a point to look at
+    void advance(glm::vec3& eye, glm::vec3& lookAt)
+    {
+        travelled = std::min(travelled + step, length);
+        float along = travelled;
+        for (size_t i = 1; i < points.size(); i++)
+        {
+            glm::vec3 segment = points[i] - points[i - 1];
+            float segmentLength = glm::length(segment);
+            if (along <= segmentLength || i + 1 == points.size())
+            {
+                eye = points[i - 1] + segment * (segmentLength > 0.0f ? along / segmentLength : 0.0f);
+                glm::vec3 horizontal(segment.x, 0.0f, segment.z);
+                if (glm::length(horizontal) > 0.0f)
+                    direction = glm::normalize(horizontal);
+                lookAt = eye + direction + glm::vec3(0.0f, -0.3f, 0.0f);
+                return;
+            }
+            along -= segmentLength;
+        }
+    }
+
+    float pathLength() const
+    {
+        return length;
+    }
+
+private:
+    std::vector<glm::vec3> points;
+    float step;
+    float travelled;
+    float length;
+    glm::vec3 direction = glm::vec3(1.0f, 0.0f, 0.0f);
+};
+
+inline double percentile(std::vector<double> values, double p)
+{
+    if (values.empty())
+        return 0.0;
+    std::sort(values.begin(), values.end());
+    size_t index = (size_t)(p * (values.size() - 1) + 0.5);
+    return values[index];
+}
+
+// what a walk through the world cost: frame times and their spikes, cell load latency and
+// memory; a spike is a frame over twice the median
+class WalkReport
+{
+public:
+    void record(double frameMs, const StreamingStats& stats)
+    {
+        frameTimes.push_back(frameMs);
+        uploads.push_back(stats.uploadedBytes);
+    }
+
+    void print(const WorldStreamer& streamer, float pathLength) const
+    {
+        const StreamingStats& stats = streamer.stats;
+        double median = percentile(frameTimes, 0.5);
+        size_t spikes = 0, spikesWithUploads = 0;
+        double worst = 0.0;
+        for (size_t i = 0; i < frameTimes.size(); i++)
+        {
+            worst = std::max(worst, frameTimes[i]);
+            if (frameTimes[i] > 2.0 * median)
+            {
+                spikes++;
+                if (uploads[i] > 0)
+                    spikesWithUploads++;
+            }
+        }
+        std::printf("walk: %.1f m in %zu frames\n", pathLength, frameTimes.size());
+        std::printf("  frame ms: p50 %.3f  p99 %.3f  max %.3f  spikes (> 2x p50): %zu, %zu of them in frames that uploaded\n",
+            median, percentile(frameTimes, 0.99), worst, spikes, spikesWithUploads);
+        std::printf("  cell loads: %zu (%zu failed), latency ms: p50 %.3f  p90 %.3f  max %.3f  read ms p50 %.3f\n", stats.loads, stats.failedLoads,
+            percentile(streamer.loadLatencies, 0.5), percentile(streamer.loadLatencies, 0.9), percentile(streamer.loadLatencies, 1.0),
+            percentile(streamer.readTimes, 0.5));
+        std::printf("  memory: peak %.2f MB, end %.2f MB in %zu cells  evictions: %zu  frames over budget: %zu  uploaded %.2f MB\n",
+            stats.peakBytes / 1048576.0, (stats.residentBytes + stats.stagedBytes) / 1048576.0, stats.residentCells, stats.evictions,
+            stats.overBudgetFrames, stats.totalUploadedBytes / 1048576.0);
+    }
+
+private:
+    std::vector<double> frameTimes;
+    std::vector<size_t> uploads;
+};
+
+#endif